@@ -1,583 +1,2098 @@
-/***********************************************************************************************/ /**
- * \file   app.c
- * \brief  Event handling and application code for NCP Host application
- **************************************************************************************************/
-
-#include <stdint.h>
-#include <string.h>
-#include <stdio.h>
-#include <stdbool.h>
-
-/***************************************************************************************************
- * Platform specific timing functions for calculating transmission time.
- **************************************************************************************************/
-#if ((_WIN32 == 1) || (__CYGWIN__ == 1))
-#include <windows.h>
-LARGE_INTEGER StartingTime;
-LARGE_INTEGER EndingTime;
-LARGE_INTEGER ElapsedMicroseconds;
-LARGE_INTEGER Frequency;
-
-static void timer_start()
-{
-    QueryPerformanceFrequency(&Frequency); 
-    QueryPerformanceCounter(&StartingTime);
-}
-
-static double timer_end()
-{
-    QueryPerformanceCounter(&EndingTime);
-    ElapsedMicroseconds.QuadPart = EndingTime.QuadPart - StartingTime.QuadPart;
-    ElapsedMicroseconds.QuadPart *= 1000000;
-    
-    volatile double time = (double)(ElapsedMicroseconds.QuadPart / Frequency.QuadPart) / 1e6;
-    return time;
-}
-#else
-#include <unistd.h>
-#include <time.h>
-volatile struct timespec startingTime;
-volatile struct timespec endingTime;
-
-static void timer_start()
-{
-    clock_gettime(CLOCK_REALTIME, &startingTime);
-}
-
-static double timer_end()
-{
-    clock_gettime(CLOCK_REALTIME, &endingTime);
-    volatile double time = (double)((endingTime.tv_sec - startingTime.tv_sec) + (endingTime.tv_nsec - startingTime.tv_nsec) * 1e-9);
-    return time;
-}
-#endif
-
-/* BG stack headers */
-#include "bg_types.h"
-#include "gecko_bglib.h"
-
-/* Own header */
-#include "app.h"
-
-// --------------------------------
-// Local variables and constants
-const uint16_t SCAN_INTERVAL = 16;                      // 16 * 0.625 = 10ms
-const uint16_t SCAN_WINDOW = 16;                        // 16 * 0.625 = 10ms
-const uint16_t HW_TICKS_PER_SECOND = 32768;             // Hardware clock ticks that equal one second
-const uint8_t SOFT_TIMER_FIXED_TRANSFER_TIME_HANDLE = 0;
-const uint8_t TX_POWER = 100;                           // 10 dBm is the max allowed without Adaptive Frequency Hopping. 
-
-const char *DEVICE_NAME = "Throughput Tester"; // Device name to match against scan results.
-// bbb99e70-fff7-46cf-abc7-2d32c71820f2
-const uint8_t SERVICE_UUID[] = {0xf2, 0x20, 0x18, 0xc7, 0x32, 0x2d, 0xc7, 0xab, 0xcf, 0x46, 0xf7, 0xff, 0x70, 0x9e, 0xb9, 0xbb};
-// 6109b631-a643-4a51-83d2-2059700ad49f
-const uint8_t INDICATIONS_CHARACTERISTIC_UUID[] = {0x9f, 0xd4, 0x0a, 0x70, 0x59, 0x20, 0xd2, 0x83, 0x51, 0x4a, 0x43, 0xa6, 0x31, 0xb6, 0x09, 0x61};
-// 47b73dd6-dee3-4da1-9be0-f5c539a9a4be
-const uint8_t NOTIFICATIONS_CHARACTERISTIC_UUID[] = {0xbe, 0xa4, 0xa9, 0x39, 0xc5, 0xf5, 0xe0, 0x9b, 0xa1, 0x4d, 0xe3, 0xde, 0xd6, 0x3d, 0xb7, 0x47};
-// be6b6be1-cd8a-4106-9181-5ffe2bc67718
-const uint8_t TRANSMISSION_CHARACTERISTIC_UUID[] = {0x18, 0x77, 0xc6, 0x2b, 0xfe, 0x5f, 0x81, 0x91, 0x06, 0x41, 0x8a, 0xcd, 0xe1, 0x6b, 0x6b, 0xbe};
-//adf32227-b00f-400c-9eeb-b903a6cc291b
-const uint8_t RESULT_CHARACTERISTIC_UUID[] = {0x1b, 0x29, 0xcc, 0xa6, 0x03, 0xb9, 0xeb, 0x9e, 0x0c, 0x40, 0x0f, 0xb0, 0x27, 0x22, 0xf3, 0xad};
-
-static bool appBooted = false;
-static uint8_t askForInput = 0;
-
-static Action_t action = act_none;
-static State_t state = State_SCANNING;
-
-static uint8_t connection = 0xFF;
-static uint32_t serviceHandle = 0xFFFFFFFF;
-static uint16_t notificationsHandle = 0xFFFF;
-static uint16_t indicationsHandle = 0xFFFF;
-static uint16_t transmissionHandle = 0xFFFF;
-static uint16_t resultHandle = 0xFFFF;
-static uint8_t numCharacteristicsDiscovered = 0;
-static uint8_t initPhy = 1;
-static uint8_t phyInUse = 1;
-
-static uint16_t interval = 0;
-static uint16_t mtuSize = 0;
-static uint16_t pduSize = 0;
-static uint16_t supervisionTimeout = 0;
-static uint16_t slaveLatency = 0;
-
-static bool isFirstPacket = true;
-static uint64_t bitsSent = 0;
-static uint64_t throughput = 0;
-static uint32_t operationCount = 0;
-static uint32_t result = 0;
-
-const uint8_t TRANSMISSION_ON = 1;
-const uint8_t TRANSMISSION_OFF = 0;
-
-/***************************************************************************************************
- * Static Function Declarations
- **************************************************************************************************/
-// Helper functions
-static void set_action(Action_t act) { action = act; }
-static void waiting_indication(void);
-static void reset_variables(void);
-// Data transmission functions
-static void start_data_transmission(TestParameters_t *params);
-static void end_data_transmission(TestParameters_t *params);
-// Scan and discovery result processing
-static void process_procedure_complete_event(struct gecko_cmd_packet *evt, TestParameters_t *params);
-static bool process_scan_response(struct gecko_msg_le_gap_scan_response_evt_t *pResp);
-static void check_characteristic_uuid(struct gecko_cmd_packet *evt);
-
-/***************************************************************************************************
- * Public Function Definitions
- **************************************************************************************************/
-
-/***********************************************************************************************/ /**
- *  \brief  Event handler function.
- *  \param[in] evt Event pointer.
- **************************************************************************************************/
-int app_handle_events(struct gecko_cmd_packet *evt, TestParameters_t *params)
-{
-    askForInput = 0;
-    if (NULL == evt) {
-        return 0;
-    }
-
-    // Do not handle any events until system is booted up properly.
-    if ((BGLIB_MSG_ID(evt->header) != gecko_evt_system_boot_id) && !appBooted) {
-#if defined(DEBUG)
-        printf("Event: 0x%04x\n", BGLIB_MSG_ID(evt->header));
-#endif
-
-#if ((_WIN32 == 1) || (__CYGWIN__ == 1))
-        Sleep(50);
-#else
-        usleep(50000);  
-#endif
-        return 0;
-    }
-
-    // Switch main state, check only events relevant to those states.
-    switch (state) {
-        case State_SCANNING:
-            switch(BGLIB_MSG_ID(evt->header) ) {
-                case gecko_evt_system_boot_id:
-                    appBooted = true;
-                    reset_variables();
-                    gecko_cmd_gatt_set_max_mtu(params->mtu_size);
-                    gecko_cmd_system_set_tx_power(TX_POWER);
-                    // 2M isn't allowed as initiating PHY by stack.
-                    if (params->phy == 2) {
-                        initPhy = 1;
-                    } else {
-                        initPhy = params->phy;
-                    }
-                    printf("\nSystem booted. Starting scanning... \n\n");
-                    printf("Mode: %s\n\n", (params->mode == 3) ? "Free mode" : ((params->mode == 2) ? "Fixed data" : "Fixed time"));
-                    gecko_cmd_le_gap_set_discovery_type(5, 0);
-                    gecko_cmd_le_gap_set_discovery_timing(5, SCAN_INTERVAL, SCAN_WINDOW);
-                    gecko_cmd_le_gap_start_discovery(initPhy, le_gap_discover_observation);
-                    break;
-
-                case gecko_evt_le_gap_scan_response_id:
-                    if (process_scan_response(&(evt->data.evt_le_gap_scan_response))) {
-                        gecko_cmd_le_gap_end_procedure(); // Stop scanning in the background.
-                        gecko_cmd_le_gap_connect(evt->data.evt_le_gap_scan_response.address, evt->data.evt_le_gap_scan_response.address_type, initPhy);
-                    } else {
-                        waiting_indication();
-                    }
-
-                    break;
-
-                case gecko_evt_le_connection_opened_id:
-                    connection = evt->data.evt_le_connection_opened.connection;
-                    printf("Connection opened!\n\n");
-                    // Change PHY from initial if needed (2M).
-                    if (initPhy != params->phy) {
-                        while (gecko_cmd_le_connection_set_phy(evt->data.evt_le_connection_opened.connection, params->phy)->result != 0);
-                    }
-                    // Set connection parameters to those that were given as input.
-                    gecko_cmd_le_connection_set_timing_parameters(evt->data.evt_le_connection_opened.connection, params->connection_interval, params->connection_interval, 0, 100, 0, 0xFFFF);
-                    state = State_SET_PARAMETERS;
-                    break;
-                default:
-                    break;
-            }
-            break;
-
-        case State_SET_PARAMETERS:
-            // Wait for parameters to update.
-            switch(BGLIB_MSG_ID(evt->header) ) {
-                    
-                case gecko_evt_le_connection_parameters_id:
-                    interval = evt->data.evt_le_connection_parameters.interval;
-                    pduSize = evt->data.evt_le_connection_parameters.txsize;
-                    slaveLatency = evt->data.evt_le_connection_parameters.latency;
-                    supervisionTimeout = evt->data.evt_le_connection_parameters.timeout;
-
-                    if ((interval == params->connection_interval) && (mtuSize == params->mtu_size)) {
-                        if (phyInUse == params->phy) {
-                            state = State_DISCOVER;
-                            gecko_cmd_gatt_discover_primary_services_by_uuid(connection, 16, SERVICE_UUID);
-                        }
-                    }
-                    break;
-
-                default: break;
-            }
-            break;
-
-        case State_DISCOVER:
-            switch(BGLIB_MSG_ID(evt->header) ) {
-                case gecko_evt_gatt_procedure_completed_id:
-                    process_procedure_complete_event(evt, params);
-                    break;
-
-                case gecko_evt_gatt_characteristic_id:
-                    check_characteristic_uuid(evt);
-                    break;
-
-                case gecko_evt_gatt_service_id:
-
-                    if (evt->data.evt_gatt_service.uuid.len == 16) {
-                        if (memcmp(SERVICE_UUID, evt->data.evt_gatt_service.uuid.data, 16) == 0) {
-                            serviceHandle = evt->data.evt_gatt_service.service;
-                            set_action(act_discover_service);
-                            printf("-------------------------------\n");
-                            printf("Service found!\n\n");
-                        }
-                    }
-                    break;
-
-                default:
-                    break;
-            }
-            break;
-
-        case State_TRANSMISSION:
-            switch(BGLIB_MSG_ID(evt->header) ) {
-                case gecko_evt_gatt_characteristic_value_id:
-                    if (evt->data.evt_gatt_characteristic_value.characteristic == resultHandle) {
-                        if (evt->data.evt_gatt_characteristic_value.att_opcode == gatt_handle_value_indication) {
-                            gecko_cmd_gatt_send_characteristic_confirmation(evt->data.evt_gatt_characteristic_value.connection);
-                            // Slave sends indication about result after each test. Data is uint8array LSB first.
-                            memcpy(&result, evt->data.evt_gatt_characteristic_value.value.data, 4);  
-                        }
-
-                        if (params->mode == 3) {
-                            end_data_transmission(params);
-                            askForInput = 0;
-                        }
-
-                        printf("Throughput result reported by slave: %lu bps\n\n", result);
-
-                        if ((params->mode == 1) || (params->mode == 2)) {   
-                            // If in one-shot modes, ask if user wants to re-run test.
-                            state = State_SCANNING;
-                            askForInput = 1;
-                        }
-                        break;
-                    }
-                    // Data received
-                    if (evt->data.evt_gatt_characteristic_value.characteristic == indicationsHandle) {
-                        if (evt->data.evt_gatt_characteristic_value.att_opcode == gatt_handle_value_indication) {
-                            gecko_cmd_gatt_send_characteristic_confirmation(evt->data.evt_gatt_characteristic_value.connection);
-                        }
-                    }
-                    bitsSent += (evt->data.evt_gatt_characteristic_value.value.len * 8);
-                    operationCount++;
-
-                    // Fixed data mode
-                    if (params->mode == 2) { 
-                        if (bitsSent >= (params->fixed_amount * 8)) {
-                            end_data_transmission(params);
-                        }
-                    }
-
-                    // Button has been pressed on slave, first packet of transmission.
-                    if (isFirstPacket && (params->mode == 3)) { 
-                        start_data_transmission(params);
-                    }
-                    isFirstPacket = false;
-                    break;
-
-                default:
-                    break;
-            }
-            break;
-
-        default:
-            break;
-    }
-
-    // Handle universal events regardless of state.
-    switch (BGLIB_MSG_ID(evt->header)) {
-        
-        case gecko_evt_gatt_mtu_exchanged_id:
-            mtuSize = evt->data.evt_gatt_mtu_exchanged.mtu;
-            printf("MTU exchanged: %u\n\n", mtuSize);
-            break;
-
-        case gecko_evt_le_connection_phy_status_id:
-            phyInUse = evt->data.evt_le_connection_phy_status.phy;
-            printf("PHY status: %u\n\n", phyInUse);
-            break;
-
-        case gecko_evt_le_connection_parameters_id:
-            interval = evt->data.evt_le_connection_parameters.interval;
-            pduSize = evt->data.evt_le_connection_parameters.txsize;
-            slaveLatency = evt->data.evt_le_connection_parameters.latency;
-            supervisionTimeout = evt->data.evt_le_connection_parameters.timeout;
-            break;
-
-        case gecko_evt_hardware_soft_timer_id:
-            if (evt->data.evt_hardware_soft_timer.handle == SOFT_TIMER_FIXED_TRANSFER_TIME_HANDLE) {
-                end_data_transmission(params);
-            }
-            break;
-
-        case gecko_evt_le_connection_closed_id:
-            printf("Connection closed.\n\n");
-            reset_variables();
-            gecko_cmd_le_gap_set_discovery_type(5, 0);
-            gecko_cmd_le_gap_set_discovery_timing(5, SCAN_INTERVAL, SCAN_WINDOW);
-            gecko_cmd_le_gap_start_discovery(initPhy, le_gap_discover_observation);
-            state = State_SCANNING;
-            break;
-        
-        default:
-            break;
-    }
-    return askForInput;
-}
-
-
-/***************************************************************************************************
- * Static Function Definitions
- **************************************************************************************************/
-
-// Make a loading animation while waiting for scan response match.
-static void waiting_indication(void)
-{
-    static uint32_t cnt = 0;
-    const char *fan[] = {"-", "\\", "|", "/"};
-    printf("(%s)", fan[((cnt++) % 4)]);
-    printf("\b\b\b");   // Move cursor back with backspace character '\b'.
-    fflush(stdout);
-}
-
-// Reset handles, flags and calculation variables to initial state.
-static void reset_variables(void)
-{
-    connection = 0xFF;
-    serviceHandle = 0xFFFFFFFF;
-    notificationsHandle = 0xFFFF;
-    indicationsHandle = 0xFFFF;
-    transmissionHandle = 0xFFFF;
-    numCharacteristicsDiscovered = 0;
-    throughput = 0;
-    bitsSent = 0;
-    operationCount = 0;
-    interval = 0;
-    mtuSize = 0;
-    pduSize = 0;
-    supervisionTimeout = 0;
-    slaveLatency = 0;
-    isFirstPacket = true;
-    state = State_SCANNING;
-}
-
-static void start_data_transmission(TestParameters_t *params)
-{
-    throughput = 0;
-    timer_start();
-
-    // Turn OFF Display refresh on slave side
-    if ((params->mode == 1) || (params->mode == 2)) {
-        // This triggers the data transmission if we're on fixed data amount or fixed time modes.
-        while (gecko_cmd_gatt_write_characteristic_value_without_response(connection, transmissionHandle, 1, &TRANSMISSION_ON)->result != 0);
-    }
-
-    if (params->mode == 1) {
-        // Start fixed time one-shot soft timer.
-        gecko_cmd_hardware_set_soft_timer(((HW_TICKS_PER_SECOND)*params->fixed_time), SOFT_TIMER_FIXED_TRANSFER_TIME_HANDLE, 1);
-    }
-}
-
-// When transmission is done, print out the summary of the transmission.
-static void end_data_transmission(TestParameters_t *params)
-{
-    volatile double endTime = timer_end();
-
-    // Turn ON display again
-    if ((params->mode == 1) || (params->mode == 2)) {
-        // This triggers the data transmission end if we're on fixed data amount or fixed time modes.
-        while (gecko_cmd_gatt_write_characteristic_value_without_response(connection, transmissionHandle, 1, &TRANSMISSION_OFF)->result != 0);
-    }
-
-    throughput = (uint64_t)((double)bitsSent / endTime);
-
-    printf("-------------------------------\n");
-    printf("RESULTS:\n\n");
-    printf("Bits sent: %lu\n", bitsSent);
-    printf("Time elapsed: %.3f sec\n", endTime);
-    printf("Host calculated throughput: %lu bps\n", throughput);
-    printf("Operation count: %lu\n", operationCount);
-    printf("-------------------------------\n\n");
-
-    isFirstPacket = true;
-    bitsSent = 0;
-    throughput = 0;
-    operationCount = 0;
-}
-
-// Helper function to make the discovery and subscribing flow correct.
-// Action enum values indicate which procedure was completed.
-static void process_procedure_complete_event(struct gecko_cmd_packet *evt, TestParameters_t *params)
-{
-    uint16_t result = evt->data.evt_gatt_procedure_completed.result;
-
-    switch (action) {
-        case act_discover_service:
-            set_action(act_none);
-            if (!result) {
-                printf("Starting characteristic discovery...\n");
-                // Discover successful, start characteristic discovery.
-                gecko_cmd_gatt_discover_characteristics(connection, serviceHandle);
-                set_action(act_discover_characteristics);
-            }
-        break;
-
-        case act_discover_characteristics:
-            set_action(act_none);
-            if (!result) {
-                if (numCharacteristicsDiscovered == 4) {
-                    printf("All necessary characteristics discovered.\n");
-                    if (params->mode == 3) {
-                        // In free mode subscribe to notifications first, then indications
-                        printf("Subscribing to notifications.\n");
-                        gecko_cmd_gatt_set_characteristic_notification(connection, notificationsHandle, gatt_notification);
-                        set_action(act_enable_notification);
-                    } else {
-                        if (params->client_conf_flag == gatt_indication) {
-                            printf("Subscribing to indications.\n");
-                            gecko_cmd_gatt_set_characteristic_notification(connection, indicationsHandle, gatt_indication);
-                            set_action(act_enable_indication);
-                        } else if (params->client_conf_flag == gatt_notification) {
-                            printf("Subscribing to notifications.\n");
-                            gecko_cmd_gatt_set_characteristic_notification(connection, notificationsHandle, gatt_notification);
-                            set_action(act_enable_notification);
-                        }
-                    }
-                    
-                }
-            }
-        break;
-
-        case act_enable_notification:
-            set_action(act_none);
-            if (!result) {
-                // Notifications turned on.
-                printf("Subscribed to notifications.\n");
-                
-                if (params->mode == 3) {
-                    printf("Subscribing to indications.\n");
-                    gecko_cmd_gatt_set_characteristic_notification(connection, indicationsHandle, gatt_indication);
-                    set_action(act_enable_indication);
-                } else {
-                    // Subscribe to slave result.
-                    gecko_cmd_gatt_set_characteristic_notification(connection, resultHandle, gatt_indication);
-                    set_action(act_subscribe_result);
-                }
-            }
-        break;
-
-        case act_enable_indication:
-            set_action(act_none);
-            if (!result) {
-                // Indications turned on.
-                printf("Subscribed to indications.\n");
-                // Subscribe to slave result.
-                gecko_cmd_gatt_set_characteristic_notification(connection, resultHandle, gatt_indication);
-                set_action(act_subscribe_result);
-            }
-        break;
-
-        case act_subscribe_result:
-            set_action(act_none);
-            if (!result) {
-                printf("Subscribed to throughput result.\n");
-                printf("\nDISCOVERY DONE.\n");
-                printf("-----------------------------------------------------------------------------\n");
-                printf("\nParameters to be used:\n");
-                printf("-------------------------------\n");
-                printf("Interval: %u\n", (unsigned int)((float)interval * 1.25));
-                printf("Latency: %u\n", slaveLatency);
-                printf("Timeout: %u\n", supervisionTimeout);
-                printf("PDU size: %u\n", pduSize);
-                printf("-----------------------------------------------------------------------------\n\n");
-                printf("\nSTARTING TEST\n\n");
-                state = State_TRANSMISSION;
-                // In free mode, button press on slave triggers the transmission,
-                // but in fixed modes, transmission is initiated here with the following call.
-                if ((params->mode == 1) || (params->mode == 2)) {
-                    start_data_transmission(params);
-                }
-            }
-            break;
-
-        case act_none:
-            break;
-
-        default:
-            break;
-    }
-}
-
-// Cycle through advertisement contents and look for matching device name.
-static bool process_scan_response(struct gecko_msg_le_gap_scan_response_evt_t *pResp)
-{
-    int i = 0;
-    bool adMatchFound = false;
-    uint8_t adLen;
-    uint8_t adType;
-
-    while (i < (pResp->data.len - 1)) {
-        adLen = pResp->data.data[i];
-        adType = pResp->data.data[i + 1];
-
-        /* Type 0x09 = Complete Local Name, 0x08 Shortened Name */
-        if (adType == 0x09) {
-            /* Check if device name is Throughput Tester */
-            if (memcmp(pResp->data.data + i + 2, DEVICE_NAME, 17) == 0) {
-                adMatchFound = true;
-                break;
-            }
-        }
-        /* Jump to next AD record */
-        i = i + adLen + 1;
-    }
-
-    return (adMatchFound);
-}
-
-// Check if found characteristic matches the UUIDs that we are searching for.
-static void check_characteristic_uuid(struct gecko_cmd_packet *evt) 
-{
-    if (evt->data.evt_gatt_characteristic.uuid.len == 16) {
-        if (memcmp(NOTIFICATIONS_CHARACTERISTIC_UUID, evt->data.evt_gatt_characteristic.uuid.data, 16) == 0) {
-            notificationsHandle = evt->data.evt_gatt_characteristic.characteristic;
-            printf("Found notifications characteristic.\n");
-            numCharacteristicsDiscovered++;
-        } else if (memcmp(INDICATIONS_CHARACTERISTIC_UUID, evt->data.evt_gatt_characteristic.uuid.data, 16) == 0) {
-            indicationsHandle = evt->data.evt_gatt_characteristic.characteristic;
-            printf("Found indications characteristic.\n");
-            numCharacteristicsDiscovered++;
-        } else if (memcmp(TRANSMISSION_CHARACTERISTIC_UUID, evt->data.evt_gatt_characteristic.uuid.data, 16) == 0) {
-            printf("Found transmission characteristic.\n");
-            transmissionHandle = evt->data.evt_gatt_characteristic.characteristic;
-            numCharacteristicsDiscovered++;
-        } else if (memcmp(RESULT_CHARACTERISTIC_UUID, evt->data.evt_gatt_characteristic.uuid.data, 16) == 0) {
-            printf("Found throughput result characteristic.\n");
-            resultHandle = evt->data.evt_gatt_characteristic.characteristic;
-            numCharacteristicsDiscovered++;
-        }
-    }
+/***********************************************************************************************/ /**
+ * \file   app.c
+ * \brief  Event handling and application code for NCP Host application
+ **************************************************************************************************/
+
+#include <stdint.h>
+#include <string.h>
+#include <stdio.h>
+#include <stdbool.h>
+
+/* BG stack headers */
+#include "bg_types.h"
+#include "gecko_bglib.h"
+
+/* Own header */
+#include "app.h"
+#include "../soc/app_histogram.h"
+#include "../soc/app_setup_timing.h"
+#include "../soc/app_cmd_queue.h"
+#include "../soc/app_broadcast.h"
+#include "../soc/app_test_plan.h"
+#include "../soc/app_payload.h"
+#include "../soc/app_clock_sync.h"
+#include "../soc/app_event_census.h"
+#include "channel_plan.h"
+#include "payload_trace.h"
+#include "monotonic.h"
+
+#if ((_WIN32 == 1) || (__CYGWIN__ == 1))
+#include <windows.h>
+#else
+#include <unistd.h>
+#endif
+
+// Transmission time is measured between event arrival times when the caller provides them,
+// so time spent waiting in the RX queue or in console output doesn't count.
+static uint64_t event_time_us(AppContext_t *ctx)
+{
+    return ctx->eventTimeGiven ? ctx->eventTimeUs : monotonic_now_us();
+}
+
+static void timer_start(AppContext_t *ctx)
+{
+    ctx->startingTimeUs = event_time_us(ctx);
+}
+
+static double timer_end(AppContext_t *ctx)
+{
+    return (double)(event_time_us(ctx) - ctx->startingTimeUs) / 1e6;
+}
+
+// --------------------------------
+// Local variables and constants
+static const uint16_t SCAN_INTERVAL = 16;                      // 16 * 0.625 = 10ms
+static const uint16_t SCAN_WINDOW = 16;                        // 16 * 0.625 = 10ms
+static const uint16_t HW_TICKS_PER_SECOND = 32768;             // Hardware clock ticks that equal one second
+static const uint8_t SOFT_TIMER_FIXED_TRANSFER_TIME_HANDLE = 0;
+static const uint8_t SOFT_TIMER_LATENCY_TIMEOUT_HANDLE = 1;
+static const uint8_t SOFT_TIMER_SETUP_TIMEOUT_HANDLE = 2;
+static const uint8_t SOFT_TIMER_CHANNEL_SETTLE_HANDLE = 3;
+static const uint8_t SOFT_TIMER_FLIGHT_DUMP_HANDLE = 4;
+static const uint8_t ALL_CHANNELS[CHANNEL_MAP_LEN] = {0xFF, 0xFF, 0xFF, 0xFF, 0x1F}; // Channel classification with all 37 data channels
+static const uint8_t TX_POWER = 100;                           // 10 dBm is the max allowed without Adaptive Frequency Hopping. 
+
+static const char *DEVICE_NAME = "Throughput Tester"; // Device name to match against scan results.
+// bbb99e70-fff7-46cf-abc7-2d32c71820f2
+static const uint8_t SERVICE_UUID[] = {0xf2, 0x20, 0x18, 0xc7, 0x32, 0x2d, 0xc7, 0xab, 0xcf, 0x46, 0xf7, 0xff, 0x70, 0x9e, 0xb9, 0xbb};
+// 6109b631-a643-4a51-83d2-2059700ad49f
+static const uint8_t INDICATIONS_CHARACTERISTIC_UUID[] = {0x9f, 0xd4, 0x0a, 0x70, 0x59, 0x20, 0xd2, 0x83, 0x51, 0x4a, 0x43, 0xa6, 0x31, 0xb6, 0x09, 0x61};
+// 47b73dd6-dee3-4da1-9be0-f5c539a9a4be
+static const uint8_t NOTIFICATIONS_CHARACTERISTIC_UUID[] = {0xbe, 0xa4, 0xa9, 0x39, 0xc5, 0xf5, 0xe0, 0x9b, 0xa1, 0x4d, 0xe3, 0xde, 0xd6, 0x3d, 0xb7, 0x47};
+// be6b6be1-cd8a-4106-9181-5ffe2bc67718
+static const uint8_t TRANSMISSION_CHARACTERISTIC_UUID[] = {0x18, 0x77, 0xc6, 0x2b, 0xfe, 0x5f, 0x81, 0x91, 0x06, 0x41, 0x8a, 0xcd, 0xe1, 0x6b, 0x6b, 0xbe};
+//adf32227-b00f-400c-9eeb-b903a6cc291b
+static const uint8_t RESULT_CHARACTERISTIC_UUID[] = {0x1b, 0x29, 0xcc, 0xa6, 0x03, 0xb9, 0xeb, 0x9e, 0x0c, 0x40, 0x0f, 0xb0, 0x27, 0x22, 0xf3, 0xad};
+// 3f1b5a90-6d0e-4a47-9f3a-2c5e7c6e8b14
+static const uint8_t LATENCY_CHARACTERISTIC_UUID[] = {0x14, 0x8b, 0x6e, 0x7c, 0x5e, 0x2c, 0x3a, 0x9f, 0x47, 0x4a, 0x0e, 0x6d, 0x90, 0x5a, 0x1b, 0x3f};
+// 8d1f3c52-7a64-4e0b-b5c9-1f2e3d4c5b6a
+static const uint8_t TEST_PLAN_CHARACTERISTIC_UUID[] = {0x6a, 0x5b, 0x4c, 0x3d, 0x2e, 0x1f, 0xc9, 0xb5, 0x0b, 0x4e, 0x64, 0x7a, 0x52, 0x3c, 0x1f, 0x8d};
+// e5a1c3d7-4b29-4f86-9d0e-7c2b8a6f1e93
+static const uint8_t PAYLOAD_SCHEDULE_CHARACTERISTIC_UUID[] = {0x93, 0x1e, 0x6f, 0x8a, 0x2b, 0x7c, 0x0e, 0x9d, 0x86, 0x4f, 0x29, 0x4b, 0xd7, 0xc3, 0xa1, 0xe5};
+// stream_1 to stream_4: 3c23e4a5-1d75-4f6e-9f9b-eb474b83a6fc, 0384c018-0c80-4ea8-95b4-705eef3fc3b9,
+// 8f612db2-e920-4627-84f9-d62e9386b051, d38fbd0b-5348-4a1c-ba3b-72ff9e250293
+static const uint8_t STREAM_CHARACTERISTIC_UUIDS[STREAM_MAX][16] = {
+    {0xfc, 0xa6, 0x83, 0x4b, 0x47, 0xeb, 0x9b, 0x9f, 0x6e, 0x4f, 0x75, 0x1d, 0xa5, 0xe4, 0x23, 0x3c},
+    {0xb9, 0xc3, 0x3f, 0xef, 0x5e, 0x70, 0xb4, 0x95, 0xa8, 0x4e, 0x80, 0x0c, 0x18, 0xc0, 0x84, 0x03},
+    {0x51, 0xb0, 0x86, 0x93, 0x2e, 0xd6, 0xf9, 0x84, 0x27, 0x46, 0x20, 0xe9, 0xb2, 0x2d, 0x61, 0x8f},
+    {0x93, 0x02, 0x25, 0x9e, 0xff, 0x72, 0x3b, 0xba, 0x1c, 0x4a, 0x48, 0x53, 0x0b, 0xbd, 0x8f, 0xd3}
+};
+// 3ab269c9-43f5-4b47-b479-24309e921f33
+static const uint8_t STREAM_CONFIG_CHARACTERISTIC_UUID[] = {0x33, 0x1f, 0x92, 0x9e, 0x30, 0x24, 0x79, 0xb4, 0x47, 0x4b, 0xf5, 0x43, 0xc9, 0x69, 0xb2, 0x3a};
+// 7b2e91c4-58d3-4a0f-b6e1-3c9d8a5f2e70
+static const uint8_t FLIGHT_RECORDER_CHARACTERISTIC_UUID[] = {0x70, 0x2e, 0x5f, 0x8a, 0x9d, 0x3c, 0xe1, 0xb6, 0x0f, 0x4a, 0xd3, 0x58, 0xc4, 0x91, 0x2e, 0x7b};
+
+#define LATENCY_TIMEOUT_US      2000000     // Ping is counted as lost if the echo takes longer
+#define SETUP_TIMEOUT_MIN_MS    2000        // Wait at least this long for the requested PHY and interval
+#define FLIGHT_DUMP_TIMEOUT_MS  5000        // A flight recorder dump without a chunk for this long is given up
+#define SETUP_TIMEOUT_INTERVALS 12          // ... or this many connection intervals, whichever is longer
+#define ATT_DEFAULT_MTU         23
+#define ATT_MAX_VALUE_LEN       244         // Length of the payload_schedule characteristic
+#define CMD_RETRY_GAP_US        1000        // Between attempts of a command the NCP was too busy to take
+#define CMD_MAX_ATTEMPTS        5000        // About 5 s, longer than the longest connection interval
+#define CHANNEL_SETTLE_MIN_MS   200         // Wait at least this long for a new channel map to take effect
+#define CHANNEL_SETTLE_INTERVALS 10         // ... or this many connection intervals, whichever is longer
+
+// Commands retried through the command queue, ids index its counters.
+enum {
+    CMD_TRANSMISSION_ON_OFF
+};
+
+static const uint8_t TRANSMISSION_ON = 1;
+static const uint8_t TRANSMISSION_OFF = 0;
+
+/***************************************************************************************************
+ * Static Function Declarations
+ **************************************************************************************************/
+// Helper functions
+static void set_action(AppContext_t *ctx, Action_t act) { ctx->action = act; }
+static void waiting_indication(void);
+static void reset_variables(AppContext_t *ctx);
+static void clear_peer_cache(AppContext_t *ctx);
+static uint8_t initiating_phy(TestParameters_t *params);
+// Data transmission functions
+static void start_data_transmission(AppContext_t *ctx, TestParameters_t *params);
+static void end_data_transmission(AppContext_t *ctx, TestParameters_t *params);
+static void start_latency_test(AppContext_t *ctx, TestParameters_t *params);
+static void send_ping(AppContext_t *ctx);
+static void end_latency_test(AppContext_t *ctx);
+static void report_packet(AppContext_t *ctx, uint16_t characteristic, uint16_t len);
+static void report_window(AppContext_t *ctx, uint64_t lengthUs);
+static void report_result(AppContext_t *ctx);
+static void finish_test(AppContext_t *ctx);
+static void print_latency(const char *label, Histogram_t *hist);
+static void print_setup_timing(AppContext_t *ctx);
+static void end_setup_timing(AppContext_t *ctx);
+// Scan and discovery result processing
+static void process_procedure_complete_event(AppContext_t *ctx, struct gecko_cmd_packet *evt, TestParameters_t *params);
+static void start_link_setup(AppContext_t *ctx, TestParameters_t *params);
+static void check_link_ready(AppContext_t *ctx, TestParameters_t *params);
+static uint32_t cmd_clock(void);
+static void start_broadcast_scan(AppContext_t *ctx, TestParameters_t *params);
+static void end_broadcast_scan(AppContext_t *ctx);
+static uint16_t issue_transmission_on(const void *args);
+static void submit_transmission_on(AppContext_t *ctx, uint8_t value);
+static void start_gatt_setup(AppContext_t *ctx, TestParameters_t *params);
+static void setup_timeout(AppContext_t *ctx, TestParameters_t *params);
+static void try_begin_test(AppContext_t *ctx, TestParameters_t *params);
+static void start_run(AppContext_t *ctx, TestParameters_t *params);
+static bool channel_plan_active(AppContext_t *ctx, TestParameters_t *params);
+static void end_channel_plan(AppContext_t *ctx);
+static bool tx_power_plan_active(AppContext_t *ctx, TestParameters_t *params);
+static bool read_slave_plan(AppContext_t *ctx);
+static void start_tx_power_level(AppContext_t *ctx, TestParameters_t *params);
+static void end_tx_power_plan(AppContext_t *ctx);
+static bool run_plan_pending(AppContext_t *ctx, TestParameters_t *params);
+static bool push_payload_schedule(AppContext_t *ctx);
+static bool push_clock_stamps(AppContext_t *ctx);
+static void record_clock_stamp(AppContext_t *ctx, uint16_t characteristic, const uint8_t *data, uint16_t len);
+static void print_clock_sync(AppContext_t *ctx);
+static void slave_result_done(AppContext_t *ctx, TestParameters_t *params);
+static bool start_flight_dump(AppContext_t *ctx, TestParameters_t *params);
+static void request_flight_dump(AppContext_t *ctx);
+static void arm_flight_dump_timeout(void);
+static void end_flight_dump(AppContext_t *ctx, TestParameters_t *params, bool complete);
+static bool streams_active(AppContext_t *ctx, TestParameters_t *params);
+static void stream_setup_next(AppContext_t *ctx, TestParameters_t *params);
+static void gatt_setup_done(AppContext_t *ctx, TestParameters_t *params);
+static void print_streams(AppContext_t *ctx, double endTime);
+static void print_event_census(AppContext_t *ctx);
+static void start_subscriptions(AppContext_t *ctx, TestParameters_t *params);
+static void begin_test(AppContext_t *ctx, TestParameters_t *params);
+static bool process_scan_response(struct gecko_msg_le_gap_scan_response_evt_t *pResp);
+static void check_characteristic_uuid(AppContext_t *ctx, struct gecko_cmd_packet *evt);
+
+/***************************************************************************************************
+ * Public Function Definitions
+ **************************************************************************************************/
+
+/***********************************************************************************************/ /**
+ *  \brief  Set up a tester context. Call once before any other app_ function.
+ *  \param[out] ctx Tester context.
+ *  \param[in] callbacks Packet, window and result callbacks, copied. NULL for none.
+ **************************************************************************************************/
+void app_init(AppContext_t *ctx, const AppCallbacks_t *callbacks)
+{
+    memset(ctx, 0, sizeof(AppContext_t));
+    if (callbacks != NULL) {
+        ctx->callbacks = *callbacks;
+    }
+    ctx->initPhy = 1;
+    ctx->phyInUse = 1;
+    ctx->rssi = APP_RSSI_UNKNOWN;
+    reset_variables(ctx);
+    clear_peer_cache(ctx);
+    histogram_reset(&ctx->latencyRun);
+    stream_rx_reset(&ctx->streamRx);
+    app_set_gap_detector(ctx, GAP_DEFAULT_MULTIPLE, GAP_DEFAULT_FLAG_MS);
+}
+
+/***********************************************************************************************/ /**
+ *  \brief  Replace the callbacks given to app_init(), e.g. once the command line has been read.
+ *  The window in progress keeps its start, the new window length applies from the next window.
+ *  \param[in] ctx Tester context.
+ *  \param[in] callbacks Packet, window and result callbacks, NULL for none.
+ **************************************************************************************************/
+void app_set_callbacks(AppContext_t *ctx, const AppCallbacks_t *callbacks)
+{
+    if (callbacks != NULL) {
+        ctx->callbacks = *callbacks;
+    } else {
+        memset(&ctx->callbacks, 0, sizeof(ctx->callbacks));
+    }
+}
+
+/***********************************************************************************************/ /**
+ *  \brief  Start a test. The first start resets the NCP and the test follows its boot, later
+ *  starts go through app_rerun().
+ *  \param[in] ctx Tester context.
+ *  \param[in] params Test parameters, kept by pointer and passed to app_handle_events() as well.
+ **************************************************************************************************/
+void app_start(AppContext_t *ctx, TestParameters_t *params)
+{
+    if (ctx->appBooted) {
+        app_rerun(ctx, params);
+    } else {
+        gecko_cmd_system_reset(0);
+    }
+}
+
+/***********************************************************************************************/ /**
+ *  \brief  End the measurement in progress now. The result is reported as for a finished test,
+ *  in fixed modes once the slave result arrives. A channel or TX power plan moves on to its next run.
+ *  \param[in] ctx Tester context.
+ *  \param[in] params Test parameters of the run.
+ *  \return  true if a measurement was in progress.
+ **************************************************************************************************/
+bool app_stop(AppContext_t *ctx, TestParameters_t *params)
+{
+    if (ctx->state == State_BROADCAST_SCAN) {
+        gecko_cmd_hardware_set_soft_timer(0, SOFT_TIMER_FIXED_TRANSFER_TIME_HANDLE, 0);
+        end_broadcast_scan(ctx);
+        finish_test(ctx);
+        return true;
+    }
+    if (ctx->state != State_TRANSMISSION) {
+        return false;
+    }
+    if (params->mode == 4) {
+        end_latency_test(ctx);
+        ctx->state = State_SCANNING;
+        finish_test(ctx);
+        return true;
+    }
+    if (!ctx->measuring) {
+        return false; // Free mode before its first packet, or waiting for the slave result
+    }
+    gecko_cmd_hardware_set_soft_timer(0, SOFT_TIMER_FIXED_TRANSFER_TIME_HANDLE, 0);
+    end_data_transmission(ctx, params);
+    if (params->mode == 3) {
+        report_result(ctx);
+    }
+    return true;
+}
+
+/***********************************************************************************************/ /**
+ *  \brief  Event handler function.
+ *  \param[in] ctx Tester context.
+ *  \param[in] evt Event pointer.
+ *  \return  1 when a test has finished and the caller decides what comes next, 0 otherwise.
+ **************************************************************************************************/
+int app_handle_events(AppContext_t *ctx, struct gecko_cmd_packet *evt, TestParameters_t *params)
+{
+    uint64_t handlingStartNs;
+
+    ctx->askForInput = 0;
+    // Retry commands the NCP couldn't take earlier, also while no events arrive.
+    cmd_queue_pump(&ctx->cmdQueue);
+    if (NULL == evt) {
+        return 0;
+    }
+
+    // Do not handle any events until system is booted up properly.
+    if ((BGLIB_MSG_ID(evt->header) != gecko_evt_system_boot_id) && !ctx->appBooted) {
+#if defined(DEBUG)
+        printf("Event: 0x%04x\n", BGLIB_MSG_ID(evt->header));
+#endif
+
+#if ((_WIN32 == 1) || (__CYGWIN__ == 1))
+        Sleep(50);
+#else
+        usleep(50000);  
+#endif
+        return 0;
+    }
+
+    handlingStartNs = monotonic_now_ns();
+    // Switch main state, check only events relevant to those states.
+    switch (ctx->state) {
+        case State_SCANNING:
+            switch(BGLIB_MSG_ID(evt->header) ) {
+                case gecko_evt_system_boot_id:
+                    ctx->appBooted = true;
+                    reset_variables(ctx);
+                    memset(&ctx->lastResult, 0, sizeof(ctx->lastResult));
+                    cmd_queue_init(&ctx->cmdQueue, cmd_clock, CMD_RETRY_GAP_US, CMD_MAX_ATTEMPTS);
+                    clear_peer_cache(ctx);
+                    gecko_cmd_gatt_set_max_mtu(params->mtu_size);
+                    gecko_cmd_system_set_tx_power(TX_POWER);
+                    ctx->initPhy = initiating_phy(params);
+                    if (params->mode == 5) {
+                        printf("\nSystem booted.\n\nMode: Connectionless\n\n");
+                        start_broadcast_scan(ctx, params);
+                        break;
+                    }
+                    printf("\nSystem booted. Starting scanning... \n\n");
+                    printf("Mode: %s\n\n", (params->mode == 4) ? "Latency" : ((params->mode == 3) ? "Free mode" : ((params->mode == 2) ? "Fixed data" : "Fixed time")));
+                    gecko_cmd_le_gap_set_discovery_type(5, 0);
+                    gecko_cmd_le_gap_set_discovery_timing(5, SCAN_INTERVAL, SCAN_WINDOW);
+                    gecko_cmd_le_gap_start_discovery(ctx->initPhy, le_gap_discover_observation);
+                    setup_timing_begin(&ctx->setupRun, (uint32_t)event_time_us(ctx));
+                    break;
+
+                case gecko_evt_le_gap_scan_response_id:
+                    if (process_scan_response(&(evt->data.evt_le_gap_scan_response))) {
+                        setup_timing_mark(&ctx->setupRun, SETUP_MARK_PEER_FOUND, (uint32_t)event_time_us(ctx));
+                        gecko_cmd_le_gap_end_procedure(); // Stop scanning in the background.
+                        // Remember the peer so a rerun can connect without scanning.
+                        if (ctx->peerCached && (memcmp(&ctx->peerAddress, &evt->data.evt_le_gap_scan_response.address, sizeof(bd_addr)) != 0)) {
+                            ctx->handlesCached = false;
+                        }
+                        memcpy(&ctx->peerAddress, &evt->data.evt_le_gap_scan_response.address, sizeof(bd_addr));
+                        ctx->peerAddressType = evt->data.evt_le_gap_scan_response.address_type;
+                        ctx->peerCached = true;
+                        gecko_cmd_le_gap_connect(evt->data.evt_le_gap_scan_response.address, evt->data.evt_le_gap_scan_response.address_type, ctx->initPhy);
+                    } else {
+                        waiting_indication();
+                    }
+
+                    break;
+
+                case gecko_evt_le_connection_opened_id:
+                    ctx->connection = evt->data.evt_le_connection_opened.connection;
+                    setup_timing_mark(&ctx->setupRun, SETUP_MARK_CONNECTED, (uint32_t)event_time_us(ctx));
+                    printf("Connection opened!\n\n");
+                    ctx->phyInUse = ctx->initPhy;
+                    ctx->linkReady = false;
+                    ctx->gattStarted = false;
+                    ctx->gattReady = false;
+                    start_link_setup(ctx, params);
+                    // The stack starts the MTU exchange by itself, GATT setup follows it. Without one there is nothing to wait for.
+                    if (params->mtu_size <= ATT_DEFAULT_MTU) {
+                        start_gatt_setup(ctx, params);
+                    }
+                    break;
+                default:
+                    break;
+            }
+            break;
+
+        case State_SET_PARAMETERS:
+        case State_DISCOVER:
+            // PHY and interval updates, MTU exchange and GATT discovery are all in flight together.
+            switch(BGLIB_MSG_ID(evt->header) ) {
+                case gecko_evt_le_connection_parameters_id:
+                    ctx->interval = evt->data.evt_le_connection_parameters.interval;
+                    ctx->pduSize = evt->data.evt_le_connection_parameters.txsize;
+                    ctx->slaveLatency = evt->data.evt_le_connection_parameters.latency;
+                    ctx->supervisionTimeout = evt->data.evt_le_connection_parameters.timeout;
+                    check_link_ready(ctx, params);
+                    break;
+
+                case gecko_evt_le_connection_phy_status_id:
+                    ctx->phyInUse = evt->data.evt_le_connection_phy_status.phy;
+                    check_link_ready(ctx, params);
+                    break;
+
+                case gecko_evt_gatt_mtu_exchanged_id:
+                    ctx->mtuSize = evt->data.evt_gatt_mtu_exchanged.mtu;
+                    setup_timing_mark(&ctx->setupRun, SETUP_MARK_MTU, (uint32_t)event_time_us(ctx));
+                    if (ctx->mtuSize != params->mtu_size) {
+                        printf("Peer limits MTU to %u (requested %u).\n\n", ctx->mtuSize, params->mtu_size);
+                    }
+                    // ATT bearer is free again, GATT setup can run while the link layer procedures finish.
+                    start_gatt_setup(ctx, params);
+                    break;
+
+                case gecko_evt_gatt_procedure_completed_id:
+                    process_procedure_complete_event(ctx, evt, params);
+                    break;
+
+                case gecko_evt_gatt_characteristic_id:
+                    check_characteristic_uuid(ctx, evt);
+                    break;
+
+                case gecko_evt_gatt_service_id:
+
+                    if (evt->data.evt_gatt_service.uuid.len == 16) {
+                        if (memcmp(SERVICE_UUID, evt->data.evt_gatt_service.uuid.data, 16) == 0) {
+                            ctx->serviceHandle = evt->data.evt_gatt_service.service;
+                            set_action(ctx, act_discover_service);
+                            printf("-------------------------------\n");
+                            printf("Service found!\n\n");
+                        }
+                    }
+                    break;
+
+                default:
+                    break;
+            }
+            break;
+
+        case State_BROADCAST_SCAN:
+            // Bit 7 of the packet type marks extended advertising, legacy packets can't carry a broadcast.
+            if ((BGLIB_MSG_ID(evt->header) == gecko_evt_le_gap_scan_response_id)
+                && (evt->data.evt_le_gap_scan_response.packet_type & 0x80)) {
+                broadcast_rx_add(&ctx->broadcastRx, evt->data.evt_le_gap_scan_response.data.data,
+                                 evt->data.evt_le_gap_scan_response.data.len, (uint32_t)event_time_us(ctx));
+            }
+            break;
+
+        case State_TRANSMISSION:
+            switch(BGLIB_MSG_ID(evt->header) ) {
+                case gecko_evt_gatt_characteristic_value_id:
+                    if (evt->data.evt_gatt_characteristic_value.characteristic == ctx->latencyHandle) {
+                        uint64_t now = event_time_us(ctx);
+                        uint32_t seq;
+
+                        if (evt->data.evt_gatt_characteristic_value.value.len < LATENCY_PING_SIZE) {
+                            break;
+                        }
+                        memcpy(&seq, evt->data.evt_gatt_characteristic_value.value.data, sizeof(seq));
+                        // Late echoes of pings already counted as lost are dropped.
+                        if ((params->mode == 4) && (seq == ctx->pingSeq)) {
+                            histogram_record(&ctx->latencyRun, (uint32_t)(now - ctx->pingSentUs));
+                            if ((ctx->latencyRun.total + ctx->pingsLost) >= params->ping_count) {
+                                end_latency_test(ctx);
+                                ctx->state = State_SCANNING;
+                                finish_test(ctx);
+                            } else {
+                                send_ping(ctx);
+                            }
+                        }
+                        break;
+                    }
+                    if (evt->data.evt_gatt_characteristic_value.characteristic == ctx->resultHandle) {
+                        if (evt->data.evt_gatt_characteristic_value.att_opcode == gatt_handle_value_indication) {
+                            gecko_cmd_gatt_send_characteristic_confirmation(evt->data.evt_gatt_characteristic_value.connection);
+                            // Slave sends indication about result after each test. Data is uint8array LSB first.
+                            memcpy(&ctx->slaveResult, evt->data.evt_gatt_characteristic_value.value.data, 4);  
+                        }
+                        ctx->lastResult.slaveThroughput = ctx->slaveResult;
+
+                        if ((params->mode == 3) && ctx->measuring) {
+                            end_data_transmission(ctx, params);
+                            ctx->lastResult.slaveThroughput = ctx->slaveResult;
+                        }
+
+                        printf("Throughput result reported by slave: %lu bps\n\n", ctx->slaveResult);
+                        if (ctx->clockSyncWanted) {
+                            print_clock_sync(ctx);
+                        }
+                        if (params->mode == 3) {
+                            report_result(ctx); // Free mode goes on without asking.
+                        }
+                        if (!start_flight_dump(ctx, params)) {
+                            slave_result_done(ctx, params);
+                        }
+                        break;
+                    }
+                    // Flight recorder chunks, see the universal events.
+                    if (evt->data.evt_gatt_characteristic_value.characteristic == ctx->flightRecorderHandle) {
+                        break;
+                    }
+                    // Data received
+                    if (evt->data.evt_gatt_characteristic_value.characteristic == ctx->indicationsHandle) {
+                        if (evt->data.evt_gatt_characteristic_value.att_opcode == gatt_handle_value_indication) {
+                            gecko_cmd_gatt_send_characteristic_confirmation(evt->data.evt_gatt_characteristic_value.connection);
+                        }
+                    }
+                    if (!ctx->measuring) {
+                        // Button has been pressed on slave, first packet of transmission.
+                        if (!ctx->isFirstPacket || (params->mode != 3)) {
+                            break; // Stragglers after the run ended, the slave result comes next.
+                        }
+                        start_data_transmission(ctx, params);
+                    }
+                    for (uint8_t i = 0; (ctx->streamConfig != NULL) && (i < STREAM_MAX); i++) {
+                        if (evt->data.evt_gatt_characteristic_value.characteristic == ctx->streamHandles[i]) {
+                            stream_rx_record(&ctx->streamRx, i, evt->data.evt_gatt_characteristic_value.value.data,
+                                             evt->data.evt_gatt_characteristic_value.value.len, event_time_us(ctx));
+                            break;
+                        }
+                    }
+                    record_clock_stamp(ctx, evt->data.evt_gatt_characteristic_value.characteristic,
+                                       evt->data.evt_gatt_characteristic_value.value.data, evt->data.evt_gatt_characteristic_value.value.len);
+                    ctx->bitsSent += (evt->data.evt_gatt_characteristic_value.value.len * 8);
+                    ctx->operationCount++;
+                    gap_detector_add(&ctx->gaps, event_time_us(ctx), ctx->interval);
+                    ctx->airtimeUs += payload_airtime_us(evt->data.evt_gatt_characteristic_value.value.len, ctx->pduSize, ctx->phyInUse);
+                    report_packet(ctx, evt->data.evt_gatt_characteristic_value.characteristic, evt->data.evt_gatt_characteristic_value.value.len);
+
+                    // Fixed data mode
+                    if (params->mode == 2) { 
+                        if (ctx->bitsSent >= (params->fixed_amount * 8)) {
+                            end_data_transmission(ctx, params);
+                        }
+                    }
+
+                    break;
+
+                default:
+                    break;
+            }
+            break;
+
+        default:
+            break;
+    }
+
+    // Handle universal events regardless of state.
+    switch (BGLIB_MSG_ID(evt->header)) {
+        
+        case gecko_evt_gatt_mtu_exchanged_id:
+            ctx->mtuSize = evt->data.evt_gatt_mtu_exchanged.mtu;
+            printf("MTU exchanged: %u\n\n", ctx->mtuSize);
+            break;
+
+        case gecko_evt_le_connection_phy_status_id:
+            ctx->phyInUse = evt->data.evt_le_connection_phy_status.phy;
+            printf("PHY status: %u\n\n", ctx->phyInUse);
+            break;
+
+        case gecko_evt_le_connection_parameters_id:
+            ctx->interval = evt->data.evt_le_connection_parameters.interval;
+            ctx->pduSize = evt->data.evt_le_connection_parameters.txsize;
+            ctx->slaveLatency = evt->data.evt_le_connection_parameters.latency;
+            ctx->supervisionTimeout = evt->data.evt_le_connection_parameters.timeout;
+            break;
+
+        case gecko_evt_le_connection_rssi_id:
+            ctx->rssi = evt->data.evt_le_connection_rssi.rssi;
+            if (ctx->rssiRequested && tx_power_plan_active(ctx, params)) {
+                tx_power_plan_set_rssi(ctx->txPowerPlan, evt->data.evt_le_connection_rssi.rssi);
+            }
+            ctx->rssiRequested = false;
+            break;
+
+        case gecko_evt_gatt_characteristic_value_id:
+            if ((evt->data.evt_gatt_characteristic_value.characteristic == ctx->flightRecorderHandle) && ctx->flightDumpPending) {
+                arm_flight_dump_timeout();
+                if (flight_dump_add(&ctx->flightDump, evt->data.evt_gatt_characteristic_value.value.data, evt->data.evt_gatt_characteristic_value.value.len)
+                    && (ctx->action != act_write_flight_recorder)) {
+                    end_flight_dump(ctx, params, ctx->flightDump.complete);
+                }
+            }
+            // Slave test plan read back, it holds the TX power the slave stack set and the flags it knows.
+            if ((evt->data.evt_gatt_characteristic_value.characteristic == ctx->testPlanHandle)
+                && ((ctx->action == act_read_test_plan) || (ctx->action == act_read_slave_plan) || (ctx->action == act_read_clock_stamps))) {
+                TestPlan_t slavePlan = { .txPower = TEST_PLAN_TX_POWER_KEEP };
+
+                if (test_plan_parse(&slavePlan, evt->data.evt_gatt_characteristic_value.value.data, evt->data.evt_gatt_characteristic_value.value.len)) {
+                    if (ctx->action == act_read_test_plan) {
+                        ctx->txPowerPlan->levels[ctx->txPowerPlan->current].peerActual = slavePlan.txPower;
+                    } else if (ctx->action == act_read_slave_plan) {
+                        ctx->slavePlan = slavePlan;
+                    } else {
+                        ctx->clockStampsOn = ((slavePlan.flags & TEST_PLAN_FLAG_CLOCK_STAMPS) != 0);
+                        ctx->slavePlan.flags = slavePlan.flags;
+                    }
+                }
+            }
+            break;
+
+        case gecko_evt_gatt_procedure_completed_id:
+            // Test plan writes between runs, during setup they are handled with the rest of the GATT procedures.
+            if (((ctx->action == act_write_test_plan) || (ctx->action == act_read_test_plan) || (ctx->action == act_read_slave_plan)
+                 || (ctx->action == act_write_payload_schedule)
+                 || (ctx->action == act_write_clock_stamps) || (ctx->action == act_read_clock_stamps)
+                 || (ctx->action == act_enable_flight_recorder) || (ctx->action == act_write_flight_recorder))
+                && (ctx->state != State_SET_PARAMETERS) && (ctx->state != State_DISCOVER)) {
+                process_procedure_complete_event(ctx, evt, params);
+            }
+            break;
+
+        case gecko_evt_hardware_soft_timer_id:
+            if ((evt->data.evt_hardware_soft_timer.handle == SOFT_TIMER_LATENCY_TIMEOUT_HANDLE) && (ctx->state == State_TRANSMISSION)) {
+                if ((event_time_us(ctx) - ctx->pingSentUs) > LATENCY_TIMEOUT_US) {
+                    ctx->pingsLost++;
+                    if ((ctx->latencyRun.total + ctx->pingsLost) >= params->ping_count) {
+                        end_latency_test(ctx);
+                        ctx->state = State_SCANNING;
+                        finish_test(ctx);
+                    } else {
+                        send_ping(ctx);
+                    }
+                }
+            }
+            if (evt->data.evt_hardware_soft_timer.handle == SOFT_TIMER_FIXED_TRANSFER_TIME_HANDLE) {
+                if (ctx->state == State_BROADCAST_SCAN) {
+                    end_broadcast_scan(ctx);
+                    finish_test(ctx);
+                } else {
+                    end_data_transmission(ctx, params);
+                }
+            }
+            if ((evt->data.evt_hardware_soft_timer.handle == SOFT_TIMER_SETUP_TIMEOUT_HANDLE)
+                && ((ctx->state == State_SET_PARAMETERS) || (ctx->state == State_DISCOVER))) {
+                setup_timeout(ctx, params);
+            }
+            if ((evt->data.evt_hardware_soft_timer.handle == SOFT_TIMER_FLIGHT_DUMP_HANDLE) && ctx->flightDumpPending) {
+                printf("Flight recorder dump timed out after %u of %u events.\n\n", ctx->flightDump.received, ctx->flightDump.total);
+                if ((ctx->action == act_enable_flight_recorder) || (ctx->action == act_write_flight_recorder)) {
+                    set_action(ctx, act_none);
+                }
+                end_flight_dump(ctx, params, false);
+            }
+            if ((evt->data.evt_hardware_soft_timer.handle == SOFT_TIMER_CHANNEL_SETTLE_HANDLE)
+                && (ctx->connection != 0xFF) && (ctx->state != State_TRANSMISSION)) {
+                begin_test(ctx, params);
+            }
+            break;
+
+        case gecko_evt_le_connection_closed_id:
+            printf("Connection closed.\n\n");
+            ctx->disconnects++;
+            cmd_queue_clear(&ctx->cmdQueue); // Pending commands refer to the closed connection.
+            reset_variables(ctx);
+            if (ctx->txPowerPlan != NULL) {
+                // The plan may have stopped at any level, the next connection starts at the default power.
+                gecko_cmd_system_set_tx_power(TX_POWER);
+            }
+            if (ctx->channelPlan != NULL) {
+                // The classification outlives the connection, don't leave the next one on a subset.
+                gecko_cmd_le_gap_set_data_channel_classification(CHANNEL_MAP_LEN, ALL_CHANNELS);
+            }
+            if (ctx->reconnectPending) {
+                // Rerun with new link parameters, go straight to the cached peer.
+                ctx->reconnectPending = false;
+                gecko_cmd_gatt_set_max_mtu(params->mtu_size);
+                ctx->initPhy = initiating_phy(params);
+                printf("Reconnecting to cached peer...\n\n");
+                gecko_cmd_le_gap_connect(ctx->peerAddress, ctx->peerAddressType, ctx->initPhy);
+            } else {
+                gecko_cmd_le_gap_set_discovery_type(5, 0);
+                gecko_cmd_le_gap_set_discovery_timing(5, SCAN_INTERVAL, SCAN_WINDOW);
+                gecko_cmd_le_gap_start_discovery(ctx->initPhy, le_gap_discover_observation);
+                setup_timing_begin(&ctx->setupRun, (uint32_t)event_time_us(ctx));
+            }
+            ctx->state = State_SCANNING;
+            break;
+        
+        default:
+            break;
+    }
+    event_census_add(&ctx->eventCensus, BGLIB_MSG_ID(evt->header), (uint32_t)(monotonic_now_ns() - handlingStartNs));
+    ctx->eventTimeGiven = false;
+    return ctx->askForInput;
+}
+
+/***********************************************************************************************/ /**
+ *  \brief  Give the arrival time of the next event passed to app_handle_events().
+ *  \param[in] ctx Tester context.
+ *  \param[in] timeUs Monotonic arrival time in microseconds.
+ **************************************************************************************************/
+void app_set_event_time(AppContext_t *ctx, uint64_t timeUs)
+{
+    ctx->eventTimeUs = timeUs;
+    ctx->eventTimeGiven = true;
+}
+
+/***********************************************************************************************/ /**
+ *  \brief  Run fixed time tests once per channel subset of the plan instead of on all channels.
+ *  \param[in] ctx Tester context.
+ *  \param[in] plan Channel plan, NULL to go back to all channels.
+ *  \param[in] csvPath CSV file to append the per-channel profile to, NULL for none.
+ **************************************************************************************************/
+void app_set_channel_plan(AppContext_t *ctx, ChannelPlan_t *plan, const char *csvPath)
+{
+    ctx->channelPlan = plan;
+    ctx->channelCsvPath = csvPath;
+}
+
+/***********************************************************************************************/ /**
+ *  \brief  Run fixed time tests once per TX power level of the plan, on the NCP and the slave.
+ *  \param[in] ctx Tester context.
+ *  \param[in] plan TX power plan, NULL to keep TX_POWER.
+ **************************************************************************************************/
+void app_set_tx_power_plan(AppContext_t *ctx, TxPowerPlan_t *plan)
+{
+    ctx->txPowerPlan = plan;
+}
+
+/***********************************************************************************************/ /**
+ *  \brief  Have the slave draw notification sizes from a mix or replay a trace.
+ *  The schedule is written once per connection, before the first run on it.
+ *  \param[in] ctx Tester context.
+ *  \param[in] schedule Size mix or trace, NULL for the usual constant size.
+ **************************************************************************************************/
+void app_set_payload_schedule(AppContext_t *ctx, PayloadSchedule_t *schedule)
+{
+    ctx->payloadSchedule = schedule;
+}
+
+/***********************************************************************************************/ /**
+ *  \brief  Have the slave send on several stream characteristics, weighted and with an optional
+ *  latency probe. The streams are subscribed and configured with the other subscriptions.
+ *  \param[in] ctx Tester context.
+ *  \param[in] config Stream configuration, NULL to use the notifications characteristic only.
+ **************************************************************************************************/
+void app_set_stream_config(AppContext_t *ctx, StreamConfig_t *config)
+{
+    ctx->streamConfig = config;
+    stream_rx_reset(&ctx->streamRx);
+}
+
+/***********************************************************************************************/ /**
+ *  \brief  Have the slave stamp its data with its RTCC count and fit that clock against the host
+ *  clock. After each data run the drift, and both throughputs on the host timebase, are printed
+ *  and given in TestResult_t. Stream notifications carry a stamp anyway.
+ *  \param[in] ctx Tester context.
+ *  \param[in] enable true to ask the slave for clock stamps on the next connection.
+ **************************************************************************************************/
+void app_set_clock_sync(AppContext_t *ctx, bool enable)
+{
+    ctx->clockSyncWanted = enable;
+    clock_sync_reset(&ctx->clockSync);
+}
+
+/***********************************************************************************************/ /**
+ *  \brief  Dump the slave flight recorder after each data run, print a summary of the slave sends
+ *  and append the events to a CSV file. The next run waits for the dump.
+ *  \param[in] ctx Tester context.
+ *  \param[in] csvPath File the events are appended to, NULL for no dumps.
+ **************************************************************************************************/
+void app_set_flight_recorder(AppContext_t *ctx, const char *csvPath)
+{
+    ctx->flightCsvPath = csvPath;
+    ctx->flightDumpPending = false;
+}
+
+/***********************************************************************************************/ /**
+ *  \brief  Set what counts as a gap between received packets and which runs are flagged as stalled.
+ *  \param[in] ctx Tester context.
+ *  \param[in] multiple Connection intervals without data before a pause counts as a gap, 0 for the default.
+ *  \param[in] flagMs Runs with a gap at least this long are flagged, 0 flags any gap.
+ **************************************************************************************************/
+void app_set_gap_detector(AppContext_t *ctx, uint8_t multiple, uint32_t flagMs)
+{
+    ctx->gapMultiple = (multiple > 0) ? multiple : GAP_DEFAULT_MULTIPLE;
+    ctx->gapFlagMs = flagMs;
+    gap_detector_reset(&ctx->gaps, ctx->gapMultiple, 0);
+}
+
+/***********************************************************************************************/ /**
+ *  \brief  Summary of the last finished test. Valid once app_handle_events() has asked for input.
+ *  \param[in] ctx Tester context.
+ *  \return  Result of the last test, zeroed while a test is running.
+ **************************************************************************************************/
+const TestResult_t *app_last_result(AppContext_t *ctx)
+{
+    return &ctx->lastResult;
+}
+
+/***********************************************************************************************/ /**
+ *  \brief  Copy out the state, link parameters and counters of the tester. Cheap enough to call
+ *  from the event loop, it only reads the clock for the run time.
+ *  \param[in] ctx Tester context.
+ *  \param[out] progress Current progress.
+ **************************************************************************************************/
+void app_progress(AppContext_t *ctx, AppProgress_t *progress)
+{
+    const CmdStats_t *cmdStats = cmd_queue_stats(&ctx->cmdQueue, CMD_TRANSMISSION_ON_OFF);
+
+    progress->state = ctx->state;
+    progress->connected = (ctx->connection != 0xFF);
+    progress->measuring = ctx->measuring;
+    progress->connection = ctx->connection;
+    progress->phy = ctx->phyInUse;
+    progress->interval = ctx->interval;
+    progress->slaveLatency = ctx->slaveLatency;
+    progress->supervisionTimeout = ctx->supervisionTimeout;
+    progress->mtu = ctx->mtuSize;
+    progress->pdu = ctx->pduSize;
+    progress->rssi = ctx->rssi;
+    progress->seconds = progress->measuring ? ((double)(monotonic_now_us() - ctx->startingTimeUs) / 1e6) : ctx->lastResult.seconds;
+    progress->bits = ctx->bitsSent;
+    progress->operations = ctx->operationCount;
+    progress->runs = ctx->runs;
+    progress->roundTrips = ctx->latencyRun.total;
+    progress->pingsLost = ctx->pingsLost;
+    progress->setupTimeouts = ctx->setupTimeouts;
+    progress->disconnects = ctx->disconnects;
+    progress->cmdDeferred = cmdStats->deferred;
+    progress->cmdRetries = cmdStats->retries;
+    progress->cmdDropped = cmdStats->dropped;
+    progress->cmdLastError = cmdStats->lastError;
+    progress->setup = ctx->setupStats;
+}
+
+/***********************************************************************************************/ /**
+ *  \brief  Ask the NCP for the RSSI of the open connection, it arrives as an event and shows up in
+ *  app_progress(). Does nothing without a connection.
+ *  \param[in] ctx Tester context.
+ **************************************************************************************************/
+void app_request_rssi(AppContext_t *ctx)
+{
+    if (ctx->connection != 0xFF) {
+        gecko_cmd_le_connection_get_rssi(ctx->connection);
+    }
+}
+
+/***********************************************************************************************/ /**
+ *  \brief  Start the test again with as little setup as possible.
+ *  Keeps the connection if link parameters and subscriptions still match, renegotiates PHY and
+ *  interval in place, or reconnects directly to the cached peer with cached GATT handles.
+ *  Falls back to a full NCP reset if no peer has been found yet.
+ *  \param[in] ctx Tester context.
+ *  \param[in] params Test parameters for the next run.
+ **************************************************************************************************/
+void app_rerun(AppContext_t *ctx, TestParameters_t *params)
+{
+    bool subscriptionsMatch = (ctx->subscribedMode == params->mode) && (ctx->subscribedConfFlag == params->client_conf_flag);
+
+    memset(&ctx->lastResult, 0, sizeof(ctx->lastResult));
+    if (params->mode == 5) {
+        start_broadcast_scan(ctx, params);
+        return;
+    }
+
+    if (channel_plan_active(ctx, params)) {
+        channel_plan_restart(ctx->channelPlan);
+    }
+    if (tx_power_plan_active(ctx, params)) {
+        tx_power_plan_restart(ctx->txPowerPlan);
+    }
+    setup_timing_begin(&ctx->setupRun, (uint32_t)monotonic_now_us());
+    if (ctx->connection != 0xFF) {
+        if (subscriptionsMatch && (ctx->mtuSize == params->mtu_size)) {
+            if ((ctx->interval == params->connection_interval) && (ctx->phyInUse == params->phy)) {
+                printf("\nReusing open connection.\n");
+                end_setup_timing(ctx);
+                start_run(ctx, params);
+            } else {
+                printf("\nUpdating connection parameters...\n");
+                ctx->linkReady = false;
+                ctx->gattStarted = true;
+                ctx->gattReady = true;
+                start_link_setup(ctx, params);
+            }
+        } else {
+            // ATT MTU can only be exchanged once per connection, so reconnect.
+            ctx->reconnectPending = true;
+            gecko_cmd_le_connection_close(ctx->connection);
+        }
+    } else if (ctx->peerCached) {
+        gecko_cmd_le_gap_end_procedure();
+        gecko_cmd_gatt_set_max_mtu(params->mtu_size);
+        ctx->initPhy = initiating_phy(params);
+        ctx->state = State_SCANNING;
+        printf("\nReconnecting to cached peer...\n\n");
+        gecko_cmd_le_gap_connect(ctx->peerAddress, ctx->peerAddressType, ctx->initPhy);
+    } else {
+        gecko_cmd_le_gap_end_procedure();
+        gecko_cmd_system_reset(0); // Go to regular boot and start scanning again.
+    }
+}
+
+
+/***************************************************************************************************
+ * Static Function Definitions
+ **************************************************************************************************/
+
+// Make a loading animation while waiting for scan response match.
+static void waiting_indication(void)
+{
+    static uint32_t cnt = 0;
+    const char *fan[] = {"-", "\\", "|", "/"};
+    printf("(%s)", fan[((cnt++) % 4)]);
+    printf("\b\b\b");   // Move cursor back with backspace character '\b'.
+    fflush(stdout);
+}
+
+// Reset handles, flags and calculation variables to initial state.
+static void reset_variables(AppContext_t *ctx)
+{
+    ctx->connection = 0xFF;
+    ctx->rssi = APP_RSSI_UNKNOWN;
+    ctx->throughput = 0;
+    ctx->bitsSent = 0;
+    ctx->operationCount = 0;
+    ctx->airtimeUs = 0;
+    ctx->payloadSchedulePushed = false;
+    ctx->clockStampsPushed = false;
+    ctx->clockStampsOn = false;
+    ctx->slavePlanKnown = false;
+    ctx->rssiRequested = false;
+    ctx->flightSubscribed = false;
+    ctx->flightDumpPending = false;
+    ctx->interval = 0;
+    ctx->mtuSize = 0;
+    ctx->pduSize = 0;
+    ctx->supervisionTimeout = 0;
+    ctx->slaveLatency = 0;
+    ctx->isFirstPacket = true;
+    ctx->measuring = false;
+    ctx->subscribedMode = 0xFF;
+    ctx->subscribedConfFlag = 0xFF;
+    set_action(ctx, act_none);
+    ctx->state = State_SCANNING;
+}
+
+// Forget the peer and its GATT handles, e.g. after an NCP reset.
+static void clear_peer_cache(AppContext_t *ctx)
+{
+    ctx->serviceHandle = 0xFFFFFFFF;
+    ctx->notificationsHandle = 0xFFFF;
+    ctx->indicationsHandle = 0xFFFF;
+    ctx->transmissionHandle = 0xFFFF;
+    ctx->resultHandle = 0xFFFF;
+    ctx->latencyHandle = 0xFFFF;
+    ctx->testPlanHandle = 0xFFFF;
+    ctx->payloadScheduleHandle = 0xFFFF;
+    memset(ctx->streamHandles, 0xFF, sizeof(ctx->streamHandles));
+    ctx->streamConfigHandle = 0xFFFF;
+    ctx->flightRecorderHandle = 0xFFFF;
+    ctx->numCharacteristicsDiscovered = 0;
+    ctx->peerCached = false;
+    ctx->handlesCached = false;
+    ctx->reconnectPending = false;
+}
+
+// Connectionless mode: passive scan for broadcasts for the fixed time. The --params PHY picks the
+// primary PHY, 4 scans on Coded, anything else on 1M where 2M broadcasts are announced too.
+static void start_broadcast_scan(AppContext_t *ctx, TestParameters_t *params)
+{
+    uint8_t scanPhy = (params->phy == 4) ? le_gap_phy_coded : le_gap_phy_1m;
+
+    broadcast_rx_reset(&ctx->broadcastRx);
+    gecko_cmd_le_gap_end_procedure();
+    gecko_cmd_le_gap_set_discovery_type(5, 0);
+    gecko_cmd_le_gap_set_discovery_timing(5, SCAN_INTERVAL, SCAN_WINDOW);
+    gecko_cmd_le_gap_start_discovery(scanPhy, le_gap_discover_observation);
+    gecko_cmd_hardware_set_soft_timer(HW_TICKS_PER_SECOND * params->fixed_time, SOFT_TIMER_FIXED_TRANSFER_TIME_HANDLE, 1);
+    ctx->state = State_BROADCAST_SCAN;
+    printf("Counting broadcasts for %u s, scanning on %s PHY...\n\n", params->fixed_time, (scanPhy == le_gap_phy_coded) ? "Coded" : "1M");
+}
+
+// Stop scanning and print throughput and loss of each PHY heard from.
+static void end_broadcast_scan(AppContext_t *ctx)
+{
+    bool heard = false;
+
+    gecko_cmd_le_gap_end_procedure();
+    ctx->state = State_SCANNING;
+
+    memset(&ctx->lastResult, 0, sizeof(ctx->lastResult));
+    ctx->lastResult.mode = 5;
+    for (uint8_t i = 0; i < BROADCAST_PHYS; i++) {
+        ctx->lastResult.throughput += broadcast_bps(&ctx->broadcastRx.phy[i], 1000000);
+        ctx->lastResult.operations += ctx->broadcastRx.phy[i].packets;
+        ctx->lastResult.lost += ctx->broadcastRx.phy[i].lost;
+        ctx->lastResult.bits += ctx->broadcastRx.phy[i].bytes * 8;
+    }
+
+    printf("-------------------------------\n");
+    printf("CONNECTIONLESS RESULTS:\n\n");
+    for (uint8_t i = 0; i < BROADCAST_PHYS; i++) {
+        const BroadcastStats_t *stats = &ctx->broadcastRx.phy[i];
+        uint16_t loss = broadcast_loss_permille(stats);
+
+        if (stats->packets == 0) {
+            continue;
+        }
+        heard = true;
+        printf("PHY %s:\n", broadcast_phy_name(i));
+        printf("  Throughput: %u bps\n", broadcast_bps(stats, 1000000));
+        printf("  Packets: %u, bytes: %llu, duplicates: %u\n", stats->packets, (unsigned long long)stats->bytes, stats->duplicates);
+        printf("  Lost: %u (%u.%u%%), gaps: %u, longest gap: %u\n", stats->lost, loss / 10, loss % 10, stats->gaps, stats->longestGap);
+    }
+    if (!heard) {
+        printf("No broadcasts received.\n");
+    }
+    printf("-------------------------------\n\n");
+}
+
+// Time source of the command queue, microseconds.
+static uint32_t cmd_clock(void)
+{
+    return (uint32_t)monotonic_now_us();
+}
+
+// Arguments: connection, transmission_on handle little endian and the value to write.
+static uint16_t issue_transmission_on(const void *args)
+{
+    const uint8_t *p = (const uint8_t *)args;
+    return gecko_cmd_gatt_write_characteristic_value_without_response(p[0], (uint16_t)(p[1] | (p[2] << 8)), 1, &p[3])->result;
+}
+
+// The queue keeps a copy of the arguments, so a retry doesn't need the context.
+static void submit_transmission_on(AppContext_t *ctx, uint8_t value)
+{
+    uint8_t args[4] = {ctx->connection, (uint8_t)ctx->transmissionHandle, (uint8_t)(ctx->transmissionHandle >> 8), value};
+    cmd_queue_submit(&ctx->cmdQueue, CMD_TRANSMISSION_ON_OFF, issue_transmission_on, args, sizeof(args));
+}
+
+// 2M isn't allowed as initiating PHY by stack.
+static uint8_t initiating_phy(TestParameters_t *params)
+{
+    return (params->phy == 2) ? 1 : params->phy;
+}
+
+static void start_data_transmission(AppContext_t *ctx, TestParameters_t *params)
+{
+    // A rerun on the same connection comes here straight from the last run.
+    ctx->measuring = true;
+    ctx->isFirstPacket = false;
+    ctx->bitsSent = 0;
+    ctx->operationCount = 0;
+    ctx->airtimeUs = 0;
+    stream_rx_reset(&ctx->streamRx);
+    ctx->throughput = 0;
+    timer_start(ctx);
+    ctx->windowStartUs = ctx->startingTimeUs;
+    ctx->windowBits = 0;
+    ctx->windowPackets = 0;
+    clock_sync_reset(&ctx->clockSync);
+    gap_detector_reset(&ctx->gaps, ctx->gapMultiple, ctx->startingTimeUs);
+    event_census_reset(&ctx->eventCensus, 1000000000);
+    if (params->mode == 3) {
+        gap_detector_add(&ctx->gaps, ctx->startingTimeUs, ctx->interval); // Free mode runs start with their first packet.
+    }
+    ctx->flightDumpPending = false; // A free mode run started before the dump was in, the slave drops it too.
+
+    // Turn OFF Display refresh on slave side
+    if ((params->mode == 1) || (params->mode == 2)) {
+        // This triggers the data transmission if we're on fixed data amount or fixed time modes.
+        submit_transmission_on(ctx, TRANSMISSION_ON);
+    }
+
+    if (params->mode == 1) {
+        // Start fixed time one-shot soft timer.
+        gecko_cmd_hardware_set_soft_timer(((HW_TICKS_PER_SECOND)*params->fixed_time), SOFT_TIMER_FIXED_TRANSFER_TIME_HANDLE, 1);
+    }
+}
+
+// When transmission is done, print out the summary of the transmission.
+static void end_data_transmission(AppContext_t *ctx, TestParameters_t *params)
+{
+    double endTime = timer_end(ctx);
+    const CmdStats_t *cmdStats = cmd_queue_stats(&ctx->cmdQueue, CMD_TRANSMISSION_ON_OFF);
+
+    ctx->runs++;
+    ctx->measuring = false;
+
+    // The last window ends with the run.
+    if ((ctx->windowStartUs != 0) && (ctx->callbacks.window != NULL) && (ctx->callbacks.windowMs > 0)
+        && (event_time_us(ctx) > ctx->windowStartUs)) {
+        report_window(ctx, event_time_us(ctx) - ctx->windowStartUs);
+    }
+    ctx->windowStartUs = 0;
+
+    // Turn ON display again
+    if ((params->mode == 1) || (params->mode == 2)) {
+        // This triggers the data transmission end if we're on fixed data amount or fixed time modes.
+        // The NCP is often still busy with the last packets, the queue retries without stalling the event loop.
+        submit_transmission_on(ctx, TRANSMISSION_OFF);
+    }
+
+    ctx->throughput = (uint64_t)((double)ctx->bitsSent / endTime);
+    if (channel_plan_active(ctx, params)) {
+        channel_plan_record(ctx->channelPlan, (uint32_t)ctx->throughput, ctx->operationCount);
+    }
+    if (tx_power_plan_active(ctx, params)) {
+        // The RSSI arrives with the next link event, before the slave result.
+        tx_power_plan_record(ctx->txPowerPlan, (uint32_t)ctx->throughput);
+        gecko_cmd_le_connection_get_rssi(ctx->connection);
+        ctx->rssiRequested = true;
+    }
+
+    memset(&ctx->lastResult, 0, sizeof(ctx->lastResult));
+    ctx->lastResult.mode = params->mode;
+    ctx->lastResult.phy = ctx->phyInUse;
+    ctx->lastResult.interval = ctx->interval;
+    ctx->lastResult.mtu = ctx->mtuSize;
+    ctx->lastResult.seconds = endTime;
+    ctx->lastResult.bits = ctx->bitsSent;
+    ctx->lastResult.throughput = (uint32_t)ctx->throughput;
+    ctx->lastResult.operations = ctx->operationCount;
+    ctx->lastResult.utilization = (endTime > 0) ? ((double)ctx->airtimeUs / (endTime * 1e4)) : 0;
+    ctx->lastResult.gaps = ctx->gaps.count;
+    ctx->lastResult.gapStalledSeconds = (double)ctx->gaps.stalledUs / 1e6;
+    ctx->lastResult.gapLongestUs = ctx->gaps.longestUs;
+    ctx->lastResult.gapLongestAt = (double)ctx->gaps.longestAtUs / 1e6;
+    ctx->lastResult.stalled = gap_detector_flagged(&ctx->gaps, ctx->gapFlagMs);
+    ctx->lastResult.events = ctx->eventCensus.total;
+    ctx->lastResult.eventHandlingUs = event_census_us(&ctx->eventCensus, ctx->eventCensus.totalTicks);
+
+    printf("-------------------------------\n");
+    printf("RESULTS:\n\n");
+    printf("Bits sent: %lu\n", ctx->bitsSent);
+    printf("Time elapsed: %.3f sec\n", endTime);
+    printf("Host calculated throughput: %lu bps\n", ctx->throughput);
+    printf("Operation count: %lu\n", ctx->operationCount);
+    if ((ctx->operationCount > 0) && (endTime > 0)) {
+        // Utilization is the share of the run the packets and the empty PDUs answering them kept the radio busy.
+        printf("Packets per second: %.1f\n", (double)ctx->operationCount / endTime);
+        printf("Mean payload: %.1f B\n", (double)ctx->bitsSent / 8.0 / ctx->operationCount);
+        printf("Connection event utilization: %.1f %%\n", (double)ctx->airtimeUs / (endTime * 1e4));
+    }
+    if (streams_active(ctx, params)) {
+        print_streams(ctx, endTime);
+    }
+    // Stalls the average hides: missed connection events, retransmissions, a link close to its supervision timeout.
+    printf("Gaps over %u connection intervals: %u", ctx->gaps.multiple, ctx->gaps.count);
+    if (ctx->gaps.count > 0) {
+        printf(", stalled %.1f ms in total, longest %.1f ms at %.3f sec", (double)ctx->gaps.stalledUs / 1e3,
+               (double)ctx->gaps.longestUs / 1e3, (double)ctx->gaps.longestAtUs / 1e6);
+    }
+    printf("\n");
+    if (ctx->lastResult.stalled) {
+        printf("STALLED: a gap reached the %u ms limit\n", ctx->gapFlagMs);
+    }
+    print_event_census(ctx);
+    if ((cmdStats->deferred > 0) || (cmdStats->dropped > 0)) {
+        printf("Deferred transmission_on writes: %u, retries: %u, dropped: %u, last error: 0x%04x\n",
+               cmdStats->deferred, cmdStats->retries, cmdStats->dropped, cmdStats->lastError);
+    }
+    printf("-------------------------------\n\n");
+
+    ctx->isFirstPacket = true;
+    ctx->bitsSent = 0;
+    ctx->throughput = 0;
+    ctx->operationCount = 0;
+    ctx->airtimeUs = 0;
+    stream_rx_reset(&ctx->streamRx);
+}
+
+// Per-packet callback, and the throughput windows of a run closed by this packet.
+static void report_packet(AppContext_t *ctx, uint16_t characteristic, uint16_t len)
+{
+    bool windows = (ctx->windowStartUs != 0) && (ctx->callbacks.window != NULL) && (ctx->callbacks.windowMs > 0);
+    uint64_t now;
+
+    // Without callbacks the receive path stays free of clock reads.
+    if ((ctx->callbacks.packet == NULL) && !windows) {
+        return;
+    }
+    now = event_time_us(ctx);
+    if (ctx->callbacks.packet != NULL) {
+        AppPacket_t packet = { .characteristic = characteristic, .len = len, .timeUs = now };
+        ctx->callbacks.packet(ctx->callbacks.user, &packet);
+    }
+    if (!windows) {
+        return;
+    }
+    // Windows without packets are reported too, with zero throughput.
+    while ((now - ctx->windowStartUs) >= ((uint64_t)ctx->callbacks.windowMs * 1000)) {
+        report_window(ctx, (uint64_t)ctx->callbacks.windowMs * 1000);
+    }
+    ctx->windowBits += (uint64_t)len * 8;
+    ctx->windowPackets++;
+}
+
+static void report_window(AppContext_t *ctx, uint64_t lengthUs)
+{
+    AppWindow_t window;
+
+    window.start = (double)(ctx->windowStartUs - ctx->startingTimeUs) / 1e6;
+    window.seconds = (double)lengthUs / 1e6;
+    window.bits = ctx->windowBits;
+    window.packets = ctx->windowPackets;
+    window.throughput = (uint32_t)((double)ctx->windowBits / window.seconds);
+    ctx->callbacks.window(ctx->callbacks.user, &window);
+
+    ctx->windowStartUs += lengthUs;
+    ctx->windowBits = 0;
+    ctx->windowPackets = 0;
+}
+
+static void report_result(AppContext_t *ctx)
+{
+    if (ctx->callbacks.result != NULL) {
+        ctx->callbacks.result(ctx->callbacks.user, &ctx->lastResult);
+    }
+}
+
+// The test is over: the client gets the result and the caller of app_handle_events() is asked what next.
+static void finish_test(AppContext_t *ctx)
+{
+    ctx->askForInput = 1;
+    report_result(ctx);
+}
+
+// Ping-pong against the slave echo until params->ping_count round trips are done.
+static void start_latency_test(AppContext_t *ctx, TestParameters_t *params)
+{
+    histogram_reset(&ctx->latencyRun);
+    ctx->pingSeq = 0;
+    ctx->pingsLost = 0;
+    printf("Sending %lu pings...\n", (unsigned long)params->ping_count);
+    // Periodic check for lost pings.
+    gecko_cmd_hardware_set_soft_timer(HW_TICKS_PER_SECOND / 2, SOFT_TIMER_LATENCY_TIMEOUT_HANDLE, 0);
+    send_ping(ctx);
+}
+
+// A failed write is caught by the timeout check.
+static void send_ping(AppContext_t *ctx)
+{
+    ctx->pingSeq++;
+    memcpy(ctx->pingData, &ctx->pingSeq, sizeof(ctx->pingSeq));
+    ctx->pingSentUs = monotonic_now_us();
+    gecko_cmd_gatt_write_characteristic_value_without_response(ctx->connection, ctx->latencyHandle, LATENCY_PING_SIZE, ctx->pingData);
+}
+
+// Print the run and add it to the session totals of the PHY and interval in use.
+static void end_latency_test(AppContext_t *ctx)
+{
+    LatencySet_t *set = NULL;
+
+    gecko_cmd_hardware_set_soft_timer(0, SOFT_TIMER_LATENCY_TIMEOUT_HANDLE, 0);
+
+    for (uint8_t i = 0; i < ctx->latencySetCount; i++) {
+        if ((ctx->latencySets[i].phy == ctx->phyInUse) && (ctx->latencySets[i].interval == ctx->interval)) {
+            set = &ctx->latencySets[i];
+        }
+    }
+    if ((set == NULL) && (ctx->latencySetCount < LATENCY_SETS_MAX)) {
+        set = &ctx->latencySets[ctx->latencySetCount++];
+        set->phy = ctx->phyInUse;
+        set->interval = ctx->interval;
+        histogram_reset(&set->hist);
+    }
+    if (set) {
+        histogram_merge(&set->hist, &ctx->latencyRun);
+    }
+
+    memset(&ctx->lastResult, 0, sizeof(ctx->lastResult));
+    ctx->lastResult.mode = 4;
+    ctx->lastResult.phy = ctx->phyInUse;
+    ctx->lastResult.interval = ctx->interval;
+    ctx->lastResult.mtu = ctx->mtuSize;
+    ctx->lastResult.roundTrips = ctx->latencyRun.total;
+    ctx->lastResult.lost = ctx->pingsLost;
+    ctx->lastResult.p50Us = histogram_percentile(&ctx->latencyRun, 500);
+    ctx->lastResult.p99Us = histogram_percentile(&ctx->latencyRun, 990);
+    ctx->lastResult.maxUs = ctx->latencyRun.max;
+
+    printf("-------------------------------\n");
+    printf("LATENCY RESULTS:\n\n");
+    printf("Round trips: %lu\n", (unsigned long)ctx->latencyRun.total);
+    printf("Lost pings: %lu\n", (unsigned long)ctx->pingsLost);
+    print_latency("This run", &ctx->latencyRun);
+    printf("\nSession totals per PHY and interval:\n");
+    for (uint8_t i = 0; i < ctx->latencySetCount; i++) {
+        char label[32];
+        snprintf(label, sizeof(label), "PHY %u, %u ms", ctx->latencySets[i].phy, (unsigned int)((float)ctx->latencySets[i].interval * 1.25));
+        print_latency(label, &ctx->latencySets[i].hist);
+    }
+    printf("-------------------------------\n\n");
+}
+
+static void print_latency(const char *label, Histogram_t *hist)
+{
+    printf("%-16s p50 %lu, p90 %lu, p99 %lu, p99.9 %lu, max %lu us (%lu samples)\n", label,
+           (unsigned long)histogram_percentile(hist, 500), (unsigned long)histogram_percentile(hist, 900),
+           (unsigned long)histogram_percentile(hist, 990), (unsigned long)histogram_percentile(hist, 999),
+           (unsigned long)hist->max, (unsigned long)hist->total);
+}
+
+// Setup phases of this run next to the session statistics. Phases that were skipped, e.g. discovery
+// with cached handles, show as '-'. Parameters and MTU both count from the connection opening.
+static void print_setup_timing(AppContext_t *ctx)
+{
+    printf("-------------------------------\n");
+    printf("SETUP TIMING (ms):\n\n");
+    printf("%-11s %10s %10s %10s %10s %6s\n", "Phase", "This run", "Min", "Mean", "Max", "Runs");
+    for (uint8_t i = 0; i < SETUP_PHASES; i++) {
+        uint32_t duration;
+        char current[16] = "-";
+
+        if (setup_timing_phase(&ctx->setupRun, (SetupPhase_t)i, &duration)) {
+            snprintf(current, sizeof(current), "%.3f", (double)duration / 1000.0);
+        }
+        if (ctx->setupStats.count[i] > 0) {
+            printf("%-11s %10s %10.3f %10.3f %10.3f %6lu\n", setup_timing_phase_name((SetupPhase_t)i), current,
+                   (double)ctx->setupStats.min[i] / 1000.0, ((double)ctx->setupStats.sum[i] / ctx->setupStats.count[i]) / 1000.0,
+                   (double)ctx->setupStats.max[i] / 1000.0, (unsigned long)ctx->setupStats.count[i]);
+        } else {
+            printf("%-11s %10s %10s %10s %10s %6u\n", setup_timing_phase_name((SetupPhase_t)i), current, "-", "-", "-", 0);
+        }
+    }
+    printf("-------------------------------\n\n");
+}
+
+// The connection or rerun is ready for its first run. Counted once, the steps of a channel or TX
+// power plan reuse the setup.
+static void end_setup_timing(AppContext_t *ctx)
+{
+    setup_timing_mark(&ctx->setupRun, SETUP_MARK_TEST_START, (uint32_t)event_time_us(ctx));
+    setup_timing_add(&ctx->setupStats, &ctx->setupRun);
+    print_setup_timing(ctx);
+}
+
+// Helper function to make the discovery and subscribing flow correct.
+// Action enum values indicate which procedure was completed.
+static void process_procedure_complete_event(AppContext_t *ctx, struct gecko_cmd_packet *evt, TestParameters_t *params)
+{
+    uint16_t result = evt->data.evt_gatt_procedure_completed.result;
+
+    switch (ctx->action) {
+        case act_discover_service:
+            set_action(ctx, act_none);
+            if (!result) {
+                printf("Starting characteristic discovery...\n");
+                // Discover successful, start characteristic discovery.
+                gecko_cmd_gatt_discover_characteristics(ctx->connection, ctx->serviceHandle);
+                set_action(ctx, act_discover_characteristics);
+            }
+        break;
+
+        case act_discover_characteristics:
+            set_action(ctx, act_none);
+            if (!result) {
+                if (ctx->numCharacteristicsDiscovered >= 4) {
+                    printf("All necessary characteristics discovered.\n");
+                    ctx->handlesCached = true;
+                    if ((params->mode == 4) && (ctx->latencyHandle == 0xFFFF)) {
+                        printf("Slave firmware has no latency characteristic, please update it.\n");
+                    } else {
+                        start_subscriptions(ctx, params);
+                    }
+                }
+            }
+        break;
+
+        case act_enable_notification:
+            set_action(ctx, act_none);
+            if (!result) {
+                // Notifications turned on.
+                printf("Subscribed to notifications.\n");
+                
+                if (params->mode == 3) {
+                    printf("Subscribing to indications.\n");
+                    gecko_cmd_gatt_set_characteristic_notification(ctx->connection, ctx->indicationsHandle, gatt_indication);
+                    set_action(ctx, act_enable_indication);
+                } else {
+                    // Subscribe to slave result.
+                    gecko_cmd_gatt_set_characteristic_notification(ctx->connection, ctx->resultHandle, gatt_indication);
+                    set_action(ctx, act_subscribe_result);
+                }
+            }
+        break;
+
+        case act_enable_indication:
+            set_action(ctx, act_none);
+            if (!result) {
+                // Indications turned on.
+                printf("Subscribed to indications.\n");
+                // Subscribe to slave result.
+                gecko_cmd_gatt_set_characteristic_notification(ctx->connection, ctx->resultHandle, gatt_indication);
+                set_action(ctx, act_subscribe_result);
+            }
+        break;
+
+        case act_enable_latency:
+            set_action(ctx, act_none);
+            if (!result) {
+                printf("Subscribed to latency echoes.\n");
+                printf("\nDISCOVERY DONE.\n");
+                ctx->subscribedMode = params->mode;
+                ctx->subscribedConfFlag = params->client_conf_flag;
+                ctx->gattReady = true;
+                try_begin_test(ctx, params);
+            }
+            break;
+
+        case act_subscribe_result:
+            set_action(ctx, act_none);
+            if (!result) {
+                printf("Subscribed to throughput result.\n");
+                if (streams_active(ctx, params)) {
+                    ctx->streamSetupIndex = 0;
+                    stream_setup_next(ctx, params);
+                } else {
+                    gatt_setup_done(ctx, params);
+                }
+            }
+            break;
+
+        case act_enable_stream:
+            set_action(ctx, act_none);
+            if (result) {
+                printf("Subscribing to stream %u failed, 0x%04x. The slave skips it.\n", ctx->streamSetupIndex, result);
+            }
+            stream_setup_next(ctx, params);
+            break;
+
+        case act_write_stream_config:
+            set_action(ctx, act_none);
+            if (result) {
+                printf("Slave refused the stream configuration, 0x%04x. Data comes on the notifications characteristic.\n", result);
+            }
+            gatt_setup_done(ctx, params);
+            break;
+
+        case act_write_test_plan:
+            set_action(ctx, act_none);
+            if (!result) {
+                gecko_cmd_gatt_read_characteristic_value(ctx->connection, ctx->testPlanHandle);
+                set_action(ctx, act_read_test_plan);
+            } else {
+                printf("Slave refused the test plan, 0x%04x. Its TX power is unchanged.\n", result);
+                begin_test(ctx, params);
+            }
+            break;
+
+        case act_read_test_plan:
+            set_action(ctx, act_none);
+            begin_test(ctx, params);
+            break;
+
+        case act_read_slave_plan:
+            set_action(ctx, act_none);
+            if (result) {
+                printf("Reading the slave test plan failed, 0x%04x. Plan writes fall back to a free running plan.\n", result);
+            }
+            ctx->slavePlanKnown = true;
+            start_run(ctx, params);
+            break;
+
+        case act_write_payload_schedule:
+            set_action(ctx, act_none);
+            if (result) {
+                printf("Slave refused the payload schedule, 0x%04x. Notifications keep one size.\n", result);
+                ctx->payloadSchedulePushed = true;
+            }
+            if (!push_payload_schedule(ctx)) {
+                start_run(ctx, params);
+            }
+            break;
+
+        case act_write_clock_stamps:
+            set_action(ctx, act_none);
+            if (!result) {
+                gecko_cmd_gatt_read_characteristic_value(ctx->connection, ctx->testPlanHandle);
+                set_action(ctx, act_read_clock_stamps);
+            } else {
+                printf("Slave refused the clock stamp request, 0x%04x.\n", result);
+                start_run(ctx, params);
+            }
+            break;
+
+        case act_enable_flight_recorder:
+            set_action(ctx, act_none);
+            if (!result) {
+                ctx->flightSubscribed = true;
+                request_flight_dump(ctx);
+            } else {
+                printf("Subscribing to the flight recorder failed, 0x%04x.\n", result);
+                end_flight_dump(ctx, params, false);
+            }
+            break;
+
+        case act_write_flight_recorder:
+            set_action(ctx, act_none);
+            if (result) {
+                printf("Slave refused the flight recorder dump, 0x%04x.\n", result);
+                end_flight_dump(ctx, params, false);
+            } else if (ctx->flightDump.complete || ctx->flightDump.failed) {
+                end_flight_dump(ctx, params, ctx->flightDump.complete);
+            }
+            break;
+
+        case act_read_clock_stamps:
+            set_action(ctx, act_none);
+            if (ctx->clockStampsOn) {
+                printf("Slave stamps its data with its RTCC count.\n");
+            } else {
+                printf("Slave firmware doesn't stamp its data%s.\n", streams_active(ctx, params) ? ", the clock fit uses the stream headers" : "");
+            }
+            start_run(ctx, params);
+            break;
+
+        case act_none:
+            break;
+
+        default:
+            break;
+    }
+}
+
+// Request PHY and connection interval together and arm the setup timeout.
+static void start_link_setup(AppContext_t *ctx, TestParameters_t *params)
+{
+    uint32_t timeoutMs = ((uint32_t)params->connection_interval * 5 * SETUP_TIMEOUT_INTERVALS) / 4; // 1.25 ms units
+
+    if (timeoutMs < SETUP_TIMEOUT_MIN_MS) {
+        timeoutMs = SETUP_TIMEOUT_MIN_MS;
+    }
+
+    ctx->phyRequestPending = false;
+    if (ctx->phyInUse != params->phy) {
+        // Change PHY from initial if needed (2M). A busy stack gets another try on the next link event.
+        ctx->phyRequestPending = (gecko_cmd_le_connection_set_phy(ctx->connection, params->phy)->result != 0);
+    }
+    gecko_cmd_le_connection_set_timing_parameters(ctx->connection, params->connection_interval, params->connection_interval, 0, 100, 0, 0xFFFF);
+    gecko_cmd_hardware_set_soft_timer((HW_TICKS_PER_SECOND * timeoutMs) / 1000, SOFT_TIMER_SETUP_TIMEOUT_HANDLE, 1);
+    if (ctx->state != State_DISCOVER) {
+        ctx->state = State_SET_PARAMETERS;
+    }
+}
+
+// Link layer side of the setup is done once PHY and interval match the requested ones.
+static void check_link_ready(AppContext_t *ctx, TestParameters_t *params)
+{
+    uint32_t now = (uint32_t)event_time_us(ctx);
+
+    if (ctx->phyRequestPending && (ctx->phyInUse != params->phy)) {
+        ctx->phyRequestPending = (gecko_cmd_le_connection_set_phy(ctx->connection, params->phy)->result != 0);
+    }
+    if (ctx->linkReady || (ctx->interval != params->connection_interval) || (ctx->phyInUse != params->phy)) {
+        return;
+    }
+
+    setup_timing_mark(&ctx->setupRun, SETUP_MARK_PARAMETERS, now);
+    setup_timing_mark(&ctx->setupRun, SETUP_MARK_LINK_READY, now);
+    ctx->linkReady = true;
+    try_begin_test(ctx, params);
+}
+
+// GATT side of the setup. Discovery is skipped when the handles of this peer are already known,
+// subscriptions are skipped when they still match the mode.
+static void start_gatt_setup(AppContext_t *ctx, TestParameters_t *params)
+{
+    if (ctx->gattStarted) {
+        return;
+    }
+    ctx->gattStarted = true;
+    ctx->state = State_DISCOVER;
+
+    if ((ctx->subscribedMode == params->mode) && (ctx->subscribedConfFlag == params->client_conf_flag)) {
+        ctx->gattReady = true;
+        try_begin_test(ctx, params);
+    } else if (ctx->handlesCached) {
+        printf("Using cached GATT handles.\n");
+        start_subscriptions(ctx, params);
+    } else {
+        setup_timing_mark(&ctx->setupRun, SETUP_MARK_DISCOVERY_START, (uint32_t)event_time_us(ctx));
+        gecko_cmd_gatt_discover_primary_services_by_uuid(ctx->connection, 16, SERVICE_UUID);
+    }
+}
+
+// The peer didn't settle on the requested link parameters in time, carry on with the negotiated ones.
+static void setup_timeout(AppContext_t *ctx, TestParameters_t *params)
+{
+    ctx->setupTimeouts++;
+    if (!ctx->linkReady) {
+        printf("Link setup timed out, using PHY %u (requested %u) and interval %u (requested %u).\n\n",
+               ctx->phyInUse, params->phy, ctx->interval, params->connection_interval);
+        setup_timing_mark(&ctx->setupRun, SETUP_MARK_LINK_READY, (uint32_t)event_time_us(ctx));
+        ctx->linkReady = true;
+    }
+    if (!ctx->gattStarted) {
+        printf("No MTU exchange seen, starting discovery.\n");
+        start_gatt_setup(ctx, params);
+    }
+    try_begin_test(ctx, params);
+}
+
+// Start the test once both the link layer and the GATT side are done.
+static void try_begin_test(AppContext_t *ctx, TestParameters_t *params)
+{
+    if (!ctx->linkReady || !ctx->gattReady || (ctx->state == State_TRANSMISSION)) {
+        return;
+    }
+    gecko_cmd_hardware_set_soft_timer(0, SOFT_TIMER_SETUP_TIMEOUT_HANDLE, 0);
+    end_setup_timing(ctx);
+    start_run(ctx, params);
+}
+
+// Begin the test, restricted to the next channel subset or set to the next TX power level first
+// if a plan is running.
+static void start_run(AppContext_t *ctx, TestParameters_t *params)
+{
+    char text[64];
+    uint32_t settleMs;
+
+    if ((ctx->payloadSchedule != NULL) && !ctx->payloadSchedulePushed && (params->mode != 4)) {
+        if (ctx->payloadScheduleHandle == 0xFFFF) {
+            printf("Slave firmware has no payload schedule characteristic, notifications keep one size.\n");
+            ctx->payloadSchedulePushed = true;
+        } else {
+            payload_schedule_print(ctx->payloadSchedule);
+            ctx->payloadScheduleNext = 0;
+            if (push_payload_schedule(ctx)) {
+                return;
+            }
+        }
+    }
+    if (ctx->clockSyncWanted && !ctx->clockStampsPushed && (params->mode >= 1) && (params->mode <= 3)) {
+        if (push_clock_stamps(ctx)) {
+            return;
+        }
+    }
+    if (tx_power_plan_active(ctx, params)) {
+        start_tx_power_level(ctx, params);
+        return;
+    }
+    if (!channel_plan_active(ctx, params)) {
+        begin_test(ctx, params);
+        return;
+    }
+
+    // The master applies the map at an instant some intervals ahead, give it time before measuring.
+    channel_plan_describe(channel_plan_map(ctx->channelPlan), text, sizeof(text));
+    printf("Channel subset %u/%u: %s\n", ctx->channelPlan->current + 1, ctx->channelPlan->count, text);
+    gecko_cmd_le_gap_set_data_channel_classification(CHANNEL_MAP_LEN, channel_plan_map(ctx->channelPlan));
+    settleMs = ((uint32_t)ctx->interval * 125 * CHANNEL_SETTLE_INTERVALS) / 100;
+    if (settleMs < CHANNEL_SETTLE_MIN_MS) {
+        settleMs = CHANNEL_SETTLE_MIN_MS;
+    }
+    gecko_cmd_hardware_set_soft_timer((HW_TICKS_PER_SECOND * settleMs) / 1000, SOFT_TIMER_CHANNEL_SETTLE_HANDLE, 1);
+}
+
+static bool channel_plan_active(AppContext_t *ctx, TestParameters_t *params)
+{
+    return (ctx->channelPlan != NULL) && (params->mode == 1);
+}
+
+static bool tx_power_plan_active(AppContext_t *ctx, TestParameters_t *params)
+{
+    return (ctx->txPowerPlan != NULL) && (params->mode == 1);
+}
+
+static bool run_plan_pending(AppContext_t *ctx, TestParameters_t *params)
+{
+    return (channel_plan_active(ctx, params) && channel_plan_pending(ctx->channelPlan))
+           || (tx_power_plan_active(ctx, params) && tx_power_plan_pending(ctx->txPowerPlan));
+}
+
+// Subscriptions and configuration are in place, the test can start once the link is ready too.
+static void gatt_setup_done(AppContext_t *ctx, TestParameters_t *params)
+{
+    printf("\nDISCOVERY DONE.\n");
+    ctx->subscribedMode = params->mode;
+    ctx->subscribedConfFlag = params->client_conf_flag;
+    ctx->gattReady = true;
+    try_begin_test(ctx, params);
+}
+
+static bool streams_active(AppContext_t *ctx, TestParameters_t *params)
+{
+    return (ctx->streamConfig != NULL) && (params->mode >= 1) && (params->mode <= 3);
+}
+
+// Subscribe to each stream in use, then write the configuration to the slave. Continued in
+// process_procedure_complete_event(ctx).
+static void stream_setup_next(AppContext_t *ctx, TestParameters_t *params)
+{
+    uint8_t total = stream_config_total(ctx->streamConfig);
+    uint8_t encoded[STREAM_CONFIG_LEN];
+
+    if ((ctx->streamConfigHandle == 0xFFFF) || (ctx->streamHandles[total - 1] == 0xFFFF)) {
+        printf("Slave firmware has no stream characteristics, data comes on the notifications characteristic.\n");
+        gatt_setup_done(ctx, params);
+        return;
+    }
+    if (ctx->streamSetupIndex < total) {
+        printf("Subscribing to stream %u.\n", ctx->streamSetupIndex + 1);
+        gecko_cmd_gatt_set_characteristic_notification(ctx->connection, ctx->streamHandles[ctx->streamSetupIndex], gatt_notification);
+        set_action(ctx, act_enable_stream);
+    } else {
+        gecko_cmd_gatt_write_characteristic_value(ctx->connection, ctx->streamConfigHandle, stream_config_encode(ctx->streamConfig, encoded), encoded);
+        set_action(ctx, act_write_stream_config);
+    }
+    ctx->streamSetupIndex++;
+}
+
+// Throughput, share and queueing delay per stream. A probe whose delay grows with the bulk load
+// is waiting behind bulk data in the slave TX queue.
+static void print_streams(AppContext_t *ctx, double endTime)
+{
+    uint64_t totalBytes = 0;
+
+    for (uint8_t i = 0; i < STREAM_MAX; i++) {
+        totalBytes += ctx->streamRx.streams[i].bytes;
+    }
+    for (uint8_t i = 0; (i < stream_config_total(ctx->streamConfig)) && (endTime > 0); i++) {
+        StreamStats_t *stats = &ctx->streamRx.streams[i];
+
+        printf("Stream %u%s: %.0f bps (%.1f %%), %u packets, %u missing, queueing delay p50 %u, p99 %u, max %u us\n",
+               i + 1, (i == stream_probe_index(ctx->streamConfig)) ? " (probe)" : "",
+               (double)stats->bytes * 8.0 / endTime, totalBytes ? (100.0 * stats->bytes) / totalBytes : 0.0,
+               stats->packets, stats->missing, histogram_percentile(&stats->delay, 500),
+               histogram_percentile(&stats->delay, 990), stats->delay.max);
+    }
+}
+
+// Events handled during the run per kB received, and the ones that took the most time. Stray
+// RSSI reports, soft timers or parameter updates show up here when they cost throughput.
+static void print_event_census(AppContext_t *ctx)
+{
+    EventCensusTop_t top[EVENT_CENSUS_TOP];
+    uint8_t n = event_census_top(&ctx->eventCensus, top, EVENT_CENSUS_TOP);
+    double kB = (double)ctx->bitsSent / 8192.0;
+    uint32_t totalUs = event_census_us(&ctx->eventCensus, ctx->eventCensus.totalTicks);
+
+    printf("Events handled: %u in %.3f ms", ctx->eventCensus.total, (double)totalUs / 1e3);
+    if (kB > 0) {
+        printf(", %.2f per kB, %.2f us per kB", (double)ctx->eventCensus.total / kB, (double)totalUs / kB);
+    }
+    printf("\n");
+    for (uint8_t i = 0; i < n; i++) {
+        const char *name = event_census_name(top[i].cls, top[i].id);
+        uint32_t us = event_census_us(&ctx->eventCensus, top[i].ticks);
+
+        if (name != NULL) {
+            printf("  %-34s", name);
+        } else if (top[i].cls == EVENT_CENSUS_OTHER) {
+            printf("  %-34s", "other classes and IDs");
+        } else {
+            printf("  class 0x%02x id 0x%02x              ", top[i].cls, top[i].id);
+        }
+        printf("%8u events %10.3f ms %8.2f us each\n", top[i].count, (double)us / 1e3, (double)us / top[i].count);
+    }
+}
+
+// The run is over on both sides: move on to the next step of a plan, or ask what next.
+static void slave_result_done(AppContext_t *ctx, TestParameters_t *params)
+{
+    if (tx_power_plan_active(ctx, params)) {
+        tx_power_plan_complete(ctx->txPowerPlan, ctx->slaveResult);
+    }
+    if (run_plan_pending(ctx, params)) {
+        // Next channel subset or TX power level on the same connection.
+        ctx->state = State_PLAN_STEP;
+        start_run(ctx, params);
+    } else if ((params->mode == 1) || (params->mode == 2)) {   
+        // If in one-shot modes, ask if user wants to re-run test.
+        if (channel_plan_active(ctx, params)) {
+            end_channel_plan(ctx);
+        }
+        if (tx_power_plan_active(ctx, params)) {
+            end_tx_power_plan(ctx);
+        }
+        ctx->state = State_SCANNING;
+        finish_test(ctx);
+    }
+}
+
+// Ask the slave for the flight recorder of the run, subscribing first on a new connection. The
+// run is wrapped up in end_flight_dump(). Returns false if no dump is wanted or possible.
+static bool start_flight_dump(AppContext_t *ctx, TestParameters_t *params)
+{
+    if ((ctx->flightCsvPath == NULL) || (params->mode < 1) || (params->mode > 3)) {
+        return false;
+    }
+    if (ctx->flightRecorderHandle == 0xFFFF) {
+        printf("Slave firmware has no flight recorder characteristic.\n\n");
+        return false;
+    }
+    flight_dump_reset(&ctx->flightDump);
+    ctx->flightDumpPending = true;
+    arm_flight_dump_timeout();
+    if (ctx->flightSubscribed) {
+        request_flight_dump(ctx);
+    } else {
+        gecko_cmd_gatt_set_characteristic_notification(ctx->connection, ctx->flightRecorderHandle, gatt_notification);
+        set_action(ctx, act_enable_flight_recorder);
+    }
+    return true;
+}
+
+static void request_flight_dump(AppContext_t *ctx)
+{
+    uint8_t command = FLIGHT_DUMP_START;
+
+    gecko_cmd_gatt_write_characteristic_value(ctx->connection, ctx->flightRecorderHandle, sizeof(command), &command);
+    set_action(ctx, act_write_flight_recorder);
+}
+
+// Started with the dump and again with each chunk, so a long dump on a slow link isn't cut short.
+static void arm_flight_dump_timeout(void)
+{
+    gecko_cmd_hardware_set_soft_timer((HW_TICKS_PER_SECOND * FLIGHT_DUMP_TIMEOUT_MS) / 1000, SOFT_TIMER_FLIGHT_DUMP_HANDLE, 1);
+}
+
+// Summarize and save a complete dump, then carry on as without one. The dump is only over once
+// both the last chunk and the write response are in, or the next step would take the response.
+static void end_flight_dump(AppContext_t *ctx, TestParameters_t *params, bool complete)
+{
+    if (!ctx->flightDumpPending) {
+        return;
+    }
+    ctx->flightDumpPending = false;
+    gecko_cmd_hardware_set_soft_timer(0, SOFT_TIMER_FLIGHT_DUMP_HANDLE, 0);
+    if (!complete && ctx->flightDump.failed) {
+        printf("Flight recorder dump ended after %u of %u events.\n\n", ctx->flightDump.received, ctx->flightDump.total);
+    }
+    if (complete) {
+        flight_dump_print(&ctx->flightDump);
+        if (flight_dump_write_csv(&ctx->flightDump, ctx->runs, ctx->flightCsvPath) < 0) {
+            printf("Could not write flight recorder events to %s\n\n", ctx->flightCsvPath);
+        }
+    }
+    slave_result_done(ctx, params);
+}
+
+// Feed the slave RTCC stamp of a received packet to the clock fit. Stream headers always carry one,
+// notifications and indications once the slave has agreed to stamp them.
+static void record_clock_stamp(AppContext_t *ctx, uint16_t characteristic, const uint8_t *data, uint16_t len)
+{
+    uint32_t ticks;
+
+    if (!ctx->clockSyncWanted || !ctx->measuring) {
+        return;
+    }
+    for (uint8_t i = 0; (ctx->streamConfig != NULL) && (i < STREAM_MAX); i++) {
+        if (characteristic == ctx->streamHandles[i]) {
+            if ((len >= STREAM_HEADER_LEN) && clock_stamp_read(&data[4], CLOCK_STAMP_LEN, &ticks)) {
+                clock_sync_add(&ctx->clockSync, ticks, event_time_us(ctx), len);
+            }
+            return;
+        }
+    }
+    if (ctx->clockStampsOn && ((characteristic == ctx->notificationsHandle) || (characteristic == ctx->indicationsHandle))
+        && clock_stamp_read(data, len, &ticks)) {
+        clock_sync_add(&ctx->clockSync, ticks, event_time_us(ctx), len);
+    }
+}
+
+// Slave clock against the host clock over the run, and the slave result on the host timebase. The
+// two results also differ because each side starts and stops its clock at a different moment, the
+// throughput over the stamped packets on both clocks shows how much of the gap is drift.
+static void print_clock_sync(AppContext_t *ctx)
+{
+    ClockFit_t fit;
+    double drift, driftError, slaveOnHost;
+
+    if (!clock_sync_fit(&ctx->clockSync, &fit)) {
+        printf("Clock sync: %u stamped packets, too few for a fit.\n\n", ctx->clockSync.count);
+        return;
+    }
+    // rate is host seconds per slave second, a fast slave clock counts more seconds than the host.
+    drift = (1.0 / fit.rate) - 1.0;
+    driftError = fit.rateError / (fit.rate * fit.rate);
+    slaveOnHost = (double)ctx->slaveResult / fit.rate;
+    ctx->lastResult.clockDriftPpm = drift * 1e6;
+    ctx->lastResult.clockDriftErrorPpm = driftError * 1e6;
+    ctx->lastResult.slaveThroughputHostClock = (uint32_t)(slaveOnHost + 0.5);
+
+    printf("Clock sync: %u stamps over %.3f s, slave clock %+.1f +/- %.1f ppm against the host, jitter %.0f us\n",
+           fit.stamps, fit.receiverSeconds, drift * 1e6, driftError * 1e6, fit.jitterUs);
+    printf("Clock offset: %.6f s host minus slave, one-way delay included\n", fit.offsetUs / 1e6);
+    if ((fit.slaveSeconds > 0) && (fit.receiverSeconds > 0)) {
+        printf("Stamped packets: %.0f bps on the host clock, %.0f bps on the slave clock\n",
+               (double)fit.bits / fit.receiverSeconds, (double)fit.bits / fit.slaveSeconds);
+    }
+    printf("Slave result on the host timebase: %.0f +/- %.0f bps, host result %lu bps\n\n",
+           slaveOnHost, slaveOnHost * (fit.rateError / fit.rate), (unsigned long)ctx->lastResult.throughput);
+}
+
+// Write the next part of the payload schedule, continued in process_procedure_complete_event(ctx).
+// Returns false once the whole schedule is written.
+static bool push_payload_schedule(AppContext_t *ctx)
+{
+    uint8_t data[ATT_MAX_VALUE_LEN];
+    uint16_t maxLen = (ctx->mtuSize > 3) ? (ctx->mtuSize - 3) : (ATT_DEFAULT_MTU - 3);
+    uint16_t len;
+
+    if (ctx->payloadSchedulePushed) {
+        return false;
+    }
+    len = payload_schedule_encode(ctx->payloadSchedule, &ctx->payloadScheduleNext, (maxLen < sizeof(data)) ? maxLen : sizeof(data), data);
+    if (len == 0) {
+        ctx->payloadSchedulePushed = true;
+        return false;
+    }
+    gecko_cmd_gatt_write_characteristic_value(ctx->connection, ctx->payloadScheduleHandle, len, data);
+    set_action(ctx, act_write_payload_schedule);
+    return true;
+}
+
+// Ask the slave for clock stamps through its test plan and read the plan back, a slave that doesn't
+// know the flag leaves it out. The rest of the plan is written back as the slave had it. Continued
+// in process_procedure_complete_event(ctx). Returns false if there is nothing to ask.
+static bool push_clock_stamps(AppContext_t *ctx)
+{
+    TestPlan_t plan;
+    uint8_t encoded[TEST_PLAN_ENCODED_LEN];
+
+    if (ctx->testPlanHandle == 0xFFFF) {
+        ctx->clockStampsPushed = true;
+        printf("Slave firmware has no test plan characteristic, it doesn't stamp its data.\n");
+        return false;
+    }
+    if (read_slave_plan(ctx)) {
+        return true;
+    }
+    ctx->clockStampsPushed = true;
+    plan = ctx->slavePlan;
+    plan.txPower = TEST_PLAN_TX_POWER_KEEP;
+    plan.flags |= TEST_PLAN_FLAG_CLOCK_STAMPS;
+    gecko_cmd_gatt_write_characteristic_value(ctx->connection, ctx->testPlanHandle, test_plan_encode(&plan, encoded), encoded);
+    set_action(ctx, act_write_clock_stamps);
+    return true;
+}
+
+// Read the slave test plan once per connection, so plan writes change only the fields they are
+// about. Continued in process_procedure_complete_event(ctx). Returns false if it is known already.
+static bool read_slave_plan(AppContext_t *ctx)
+{
+    if (ctx->slavePlanKnown) {
+        return false;
+    }
+    ctx->slavePlan = (TestPlan_t){
+        .mode = PLAN_MODE_FREE,
+        .direction = PLAN_DIRECTION_AUTO,
+        .txPower = TEST_PLAN_TX_POWER_KEEP
+    };
+    gecko_cmd_gatt_read_characteristic_value(ctx->connection, ctx->testPlanHandle);
+    set_action(ctx, act_read_slave_plan);
+    return true;
+}
+
+// Set the NCP to the next TX power level, then the slave through its test plan. The test begins
+// once the slave has reported the power it set, see process_procedure_complete_event(ctx).
+static void start_tx_power_level(AppContext_t *ctx, TestParameters_t *params)
+{
+    int16_t level = tx_power_plan_level(ctx->txPowerPlan);
+    int16_t actual;
+    TestPlan_t plan;
+    uint8_t encoded[TEST_PLAN_ENCODED_LEN];
+
+    if ((ctx->testPlanHandle != 0xFFFF) && read_slave_plan(ctx)) {
+        return;
+    }
+    actual = gecko_cmd_system_set_tx_power(level)->set_power;
+    tx_power_plan_set_actual(ctx->txPowerPlan, actual, TX_POWER_UNKNOWN);
+    printf("TX power level %u/%u: requested %.1f dBm, NCP set %.1f dBm\n",
+           ctx->txPowerPlan->current + 1, ctx->txPowerPlan->count, (double)level / 10.0, (double)actual / 10.0);
+    if (ctx->testPlanHandle == 0xFFFF) {
+        printf("Slave firmware has no test plan characteristic, only the NCP TX power changes.\n");
+        begin_test(ctx, params);
+        return;
+    }
+    plan = ctx->slavePlan;
+    plan.txPower = level;
+    gecko_cmd_gatt_write_characteristic_value(ctx->connection, ctx->testPlanHandle, test_plan_encode(&plan, encoded), encoded);
+    set_action(ctx, act_write_test_plan);
+}
+
+// Print the TX power profile and go back to the default power on the NCP and to the plan the
+// slave had before the first level.
+static void end_tx_power_plan(AppContext_t *ctx)
+{
+    uint8_t encoded[TEST_PLAN_ENCODED_LEN];
+
+    tx_power_plan_print(ctx->txPowerPlan);
+    gecko_cmd_system_set_tx_power(TX_POWER);
+    if ((ctx->testPlanHandle != 0xFFFF) && ctx->slavePlanKnown) {
+        // Without response, so the ATT bearer is free for a rerun straight away.
+        gecko_cmd_gatt_write_characteristic_value_without_response(ctx->connection, ctx->testPlanHandle, test_plan_encode(&ctx->slavePlan, encoded), encoded);
+    }
+}
+
+// Print the per-channel profile and go back to all channels.
+static void end_channel_plan(AppContext_t *ctx)
+{
+    channel_plan_print(ctx->channelPlan);
+    if (ctx->channelCsvPath && (channel_plan_write_csv(ctx->channelPlan, ctx->channelCsvPath) < 0)) {
+        printf("Could not write channel profile to %s\n", ctx->channelCsvPath);
+    }
+    gecko_cmd_le_gap_set_data_channel_classification(CHANNEL_MAP_LEN, ALL_CHANNELS);
+}
+
+// First step of the subscription chain, continued in process_procedure_complete_event(ctx).
+static void start_subscriptions(AppContext_t *ctx, TestParameters_t *params)
+{
+    setup_timing_mark(&ctx->setupRun, SETUP_MARK_SUBSCRIBE_START, (uint32_t)event_time_us(ctx));
+    if (params->mode == 4) {
+        // Latency mode only needs the echoes.
+        printf("Subscribing to latency echoes.\n");
+        gecko_cmd_gatt_set_characteristic_notification(ctx->connection, ctx->latencyHandle, gatt_notification);
+        set_action(ctx, act_enable_latency);
+    } else if (params->mode == 3) {
+        // In free mode subscribe to notifications first, then indications
+        printf("Subscribing to notifications.\n");
+        gecko_cmd_gatt_set_characteristic_notification(ctx->connection, ctx->notificationsHandle, gatt_notification);
+        set_action(ctx, act_enable_notification);
+    } else {
+        if (params->client_conf_flag == gatt_indication) {
+            printf("Subscribing to indications.\n");
+            gecko_cmd_gatt_set_characteristic_notification(ctx->connection, ctx->indicationsHandle, gatt_indication);
+            set_action(ctx, act_enable_indication);
+        } else if (params->client_conf_flag == gatt_notification) {
+            printf("Subscribing to notifications.\n");
+            gecko_cmd_gatt_set_characteristic_notification(ctx->connection, ctx->notificationsHandle, gatt_notification);
+            set_action(ctx, act_enable_notification);
+        }
+    }
+}
+
+// Print the link parameters and start the transfer.
+static void begin_test(AppContext_t *ctx, TestParameters_t *params)
+{
+    printf("-----------------------------------------------------------------------------\n");
+    printf("\nParameters to be used:\n");
+    printf("-------------------------------\n");
+    printf("Interval: %u\n", (unsigned int)((float)ctx->interval * 1.25));
+    printf("Latency: %u\n", ctx->slaveLatency);
+    printf("Timeout: %u\n", ctx->supervisionTimeout);
+    printf("PDU size: %u\n", ctx->pduSize);
+    printf("-----------------------------------------------------------------------------\n\n");
+    printf("\nSTARTING TEST\n\n");
+    ctx->state = State_TRANSMISSION;
+    stream_rx_reset(&ctx->streamRx);
+    // In free mode, button press on slave triggers the transmission,
+    // but in fixed modes, transmission is initiated here with the following call.
+    if ((params->mode == 1) || (params->mode == 2)) {
+        start_data_transmission(ctx, params);
+    } else if (params->mode == 4) {
+        start_latency_test(ctx, params);
+    }
+}
+
+// Cycle through advertisement contents and look for matching device name.
+static bool process_scan_response(struct gecko_msg_le_gap_scan_response_evt_t *pResp)
+{
+    int i = 0;
+    bool adMatchFound = false;
+    uint8_t adLen;
+    uint8_t adType;
+
+    while (i < (pResp->data.len - 1)) {
+        adLen = pResp->data.data[i];
+        adType = pResp->data.data[i + 1];
+
+        /* Type 0x09 = Complete Local Name, 0x08 Shortened Name */
+        if (adType == 0x09) {
+            /* Check if device name is Throughput Tester */
+            if (memcmp(pResp->data.data + i + 2, DEVICE_NAME, 17) == 0) {
+                adMatchFound = true;
+                break;
+            }
+        }
+        /* Jump to next AD record */
+        i = i + adLen + 1;
+    }
+
+    return (adMatchFound);
+}
+
+// Check if found characteristic matches the UUIDs that we are searching for.
+static void check_characteristic_uuid(AppContext_t *ctx, struct gecko_cmd_packet *evt) 
+{
+    if (evt->data.evt_gatt_characteristic.uuid.len == 16) {
+        if (memcmp(NOTIFICATIONS_CHARACTERISTIC_UUID, evt->data.evt_gatt_characteristic.uuid.data, 16) == 0) {
+            ctx->notificationsHandle = evt->data.evt_gatt_characteristic.characteristic;
+            printf("Found notifications characteristic.\n");
+            ctx->numCharacteristicsDiscovered++;
+        } else if (memcmp(INDICATIONS_CHARACTERISTIC_UUID, evt->data.evt_gatt_characteristic.uuid.data, 16) == 0) {
+            ctx->indicationsHandle = evt->data.evt_gatt_characteristic.characteristic;
+            printf("Found indications characteristic.\n");
+            ctx->numCharacteristicsDiscovered++;
+        } else if (memcmp(TRANSMISSION_CHARACTERISTIC_UUID, evt->data.evt_gatt_characteristic.uuid.data, 16) == 0) {
+            printf("Found transmission characteristic.\n");
+            ctx->transmissionHandle = evt->data.evt_gatt_characteristic.characteristic;
+            ctx->numCharacteristicsDiscovered++;
+        } else if (memcmp(RESULT_CHARACTERISTIC_UUID, evt->data.evt_gatt_characteristic.uuid.data, 16) == 0) {
+            printf("Found throughput result characteristic.\n");
+            ctx->resultHandle = evt->data.evt_gatt_characteristic.characteristic;
+            ctx->numCharacteristicsDiscovered++;
+        } else if (memcmp(LATENCY_CHARACTERISTIC_UUID, evt->data.evt_gatt_characteristic.uuid.data, 16) == 0) {
+            printf("Found latency characteristic.\n");
+            ctx->latencyHandle = evt->data.evt_gatt_characteristic.characteristic;
+        } else if (memcmp(TEST_PLAN_CHARACTERISTIC_UUID, evt->data.evt_gatt_characteristic.uuid.data, 16) == 0) {
+            printf("Found test plan characteristic.\n");
+            ctx->testPlanHandle = evt->data.evt_gatt_characteristic.characteristic;
+        } else if (memcmp(PAYLOAD_SCHEDULE_CHARACTERISTIC_UUID, evt->data.evt_gatt_characteristic.uuid.data, 16) == 0) {
+            printf("Found payload schedule characteristic.\n");
+            ctx->payloadScheduleHandle = evt->data.evt_gatt_characteristic.characteristic;
+        } else if (memcmp(STREAM_CONFIG_CHARACTERISTIC_UUID, evt->data.evt_gatt_characteristic.uuid.data, 16) == 0) {
+            printf("Found stream configuration characteristic.\n");
+            ctx->streamConfigHandle = evt->data.evt_gatt_characteristic.characteristic;
+        } else if (memcmp(FLIGHT_RECORDER_CHARACTERISTIC_UUID, evt->data.evt_gatt_characteristic.uuid.data, 16) == 0) {
+            printf("Found flight recorder characteristic.\n");
+            ctx->flightRecorderHandle = evt->data.evt_gatt_characteristic.characteristic;
+        } else {
+            for (uint8_t i = 0; i < STREAM_MAX; i++) {
+                if (memcmp(STREAM_CHARACTERISTIC_UUIDS[i], evt->data.evt_gatt_characteristic.uuid.data, 16) == 0) {
+                    printf("Found stream %u characteristic.\n", i + 1);
+                    ctx->streamHandles[i] = evt->data.evt_gatt_characteristic.characteristic;
+                }
+            }
+        }
+    }
 }
\ No newline at end of file
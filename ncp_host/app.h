@@ -10,6 +10,25 @@
 extern "C" {
 #endif
 
+#include "bg_types.h"
+#include "channel_plan.h"
+#include "tx_power_plan.h"
+#include "payload_trace.h"
+#include "flight_dump.h"
+#include "../soc/app_streams.h"
+#include "../soc/app_test_plan.h"
+#include "../soc/app_histogram.h"
+#include "../soc/app_setup_timing.h"
+#include "../soc/app_cmd_queue.h"
+#include "../soc/app_broadcast.h"
+#include "../soc/app_clock_sync.h"
+#include "../soc/app_gap_detector.h"
+#include "../soc/app_event_census.h"
+
+#define LATENCY_PING_SIZE       4           // Sequence number only
+#define LATENCY_SETS_MAX        8           // PHY and interval combinations kept per session
+#define APP_RSSI_UNKNOWN        127
+
 /***************************************************************************************************
  * Type Definitions
  **************************************************************************************************/
@@ -22,8 +41,40 @@ typedef struct {
     uint8_t mode;
     uint32_t fixed_time;
     uint32_t fixed_amount;
+    uint32_t ping_count;
 } TestParameters_t;
 
+// Summary of the last finished test, for callers driving tests without the console.
+typedef struct {
+    uint8_t mode;
+    uint8_t phy;
+    uint16_t interval;          // 1.25 ms units
+    uint16_t mtu;
+    double seconds;
+    uint64_t bits;
+    uint32_t throughput;        // Host calculated, bps. Broadcasts: sum over the PHYs heard.
+    uint32_t slaveThroughput;   // Reported by the slave, 0 if none arrived
+    uint32_t operations;        // Packets received, or broadcasts counted
+    double utilization;         // Connection event utilization in percent
+    uint32_t roundTrips;
+    uint32_t lost;              // Lost pings or broadcasts
+    uint32_t p50Us;
+    uint32_t p99Us;
+    uint32_t maxUs;
+    // Slave RTCC against the host clock, from the clock stamps. All 0 without --clock-sync.
+    double clockDriftPpm;       // Positive when the slave clock runs fast
+    double clockDriftErrorPpm;  // Standard error of clockDriftPpm
+    uint32_t slaveThroughputHostClock; // slaveThroughput with the slave run time on the host clock
+    // Pauses between received packets longer than the gap multiple of the connection interval.
+    uint32_t gaps;
+    double gapStalledSeconds;   // Sum of the gaps
+    uint32_t gapLongestUs;
+    double gapLongestAt;        // Seconds into the run the longest gap started
+    bool stalled;               // The longest gap reached the flag limit
+    uint32_t events;            // BGAPI events handled during the run
+    uint32_t eventHandlingUs;   // Time app_handle_events() spent on them
+} TestResult_t;
+
 // Discovering services/characteristics and subscribing raises procedure_complete events
 // Actions are used to indicate which procedure was completed.
 typedef enum {
@@ -32,7 +83,18 @@ typedef enum {
     act_discover_characteristics,
     act_enable_notification,
     act_enable_indication,
-    act_subscribe_result
+    act_enable_latency,
+    act_subscribe_result,
+    act_write_test_plan,
+    act_read_test_plan,
+    act_read_slave_plan,
+    act_write_payload_schedule,
+    act_enable_stream,
+    act_write_stream_config,
+    act_write_clock_stamps,
+    act_read_clock_stamps,
+    act_enable_flight_recorder,
+    act_write_flight_recorder
 } Action_t;
 
 // App main states
@@ -40,12 +102,204 @@ typedef enum {
     State_SCANNING = 0, 
     State_SET_PARAMETERS,
     State_DISCOVER,
-    State_TRANSMISSION
+    State_TRANSMISSION,
+    State_BROADCAST_SCAN,   // Connectionless mode, counting broadcasts without connecting
+    State_PLAN_STEP         // Connected between two steps of a channel or TX power plan, e.g. while a channel map settles
 } State_t;
+
+// One received data packet.
+typedef struct {
+    uint16_t characteristic;
+    uint16_t len;
+    uint64_t timeUs;            // Arrival time, monotonic
+} AppPacket_t;
+
+// Throughput over one window of a run.
+typedef struct {
+    double start;               // Seconds since the run started
+    double seconds;             // Window length, the last window of a run can be shorter
+    uint64_t bits;
+    uint32_t packets;
+    uint32_t throughput;        // bps
+} AppWindow_t;
+
+// Callbacks of a library client, any of them can be NULL. They are called from app_handle_events().
+typedef struct {
+    void (*packet)(void *user, const AppPacket_t *packet);
+    void (*window)(void *user, const AppWindow_t *window);
+    void (*result)(void *user, const TestResult_t *result);
+    uint32_t windowMs;          // Window length, 0 for no window reports
+    void *user;
+} AppCallbacks_t;
+
+// Where a tester is right now, for monitors polling it while a test runs. See app_progress().
+typedef struct {
+    State_t state;
+    bool connected;
+    bool measuring;             // Data run in progress, the counters below are growing
+    uint8_t connection;
+    uint8_t phy;
+    uint16_t interval;          // 1.25 ms units
+    uint16_t slaveLatency;
+    uint16_t supervisionTimeout; // 10 ms units
+    uint16_t mtu;
+    uint16_t pdu;
+    int8_t rssi;                // Last reported, APP_RSSI_UNKNOWN before the first report
+    double seconds;             // Into the run in progress, or length of the last run
+    uint64_t bits;
+    uint32_t operations;
+    uint32_t runs;              // Data runs ended since app_init()
+    uint32_t roundTrips;
+    uint32_t pingsLost;
+    uint32_t setupTimeouts;
+    uint32_t disconnects;       // Connections closed, planned reconnections included
+    uint32_t cmdDeferred;       // transmission_on/off writes the NCP was too busy for
+    uint32_t cmdRetries;
+    uint32_t cmdDropped;
+    uint16_t cmdLastError;
+    SetupStats_t setup;         // Connection setup phases over the session, microseconds
+} AppProgress_t;
+
+// Round trip latency of one PHY and interval combination.
+typedef struct {
+    uint8_t phy;
+    uint16_t interval;
+    Histogram_t hist;
+} LatencySet_t;
+
+// State of one tester, owned by the caller and set up with app_init(). The fields are private to app.c.
+typedef struct {
+    AppCallbacks_t callbacks;
+
+    // Transmission time is measured between event arrival times when the caller provides them,
+    // so time spent waiting in the RX queue or in console output doesn't count.
+    uint64_t startingTimeUs;
+    uint64_t eventTimeUs;
+    bool eventTimeGiven;
+
+    bool appBooted;
+    uint8_t askForInput;
+
+    Action_t action;
+    State_t state;
+    int8_t rssi;
+    uint32_t runs;
+    uint32_t setupTimeouts;
+    uint32_t disconnects;
+
+    uint8_t connection;
+    uint32_t serviceHandle;
+    uint16_t notificationsHandle;
+    uint16_t indicationsHandle;
+    uint16_t transmissionHandle;
+    uint16_t resultHandle;
+    uint16_t latencyHandle;
+    uint16_t testPlanHandle;
+    uint16_t payloadScheduleHandle;
+    uint16_t streamHandles[STREAM_MAX];
+    uint16_t streamConfigHandle;
+    uint16_t flightRecorderHandle;
+    uint8_t numCharacteristicsDiscovered;
+    uint8_t initPhy;
+    uint8_t phyInUse;
+
+    // Peer and GATT handles cached from the last discovery. The server GATT DB is static and has
+    // gatt_caching enabled, so the handles stay valid across reconnections to the same peer.
+    bd_addr peerAddress;
+    uint8_t peerAddressType;
+    bool peerCached;
+    bool handlesCached;
+    bool reconnectPending;
+
+    // Link layer and GATT setup run side by side after connecting, the test starts once both are done.
+    bool linkReady;                     // Requested PHY and interval in place, or setup timed out
+    bool gattStarted;                   // Discovery or subscriptions issued
+    bool gattReady;                     // Subscriptions for this mode done
+    bool phyRequestPending;             // PHY update was rejected, retried on the next link event
+    CmdQueue_t cmdQueue;                // Commands the NCP was too busy to take, retried from the event loop
+    BroadcastRx_t broadcastRx;          // Connectionless mode counters per PHY
+    ChannelPlan_t *channelPlan;         // Channel subsets to run in fixed time mode, NULL to use all channels
+    const char *channelCsvPath;         // Per-channel profile is appended here when the plan is done
+    TxPowerPlan_t *txPowerPlan;         // TX power levels to run in fixed time mode, NULL to keep TX_POWER
+    TestPlan_t slavePlan;               // Slave test plan as read before the first plan write, writes change only the TX power or the flags
+    bool slavePlanKnown;                // slavePlan has been read on this connection
+    bool rssiRequested;                 // RSSI asked for at the end of a TX power level, other reports don't go into the plan
+    PayloadSchedule_t *payloadSchedule; // Notification size mix or trace for the slave, NULL for one size
+    uint16_t payloadScheduleNext;       // Progress of the schedule writes
+    bool payloadSchedulePushed;         // The slave has the schedule, it keeps it until the connection closes
+    StreamConfig_t *streamConfig;       // Streams for the slave to send on, NULL for the notifications characteristic only
+    uint8_t streamSetupIndex;           // Stream subscriptions made, then the configuration write
+    StreamRx_t streamRx;                // Per-stream counters and queueing delay of the run
+    bool clockSyncWanted;               // Fit the slave RTCC against the host clock in data runs
+    bool clockStampsPushed;             // Clock stamps asked for on this connection
+    bool clockStampsOn;                 // The slave stamps notifications and indications, stream headers always carry a stamp
+    ClockSync_t clockSync;              // Stamps of the run
+    const char *flightCsvPath;          // Slave flight recorder dumped here after each data run, NULL for no dumps
+    bool flightSubscribed;              // Flight recorder notifications on for this connection
+    bool flightDumpPending;             // Dump asked for, the run is wrapped up once it is in
+    FlightDump_t flightDump;
+    uint8_t gapMultiple;                // Connection intervals without data before a pause counts as a gap
+    uint32_t gapFlagMs;                 // Runs with a gap this long are flagged as stalled
+    GapDetector_t gaps;                 // Gaps of the run
+    EventCensus_t eventCensus;          // Events handled in the run and the time they took, nanoseconds
+    // Subscriptions made on the open connection, 0xFF when none.
+    uint8_t subscribedMode;
+    uint8_t subscribedConfFlag;
+
+    uint16_t interval;
+    uint16_t mtuSize;
+    uint16_t pduSize;
+    uint16_t supervisionTimeout;
+    uint16_t slaveLatency;
+
+    bool isFirstPacket;
+    bool measuring;                     // Between start_data_transmission() and end_data_transmission()
+    uint64_t bitsSent;
+    uint64_t throughput;
+    uint32_t operationCount;
+    uint64_t airtimeUs;                 // Connection event time the received data took, see payload_airtime_us()
+    uint32_t slaveResult;
+    TestResult_t lastResult;            // Filled in as a test ends, see app_last_result()
+
+    // Throughput window in progress, see AppCallbacks_t.windowMs.
+    uint64_t windowStartUs;
+    uint64_t windowBits;
+    uint32_t windowPackets;
+
+    // Round trip latency, one ping in flight at a time.
+    Histogram_t latencyRun;
+    LatencySet_t latencySets[LATENCY_SETS_MAX];
+    uint8_t latencySetCount;
+    uint32_t pingSeq;
+    uint64_t pingSentUs;
+    uint32_t pingsLost;
+    uint8_t pingData[LATENCY_PING_SIZE];
+
+    // Connection setup breakdown in microseconds, per run and over the session.
+    SetupRun_t setupRun;
+    SetupStats_t setupStats;
+} AppContext_t;
 /***************************************************************************************************
  * Function Declarations
  **************************************************************************************************/
-int app_handle_events(struct gecko_cmd_packet *evt, TestParameters_t *params);
+// BGLIB itself is one instance per process, defined and initialized by the client.
+void app_init(AppContext_t *ctx, const AppCallbacks_t *callbacks);
+void app_set_callbacks(AppContext_t *ctx, const AppCallbacks_t *callbacks);
+int app_handle_events(AppContext_t *ctx, struct gecko_cmd_packet *evt, TestParameters_t *params);
+void app_start(AppContext_t *ctx, TestParameters_t *params);
+bool app_stop(AppContext_t *ctx, TestParameters_t *params);
+void app_rerun(AppContext_t *ctx, TestParameters_t *params);
+void app_set_event_time(AppContext_t *ctx, uint64_t timeUs);
+void app_set_channel_plan(AppContext_t *ctx, ChannelPlan_t *plan, const char *csvPath);
+void app_set_tx_power_plan(AppContext_t *ctx, TxPowerPlan_t *plan);
+void app_set_payload_schedule(AppContext_t *ctx, PayloadSchedule_t *schedule);
+void app_set_stream_config(AppContext_t *ctx, StreamConfig_t *config);
+void app_set_clock_sync(AppContext_t *ctx, bool enable);
+void app_set_flight_recorder(AppContext_t *ctx, const char *csvPath);
+void app_set_gap_detector(AppContext_t *ctx, uint8_t multiple, uint32_t flagMs);
+const TestResult_t *app_last_result(AppContext_t *ctx);
+void app_progress(AppContext_t *ctx, AppProgress_t *progress);
+void app_request_rssi(AppContext_t *ctx);
 
 
 #ifdef __cplusplus
@@ -0,0 +1,408 @@
+/***********************************************************************************************/ /**
+ * \file   bench.c
+ * \brief  Microbenchmarks for the NCP host receive path and the SoC payload helpers.
+ *
+ * The host event handler and its static helpers are compiled into this translation unit
+ * directly so they can be driven with synthetic BGAPI events without a serial port or NCP.
+ * Commands issued by the handler are answered by a loopback that returns success immediately.
+ **************************************************************************************************/
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "app.c"
+
+#include "../soc/app_payload.h"
+
+#if defined(__linux__)
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#endif
+
+/***************************************************************************************************
+ * Local Macros and Definitions
+ **************************************************************************************************/
+BGLIB_DEFINE();
+
+#define BENCH_DEFAULT_ITERATIONS  1000000
+#define BENCH_MAX_RESULTS         16
+#define BENCH_NAME_LEN            48
+
+typedef struct {
+    char name[BENCH_NAME_LEN];
+    double nsPerOp;
+    double allocsPerOp;
+    double instructionsPerOp;   // Negative when hardware counters are not available.
+} BenchResult_t;
+
+static BenchResult_t results[BENCH_MAX_RESULTS];
+static uint32_t resultCount = 0;
+static uint32_t iterations = BENCH_DEFAULT_ITERATIONS;
+static FILE *report = NULL;
+static volatile uint32_t sink = 0;  // Keeps results of pure functions observable to the compiler.
+
+/***************************************************************************************************
+ * Allocation counting. The makefile wraps the allocator symbols on Linux builds.
+ **************************************************************************************************/
+static uint64_t allocationCount = 0;
+
+#if defined(BENCH_WRAP_MALLOC)
+void *__real_malloc(size_t size);
+void *__real_calloc(size_t count, size_t size);
+void *__real_realloc(void *ptr, size_t size);
+
+void *__wrap_malloc(size_t size) { allocationCount++; return __real_malloc(size); }
+void *__wrap_calloc(size_t count, size_t size) { allocationCount++; return __real_calloc(count, size); }
+void *__wrap_realloc(void *ptr, size_t size) { allocationCount++; return __real_realloc(ptr, size); }
+#endif
+
+/***************************************************************************************************
+ * Instruction counting through perf events where the platform provides them.
+ **************************************************************************************************/
+static int instructionCounter = -1;
+
+static void counter_open(void)
+{
+#if defined(__linux__)
+    struct perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.type = PERF_TYPE_HARDWARE;
+    attr.size = sizeof(attr);
+    attr.config = PERF_COUNT_HW_INSTRUCTIONS;
+    attr.disabled = 1;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    instructionCounter = (int)syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0);
+#endif
+}
+
+static void counter_start(void)
+{
+#if defined(__linux__)
+    if (instructionCounter >= 0) {
+        ioctl(instructionCounter, PERF_EVENT_IOC_RESET, 0);
+        ioctl(instructionCounter, PERF_EVENT_IOC_ENABLE, 0);
+    }
+#endif
+}
+
+static int64_t counter_stop(void)
+{
+#if defined(__linux__)
+    uint64_t count = 0;
+    if (instructionCounter >= 0) {
+        ioctl(instructionCounter, PERF_EVENT_IOC_DISABLE, 0);
+        if (read(instructionCounter, &count, sizeof(count)) == sizeof(count)) {
+            return (int64_t)count;
+        }
+    }
+#endif
+    return -1;
+}
+
+/***************************************************************************************************
+ * Synthetic events
+ **************************************************************************************************/
+static struct gecko_cmd_packet notificationEvt;
+static struct gecko_cmd_packet indicationEvt;
+static struct gecko_cmd_packet parametersEvt;
+static struct gecko_cmd_packet characteristicEvt;
+static struct gecko_msg_le_gap_scan_response_evt_t scanMatch;
+static struct gecko_msg_le_gap_scan_response_evt_t scanOther;
+
+static uint8_t payloadBuffer[255];
+static uint16_t benchMtu = 247;
+static uint16_t benchPdu = 251;
+
+static void build_events(void)
+{
+    const uint8_t otherName[] = "Some Other Device";
+    uint8_t *ad;
+
+    notificationEvt.header = gecko_evt_gatt_characteristic_value_id;
+    notificationEvt.data.evt_gatt_characteristic_value.connection = 1;
+    notificationEvt.data.evt_gatt_characteristic_value.characteristic = 0x20;
+    notificationEvt.data.evt_gatt_characteristic_value.att_opcode = gatt_handle_value_notification;
+    notificationEvt.data.evt_gatt_characteristic_value.value.len = 244;
+
+    indicationEvt = notificationEvt;
+    indicationEvt.data.evt_gatt_characteristic_value.characteristic = 0x23;
+    indicationEvt.data.evt_gatt_characteristic_value.att_opcode = gatt_handle_value_indication;
+
+    parametersEvt.header = gecko_evt_le_connection_parameters_id;
+    parametersEvt.data.evt_le_connection_parameters.connection = 1;
+    parametersEvt.data.evt_le_connection_parameters.interval = 40;
+    parametersEvt.data.evt_le_connection_parameters.timeout = 100;
+    parametersEvt.data.evt_le_connection_parameters.txsize = 251;
+
+    characteristicEvt.header = gecko_evt_gatt_characteristic_id;
+    characteristicEvt.data.evt_gatt_characteristic.connection = 1;
+    characteristicEvt.data.evt_gatt_characteristic.characteristic = 0x2a;
+    characteristicEvt.data.evt_gatt_characteristic.uuid.len = 16;
+    memcpy(characteristicEvt.data.evt_gatt_characteristic.uuid.data, RESULT_CHARACTERISTIC_UUID, 16);
+
+    // Flags, 128-bit service UUID and complete local name, as advertised by the SoC slave.
+    ad = scanMatch.data.data;
+    *ad++ = 2; *ad++ = 0x01; *ad++ = 0x06;
+    *ad++ = 17; *ad++ = 0x07; memcpy(ad, SERVICE_UUID, 16); ad += 16;
+    *ad++ = 18; *ad++ = 0x09; memcpy(ad, DEVICE_NAME, 17); ad += 17;
+    scanMatch.data.len = (uint8_t)(ad - scanMatch.data.data);
+
+    scanOther = scanMatch;
+    memcpy(&scanOther.data.data[scanOther.data.len - 17], otherName, 17);
+}
+
+/***************************************************************************************************
+ * Benchmark cases. Each runs one operation per call.
+ **************************************************************************************************/
+static AppContext_t benchApp;
+static TestParameters_t benchParams = {
+    .connection_interval = 40,
+    .phy = 1,
+    .mtu_size = 250,
+    .client_conf_flag = 1,
+    .mode = 3,
+    .fixed_time = 0,
+    .fixed_amount = 0
+};
+
+static void case_receive_notification(void)
+{
+    sink += app_handle_events(&benchApp, &notificationEvt, &benchParams);
+}
+
+static void case_receive_indication(void)
+{
+    sink += app_handle_events(&benchApp, &indicationEvt, &benchParams);
+}
+
+static void case_connection_parameters(void)
+{
+    sink += app_handle_events(&benchApp, &parametersEvt, &benchParams);
+}
+
+static void case_scan_response_match(void)
+{
+    sink += process_scan_response(&scanMatch);
+}
+
+static void case_scan_response_other(void)
+{
+    sink += process_scan_response(&scanOther);
+}
+
+static void case_check_characteristic_uuid(void)
+{
+    check_characteristic_uuid(&benchApp, &characteristicEvt);
+    benchApp.numCharacteristicsDiscovered = 0;
+}
+
+static void case_notification_size(void)
+{
+    sink += payload_notification_size(benchMtu, benchPdu, 0, 0);
+}
+
+static void case_generate_data(void)
+{
+    payload_generate(payloadBuffer, 244);
+    sink += payloadBuffer[0];
+}
+
+/***************************************************************************************************
+ * Runner
+ **************************************************************************************************/
+static void run_case(const char *name, void (*fn)(void))
+{
+    BenchResult_t *res = &results[resultCount++];
+    uint64_t allocsBefore;
+    uint64_t start;
+    uint64_t elapsed;
+    int64_t instructions;
+
+    // Warm up caches and branch predictors.
+    for (uint32_t i = 0; i < (iterations / 10); i++) {
+        fn();
+    }
+
+    allocsBefore = allocationCount;
+    counter_start();
+    start = monotonic_now_ns();
+    for (uint32_t i = 0; i < iterations; i++) {
+        fn();
+    }
+    elapsed = monotonic_now_ns() - start;
+    instructions = counter_stop();
+
+    snprintf(res->name, sizeof(res->name), "%s", name);
+    res->nsPerOp = (double)elapsed / (double)iterations;
+    res->allocsPerOp = (double)(allocationCount - allocsBefore) / (double)iterations;
+    res->instructionsPerOp = (instructions < 0) ? -1.0 : ((double)instructions / (double)iterations);
+}
+
+// Baseline file format: one "<name> <ns/op> <allocs/op> <instructions/op>" line per case.
+static int save_baseline(const char *path)
+{
+    FILE *f = fopen(path, "w");
+    if (f == NULL) {
+        fprintf(report, "Could not write baseline %s\n", path);
+        return -1;
+    }
+    for (uint32_t i = 0; i < resultCount; i++) {
+        fprintf(f, "%s %.3f %.4f %.1f\n", results[i].name, results[i].nsPerOp, results[i].allocsPerOp, results[i].instructionsPerOp);
+    }
+    fclose(f);
+    fprintf(report, "Baseline saved to %s\n", path);
+    return 0;
+}
+
+static void print_results(const char *baselinePath)
+{
+    FILE *f = NULL;
+    BenchResult_t base[BENCH_MAX_RESULTS];
+    uint32_t baseCount = 0;
+
+    if (baselinePath) {
+        f = fopen(baselinePath, "r");
+        if (f == NULL) {
+            fprintf(report, "Could not read baseline %s\n", baselinePath);
+        } else {
+            while ((baseCount < BENCH_MAX_RESULTS)
+                   && (fscanf(f, "%47s %lf %lf %lf", base[baseCount].name, &base[baseCount].nsPerOp,
+                              &base[baseCount].allocsPerOp, &base[baseCount].instructionsPerOp) == 4)) {
+                baseCount++;
+            }
+            fclose(f);
+        }
+    }
+
+    fprintf(report, "\n%-28s %12s %10s %12s %10s\n", "benchmark", "ns/op", "allocs/op", "instr/op", "vs base");
+    fprintf(report, "-----------------------------------------------------------------------------\n");
+    for (uint32_t i = 0; i < resultCount; i++) {
+        char instr[16] = "n/a";
+        char delta[16] = "";
+
+        if (results[i].instructionsPerOp >= 0) {
+            snprintf(instr, sizeof(instr), "%.1f", results[i].instructionsPerOp);
+        }
+        for (uint32_t j = 0; j < baseCount; j++) {
+            if ((strcmp(base[j].name, results[i].name) == 0) && (base[j].nsPerOp > 0)) {
+                snprintf(delta, sizeof(delta), "%+.1f%%", (results[i].nsPerOp - base[j].nsPerOp) * 100.0 / base[j].nsPerOp);
+            }
+        }
+        fprintf(report, "%-28s %12.2f %10.4f %12s %10s\n", results[i].name, results[i].nsPerOp, results[i].allocsPerOp, instr, delta);
+    }
+    fprintf(report, "\n");
+}
+
+/***************************************************************************************************
+ * Loopback NCP. Every command written by BGLIB is answered with a successful response carrying
+ * the same class and message ID, so command encoding and response parsing are part of the cost.
+ **************************************************************************************************/
+static uint8_t pendingResponse[6];
+static uint32_t pendingLength = 0;
+static uint32_t pendingPosition = 0;
+
+static void bench_output(uint32_t len, uint8_t *data)
+{
+    if (len < BGLIB_MSG_HEADER_LEN) {
+        return;
+    }
+    pendingResponse[0] = data[0] & 0xF8;  // Response type, payload length high bits cleared.
+    pendingResponse[1] = 2;               // uint16 result
+    pendingResponse[2] = data[2];
+    pendingResponse[3] = data[3];
+    pendingResponse[4] = 0;
+    pendingResponse[5] = 0;
+    pendingLength = sizeof(pendingResponse);
+    pendingPosition = 0;
+}
+
+static int32_t bench_input(uint32_t len, uint8_t *data)
+{
+    if ((pendingLength - pendingPosition) < len) {
+        return -1;
+    }
+    memcpy(data, &pendingResponse[pendingPosition], len);
+    pendingPosition += len;
+    return (int32_t)len;
+}
+
+static int32_t bench_peek(void) { return (int32_t)(pendingLength - pendingPosition); }
+
+static void bench_usage(void)
+{
+    printf("Usage: throughput_tester_bench [-n <iterations>] [-b <baseline file>] [-s <baseline file>]\n");
+    printf("-n <count>  - Iterations per benchmark. Default %u.\n", BENCH_DEFAULT_ITERATIONS);
+    printf("-b <file>   - Compare against a stored baseline.\n");
+    printf("-s <file>   - Store the results as a new baseline.\n");
+}
+
+int main(int argc, char *argv[])
+{
+    const char *baselinePath = NULL;
+    const char *savePath = NULL;
+
+    for (int i = 1; i < argc; i++) {
+        if ((strcmp(argv[i], "-n") == 0) && (i + 1 < argc)) {
+            iterations = (uint32_t)atoi(argv[++i]);
+        } else if ((strcmp(argv[i], "-b") == 0) && (i + 1 < argc)) {
+            baselinePath = argv[++i];
+        } else if ((strcmp(argv[i], "-s") == 0) && (i + 1 < argc)) {
+            savePath = argv[++i];
+        } else {
+            bench_usage();
+            return EXIT_FAILURE;
+        }
+    }
+    if (iterations == 0) {
+        iterations = BENCH_DEFAULT_ITERATIONS;
+    }
+
+    // The event handler prints progress, so keep the report on a duplicate of stdout
+    // and send the handler output to the null device.
+    report = fdopen(dup(fileno(stdout)), "w");
+#if ((_WIN32 == 1) || (__CYGWIN__ == 1))
+    freopen("NUL", "w", stdout);
+#else
+    freopen("/dev/null", "w", stdout);
+#endif
+
+    BGLIB_INITIALIZE_NONBLOCK(bench_output, bench_input, bench_peek);
+    counter_open();
+    build_events();
+
+    // Put the handler into the state it has while a free mode transfer is running.
+    app_init(&benchApp, NULL);
+    benchApp.appBooted = true;
+    cmd_queue_init(&benchApp.cmdQueue, cmd_clock, CMD_RETRY_GAP_US, CMD_MAX_ATTEMPTS);
+    benchApp.state = State_TRANSMISSION;
+    benchApp.connection = 1;
+    benchApp.notificationsHandle = 0x20;
+    benchApp.indicationsHandle = 0x23;
+    benchApp.transmissionHandle = 0x26;
+    benchApp.resultHandle = 0x29;
+    benchApp.isFirstPacket = false;
+    benchApp.measuring = true;
+
+    fprintf(report, "Running %u iterations per benchmark...\n", iterations);
+
+    run_case("receive_notification", case_receive_notification);
+    run_case("receive_indication", case_receive_indication);
+    run_case("connection_parameters", case_connection_parameters);
+    run_case("scan_response_match", case_scan_response_match);
+    run_case("scan_response_other", case_scan_response_other);
+    benchApp.state = State_DISCOVER;
+    run_case("check_characteristic_uuid", case_check_characteristic_uuid);
+    run_case("notification_size", case_notification_size);
+    run_case("generate_data", case_generate_data);
+
+    print_results(baselinePath);
+    if (savePath) {
+        save_baseline(savePath);
+    }
+    fclose(report);
+    return 0;
+}
@@ -0,0 +1,321 @@
+/***********************************************************************************************/ /**
+ * \file   capture.c
+ * \brief  Recording and replay of raw BGAPI serial traffic
+ *
+ * Capture file layout: an 8 byte magic followed by records of
+ *   <direction u8> <microseconds since previous record u32 LE> <length u16 LE> <bytes>
+ * A replay feeds the RX records back to BGLIB either as fast as possible or at the recorded pace.
+ **************************************************************************************************/
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <stdbool.h>
+#include <pthread.h>
+
+#include "infrastructure.h"
+#include "capture.h"
+#include "monotonic.h"
+
+/***************************************************************************************************
+ * Platform specific sleep.
+ **************************************************************************************************/
+#if ((_WIN32 == 1) || (__CYGWIN__ == 1))
+#include <windows.h>
+
+static void capture_sleep_us(uint64_t us) { Sleep((DWORD)(us / 1000)); }
+#else
+#include <unistd.h>
+
+static void capture_sleep_us(uint64_t us) { usleep((useconds_t)us); }
+#endif
+
+// --------------------------------
+// Local variables and constants
+static const uint8_t CAPTURE_MAGIC[8] = {'T', 'T', 'C', 'A', 'P', '0', '0', '1'};
+#define CAPTURE_RECORD_HEADER_LEN   7
+#define CAPTURE_WRITE_BUFFER_SIZE   (1024 * 1024)
+#define CAPTURE_MAX_REPORTED_DIFFS  5
+
+// Recording
+static FILE *recordFile = NULL;
+static uint64_t lastRecordUs = 0;
+static pthread_mutex_t recordLock = PTHREAD_MUTEX_INITIALIZER; // RX thread and application both record
+
+// Replay
+typedef struct {
+    size_t pos;         // Offset of the current record header
+    size_t offset;      // Bytes already consumed from the current record
+    uint64_t timeUs;    // Capture time of the current record
+} ReplayCursor_t;
+
+static uint8_t *replayData = NULL;
+static size_t replaySize = 0;
+static bool replayRealtime = false;
+static uint64_t replayStartUs = 0;
+static ReplayCursor_t rxCursor;
+static ReplayCursor_t txCursor;
+static uint64_t replayedBytes = 0;
+static uint32_t txMatched = 0;
+static uint32_t txMismatched = 0;
+static uint32_t txUnexpected = 0;
+
+/***************************************************************************************************
+ * Static Function Declarations
+ **************************************************************************************************/
+static uint32_t record_delta(size_t pos);
+static uint16_t record_length(size_t pos);
+static bool seek_record(ReplayCursor_t *cursor, CaptureDirection_t dir);
+
+/***************************************************************************************************
+ * Public Function Definitions
+ **************************************************************************************************/
+
+/***********************************************************************************************/ /**
+ *  \brief  Open a capture file for writing.
+ *  \param[in] path Capture file path.
+ *  \return  0 on success, -1 on failure.
+ **************************************************************************************************/
+int capture_record_open(const char *path)
+{
+    recordFile = fopen(path, "wb");
+    if (recordFile == NULL) {
+        return -1;
+    }
+    setvbuf(recordFile, NULL, _IOFBF, CAPTURE_WRITE_BUFFER_SIZE);
+    fwrite(CAPTURE_MAGIC, 1, sizeof(CAPTURE_MAGIC), recordFile);
+    lastRecordUs = monotonic_now_us();
+    return 0;
+}
+
+/***********************************************************************************************/ /**
+ *  \brief  Append a chunk of serial traffic to the capture.
+ *  \param[in] dir Direction of the chunk.
+ *  \param[in] len Chunk length.
+ *  \param[in] data Chunk data.
+ **************************************************************************************************/
+void capture_record(CaptureDirection_t dir, uint32_t len, const uint8_t *data)
+{
+    uint8_t header[CAPTURE_RECORD_HEADER_LEN];
+    uint8_t *p = header;
+    uint64_t now;
+    uint64_t delta;
+
+    pthread_mutex_lock(&recordLock);
+    if (recordFile == NULL) {
+        pthread_mutex_unlock(&recordLock);
+        return;
+    }
+
+    now = monotonic_now_us();
+    delta = MIN(now - lastRecordUs, 0xFFFFFFFFULL);
+    lastRecordUs = now;
+
+    // Serial reads and writes are far below 64 kB, but split just in case.
+    while (len > 0) {
+        uint16_t chunk = (uint16_t)MIN(len, 0xFFFFU);
+        p = header;
+        UINT8_TO_BITSTREAM(p, dir);
+        UINT32_TO_BITSTREAM(p, (uint32_t)delta);
+        UINT16_TO_BITSTREAM(p, chunk);
+        fwrite(header, 1, sizeof(header), recordFile);
+        fwrite(data, 1, chunk, recordFile);
+        data += chunk;
+        len -= chunk;
+        delta = 0;
+    }
+    pthread_mutex_unlock(&recordLock);
+}
+
+/***********************************************************************************************/ /**
+ *  \brief  Load a capture file for replay.
+ *  \param[in] path Capture file path.
+ *  \param[in] realtime Deliver data at the recorded pace instead of as fast as possible.
+ *  \return  0 on success, -1 on failure.
+ **************************************************************************************************/
+int capture_replay_open(const char *path, bool realtime)
+{
+    FILE *f = fopen(path, "rb");
+    long size;
+
+    if (f == NULL) {
+        return -1;
+    }
+    fseek(f, 0, SEEK_END);
+    size = ftell(f);
+    fseek(f, 0, SEEK_SET);
+
+    if (size < (long)sizeof(CAPTURE_MAGIC)) {
+        fclose(f);
+        return -1;
+    }
+
+    replayData = malloc((size_t)size);
+    if ((replayData == NULL) || (fread(replayData, 1, (size_t)size, f) != (size_t)size)
+        || (memcmp(replayData, CAPTURE_MAGIC, sizeof(CAPTURE_MAGIC)) != 0)) {
+        fclose(f);
+        free(replayData);
+        replayData = NULL;
+        return -1;
+    }
+    fclose(f);
+
+    replaySize = (size_t)size;
+    replayRealtime = realtime;
+    rxCursor.pos = sizeof(CAPTURE_MAGIC);
+    rxCursor.offset = 0;
+    rxCursor.timeUs = (replaySize > rxCursor.pos) ? record_delta(rxCursor.pos) : 0;
+    txCursor = rxCursor;
+    replayStartUs = monotonic_now_us();
+    return 0;
+}
+
+/***********************************************************************************************/ /**
+ *  \brief  BGLIB input function for replay. Blocks until the recorded time in realtime mode.
+ *  \param[in] len Number of bytes requested.
+ *  \param[out] data Destination buffer.
+ *  \return  Number of bytes read, -1 when the capture has ended.
+ **************************************************************************************************/
+int32_t capture_replay_rx(uint32_t len, uint8_t *data)
+{
+    uint32_t copied = 0;
+
+    while (copied < len) {
+        uint32_t available;
+
+        if (!seek_record(&rxCursor, Capture_RX)) {
+            return -1;
+        }
+
+        if (replayRealtime) {
+            uint64_t elapsed = monotonic_now_us() - replayStartUs;
+            if (elapsed < rxCursor.timeUs) {
+                capture_sleep_us(rxCursor.timeUs - elapsed);
+            }
+        }
+
+        available = record_length(rxCursor.pos) - (uint32_t)rxCursor.offset;
+        available = MIN(available, len - copied);
+        memcpy(data + copied, &replayData[rxCursor.pos + CAPTURE_RECORD_HEADER_LEN + rxCursor.offset], available);
+        rxCursor.offset += available;
+        copied += available;
+    }
+
+    replayedBytes += len;
+    return (int32_t)len;
+}
+
+/***********************************************************************************************/ /**
+ *  \brief  BGLIB peek function for replay.
+ *  \return  Number of bytes that can be read without waiting.
+ **************************************************************************************************/
+int32_t capture_replay_rx_peek(void)
+{
+    if (!seek_record(&rxCursor, Capture_RX)) {
+        return 0;
+    }
+    if (replayRealtime && ((monotonic_now_us() - replayStartUs) < rxCursor.timeUs)) {
+        return 0;
+    }
+    return (int32_t)(record_length(rxCursor.pos) - rxCursor.offset);
+}
+
+/***********************************************************************************************/ /**
+ *  \brief  Compare a message sent by the host against the next recorded TX chunk.
+ *  \param[in] len Message length.
+ *  \param[in] data Message data.
+ *  \return  len, so it can stand in for the UART write.
+ **************************************************************************************************/
+int32_t capture_replay_tx(uint32_t len, const uint8_t *data)
+{
+    if (!seek_record(&txCursor, Capture_TX)) {
+        txUnexpected++;
+        return (int32_t)len;
+    }
+
+    if ((record_length(txCursor.pos) == len)
+        && (memcmp(&replayData[txCursor.pos + CAPTURE_RECORD_HEADER_LEN], data, len) == 0)) {
+        txMatched++;
+    } else {
+        txMismatched++;
+        if (txMismatched <= CAPTURE_MAX_REPORTED_DIFFS) {
+            printf("Replay: command #%u differs from capture (sent %u B header 0x%02x%02x%02x%02x, recorded %u B)\n",
+                   txMatched + txMismatched, len, data[0], data[1], data[2], data[3], record_length(txCursor.pos));
+        }
+    }
+    txCursor.offset = record_length(txCursor.pos);
+    return (int32_t)len;
+}
+
+// True once every recorded RX byte has been handed to BGLIB.
+bool capture_replay_finished(void)
+{
+    return (replayData != NULL) && !seek_record(&rxCursor, Capture_RX);
+}
+
+void capture_replay_summary(void)
+{
+    double wallTime = (double)(monotonic_now_us() - replayStartUs) / 1e6;
+
+    printf("-------------------------------\n");
+    printf("REPLAY SUMMARY:\n\n");
+    printf("Bytes replayed: %llu\n", (unsigned long long)replayedBytes);
+    printf("Recorded duration: %.3f sec\n", (double)rxCursor.timeUs / 1e6);
+    printf("Replay duration: %.3f sec\n", wallTime);
+    printf("Commands matching capture: %u\n", txMatched);
+    printf("Commands differing from capture: %u\n", txMismatched);
+    printf("Commands beyond end of capture: %u\n", txUnexpected);
+    printf("-------------------------------\n\n");
+}
+
+// Flush the recording or release the replay buffer.
+void capture_close(void)
+{
+    if (recordFile) {
+        pthread_mutex_lock(&recordLock);
+        fclose(recordFile);
+        recordFile = NULL;
+        pthread_mutex_unlock(&recordLock);
+    }
+    free(replayData);
+    replayData = NULL;
+}
+
+/***************************************************************************************************
+ * Static Function Definitions
+ **************************************************************************************************/
+
+static uint32_t record_delta(size_t pos)
+{
+    const uint8_t *p = &replayData[pos + 1];
+    return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static uint16_t record_length(size_t pos)
+{
+    const uint8_t *p = &replayData[pos + 5];
+    return (uint16_t)(p[0] | (p[1] << 8));
+}
+
+// Move the cursor to the next record of the given direction that still has unread bytes.
+static bool seek_record(ReplayCursor_t *cursor, CaptureDirection_t dir)
+{
+    while ((cursor->pos + CAPTURE_RECORD_HEADER_LEN) <= replaySize) {
+        uint16_t len = record_length(cursor->pos);
+
+        if ((cursor->pos + CAPTURE_RECORD_HEADER_LEN + len) > replaySize) {
+            return false; // Truncated capture, e.g. recording was killed.
+        }
+        if ((replayData[cursor->pos] == dir) && (cursor->offset < len)) {
+            return true;
+        }
+
+        cursor->pos += CAPTURE_RECORD_HEADER_LEN + len;
+        cursor->offset = 0;
+        if ((cursor->pos + CAPTURE_RECORD_HEADER_LEN) <= replaySize) {
+            cursor->timeUs += record_delta(cursor->pos);
+        }
+    }
+    return false;
+}
@@ -0,0 +1,46 @@
+/***********************************************************************************************/ /**
+ * \file   capture.h
+ * \brief  Recording and replay of raw BGAPI serial traffic
+ **************************************************************************************************/
+
+#ifndef CAPTURE_H
+#define CAPTURE_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/***************************************************************************************************
+ * Type Definitions
+ **************************************************************************************************/
+// Direction of a captured chunk as seen from the host.
+typedef enum {
+    Capture_RX = 0,
+    Capture_TX = 1
+} CaptureDirection_t;
+
+/***************************************************************************************************
+ * Function Declarations
+ **************************************************************************************************/
+// Recording. Every chunk read from or written to the UART is appended with a timestamp.
+int capture_record_open(const char *path);
+void capture_record(CaptureDirection_t dir, uint32_t len, const uint8_t *data);
+
+// Replay. Recorded RX chunks are fed to BGLIB, TX chunks are compared against what the host sends.
+int capture_replay_open(const char *path, bool realtime);
+int32_t capture_replay_rx(uint32_t len, uint8_t *data);
+int32_t capture_replay_rx_peek(void);
+int32_t capture_replay_tx(uint32_t len, const uint8_t *data);
+bool capture_replay_finished(void);
+void capture_replay_summary(void);
+
+void capture_close(void);
+
+#ifdef __cplusplus
+};
+#endif
+
+#endif /* CAPTURE_H */
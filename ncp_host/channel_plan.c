@@ -0,0 +1,320 @@
+/***********************************************************************************************/ /**
+ * \file   channel_plan.c
+ * \brief  Data channel subsets run one after another and the per-channel profile built from them
+ *
+ * Each subset gets one fixed time run with the data channel classification restricted to it. A
+ * channel's throughput is the mean over the subsets it was part of. The link layer retransmits
+ * until a packet gets through, so a bad channel shows up as lost throughput rather than lost data.
+ * The deficit column gives that loss against the best subset.
+ **************************************************************************************************/
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <stdbool.h>
+
+#include "channel_plan.h"
+
+/***************************************************************************************************
+ * Static Function Declarations
+ **************************************************************************************************/
+static int parse_subset(const char *spec, uint8_t *map);
+static bool add_subset(ChannelPlan_t *plan, const uint8_t *map);
+static uint8_t channel_count(const uint8_t *map);
+static bool channel_used(const uint8_t *map, uint8_t channel);
+static uint16_t channel_mhz(uint8_t channel);
+static void channel_profile(const ChannelPlan_t *plan, uint8_t channel, uint32_t *throughput, uint16_t *deficit);
+
+/***************************************************************************************************
+ * Public Function Definitions
+ **************************************************************************************************/
+
+/***********************************************************************************************/ /**
+ *  \brief  Build a channel plan from the command line.
+ *  \param[out] plan Plan to fill.
+ *  \param[in] spec Subset list or "pairs".
+ *  \return  0 on success, -1 on a malformed list or a subset of fewer than two channels.
+ **************************************************************************************************/
+int channel_plan_parse(ChannelPlan_t *plan, const char *spec)
+{
+    uint8_t map[CHANNEL_MAP_LEN];
+    char buf[256];
+    char *token;
+
+    memset(plan, 0, sizeof(ChannelPlan_t));
+    plan->afh = ChannelAfh_Unknown;
+
+    if (strcmp(spec, "pairs") == 0) {
+        // Channel 36 has no partner of its own, it shares the last pair.
+        for (uint8_t ch = 0; ch < (DATA_CHANNELS - 1); ch += 2) {
+            memset(map, 0, sizeof(map));
+            map[ch / 8] |= (uint8_t)(1 << (ch % 8));
+            map[(ch + 1) / 8] |= (uint8_t)(1 << ((ch + 1) % 8));
+            if ((ch + 2) == (DATA_CHANNELS - 1)) {
+                map[(ch + 2) / 8] |= (uint8_t)(1 << ((ch + 2) % 8));
+            }
+            add_subset(plan, map);
+        }
+    } else {
+        if (strlen(spec) >= sizeof(buf)) {
+            return -1;
+        }
+        strcpy(buf, spec);
+        for (token = strtok(buf, ","); token != NULL; token = strtok(NULL, ",")) {
+            if ((parse_subset(token, map) < 0) || (channel_count(map) < CHANNEL_SUBSET_MIN) || !add_subset(plan, map)) {
+                return -1;
+            }
+        }
+    }
+
+    if (plan->count == 0) {
+        return -1;
+    }
+
+    // Baseline with all channels, where AFH, if built into the NCP, is free to drop channels.
+    memset(map, 0xFF, sizeof(map));
+    map[CHANNEL_MAP_LEN - 1] = 0x1F;
+    return add_subset(plan, map) ? 0 : -1;
+}
+
+// Forget the results and start again from the first subset.
+void channel_plan_restart(ChannelPlan_t *plan)
+{
+    for (uint8_t i = 0; i < plan->count; i++) {
+        plan->subsets[i].done = false;
+        plan->subsets[i].throughput = 0;
+        plan->subsets[i].operations = 0;
+    }
+    plan->current = 0;
+}
+
+// True while subsets are left to run.
+bool channel_plan_pending(const ChannelPlan_t *plan)
+{
+    return plan->current < plan->count;
+}
+
+// Channel classification of the subset to run next.
+const uint8_t *channel_plan_map(const ChannelPlan_t *plan)
+{
+    return plan->subsets[(plan->current < plan->count) ? plan->current : (plan->count - 1)].map;
+}
+
+/***********************************************************************************************/ /**
+ *  \brief  Store the result of the run on the current subset and move on to the next one.
+ *  \param[in] plan Channel plan.
+ *  \param[in] throughput Host measured throughput of the run, bps.
+ *  \param[in] operations Notifications or indications received.
+ **************************************************************************************************/
+void channel_plan_record(ChannelPlan_t *plan, uint32_t throughput, uint32_t operations)
+{
+    if (plan->current >= plan->count) {
+        return;
+    }
+    plan->subsets[plan->current].throughput = throughput;
+    plan->subsets[plan->current].operations = operations;
+    plan->subsets[plan->current].done = true;
+    plan->current++;
+}
+
+/***********************************************************************************************/ /**
+ *  \brief  Write a channel map as ranges, e.g. "0-9+20".
+ *  \param[in] map Channel classification.
+ *  \param[out] text Destination.
+ *  \param[in] len Size of text.
+ **************************************************************************************************/
+void channel_plan_describe(const uint8_t *map, char *text, uint16_t len)
+{
+    uint16_t pos = 0;
+    uint8_t ch = 0;
+
+    text[0] = '\0';
+    if (channel_count(map) == DATA_CHANNELS) {
+        snprintf(text, len, "all");
+        return;
+    }
+    while (ch < DATA_CHANNELS) {
+        uint8_t first = ch;
+
+        if (!channel_used(map, ch)) {
+            ch++;
+            continue;
+        }
+        while (((ch + 1) < DATA_CHANNELS) && channel_used(map, ch + 1)) {
+            ch++;
+        }
+        if (pos < len) {
+            if (first == ch) {
+                pos += snprintf(text + pos, len - pos, "%s%u", (pos > 0) ? "+" : "", first);
+            } else {
+                pos += snprintf(text + pos, len - pos, "%s%u-%u", (pos > 0) ? "+" : "", first, ch);
+            }
+        }
+        ch++;
+    }
+}
+
+// Print the result of each subset and the per-channel profile.
+void channel_plan_print(const ChannelPlan_t *plan)
+{
+    char text[64];
+
+    printf("-------------------------------\n");
+    printf("CHANNEL PROFILE (AFH %s):\n\n", (plan->afh == ChannelAfh_On) ? "on" : ((plan->afh == ChannelAfh_Off) ? "off" : "unknown"));
+    printf("Subset                 Channels  Throughput (bps)  Operations\n");
+    for (uint8_t i = 0; i < plan->count; i++) {
+        const ChannelSubset_t *subset = &plan->subsets[i];
+
+        channel_plan_describe(subset->map, text, sizeof(text));
+        if (subset->done) {
+            printf("%-22.22s %9u %17u %11u\n", text, channel_count(subset->map), subset->throughput, subset->operations);
+        } else {
+            printf("%-22.22s %9u %17s %11s\n", text, channel_count(subset->map), "-", "-");
+        }
+    }
+
+    printf("\nChannel  MHz   Throughput (bps)  Deficit\n");
+    for (uint8_t ch = 0; ch < DATA_CHANNELS; ch++) {
+        uint32_t throughput;
+        uint16_t deficit;
+
+        channel_profile(plan, ch, &throughput, &deficit);
+        if (throughput == 0) {
+            printf("%7u %5u %18s %8s\n", ch, channel_mhz(ch), "-", "-");
+        } else {
+            printf("%7u %5u %18u %6u.%u%%\n", ch, channel_mhz(ch), throughput, deficit / 10, deficit % 10);
+        }
+    }
+    printf("-------------------------------\n\n");
+}
+
+/***********************************************************************************************/ /**
+ *  \brief  Append the per-channel profile to a CSV file, so sessions with AFH on and off can be compared.
+ *  \param[in] plan Channel plan.
+ *  \param[in] path CSV file, a header is written when the file is new.
+ *  \return  0 on success, -1 on failure.
+ **************************************************************************************************/
+int channel_plan_write_csv(const ChannelPlan_t *plan, const char *path)
+{
+    FILE *f = fopen(path, "a");
+
+    if (f == NULL) {
+        return -1;
+    }
+    fseek(f, 0, SEEK_END);
+    if (ftell(f) == 0) {
+        fprintf(f, "afh,channel,mhz,throughput_bps,deficit_permille\n");
+    }
+    for (uint8_t ch = 0; ch < DATA_CHANNELS; ch++) {
+        uint32_t throughput;
+        uint16_t deficit;
+
+        channel_profile(plan, ch, &throughput, &deficit);
+        if (throughput > 0) {
+            fprintf(f, "%d,%u,%u,%u,%u\n", (int)plan->afh, ch, channel_mhz(ch), throughput, deficit);
+        }
+    }
+    fclose(f);
+    return 0;
+}
+
+/***************************************************************************************************
+ * Static Function Definitions
+ **************************************************************************************************/
+
+// Parse one subset, channel ranges joined by '+'.
+static int parse_subset(const char *spec, uint8_t *map)
+{
+    const char *p = spec;
+
+    memset(map, 0, CHANNEL_MAP_LEN);
+    while (*p != '\0') {
+        char *end;
+        long first = strtol(p, &end, 10);
+        long last = first;
+
+        if (end == p) {
+            return -1;
+        }
+        p = end;
+        if (*p == '-') {
+            p++;
+            last = strtol(p, &end, 10);
+            if (end == p) {
+                return -1;
+            }
+            p = end;
+        }
+        if ((first < 0) || (last >= DATA_CHANNELS) || (first > last)) {
+            return -1;
+        }
+        for (long ch = first; ch <= last; ch++) {
+            map[ch / 8] |= (uint8_t)(1 << (ch % 8));
+        }
+        if (*p == '+') {
+            p++;
+        } else if (*p != '\0') {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+static bool add_subset(ChannelPlan_t *plan, const uint8_t *map)
+{
+    if (plan->count >= CHANNEL_PLAN_MAX_SUBSETS) {
+        return false;
+    }
+    memcpy(plan->subsets[plan->count].map, map, CHANNEL_MAP_LEN);
+    plan->count++;
+    return true;
+}
+
+static uint8_t channel_count(const uint8_t *map)
+{
+    uint8_t count = 0;
+
+    for (uint8_t ch = 0; ch < DATA_CHANNELS; ch++) {
+        count += channel_used(map, ch) ? 1 : 0;
+    }
+    return count;
+}
+
+static bool channel_used(const uint8_t *map, uint8_t channel)
+{
+    return (map[channel / 8] & (1 << (channel % 8))) != 0;
+}
+
+// Data channels 0-10 sit between advertising channels 37 and 38, 11-36 above 38.
+static uint16_t channel_mhz(uint8_t channel)
+{
+    return (channel <= 10) ? (2404 + (2 * channel)) : (2428 + (2 * (channel - 11)));
+}
+
+// Mean throughput of the restricted subsets holding the channel and its deficit against the best subset.
+// The full map baseline is left out, it holds every channel.
+static void channel_profile(const ChannelPlan_t *plan, uint8_t channel, uint32_t *throughput, uint16_t *deficit)
+{
+    uint64_t sum = 0;
+    uint32_t best = 0;
+    uint8_t n = 0;
+
+    for (uint8_t i = 0; i < plan->count; i++) {
+        const ChannelSubset_t *subset = &plan->subsets[i];
+
+        if (!subset->done || (channel_count(subset->map) == DATA_CHANNELS)) {
+            continue;
+        }
+        if (subset->throughput > best) {
+            best = subset->throughput;
+        }
+        if (channel_used(subset->map, channel)) {
+            sum += subset->throughput;
+            n++;
+        }
+    }
+
+    *throughput = n ? (uint32_t)(sum / n) : 0;
+    *deficit = (best && *throughput) ? (uint16_t)(((uint64_t)(best - *throughput) * 1000) / best) : 0;
+}
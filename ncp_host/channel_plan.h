@@ -0,0 +1,62 @@
+/***********************************************************************************************/ /**
+ * \file   channel_plan.h
+ * \brief  Data channel subsets run one after another and the per-channel profile built from them
+ **************************************************************************************************/
+
+#ifndef CHANNEL_PLAN_H
+#define CHANNEL_PLAN_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/***************************************************************************************************
+ * Type Definitions
+ **************************************************************************************************/
+#define DATA_CHANNELS               37
+#define CHANNEL_MAP_LEN             5       // Channel classification, one bit per data channel, LSB first
+#define CHANNEL_PLAN_MAX_SUBSETS    40
+#define CHANNEL_SUBSET_MIN          2       // The link layer needs at least two used channels
+
+typedef enum {
+    ChannelAfh_Unknown = -1,
+    ChannelAfh_Off = 0,
+    ChannelAfh_On = 1
+} ChannelAfh_t;
+
+typedef struct {
+    uint8_t map[CHANNEL_MAP_LEN];
+    uint32_t throughput;    // Host measured, bps
+    uint32_t operations;    // Notifications or indications received
+    bool done;
+} ChannelSubset_t;
+
+typedef struct {
+    ChannelSubset_t subsets[CHANNEL_PLAN_MAX_SUBSETS];
+    uint8_t count;          // Last subset is always the full map
+    uint8_t current;        // Subset of the run in progress or next to run
+    ChannelAfh_t afh;       // AFH state of the NCP firmware, as given by the user, BGAPI can't read it
+} ChannelPlan_t;
+
+/***************************************************************************************************
+ * Function Declarations
+ **************************************************************************************************/
+// Subsets are separated by ',' and are ranges joined by '+', e.g. "0-9,10-19,20-36" or "0+20,1+21".
+// "pairs" runs neighbouring channel pairs. The full map is appended as the last, baseline, run.
+int channel_plan_parse(ChannelPlan_t *plan, const char *spec);
+void channel_plan_restart(ChannelPlan_t *plan);
+bool channel_plan_pending(const ChannelPlan_t *plan);
+const uint8_t *channel_plan_map(const ChannelPlan_t *plan);
+void channel_plan_record(ChannelPlan_t *plan, uint32_t throughput, uint32_t operations);
+void channel_plan_describe(const uint8_t *map, char *text, uint16_t len);
+void channel_plan_print(const ChannelPlan_t *plan);
+int channel_plan_write_csv(const ChannelPlan_t *plan, const char *path);
+
+#ifdef __cplusplus
+};
+#endif
+
+#endif /* CHANNEL_PLAN_H */
@@ -0,0 +1,230 @@
+/***********************************************************************************************/ /**
+ * \file   console.c
+ * \brief  Console output thread
+ *
+ * stdout is replaced by a stream that copies into a bounded in-process queue. printf() then only
+ * copies into memory, and the console thread does the possibly slow writes to the real terminal
+ * or file. When the queue is full the output is dropped and counted instead of waiting, and the
+ * console thread reports the count once it has caught up.
+ **************************************************************************************************/
+
+#if defined(__linux__)
+#define _GNU_SOURCE     // fopencookie
+#endif
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <stdbool.h>
+#include <signal.h>
+
+#include "console.h"
+
+#if defined(_WIN32) && !defined(__CYGWIN__)
+
+// Native Windows console output stays on the calling thread.
+int console_start(void)
+{
+    return 0;
+}
+
+#else
+#include <unistd.h>
+#include <errno.h>
+#include <pthread.h>
+
+// --------------------------------
+// Local variables and constants
+#define CONSOLE_QUEUE_SIZE  (64 * 1024)     // Bytes of output the terminal may fall behind by
+#define CONSOLE_CHUNK_SIZE  4096
+
+static char queue[CONSOLE_QUEUE_SIZE];
+static uint32_t queueHead = 0;          // Next byte to fill, grows without wrapping the index
+static uint32_t queueTail = 0;          // Next byte to write out
+static uint64_t droppedBytes = 0;       // Output that didn't fit, reported by the console thread
+static bool stopping = false;
+static bool broken = false;             // The real stdout failed, output is discarded
+
+static pthread_mutex_t queueLock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t queueFilled = PTHREAD_COND_INITIALIZER;
+static pthread_t consoleThread;
+static FILE *originalStdout = NULL;
+
+/***************************************************************************************************
+ * Static Function Declarations
+ **************************************************************************************************/
+static FILE *open_queue_stream(void);
+static void *console_thread(void *arg);
+static bool write_all(const char *data, size_t len);
+static void console_stop(void);
+
+/***************************************************************************************************
+ * Public Function Definitions
+ **************************************************************************************************/
+
+/***********************************************************************************************/ /**
+ *  \brief  Start the console output thread.
+ *  \return  0 on success, -1 on failure. stdout is left untouched on failure.
+ **************************************************************************************************/
+int console_start(void)
+{
+    FILE *stream = open_queue_stream();
+    sigset_t blocked, previous;
+    int ret;
+
+    if (stream == NULL) {
+        return -1;
+    }
+    // Set before the stream is first used. Interactive prompts end without a newline and are
+    // flushed explicitly.
+    setvbuf(stream, NULL, _IOLBF, CONSOLE_CHUNK_SIZE);
+
+    // SIGPIPE stays blocked in the console thread so a closed terminal shows up as EPIPE there
+    // instead of ending the process.
+    sigemptyset(&blocked);
+    sigaddset(&blocked, SIGINT);
+    sigaddset(&blocked, SIGPIPE);
+    pthread_sigmask(SIG_BLOCK, &blocked, &previous);
+    ret = pthread_create(&consoleThread, NULL, console_thread, NULL);
+    pthread_sigmask(SIG_SETMASK, &previous, NULL);
+
+    if (ret != 0) {
+        fclose(stream);
+        return -1;
+    }
+    fflush(stdout);
+    originalStdout = stdout;
+    stdout = stream;
+    atexit(console_stop);
+    return 0;
+}
+
+/***************************************************************************************************
+ * Static Function Definitions
+ **************************************************************************************************/
+
+// stdio write function of the queue stream. Never waits: a write that doesn't fit is dropped
+// whole, so a line is either complete or missing.
+#if defined(__GLIBC__)
+static ssize_t queue_write(void *cookie, const char *data, size_t len)
+#else
+static int queue_write(void *cookie, const char *data, int len)
+#endif
+{
+    (void)cookie;
+
+    pthread_mutex_lock(&queueLock);
+    if (broken || ((CONSOLE_QUEUE_SIZE - (queueHead - queueTail)) < (uint32_t)len)) {
+        droppedBytes += (uint64_t)len;
+    } else {
+        for (uint32_t i = 0; i < (uint32_t)len; i++) {
+            queue[(queueHead + i) % CONSOLE_QUEUE_SIZE] = data[i];
+        }
+        queueHead += (uint32_t)len;
+        pthread_cond_signal(&queueFilled);
+    }
+    pthread_mutex_unlock(&queueLock);
+    return len;
+}
+
+static FILE *open_queue_stream(void)
+{
+#if defined(__GLIBC__)
+    cookie_io_functions_t functions = { .read = NULL, .write = queue_write,
+                                        .seek = NULL, .close = NULL };
+
+    return fopencookie(NULL, "w", functions);
+#else
+    return funopen(NULL, NULL, queue_write, NULL, NULL);
+#endif
+}
+
+// Write the queue out to the real stdout until a stop is asked for and everything is out.
+static void *console_thread(void *arg)
+{
+    char buffer[CONSOLE_CHUNK_SIZE];
+    uint64_t reported = 0;
+    bool failed = false;
+    (void)arg;
+
+    pthread_mutex_lock(&queueLock);
+    while (1) {
+        uint32_t len = queueHead - queueTail;
+        uint64_t dropped = droppedBytes;
+
+        if ((len == 0) && (dropped == reported)) {
+            if (stopping) {
+                break;
+            }
+            pthread_cond_wait(&queueFilled, &queueLock);
+            continue;
+        }
+        if (len > sizeof(buffer)) {
+            len = sizeof(buffer);
+        }
+        for (uint32_t i = 0; i < len; i++) {
+            buffer[i] = queue[(queueTail + i) % CONSOLE_QUEUE_SIZE];
+        }
+        queueTail += len;
+        pthread_mutex_unlock(&queueLock);
+
+        if ((len > 0) && !write_all(buffer, len)) {
+            failed = true;
+            break;
+        }
+        if ((len == 0) && (dropped != reported)) {
+            char note[64];
+            int noteLen = snprintf(note, sizeof(note), "\n[%llu bytes of output dropped]\n",
+                                   (unsigned long long)(dropped - reported));
+            reported = dropped;
+            if (!write_all(note, (size_t)noteLen)) {
+                failed = true;
+                break;
+            }
+        }
+        pthread_mutex_lock(&queueLock);
+    }
+    if (failed) {
+        // The terminal is gone, e.g. EPIPE or EIO. Keep the application running, output is
+        // dropped from here on.
+        pthread_mutex_lock(&queueLock);
+        broken = true;
+        queueTail = queueHead;
+    }
+    pthread_mutex_unlock(&queueLock);
+    return NULL;
+}
+
+static bool write_all(const char *data, size_t len)
+{
+    size_t written = 0;
+
+    while (written < len) {
+        ssize_t ret = write(STDOUT_FILENO, data + written, len - written);
+        if (ret < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return false;
+        }
+        written += (size_t)ret;
+    }
+    return true;
+}
+
+// Flush the queue stream, let the thread write out what is queued and give stdout back.
+static void console_stop(void)
+{
+    FILE *stream = stdout;
+
+    fflush(stream);
+    pthread_mutex_lock(&queueLock);
+    stopping = true;
+    pthread_cond_signal(&queueFilled);
+    pthread_mutex_unlock(&queueLock);
+    pthread_join(consoleThread, NULL);
+    stdout = originalStdout;
+    fclose(stream);
+}
+#endif
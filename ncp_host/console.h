@@ -0,0 +1,25 @@
+/***********************************************************************************************/ /**
+ * \file   console.h
+ * \brief  Console output thread
+ **************************************************************************************************/
+
+#ifndef CONSOLE_H
+#define CONSOLE_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/***************************************************************************************************
+ * Function Declarations
+ **************************************************************************************************/
+// Route stdout through a bounded queue drained by a separate thread, so a slow terminal never
+// blocks event handling. Output that doesn't fit is dropped and counted. Output is flushed and
+// the thread joined at exit.
+int console_start(void);
+
+#ifdef __cplusplus
+};
+#endif
+
+#endif /* CONSOLE_H */
@@ -0,0 +1,644 @@
+/***********************************************************************************************/ /**
+ * \file   daemon.c
+ * \brief  Test requests over a local control socket, run back to back on one booted NCP
+ *
+ * Clients connect to a Unix domain socket and send one JSON object per line, e.g.
+ *   {"id":"a1","mode":1,"time":5,"phy":2,"interval":25,"mtu":247}
+ *   {"id":"s","cmd":"status"}
+ * Every answer is one JSON object per line carrying the request id: "queued", "started",
+ * "result" or "error" for tests, "status" for status requests. Objects are flat, values are
+ * numbers, strings without escapes or true/false.
+ **************************************************************************************************/
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <stdbool.h>
+#include <stdarg.h>
+#include <ctype.h>
+
+/* BG stack headers, for the event type in app.h */
+#include "gecko_bglib.h"
+
+#include "daemon.h"
+#include "monotonic.h"
+
+#if ((_WIN32 == 1) || (__CYGWIN__ == 1))
+
+// Unix domain sockets only.
+int daemon_open(const char *path, const TestParameters_t *defaults) { return -1; }
+void daemon_close(void) {}
+void daemon_poll(void) {}
+bool daemon_shutdown_requested(void) { return false; }
+bool daemon_next(TestParameters_t *params) { return false; }
+bool daemon_running(void) { return false; }
+bool daemon_timed_out(void) { return false; }
+void daemon_done(const TestResult_t *result) {}
+void daemon_failed(const char *message) {}
+
+#else
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+
+// --------------------------------
+// Local variables and constants
+#define DAEMON_MAX_CLIENTS      8
+#define DAEMON_QUEUE_MAX        256
+#define DAEMON_LINE_MAX         512
+#define DAEMON_ID_LEN           48
+#define DAEMON_REPLY_MAX        512
+#define DAEMON_POLL_PERIOD_US   10000   // Socket check interval, keeps syscalls out of most event loop turns
+#define DAEMON_TIMEOUT_MARGIN_S 60      // On top of the test time for setup and the slave result
+#define DAEMON_TIMEOUT_DEFAULT_S 300    // Tests without a known duration
+
+typedef struct {
+    int fd;                     // -1 when the slot is free
+    uint32_t generation;        // Tells requests of a closed client from those of the next one in the slot
+    char line[DAEMON_LINE_MAX];
+    size_t lineLen;
+} DaemonClient_t;
+
+typedef struct {
+    char id[DAEMON_ID_LEN];
+    uint8_t client;
+    uint32_t generation;
+    TestParameters_t params;
+    uint32_t timeoutS;
+} DaemonRequest_t;
+
+static int listenFd = -1;
+static char socketPath[sizeof(((struct sockaddr_un *)0)->sun_path)];
+static TestParameters_t defaultParams;
+static DaemonClient_t clients[DAEMON_MAX_CLIENTS];
+static DaemonRequest_t queue[DAEMON_QUEUE_MAX];
+static uint16_t queueHead = 0;
+static uint16_t queueCount = 0;
+static DaemonRequest_t current;
+static bool running = false;
+static uint64_t deadlineUs = 0;
+static uint64_t lastPollUs = 0;
+static bool shutdownRequested = false;
+static uint32_t completed = 0;
+static uint32_t failed = 0;
+
+/***************************************************************************************************
+ * Static Function Declarations
+ **************************************************************************************************/
+static void accept_clients(void);
+static void read_client(uint8_t index);
+static void close_client(uint8_t index);
+static void handle_line(uint8_t index, const char *line);
+static int parse_run(const char *line, TestParameters_t *params, uint32_t *timeoutS, const char **error);
+static void reply(uint8_t client, uint32_t generation, const char *id, const char *event, const char *format, ...);
+static const char *json_value(const char *line, const char *key);
+static int json_number(const char *line, const char *key, long *value);
+static int json_string(const char *line, const char *key, char *buf, size_t size);
+static int json_bool(const char *line, const char *key, bool *value);
+
+/***************************************************************************************************
+ * Public Function Definitions
+ **************************************************************************************************/
+
+/***********************************************************************************************/ /**
+ *  \brief  Create the control socket. A stale socket file nobody listens on is replaced.
+ *  \param[in] path Socket path.
+ *  \param[in] defaults Parameters for fields a request leaves out.
+ *  \return  0 on success, -1 on failure.
+ **************************************************************************************************/
+int daemon_open(const char *path, const TestParameters_t *defaults)
+{
+    struct sockaddr_un addr;
+    struct stat st;
+
+    if (strlen(path) >= sizeof(addr.sun_path)) {
+        return -1;
+    }
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strcpy(addr.sun_path, path);
+
+    if ((lstat(path, &st) == 0) && S_ISSOCK(st.st_mode)) {
+        int probe = socket(AF_UNIX, SOCK_STREAM, 0);
+        bool live = (probe >= 0) && (connect(probe, (struct sockaddr *)&addr, sizeof(addr)) == 0);
+
+        if (probe >= 0) {
+            close(probe);
+        }
+        if (live) {
+            return -1; // Another daemon owns it.
+        }
+        unlink(path);
+    }
+
+    listenFd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (listenFd < 0) {
+        return -1;
+    }
+    if ((bind(listenFd, (struct sockaddr *)&addr, sizeof(addr)) < 0) || (listen(listenFd, DAEMON_MAX_CLIENTS) < 0)) {
+        close(listenFd);
+        listenFd = -1;
+        return -1;
+    }
+    fcntl(listenFd, F_SETFL, fcntl(listenFd, F_GETFL) | O_NONBLOCK);
+    // A client that goes away mid reply must not take the daemon down.
+    signal(SIGPIPE, SIG_IGN);
+
+    strcpy(socketPath, path);
+    defaultParams = *defaults;
+    for (uint8_t i = 0; i < DAEMON_MAX_CLIENTS; i++) {
+        clients[i].fd = -1;
+    }
+    return 0;
+}
+
+// Close all clients and remove the socket file.
+void daemon_close(void)
+{
+    if (listenFd < 0) {
+        return;
+    }
+    for (uint8_t i = 0; i < DAEMON_MAX_CLIENTS; i++) {
+        close_client(i);
+    }
+    close(listenFd);
+    listenFd = -1;
+    unlink(socketPath);
+}
+
+/***********************************************************************************************/ /**
+ *  \brief  Service the control socket. Cheap to call on every event loop turn, the sockets are
+ *  only checked every DAEMON_POLL_PERIOD_US.
+ **************************************************************************************************/
+void daemon_poll(void)
+{
+    struct pollfd fds[DAEMON_MAX_CLIENTS + 1];
+    uint8_t slots[DAEMON_MAX_CLIENTS];
+    nfds_t count = 1;
+    uint64_t now = monotonic_now_us();
+
+    if ((listenFd < 0) || ((now - lastPollUs) < DAEMON_POLL_PERIOD_US)) {
+        return;
+    }
+    lastPollUs = now;
+
+    fds[0].fd = listenFd;
+    fds[0].events = POLLIN;
+    for (uint8_t i = 0; i < DAEMON_MAX_CLIENTS; i++) {
+        if (clients[i].fd >= 0) {
+            fds[count].fd = clients[i].fd;
+            fds[count].events = POLLIN;
+            slots[count - 1] = i;
+            count++;
+        }
+    }
+    if (poll(fds, count, 0) <= 0) {
+        return;
+    }
+
+    for (nfds_t i = 1; i < count; i++) {
+        if (fds[i].revents & (POLLIN | POLLHUP | POLLERR)) {
+            read_client(slots[i - 1]);
+        }
+    }
+    if (fds[0].revents & POLLIN) {
+        accept_clients();
+    }
+}
+
+bool daemon_shutdown_requested(void)
+{
+    return shutdownRequested;
+}
+
+/***********************************************************************************************/ /**
+ *  \brief  Take the next queued test. Requests of clients that have gone away are dropped.
+ *  \param[out] params Parameters of the test.
+ *  \return  true if a test should start now.
+ **************************************************************************************************/
+bool daemon_next(TestParameters_t *params)
+{
+    while (!running && (queueCount > 0)) {
+        DaemonRequest_t *request = &queue[queueHead];
+
+        queueHead = (queueHead + 1) % DAEMON_QUEUE_MAX;
+        queueCount--;
+        if ((clients[request->client].fd < 0) || (clients[request->client].generation != request->generation)) {
+            continue;
+        }
+
+        current = *request;
+        running = true;
+        deadlineUs = monotonic_now_us() + ((uint64_t)current.timeoutS * 1000000);
+        *params = current.params;
+        printf("\nDaemon: starting request %s.\n", current.id);
+        reply(current.client, current.generation, current.id, "started", "");
+    }
+    return running;
+}
+
+bool daemon_running(void)
+{
+    return running;
+}
+
+// The running test took longer than its timeout, e.g. the peer is gone.
+bool daemon_timed_out(void)
+{
+    return running && (monotonic_now_us() > deadlineUs);
+}
+
+/***********************************************************************************************/ /**
+ *  \brief  Stream the result of the running test to its client.
+ *  \param[in] result Result reported by the application.
+ **************************************************************************************************/
+void daemon_done(const TestResult_t *result)
+{
+    if (!running) {
+        return;
+    }
+    running = false;
+    completed++;
+
+    if (result->mode == 4) {
+        reply(current.client, current.generation, current.id, "result",
+              ",\"mode\":4,\"phy\":%u,\"interval_ms\":%.2f,\"mtu\":%u,\"round_trips\":%lu,\"lost\":%lu,"
+              "\"p50_us\":%lu,\"p99_us\":%lu,\"max_us\":%lu",
+              result->phy, (double)result->interval * 1.25, result->mtu, (unsigned long)result->roundTrips,
+              (unsigned long)result->lost, (unsigned long)result->p50Us, (unsigned long)result->p99Us,
+              (unsigned long)result->maxUs);
+    } else if (result->mode == 5) {
+        reply(current.client, current.generation, current.id, "result",
+              ",\"mode\":5,\"throughput_bps\":%lu,\"packets\":%lu,\"lost\":%lu,\"bits\":%llu",
+              (unsigned long)result->throughput, (unsigned long)result->operations,
+              (unsigned long)result->lost, (unsigned long long)result->bits);
+    } else {
+        reply(current.client, current.generation, current.id, "result",
+              ",\"mode\":%u,\"phy\":%u,\"interval_ms\":%.2f,\"mtu\":%u,\"seconds\":%.3f,\"bits\":%llu,"
+              "\"throughput_bps\":%lu,\"slave_throughput_bps\":%lu,\"operations\":%lu,\"utilization_pct\":%.1f,"
+              "\"gaps\":%lu,\"stalled_ms\":%.1f,\"longest_gap_ms\":%.1f,\"longest_gap_at\":%.3f,\"stalled\":%s,"
+              "\"events\":%lu,\"event_handling_us\":%lu",
+              result->mode, result->phy, (double)result->interval * 1.25, result->mtu, result->seconds,
+              (unsigned long long)result->bits, (unsigned long)result->throughput,
+              (unsigned long)result->slaveThroughput, (unsigned long)result->operations, result->utilization,
+              (unsigned long)result->gaps, result->gapStalledSeconds * 1e3, (double)result->gapLongestUs / 1e3,
+              result->gapLongestAt, result->stalled ? "true" : "false", (unsigned long)result->events,
+              (unsigned long)result->eventHandlingUs);
+    }
+}
+
+/***********************************************************************************************/ /**
+ *  \brief  Give up on the running test and tell its client why.
+ *  \param[in] message Reason, without quotes.
+ **************************************************************************************************/
+void daemon_failed(const char *message)
+{
+    if (!running) {
+        return;
+    }
+    running = false;
+    failed++;
+    printf("\nDaemon: request %s failed: %s\n", current.id, message);
+    reply(current.client, current.generation, current.id, "error", ",\"message\":\"%s\"", message);
+}
+
+/***************************************************************************************************
+ * Static Function Definitions
+ **************************************************************************************************/
+
+static void accept_clients(void)
+{
+    int fd;
+
+    while ((fd = accept(listenFd, NULL, NULL)) >= 0) {
+        uint8_t i;
+
+        for (i = 0; (i < DAEMON_MAX_CLIENTS) && (clients[i].fd >= 0); i++) {
+        }
+        if (i == DAEMON_MAX_CLIENTS) {
+            close(fd); // Full, the client sees the connection closed.
+            continue;
+        }
+        fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+        clients[i].fd = fd;
+        clients[i].generation++;
+        clients[i].lineLen = 0;
+    }
+}
+
+// Read what the client sent and handle every complete line.
+static void read_client(uint8_t index)
+{
+    DaemonClient_t *client = &clients[index];
+    ssize_t len;
+
+    while (client->fd >= 0) {
+        char *newline;
+
+        len = recv(client->fd, &client->line[client->lineLen], sizeof(client->line) - 1 - client->lineLen, 0);
+        if (len == 0) {
+            close_client(index);
+            return;
+        }
+        if (len < 0) {
+            if ((errno != EAGAIN) && (errno != EWOULDBLOCK) && (errno != EINTR)) {
+                close_client(index);
+            }
+            return;
+        }
+        client->lineLen += (size_t)len;
+        client->line[client->lineLen] = '\0';
+
+        while ((client->fd >= 0) && ((newline = strchr(client->line, '\n')) != NULL)) {
+            size_t used = (size_t)(newline - client->line) + 1;
+
+            *newline = '\0';
+            handle_line(index, client->line);
+            memmove(client->line, &client->line[used], client->lineLen - used + 1);
+            client->lineLen -= used;
+        }
+        if ((client->fd >= 0) && (client->lineLen == (sizeof(client->line) - 1))) {
+            reply(index, client->generation, "", "error", ",\"message\":\"Line too long\"");
+            client->lineLen = 0;
+        }
+    }
+}
+
+// Queued requests of the client are dropped when they come up, a running test finishes unheard.
+static void close_client(uint8_t index)
+{
+    if (clients[index].fd >= 0) {
+        close(clients[index].fd);
+        clients[index].fd = -1;
+    }
+}
+
+static void handle_line(uint8_t index, const char *line)
+{
+    uint32_t generation = clients[index].generation;
+    char id[DAEMON_ID_LEN] = "";
+    char cmd[16] = "run";
+    const char *error = NULL;
+    DaemonRequest_t *request;
+
+    while (isspace((unsigned char)*line)) {
+        line++;
+    }
+    if (*line == '\0') {
+        return;
+    }
+    if ((*line != '{') || (json_string(line, "id", id, sizeof(id)) < 0) || (json_string(line, "cmd", cmd, sizeof(cmd)) < 0)) {
+        reply(index, generation, id, "error", ",\"message\":\"Not a JSON object with a plain id and cmd\"");
+        return;
+    }
+
+    if (strcmp(cmd, "status") == 0) {
+        reply(index, generation, id, "status", ",\"running\":%s%s%s,\"queued\":%u,\"completed\":%lu,\"failed\":%lu",
+              running ? "\"" : "", running ? current.id : "null", running ? "\"" : "",
+              queueCount, (unsigned long)completed, (unsigned long)failed);
+        return;
+    }
+    if (strcmp(cmd, "shutdown") == 0) {
+        reply(index, generation, id, "status", ",\"message\":\"Shutting down\"");
+        shutdownRequested = true;
+        return;
+    }
+    if (strcmp(cmd, "run") != 0) {
+        reply(index, generation, id, "error", ",\"message\":\"Unknown cmd, use run, status or shutdown\"");
+        return;
+    }
+
+    if (queueCount == DAEMON_QUEUE_MAX) {
+        reply(index, generation, id, "error", ",\"message\":\"Queue full\"");
+        return;
+    }
+    request = &queue[(queueHead + queueCount) % DAEMON_QUEUE_MAX];
+    if (parse_run(line, &request->params, &request->timeoutS, &error) < 0) {
+        reply(index, generation, id, "error", ",\"message\":\"%s\"", error);
+        return;
+    }
+    strcpy(request->id, id);
+    request->client = index;
+    request->generation = generation;
+    queueCount++;
+    reply(index, generation, id, "queued", ",\"position\":%u", queueCount + (running ? 1 : 0));
+}
+
+// Test parameters of a run request on top of the defaults, with the ranges of the command line.
+static int parse_run(const char *line, TestParameters_t *params, uint32_t *timeoutS, const char **error)
+{
+    long value;
+    bool indicate;
+    int found;
+
+    *params = defaultParams;
+    *error = NULL;
+
+    if ((found = json_number(line, "mode", &value)) != 0) {
+        if ((found < 0) || (value < 1) || (value > 5) || (value == 3)) {
+            *error = "mode must be 1, 2, 4 or 5, free mode needs the slave buttons";
+            return -1;
+        }
+        params->mode = (uint8_t)value;
+    }
+    if ((found = json_number(line, "time", &value)) != 0) {
+        if ((found < 0) || (value < 1) || (value >= 600)) {
+            *error = "time must be 1 - 599 s";
+            return -1;
+        }
+        params->fixed_time = (uint32_t)value;
+    }
+    if ((found = json_number(line, "amount", &value)) != 0) {
+        if ((found < 0) || (value < 1000) || (value >= 10000000)) {
+            *error = "amount must be 1k - 10M bytes";
+            return -1;
+        }
+        params->fixed_amount = (uint32_t)value;
+    }
+    if ((found = json_number(line, "pings", &value)) != 0) {
+        if ((found < 0) || (value < 1) || (value > 1000000)) {
+            *error = "pings must be 1 - 1M";
+            return -1;
+        }
+        params->ping_count = (uint32_t)value;
+    }
+    if ((found = json_number(line, "phy", &value)) != 0) {
+        if ((found < 0) || ((value != 1) && (value != 2) && (value != 4))) {
+            *error = "phy must be 1, 2 or 4";
+            return -1;
+        }
+        params->phy = (uint8_t)value;
+    }
+    if ((found = json_number(line, "interval", &value)) != 0) {
+        if ((found < 0) || (value < 20) || (value > 4000)) {
+            *error = "interval must be 20 - 4000 ms";
+            return -1;
+        }
+        params->connection_interval = (uint16_t)((float)value / 1.25);
+    }
+    if ((found = json_number(line, "mtu", &value)) != 0) {
+        if ((found < 0) || (value < 23) || (value > 250)) {
+            *error = "mtu must be 23 - 250";
+            return -1;
+        }
+        params->mtu_size = (uint16_t)value;
+    }
+    if ((found = json_bool(line, "indicate", &indicate)) != 0) {
+        if (found < 0) {
+            *error = "indicate must be true or false";
+            return -1;
+        }
+        params->client_conf_flag = indicate ? 2 : 1;
+    }
+
+    if (params->mode == 3) {
+        *error = "mode missing, the daemon default is free mode";
+        return -1;
+    }
+    if ((params->mode == 1) && (params->fixed_time == 0)) {
+        *error = "mode 1 needs time";
+        return -1;
+    }
+    if ((params->mode == 2) && (params->fixed_amount == 0)) {
+        *error = "mode 2 needs amount";
+        return -1;
+    }
+    if ((params->mode == 5) && (params->fixed_time == 0)) {
+        params->fixed_time = 10;
+    }
+
+    *timeoutS = ((params->mode == 1) || (params->mode == 5)) ? (params->fixed_time + DAEMON_TIMEOUT_MARGIN_S)
+                                                             : DAEMON_TIMEOUT_DEFAULT_S;
+    if ((found = json_number(line, "timeout", &value)) != 0) {
+        if ((found < 0) || (value < 1)) {
+            *error = "timeout must be at least 1 s";
+            return -1;
+        }
+        *timeoutS = (uint32_t)value;
+    }
+    return 0;
+}
+
+// One JSON line to a client, unless it has gone away since. A client that can't take the line is closed.
+static void reply(uint8_t client, uint32_t generation, const char *id, const char *event, const char *format, ...)
+{
+    char buf[DAEMON_REPLY_MAX];
+    int len;
+    va_list args;
+
+    if ((clients[client].fd < 0) || (clients[client].generation != generation)) {
+        return;
+    }
+    len = snprintf(buf, sizeof(buf), "{\"id\":\"%s\",\"event\":\"%s\"", id, event);
+    va_start(args, format);
+    len += vsnprintf(&buf[len], sizeof(buf) - (size_t)len, format, args);
+    va_end(args);
+    if (len > (int)sizeof(buf) - 3) {
+        len = (int)sizeof(buf) - 3;
+    }
+    len += snprintf(&buf[len], sizeof(buf) - (size_t)len, "}\n");
+
+    if (send(clients[client].fd, buf, (size_t)len, 0) != len) {
+        close_client(client);
+    }
+}
+
+// Start of the value of a key in a flat object, NULL if the key is missing. Strings are skipped
+// whole, so a key name inside a string value doesn't match.
+static const char *json_value(const char *line, const char *key)
+{
+    size_t len = strlen(key);
+    const char *p = line;
+
+    while ((p = strchr(p, '"')) != NULL) {
+        const char *start = ++p;
+
+        while ((*p != '\0') && (*p != '"')) {
+            p += (*p == '\\' && p[1] != '\0') ? 2 : 1;
+        }
+        if (*p == '\0') {
+            return NULL;
+        }
+        p++;
+        if (((size_t)(p - 1 - start) == len) && (strncmp(start, key, len) == 0)) {
+            const char *value = p;
+
+            while (isspace((unsigned char)*value)) {
+                value++;
+            }
+            if (*value == ':') {
+                value++;
+                while (isspace((unsigned char)*value)) {
+                    value++;
+                }
+                return value;
+            }
+        }
+    }
+    return NULL;
+}
+
+// 1 if found, 0 if missing, -1 if not an integer.
+static int json_number(const char *line, const char *key, long *value)
+{
+    const char *p = json_value(line, key);
+    char *end;
+
+    if (p == NULL) {
+        return 0;
+    }
+    *value = strtol(p, &end, 10);
+    if ((end == p) || ((*end != ',') && (*end != '}') && !isspace((unsigned char)*end))) {
+        return -1;
+    }
+    return 1;
+}
+
+// Strings are echoed back in replies, so quotes, backslashes and control characters are refused.
+static int json_string(const char *line, const char *key, char *buf, size_t size)
+{
+    const char *p = json_value(line, key);
+    size_t len = 0;
+
+    if (p == NULL) {
+        return 0;
+    }
+    if (*p++ != '"') {
+        return -1;
+    }
+    while ((*p != '"') && (*p != '\0')) {
+        if ((*p == '\\') || !isprint((unsigned char)*p) || (len >= (size_t)(size - 1))) {
+            return -1;
+        }
+        buf[len++] = *p++;
+    }
+    if (*p != '"') {
+        return -1;
+    }
+    buf[len] = '\0';
+    return 1;
+}
+
+static int json_bool(const char *line, const char *key, bool *value)
+{
+    const char *p = json_value(line, key);
+
+    if (p == NULL) {
+        return 0;
+    }
+    if (strncmp(p, "true", 4) == 0) {
+        *value = true;
+    } else if (strncmp(p, "false", 5) == 0) {
+        *value = false;
+    } else {
+        return -1;
+    }
+    return 1;
+}
+#endif
@@ -0,0 +1,40 @@
+/***********************************************************************************************/ /**
+ * \file   daemon.h
+ * \brief  Test requests over a local control socket, run back to back on one booted NCP
+ **************************************************************************************************/
+
+#ifndef DAEMON_H
+#define DAEMON_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "app.h"
+
+/***************************************************************************************************
+ * Function Declarations
+ **************************************************************************************************/
+// Listen on a Unix domain socket. Requests leave out what the defaults already give.
+int daemon_open(const char *path, const TestParameters_t *defaults);
+void daemon_close(void);
+
+// Accept clients, read their requests and answer the ones that don't need the radio.
+void daemon_poll(void);
+bool daemon_shutdown_requested(void);
+
+// Queued tests. daemon_next() hands out the next one and reports it started to its client.
+bool daemon_next(TestParameters_t *params);
+bool daemon_running(void);
+bool daemon_timed_out(void);
+void daemon_done(const TestResult_t *result);
+void daemon_failed(const char *message);
+
+#ifdef __cplusplus
+};
+#endif
+
+#endif /* DAEMON_H */
@@ -0,0 +1,173 @@
+/***********************************************************************************************/ /**
+ * \file   flight_dump.c
+ * \brief  Slave flight recorder dump collected after a run, summarized and written out as CSV
+ *
+ * Chunks arrive in order on one characteristic, each carrying the index of its first record, so
+ * the dump is complete once the last index is in. Times are RTCC counts on the slave, unwrapped
+ * against the first record and converted to microseconds.
+ **************************************************************************************************/
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <stdbool.h>
+
+#include "flight_dump.h"
+
+// --------------------------------
+// Local variables and constants
+#define FLIGHT_TICKS_PER_SECOND     32768   // Slave RTCC
+
+/***************************************************************************************************
+ * Static Function Declarations
+ **************************************************************************************************/
+static uint64_t record_time_us(const FlightDump_t *dump, uint16_t index);
+
+/***************************************************************************************************
+ * Public Function Definitions
+ **************************************************************************************************/
+
+// Forget the last dump before asking for the next one.
+void flight_dump_reset(FlightDump_t *dump)
+{
+    memset(dump, 0, sizeof(FlightDump_t));
+}
+
+/***********************************************************************************************/ /**
+ *  \brief  Take one chunk of the dump.
+ *  \param[in] dump Dump in progress.
+ *  \param[in] data Notification from the flight recorder characteristic.
+ *  \param[in] len Notification length.
+ *  \return  true once the dump is over, complete or failed. Malformed chunks are dropped.
+ **************************************************************************************************/
+bool flight_dump_add(FlightDump_t *dump, const uint8_t *data, uint16_t len)
+{
+    FlightChunk_t chunk;
+
+    if (!flight_chunk_parse(data, len, &chunk)) {
+        return dump->complete || dump->failed;
+    }
+    if (chunk.first == FLIGHT_CHUNK_ABORTED) {
+        dump->failed = !dump->complete;
+        return true;
+    }
+    if (chunk.total > FLIGHT_RECORDER_RECORDS) {
+        printf("Slave flight recorder holds %u events, this host takes %u. Build both with the same FLIGHT_RECORDER_RECORDS.\n",
+               chunk.total, FLIGHT_RECORDER_RECORDS);
+        dump->failed = true;
+        return true;
+    }
+    dump->total = chunk.total;
+    dump->overwritten = chunk.overwritten;
+    for (uint16_t i = 0; i < chunk.records; i++) {
+        flight_record_decode(&chunk.data[i * FLIGHT_RECORD_LEN], &dump->records[chunk.first + i]);
+    }
+    if ((chunk.first + chunk.records) > dump->received) {
+        dump->received = chunk.first + chunk.records;
+    }
+    dump->complete = (dump->received >= dump->total);
+    return dump->complete;
+}
+
+/***********************************************************************************************/ /**
+ *  \brief  Print what the slave did with the run: sends, stalls and the longest gap between sends.
+ *  \param[in] dump Complete dump.
+ **************************************************************************************************/
+void flight_dump_print(const FlightDump_t *dump)
+{
+    uint32_t sendsOk = 0, sendBytes = 0, failedAttempts = 0, stalls = 0;
+    uint32_t confirmations = 0, phyChanges = 0, parameterUpdates = 0;
+    uint64_t lastSendUs = 0, gapUs = 0, gapAtUs = 0;
+    bool sent = false;
+
+    if (dump->received == 0) {
+        printf("Flight recorder: no events recorded.\n\n");
+        return;
+    }
+    for (uint16_t i = 0; i < dump->received; i++) {
+        const FlightRecord_t *record = &dump->records[i];
+        uint64_t now = record_time_us(dump, i);
+
+        switch (record->event) {
+            case FLIGHT_SEND_OK:
+                sendsOk++;
+                sendBytes += record->value;
+                if (sent && ((now - lastSendUs) > gapUs)) {
+                    gapUs = now - lastSendUs;
+                    gapAtUs = lastSendUs;
+                }
+                lastSendUs = now;
+                sent = true;
+                break;
+            case FLIGHT_SEND_FAILED:
+                failedAttempts += record->value;
+                stalls++;
+                break;
+            case FLIGHT_CONFIRMATION:
+                confirmations++;
+                break;
+            case FLIGHT_PHY_CHANGE:
+                phyChanges++;
+                break;
+            case FLIGHT_PARAMETERS:
+                parameterUpdates++;
+                break;
+            default:
+                break;
+        }
+    }
+
+    printf("Flight recorder: %u events over %.3f ms", dump->received, (double)record_time_us(dump, dump->received - 1) / 1000.0);
+    if (dump->overwritten > 0) {
+        printf(", %lu older ones overwritten", (unsigned long)dump->overwritten);
+    }
+    printf("\n");
+    printf("Slave sends: %lu handed to the stack, %lu B, %lu failed attempts in %lu stalls\n",
+           (unsigned long)sendsOk, (unsigned long)sendBytes, (unsigned long)failedAttempts, (unsigned long)stalls);
+    if (gapUs > 0) {
+        printf("Longest gap between sends: %.3f ms, starting at %.3f ms\n", (double)gapUs / 1000.0, (double)gapAtUs / 1000.0);
+    }
+    printf("Confirmations: %lu, PHY changes: %lu, connection parameter updates: %lu\n\n",
+           (unsigned long)confirmations, (unsigned long)phyChanges, (unsigned long)parameterUpdates);
+}
+
+/***********************************************************************************************/ /**
+ *  \brief  Append the records of a dump to a CSV file, one line per record.
+ *  \param[in] dump Complete dump.
+ *  \param[in] run Run number, to tell the dumps in one file apart.
+ *  \param[in] path File, the header is written if it is empty.
+ *  \return  0 on success, -1 if the file can't be opened.
+ **************************************************************************************************/
+int flight_dump_write_csv(const FlightDump_t *dump, uint32_t run, const char *path)
+{
+    FILE *f = fopen(path, "a");
+
+    if (f == NULL) {
+        return -1;
+    }
+    fseek(f, 0, SEEK_END);
+    if (ftell(f) == 0) {
+        fprintf(f, "run,time_us,rtcc,event,detail,value\n");
+    }
+    for (uint16_t i = 0; i < dump->received; i++) {
+        const FlightRecord_t *record = &dump->records[i];
+
+        fprintf(f, "%lu,%llu,%lu,%s,%u,%u\n", (unsigned long)run, (unsigned long long)record_time_us(dump, i),
+                (unsigned long)record->ticks, flight_event_name(record->event), record->detail, record->value);
+    }
+    fclose(f);
+    return 0;
+}
+
+/***************************************************************************************************
+ * Static Function Definitions
+ **************************************************************************************************/
+
+// Time of a record since the first one. The RTCC wraps after 36 hours, the dump of one run doesn't.
+static uint64_t record_time_us(const FlightDump_t *dump, uint16_t index)
+{
+    uint32_t ticks = dump->records[index].ticks - dump->records[0].ticks;
+
+    return ((uint64_t)ticks * 1000000) / FLIGHT_TICKS_PER_SECOND;
+}
@@ -0,0 +1,42 @@
+/***********************************************************************************************/ /**
+ * \file   flight_dump.h
+ * \brief  Slave flight recorder dump collected after a run, summarized and written out as CSV
+ **************************************************************************************************/
+
+#ifndef FLIGHT_DUMP_H
+#define FLIGHT_DUMP_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "../soc/app_flight_recorder.h"
+
+/***************************************************************************************************
+ * Type Definitions
+ **************************************************************************************************/
+typedef struct {
+    FlightRecord_t records[FLIGHT_RECORDER_RECORDS];
+    uint16_t total;             // Records in the dump, known from the first chunk
+    uint16_t received;
+    uint32_t overwritten;       // Dropped by the slave before the oldest record
+    bool complete;
+    bool failed;                // The slave gave up, or the dump is larger than this host takes
+} FlightDump_t;
+
+/***************************************************************************************************
+ * Function Declarations
+ **************************************************************************************************/
+void flight_dump_reset(FlightDump_t *dump);
+bool flight_dump_add(FlightDump_t *dump, const uint8_t *data, uint16_t len);
+void flight_dump_print(const FlightDump_t *dump);
+int flight_dump_write_csv(const FlightDump_t *dump, uint32_t run, const char *path);
+
+#ifdef __cplusplus
+};
+#endif
+
+#endif /* FLIGHT_DUMP_H */
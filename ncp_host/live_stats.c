@@ -0,0 +1,232 @@
+/***********************************************************************************************/ /**
+ * \file   live_stats.c
+ * \brief  Live counters of a running test in POSIX shared memory, for monitors such as tt_top
+ *
+ * One writer, the tester, and any number of readers mapping the segment read-only. Updates go
+ * through a sequence lock: the writer makes seq odd, copies the snapshot in and makes seq even
+ * again, readers retry a copy that overlapped an update. The writer never waits for a reader.
+ **************************************************************************************************/
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <stdbool.h>
+
+#include "live_stats.h"
+#include "monotonic.h"
+
+#if ((_WIN32 == 1) || (__CYGWIN__ == 1))
+
+// POSIX shared memory only.
+int live_stats_open(const char *name) { return -1; }
+void live_stats_close(void) {}
+bool live_stats_due(void) { return false; }
+void live_stats_publish(const LiveStats_t *stats) {}
+int live_stats_attach(const char *name) { return -1; }
+void live_stats_detach(void) {}
+bool live_stats_read(LiveStats_t *stats) { return false; }
+
+#else
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <sched.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+// --------------------------------
+// Local variables and constants
+#define LIVE_STATS_PERIOD_US    50000   // Update interval, 20 per second is plenty for a screen
+#define LIVE_STATS_READ_TRIES   100     // A reader gives up on a copy after this many overlapping updates
+
+static LiveStatsSegment_t *segment = NULL;
+static char segmentName[64];
+static uint64_t lastPublishUs = 0;
+static const LiveStatsSegment_t *view = NULL;
+
+/***************************************************************************************************
+ * Static Function Declarations
+ **************************************************************************************************/
+static bool owner_alive(const char *name);
+
+/***************************************************************************************************
+ * Public Function Definitions
+ **************************************************************************************************/
+
+/***********************************************************************************************/ /**
+ *  \brief  Create the segment. A segment left behind by a writer that is gone is replaced.
+ *  \param[in] name Segment name, starting with '/'.
+ *  \return  0 on success, -1 on failure or when another tester is writing under the name.
+ **************************************************************************************************/
+int live_stats_open(const char *name)
+{
+    int fd;
+
+    if ((name[0] != '/') || (strlen(name) >= sizeof(segmentName)) || owner_alive(name)) {
+        return -1;
+    }
+    shm_unlink(name);
+    fd = shm_open(name, O_CREAT | O_EXCL | O_RDWR, 0644);
+    if (fd < 0) {
+        return -1;
+    }
+    if (ftruncate(fd, sizeof(LiveStatsSegment_t)) < 0) {
+        close(fd);
+        shm_unlink(name);
+        return -1;
+    }
+    segment = mmap(NULL, sizeof(LiveStatsSegment_t), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (segment == MAP_FAILED) {
+        segment = NULL;
+        shm_unlink(name);
+        return -1;
+    }
+
+    // ftruncate() zeroed the segment, readers take it as valid once the magic is in place.
+    segment->version = LIVE_STATS_VERSION;
+    segment->size = sizeof(LiveStatsSegment_t);
+    segment->stats.pid = (uint32_t)getpid();
+    segment->stats.rssi = LIVE_STATS_RSSI_UNKNOWN;
+    __atomic_store_n(&segment->magic, LIVE_STATS_MAGIC, __ATOMIC_RELEASE);
+    strcpy(segmentName, name);
+    return 0;
+}
+
+// Unmap and remove the segment, readers still mapping it keep the last snapshot.
+void live_stats_close(void)
+{
+    if (segment == NULL) {
+        return;
+    }
+    munmap(segment, sizeof(LiveStatsSegment_t));
+    segment = NULL;
+    shm_unlink(segmentName);
+}
+
+// True once per LIVE_STATS_PERIOD_US, so the event loop only builds snapshots that get published.
+// Also paces other consumers of the same snapshots, it works without a segment.
+bool live_stats_due(void)
+{
+    uint64_t now = monotonic_now_us();
+
+    if ((now - lastPublishUs) < LIVE_STATS_PERIOD_US) {
+        return false;
+    }
+    lastPublishUs = now;
+    return true;
+}
+
+/***********************************************************************************************/ /**
+ *  \brief  Publish a snapshot. Never blocks, a reader copying at the same time retries.
+ *  \param[in] stats Snapshot, pid and updatedUs are filled in here.
+ **************************************************************************************************/
+void live_stats_publish(const LiveStats_t *stats)
+{
+    LiveStats_t copy;
+    uint32_t seq;
+
+    if (segment == NULL) {
+        return;
+    }
+    // Everything but the copy happens outside the update, so readers rarely have to retry.
+    copy = *stats;
+    copy.pid = (uint32_t)getpid();
+    copy.updatedUs = monotonic_now_us();
+
+    seq = segment->seq; // Single writer, nobody else changes it.
+    __atomic_store_n(&segment->seq, seq + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    memcpy(&segment->stats, &copy, sizeof(LiveStats_t));
+    __atomic_store_n(&segment->seq, seq + 2, __ATOMIC_RELEASE);
+}
+
+/***********************************************************************************************/ /**
+ *  \brief  Map a tester's segment read-only.
+ *  \param[in] name Segment name given to the tester.
+ *  \return  0 on success, -1 when there is no segment or it is from another version.
+ **************************************************************************************************/
+int live_stats_attach(const char *name)
+{
+    struct stat st;
+    void *map;
+    int fd = shm_open(name, O_RDONLY, 0);
+
+    if (fd < 0) {
+        return -1;
+    }
+    if ((fstat(fd, &st) < 0) || (st.st_size < (off_t)sizeof(LiveStatsSegment_t))) {
+        close(fd);
+        return -1;
+    }
+    map = mmap(NULL, sizeof(LiveStatsSegment_t), PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) {
+        return -1;
+    }
+
+    view = map;
+    if ((__atomic_load_n(&view->magic, __ATOMIC_ACQUIRE) != LIVE_STATS_MAGIC)
+        || (view->version != LIVE_STATS_VERSION) || (view->size != sizeof(LiveStatsSegment_t))) {
+        live_stats_detach();
+        return -1;
+    }
+    return 0;
+}
+
+void live_stats_detach(void)
+{
+    if (view != NULL) {
+        munmap((void *)view, sizeof(LiveStatsSegment_t));
+        view = NULL;
+    }
+}
+
+/***********************************************************************************************/ /**
+ *  \brief  Copy out the latest consistent snapshot.
+ *  \param[out] stats Snapshot.
+ *  \return  false without a mapped segment or when every attempt overlapped an update.
+ **************************************************************************************************/
+bool live_stats_read(LiveStats_t *stats)
+{
+    if (view == NULL) {
+        return false;
+    }
+    for (uint32_t i = 0; i < LIVE_STATS_READ_TRIES; i++) {
+        uint32_t begin = __atomic_load_n(&view->seq, __ATOMIC_ACQUIRE);
+
+        if (begin & 1) {
+            sched_yield(); // Update in progress, let the writer finish it if it shares our CPU.
+            continue;
+        }
+        memcpy(stats, (const void *)&view->stats, sizeof(LiveStats_t));
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        if (__atomic_load_n(&view->seq, __ATOMIC_RELAXED) == begin) {
+            return true;
+        }
+    }
+    return false;
+}
+
+/***************************************************************************************************
+ * Static Function Definitions
+ **************************************************************************************************/
+
+// Whether the process that created an existing segment under the name is still running.
+static bool owner_alive(const char *name)
+{
+    LiveStats_t stats;
+    bool alive = false;
+
+    if (live_stats_attach(name) < 0) {
+        return false;
+    }
+    if (live_stats_read(&stats) && (stats.pid != 0) && ((pid_t)stats.pid != getpid())) {
+        alive = (kill((pid_t)stats.pid, 0) == 0) || (errno == EPERM);
+    }
+    live_stats_detach();
+    return alive;
+}
+#endif
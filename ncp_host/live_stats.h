@@ -0,0 +1,80 @@
+/***********************************************************************************************/ /**
+ * \file   live_stats.h
+ * \brief  Live counters of a running test in POSIX shared memory, for monitors such as tt_top
+ **************************************************************************************************/
+
+#ifndef LIVE_STATS_H
+#define LIVE_STATS_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#define LIVE_STATS_MAGIC        0x54534C54u // "TLST"
+#define LIVE_STATS_VERSION      1
+#define LIVE_STATS_RSSI_UNKNOWN 127
+
+/***************************************************************************************************
+ * Type Definitions
+ **************************************************************************************************/
+// One snapshot of the tester. Fixed width fields only, readers are separate programs.
+typedef struct {
+    uint64_t updatedUs;         // Writer's monotonic clock at the last update
+    uint32_t pid;               // Writer process
+    uint8_t state;              // State_t of app.h
+    uint8_t mode;               // Test mode, as -m
+    uint8_t connected;
+    uint8_t measuring;          // Data run in progress
+    uint8_t phy;
+    int8_t rssi;                // Last reported, LIVE_STATS_RSSI_UNKNOWN before the first report
+    uint16_t interval;          // 1.25 ms units
+    uint16_t slaveLatency;
+    uint16_t supervisionTimeout; // 10 ms units
+    uint16_t mtu;
+    uint16_t pdu;
+    uint16_t cmdLastError;
+    double seconds;             // Into the run in progress, or length of the last run
+    uint64_t bytes;
+    uint32_t operations;
+    uint32_t windowThroughput;  // bps over the last full window of the run
+    uint32_t throughput;        // bps since the run started
+    uint32_t runs;
+    uint32_t roundTrips;
+    uint32_t pingsLost;
+    uint32_t setupTimeouts;
+    uint32_t cmdDeferred;
+    uint32_t cmdRetries;
+    uint32_t cmdDropped;
+} LiveStats_t;
+
+// Layout of the shared memory segment. seq is odd while the writer is in the middle of an update.
+typedef struct {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t size;              // sizeof(LiveStatsSegment_t) of the writer
+    uint32_t seq;
+    LiveStats_t stats;
+} LiveStatsSegment_t;
+
+/***************************************************************************************************
+ * Function Declarations
+ **************************************************************************************************/
+// Writer. Names are shm_open() names, e.g. "/tt0".
+int live_stats_open(const char *name);
+void live_stats_close(void);
+bool live_stats_due(void);
+void live_stats_publish(const LiveStats_t *stats);
+
+// Reader. Maps the segment read-only, readers never hold up the writer.
+int live_stats_attach(const char *name);
+void live_stats_detach(void);
+bool live_stats_read(LiveStats_t *stats);
+
+#ifdef __cplusplus
+};
+#endif
+
+#endif /* LIVE_STATS_H */
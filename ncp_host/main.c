@@ -1,328 +1,920 @@
-/* Throughput tester NCP example application*/
-
-#include <stdlib.h>
-#include <stdio.h>
-#include <stdint.h>
-#include <errno.h>
-#include <string.h>
-#include <unistd.h>
-#include <signal.h>
-#include "infrastructure.h"
-
-/* BG stack headers */
-#include "gecko_bglib.h"
-
-/* hardware specific headers */
-#include "uart.h"
-
-/* application specific files */
-#include "app.h"
-
-/***************************************************************************************************
- * Local Macros and Definitions
- **************************************************************************************************/
-BGLIB_DEFINE();
-
-// The default baud rate to use.
-const uint32_t DEFAULT_BAUD_RATE = 115200;
-// The serial port to use for BGAPI communication.
-static char *uartPort = NULL;
-// The baud rate to use.
-static uint32_t baudRate = 0;
-// Enable flow control by default.
-static uint32_t flowControl = 1;
-static volatile int userKeyboardInterrupt = 0;
-
-// Test parameters structure default values.
-// 50 ms interval, 1M PHY, 250B MTU, Notifications, Free Mode.
-TestParameters_t params = {
-  .connection_interval = 40,
-  .phy = 1,
-  .mtu_size = 250,
-  .client_conf_flag = 1,
-  .mode = 3,
-  .fixed_time = 0,
-  .fixed_amount = 0
-};
-
-/***************************************************************************************************
- * Static Function Declarations
- **************************************************************************************************/
-
-static int init_serialport(int argc, char *argv[], int32_t timeout);
-static void on_message_send(uint32_t msg_len, uint8_t *msg_data);
-// Get CTRL+C interrupt signal and toggle flag.
-static void sighandler(int sig) { userKeyboardInterrupt = 1; }
-static void usage(void);
-static void help(void);
-static void handle_user_input(void);
-static void parse_commands(int argc, char *argv[]);
-
-/***************************************************************************************************
- * Public Function Definitions
- **************************************************************************************************/
-
-/***********************************************************************************************/ /**
- *  \brief  The main program.
- *  \param[in] argc Argument count.
- *  \param[in] argv Buffer contaning Serial Port data.
- *  \return  0 on success, -1 on failure.
- **************************************************************************************************/
-int main(int argc, char *argv[])
-{
-  struct gecko_cmd_packet *evt;
-  signal(SIGINT, sighandler); // Setup interrupt handler.
-  /* Initialize BGLIB with our output function for sending messages. */
-  BGLIB_INITIALIZE_NONBLOCK(on_message_send, uartRx, uartRxPeek);
-
-  /* Initialise serial communication as non-blocking. */
-  if (init_serialport(argc, argv, 100) < 0) {
-    printf("Non-blocking serial port init failure\n");
-    exit(EXIT_FAILURE);
-  }
-
-  fflush(stdout);
-
-  printf("\n\nStarting up...\nResetting NCP target...\n");
-
-  /* Reset NCP to ensure it gets into a defined state.
-   * Once the chip successfully boots, gecko_evt_system_boot_id event should be received. */
-  gecko_cmd_system_reset(0);
-
-  while (1) {
-    if (userKeyboardInterrupt) {
-      if (params.mode == 3) { // CTRL+C quits free mode straight away.
-        gecko_cmd_system_reset(0);
-        uartClose();
-        printf("Exiting program from free mode...\n\n");
-        exit(0);
-      } else {
-        handle_user_input();
-      }
-    }
-    // Check for stack event.
-    evt = gecko_peek_event();
-
-    // Run application and event handler.
-    // Return value is 1 if user input is needed after one-shot test run, default 0.
-    if (app_handle_events(evt, &params) == 1) {
-      handle_user_input();
-    }
-  }
-
-  return -1;
-}
-
-
-/***************************************************************************************************
- * Static Function Definitions
- **************************************************************************************************/
-
-/***********************************************************************************************/ /**
- *  \brief  Serial Port initialisation routine.
- *  \param[in] argc Argument count.
- *  \param[in] argv Buffer contaning Serial Port data.
- *  \return  0 on success, -1 on failure.
- **************************************************************************************************/
-static int init_serialport(int argc, char *argv[], int32_t timeout)
-{
-  // Handle the command-line arguments.
-  baudRate = DEFAULT_BAUD_RATE;
-  parse_commands(argc, argv);
-
-  if (!uartPort || !baudRate || (flowControl > 1)) {
-    usage();
-    exit(EXIT_FAILURE);
-  }
-
-  /* Initialise the serial port with RTS/CTS enabled. */
-  return uartOpen((int8_t *)uartPort, baudRate, flowControl, timeout);
-}
-/***********************************************************************************************/ /**
- *  \brief  Function called when a message needs to be written to the serial port.
- *  \param[in] msg_len Length of the message.
- *  \param[in] msg_data Message data, including the header.
- **************************************************************************************************/
-static void on_message_send(uint32_t msg_len, uint8_t *msg_data)
-{
-  // Variable for storing function return values.
-  int32_t ret;
-
-  ret = uartTx(msg_len, msg_data);
-  if (ret < 0) {
-    printf("Failed to write to serial port %s, ret: %d, errno: %d\n", uartPort, ret, errno);
-    exit(EXIT_FAILURE);
-  }
-}
-
-// Command line interface help message utility functions
-static void usage(void)
-{
-  printf("Examples of usage:\n");
-  printf("  throughput.exe -p COM11\n");                                                  // Default, free mode, 1M phy
-  printf("  throughput.exe -p COM11 -m 1 5\n");                                           // Fixed time 5 seconds
-  printf("  throughput.exe -p COM11 -m 2 50000\n");                                       // Fixed amount 50 kB
-  printf("  throughput.exe -p COM11 --params 2 25 240 1\n");                              // Free mode with 2M phy and different interval and MTU
-  printf("  throughput.exe -p COM11 -b 2000000 -f 1 -m 1 5 --params 1 50 250 1\n");
-  printf("  throughput.exe -p COM11 -b 2000000 -f 1 -m 2 100000 --params 2 25 250 1\n");  // Different modes and PHYs with full verbosity
-  printf("  throughput.exe -p COM11 -b 2000000 -f 1 -m 3 --params 4 200 250 2\n");
-  printf("  throughput.exe -h \n\n");
-}
-
-static void help(void)
-{
-  printf("\nHelp:\n");
-  printf("-p <port>       - COM port e.g. COM11 \n");
-  printf("-b <baudRate>   - Baud rate.\n");
-  printf("                  Default %u b/s.\n", DEFAULT_BAUD_RATE);
-  printf("-f <1/0>        - Enable/Disable flow control. Enabled by default (1).\n");
-  printf("-m <1/2/3>      - Transmission mode.\n");
-  printf("1=fixed time in seconds, 2=fixed data amount in bytes, 3=free mode using buttons on slave.\n");
-  printf("--params        - Connection parameters <phy 1=1M/2=2M/4=LE Coded (S8) > <connection interval [ms]> <mtu size [B]> <1=notify/2=indicate>\n");
-  printf("                  Defaults: 1, 50 ms, 250B, 1=notifications/2=indications\n");
-  printf("-h              - Help\n\n");
-  usage();
-  exit(EXIT_SUCCESS);
-}
-
-// Prompt user to exit or boot and start a new scan.
-static void handle_user_input(void)
-{
-  char command[64];
-  printf("\n\nRun the test again? (run/exit)>");
-
-  fgets(command, sizeof(command) - 2, stdin);
-  fflush(stdin);
-
-  if (strncmp(command, "exit\n", 5) == 0) {
-    gecko_cmd_system_reset(0);
-    uartClose();
-    exit(0);
-  } else if (strncmp(command, "run\n", 4) == 0) {
-    gecko_cmd_le_gap_end_procedure();
-    gecko_cmd_system_reset(0); // Go to regular boot and start scanning again.
-  } else {
-    printf("Invalid command: %s\n", command);
-    handle_user_input();
-  }
-
-  if (signal(SIGINT, &sighandler) == SIG_ERR) {
-    printf("\nCan't catch SIGINT\n");
-  }
-  userKeyboardInterrupt = 0;
-}
-
-/***********************************************************************************************/ /**
- *  \brief  Command line parser for additional parameters
- *  \param[in] argc Argument count.
- *  \param[in] argv Buffer contaning .
- **************************************************************************************************/
-static void parse_commands(int argc, char *argv[]) 
-{
-  if (argc == 1) {
-    help();
-  }
-
-  for (uint8_t i = 1; i < argc; i++)
-  { // 0th argument is name of executable so start at 1st.
-    if (argv[i][0] == '-') { // -flag.
-      // Port
-      if (argv[i][1] == 'p') {
-        if (argv[i + 1]) {
-          uartPort = argv[i + 1];
-        }
-        // Baud rate
-      } else if (argv[i][1] == 'b') {
-        if (argv[i + 1]) {
-          baudRate = atoi(argv[i + 1]);
-        }
-        // Flow control
-      } else if (argv[i][1] == 'f') {
-        if (argv[i + 1]) {
-          flowControl = atoi(argv[i + 1]);
-        }
-        // Transimission Mode
-      } else if (argv[i][1] == 'm') {
-        // Assign mode
-        if (argv[i + 1]) {
-          if ((atoi(argv[i + 1]) == 1) || (atoi(argv[i + 1]) == 2) || (atoi(argv[i + 1]) == 3)) {
-            params.mode = atoi(argv[i + 1]);
-            if (params.mode == 1) { // Fixed modes take the time or amount as argument so check for that.
-              if (argv[i + 2]) {
-                if ((atoi(argv[i + 2]) >= 1) && (atoi(argv[i + 2]) < 600)) { // Between 1s and 10min
-                  params.fixed_time = atoi(argv[i + 2]);
-                } else {
-                  printf("Fixed time has invalid type or exceeds interval 1s - 10 min.\n");
-                  exit(EXIT_FAILURE);
-                }
-              } else {
-                printf("Please input a valid time parameter.\n");
-                exit(EXIT_FAILURE);
-              }
-            } else if (params.mode == 2) {
-              if (argv[i + 2]) {
-                if ((atoi(argv[i + 2]) >= 1000) && (atoi(argv[i + 2]) < 10000000)) { // Between 1k and 10M.
-                  params.fixed_amount = atoi(argv[i + 2]);
-                } else {
-                  printf("Fixed amount has invalid type or exceeds interval 1k - 10M.\n");
-                  exit(EXIT_FAILURE);
-                }
-              } else {
-                printf("Please input a valid data amount parameter.\n");
-                exit(EXIT_FAILURE);
-              }
-            }
-          } else {
-            printf("Mode must be one of these: 1 = fixed transmit time , 2 = fixed transmit data, 3 = free mode with buttons.\n");
-            exit(EXIT_FAILURE);
-          }
-        }
-      } else if (argv[i][1] == '-') {
-        // --flags
-        if (strncmp(&argv[i][2], "params", 6) == 0) {
-          // Assign test parameters.
-          if (argv[i + 1]) {
-            if ((atoi(argv[i + 1]) == 1) || (atoi(argv[i + 1]) == 2) || (atoi(argv[i + 1]) == 4)) {
-              params.phy = atoi(argv[i + 1]);
-              if (argv[i + 2]) {
-                if (atoi(argv[i + 2]) >= 20) {
-                  // User input is in ms, but value is passed as (ms / 1.25)
-                  params.connection_interval = (uint16_t)(((float)atoi(argv[i + 2])) / 1.25);
-                  if (argv[i + 3]) {
-                    if ((atoi(argv[i + 3]) >= 23) && (atoi(argv[i + 3]) <= 250)) {
-                      params.mtu_size = atoi(argv[i + 3]);
-                      if (argv[i + 4]) {
-                        if ((atoi(argv[i + 4]) == 1) || (atoi(argv[i + 4]) == 2)) {
-                          params.client_conf_flag = atoi(argv[i + 4]);
-                        } else {
-                          printf("Wrong Client Characteristic Configuration argument. Must be 1 for notification or 2 for indication\n");
-                          exit(EXIT_FAILURE);
-                        }
-                      }
-                    } else {
-                      printf("MTU size must be between 23 and 250.\n");
-                      exit(EXIT_FAILURE);
-                    }
-                  }
-                } else {
-                  printf("Connection interval should be above 20 (20 * 1.25 = 25 ms).\n");
-                  exit(EXIT_FAILURE);
-                }
-              }
-            } else {
-              printf("PHY must be one of these: 1 = 1M, 2 = 2M, 4 = 125k\n");
-              exit(EXIT_FAILURE);
-            }
-          }
-        }
-        // Show help
-      } else if (argv[i][1] == 'h') {
-        help();
-        exit(EXIT_SUCCESS);
-      } else {
-        usage();
-        exit(EXIT_FAILURE);
-      }
-    }
-  }
-}
+/* Throughput tester NCP example application*/
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+#include <signal.h>
+#include "infrastructure.h"
+
+/* BG stack headers */
+#include "gecko_bglib.h"
+
+/* hardware specific headers */
+#include "uart.h"
+
+/* application specific files */
+#include "app.h"
+#include "capture.h"
+#include "rx_queue.h"
+#include "console.h"
+#include "channel_plan.h"
+#include "tx_power_plan.h"
+#include "payload_trace.h"
+#include "daemon.h"
+#include "live_stats.h"
+#include "metrics.h"
+
+/***************************************************************************************************
+ * Local Macros and Definitions
+ **************************************************************************************************/
+BGLIB_DEFINE();
+
+// The default baud rate to use.
+const uint32_t DEFAULT_BAUD_RATE = 115200;
+// The serial port to use for BGAPI communication.
+static char *uartPort = NULL;
+// The baud rate to use.
+static uint32_t baudRate = 0;
+// Enable flow control by default.
+static uint32_t flowControl = 1;
+static volatile int userKeyboardInterrupt = 0;
+// Capture file to record serial traffic into, or to replay instead of a serial port.
+static char *recordPath = NULL;
+static char *replayPath = NULL;
+static bool replayRealtime = false;
+// CPU for the serial RX thread.
+static int rxCpu = RX_CPU_AUTO;
+// Channel subsets for fixed time mode, AFH state of the NCP firmware and where to append the profile.
+static char *channelSpec = NULL;
+static ChannelAfh_t channelAfh = ChannelAfh_Unknown;
+static char *channelCsvPath = NULL;
+static ChannelPlan_t channelPlan;
+// TX power levels for fixed time mode and the throughput the lowest level has to reach.
+static char *txPowerSpec = NULL;
+static uint32_t txPowerTarget = 0;
+static TxPowerPlan_t txPowerPlan;
+// Notification size mix or size and inter-arrival trace pushed to the slave.
+static char *payloadMixSpec = NULL;
+static char *payloadTracePath = NULL;
+static PayloadSchedule_t payloadSchedule;
+// Stream weights and probe interval, streams are off without weights.
+static char *streamSpec = NULL;
+static int streamProbeMs = 0;
+static StreamConfig_t streamConfig;
+// Slave RTCC stamps fitted against the host clock.
+static bool clockSync = false;
+static char *flightCsvPath = NULL;
+// Gaps between received packets, in connection intervals, and the gap that flags a run as stalled.
+static int gapMultiple = GAP_DEFAULT_MULTIPLE;
+static int gapFlagMs = GAP_DEFAULT_FLAG_MS;
+// Control socket of daemon mode, and whether the NCP is booted with the last test ended cleanly.
+static char *daemonPath = NULL;
+static bool daemonNcpReady = false;
+// Shared memory segment and OpenMetrics port for live counters, the window of their throughput
+// and the RSSI polling.
+static char *liveStatsName = NULL;
+static uint16_t metricsPort = 0;
+static uint32_t liveWindowThroughput = 0;
+static bool liveMeasuring = false;
+static uint32_t liveUpdates = 0;
+#define LIVE_STATS_WINDOW_MS    1000
+#define LIVE_STATS_RSSI_EVERY   20      // Updates between RSSI requests, once a second
+// Tester state, the CLI is a client of the same library other programs link against.
+static AppContext_t app;
+
+// Test parameters structure default values.
+// 50 ms interval, 1M PHY, 250B MTU, Notifications, Free Mode.
+TestParameters_t params = {
+  .connection_interval = 40,
+  .phy = 1,
+  .mtu_size = 250,
+  .client_conf_flag = 1,
+  .mode = 3,
+  .fixed_time = 0,
+  .fixed_amount = 0,
+  .ping_count = 1000
+};
+
+/***************************************************************************************************
+ * Static Function Declarations
+ **************************************************************************************************/
+
+static int init_serialport(int argc, char *argv[], int32_t timeout);
+static void on_message_send(uint32_t msg_len, uint8_t *msg_data);
+static int32_t record_rx(uint32_t len, uint8_t *data);
+static int32_t replay_rx(uint32_t len, uint8_t *data);
+// Get CTRL+C interrupt signal and toggle flag.
+static void sighandler(int sig) { userKeyboardInterrupt = 1; }
+static void usage(void);
+static void help(void);
+static int parse_stream_weights(StreamConfig_t *config, const char *spec);
+static void handle_user_input(void);
+static void serve_daemon(void);
+static void on_result(void *user, const TestResult_t *result);
+static void on_window(void *user, const AppWindow_t *window);
+static void publish_progress(void);
+static void parse_commands(int argc, char *argv[]);
+
+/***************************************************************************************************
+ * Public Function Definitions
+ **************************************************************************************************/
+
+/***********************************************************************************************/ /**
+ *  \brief  The main program.
+ *  \param[in] argc Argument count.
+ *  \param[in] argv Buffer contaning Serial Port data.
+ *  \return  0 on success, -1 on failure.
+ **************************************************************************************************/
+int main(int argc, char *argv[])
+{
+  struct gecko_cmd_packet *evt;
+  const AppCallbacks_t callbacks = { .result = on_result };
+
+  signal(SIGINT, sighandler); // Setup interrupt handler.
+  app_init(&app, &callbacks);
+
+  /* Initialise serial communication as non-blocking. */
+  if (init_serialport(argc, argv, 100) < 0) {
+    printf("Non-blocking serial port init failure\n");
+    exit(EXIT_FAILURE);
+  }
+
+  /* Initialize BGLIB with our output function for sending messages.
+   * A replayed capture is read directly. Otherwise the RX thread reads the UART, optionally teed
+   * into a capture, and BGLIB takes whole frames from its queue. */
+  if (replayPath) {
+    BGLIB_INITIALIZE_NONBLOCK(on_message_send, replay_rx, capture_replay_rx_peek);
+  } else {
+    if (rx_thread_start(recordPath ? record_rx : uartRx, rxCpu) < 0) {
+      printf("Could not start serial RX thread\n");
+      exit(EXIT_FAILURE);
+    }
+    atexit(rx_thread_stop);
+    BGLIB_INITIALIZE_NONBLOCK(on_message_send, rx_queue_input, rx_queue_peek);
+  }
+
+  // Console output is written out by its own thread from here on.
+  console_start();
+
+  fflush(stdout);
+
+  if (liveStatsName || metricsPort) {
+    const AppCallbacks_t liveCallbacks = { .window = on_window, .result = on_result, .windowMs = LIVE_STATS_WINDOW_MS };
+
+    if (liveStatsName) {
+      if (live_stats_open(liveStatsName) < 0) {
+        printf("Could not create live statistics %s, another tester may be using the name.\n", liveStatsName);
+        exit(EXIT_FAILURE);
+      }
+      atexit(live_stats_close);
+    }
+    if (metricsPort) {
+      if (metrics_start(metricsPort) < 0) {
+        printf("Could not serve metrics on 127.0.0.1:%u\n", metricsPort);
+        exit(EXIT_FAILURE);
+      }
+      atexit(metrics_stop);
+    }
+    app_set_callbacks(&app, &liveCallbacks);
+  }
+
+  if (daemonPath) {
+    if (daemon_open(daemonPath, &params) < 0) {
+      printf("Could not listen on %s\n", daemonPath);
+      exit(EXIT_FAILURE);
+    }
+    atexit(daemon_close);
+    // Booting starts a test, so the NCP is reset when the first request arrives.
+    printf("\n\nDaemon listening on %s\n", daemonPath);
+  } else {
+    printf("\n\nStarting up...\nResetting NCP target...\n");
+
+    /* Reset NCP to ensure it gets into a defined state.
+     * Once the chip successfully boots, gecko_evt_system_boot_id event should be received. */
+    app_start(&app, &params);
+  }
+
+  while (1) {
+    if (replayPath && capture_replay_finished()) {
+      capture_replay_summary();
+      exit(0);
+    }
+
+    if (rx_thread_failed()) {
+      printf("Failed to read from serial port %s, errno: %d\n", uartPort, errno);
+      exit(EXIT_FAILURE);
+    }
+
+    if (daemonPath) {
+      serve_daemon();
+    } else if (userKeyboardInterrupt) {
+      if (params.mode == 3) { // CTRL+C quits free mode straight away.
+        gecko_cmd_system_reset(0);
+        uartClose();
+        printf("Exiting program from free mode...\n\n");
+        exit(0);
+      } else {
+        handle_user_input();
+      }
+    }
+    // Check for stack event. Timing uses the time the event arrived on the serial port.
+    evt = gecko_peek_event();
+    if (evt && !replayPath) {
+      uint64_t arrivalUs;
+      if (rx_queue_pop_event_time(&arrivalUs)) {
+        app_set_event_time(&app, arrivalUs);
+      }
+    }
+
+    // Run application and event handler.
+    // Return value is 1 if user input is needed after one-shot test run, default 0.
+    if ((app_handle_events(&app, evt, &params) == 1) && !daemonPath) {
+      handle_user_input();
+    }
+
+    if ((liveStatsName || metricsPort) && live_stats_due()) {
+      publish_progress();
+    }
+  }
+
+  return -1;
+}
+
+
+/***************************************************************************************************
+ * Static Function Definitions
+ **************************************************************************************************/
+
+/***********************************************************************************************/ /**
+ *  \brief  Serial Port initialisation routine.
+ *  \param[in] argc Argument count.
+ *  \param[in] argv Buffer contaning Serial Port data.
+ *  \return  0 on success, -1 on failure.
+ **************************************************************************************************/
+static int init_serialport(int argc, char *argv[], int32_t timeout)
+{
+  // Handle the command-line arguments.
+  baudRate = DEFAULT_BAUD_RATE;
+  parse_commands(argc, argv);
+
+  // A replayed capture stands in for the serial port.
+  if (replayPath) {
+    if (capture_replay_open(replayPath, replayRealtime) < 0) {
+      printf("Could not load capture %s\n", replayPath);
+      exit(EXIT_FAILURE);
+    }
+    atexit(capture_close);
+    return 0;
+  }
+
+  if (!uartPort || !baudRate || (flowControl > 1)) {
+    usage();
+    exit(EXIT_FAILURE);
+  }
+
+  if (recordPath) {
+    if (capture_record_open(recordPath) < 0) {
+      printf("Could not create capture %s\n", recordPath);
+      exit(EXIT_FAILURE);
+    }
+    atexit(capture_close); // Flushes the capture on every exit path.
+  }
+
+  /* Initialise the serial port with RTS/CTS enabled. */
+  return uartOpen((int8_t *)uartPort, baudRate, flowControl, timeout);
+}
+/***********************************************************************************************/ /**
+ *  \brief  Function called when a message needs to be written to the serial port.
+ *  \param[in] msg_len Length of the message.
+ *  \param[in] msg_data Message data, including the header.
+ **************************************************************************************************/
+static void on_message_send(uint32_t msg_len, uint8_t *msg_data)
+{
+  // Variable for storing function return values.
+  int32_t ret;
+
+  if (replayPath) {
+    capture_replay_tx(msg_len, msg_data);
+    return;
+  }
+
+  ret = uartTx(msg_len, msg_data);
+  if (ret < 0) {
+    printf("Failed to write to serial port %s, ret: %d, errno: %d\n", uartPort, ret, errno);
+    exit(EXIT_FAILURE);
+  }
+  capture_record(Capture_TX, msg_len, msg_data);
+}
+
+// UART input function that tees everything read into the capture file.
+static int32_t record_rx(uint32_t len, uint8_t *data)
+{
+  int32_t ret = uartRx(len, data);
+
+  if (ret > 0) {
+    capture_record(Capture_RX, (uint32_t)ret, data);
+  }
+  return ret;
+}
+
+// Replay input function. Hands over to the main loop for the summary when the capture runs out.
+static int32_t replay_rx(uint32_t len, uint8_t *data)
+{
+  int32_t ret = capture_replay_rx(len, data);
+
+  if (ret < 0) {
+    capture_replay_summary();
+    exit(0);
+  }
+  return ret;
+}
+
+// Command line interface help message utility functions
+static void usage(void)
+{
+  printf("Examples of usage:\n");
+  printf("  throughput.exe -p COM11\n");                                                  // Default, free mode, 1M phy
+  printf("  throughput.exe -p COM11 -m 1 5\n");                                           // Fixed time 5 seconds
+  printf("  throughput.exe -p COM11 -m 2 50000\n");                                       // Fixed amount 50 kB
+  printf("  throughput.exe -p COM11 --params 2 25 240 1\n");                              // Free mode with 2M phy and different interval and MTU
+  printf("  throughput.exe -p COM11 -b 2000000 -f 1 -m 1 5 --params 1 50 250 1\n");
+  printf("  throughput.exe -p COM11 -b 2000000 -f 1 -m 2 100000 --params 2 25 250 1\n");  // Different modes and PHYs with full verbosity
+  printf("  throughput.exe -p COM11 -b 2000000 -f 1 -m 3 --params 4 200 250 2\n");
+  printf("  throughput.exe -p COM11 -m 4 1000 --params 2 25 250 1\n");                      // 1000 round trips on 2M PHY
+  printf("  throughput.exe -p COM11 -m 5 30\n");                                          // Count broadcasts for 30 seconds
+  printf("  throughput.exe -p COM11 -m 1 5 --record session.ttcap\n");                     // Record serial traffic of a run
+  printf("  throughput.exe -m 1 5 --replay session.ttcap\n");                              // Rerun the capture as fast as possible
+  printf("  throughput.exe -p COM11 -m 1 5 --channels 0-9,10-19,20-36 --afh 0\n");         // 5 seconds on each channel subset
+  printf("  throughput.exe -p COM11 -m 1 5 --tx-power 10,5,0,-10 --tx-target 500000\n");   // 5 seconds on each TX power level
+  printf("  throughput.exe -p COM11 -m 1 5 --payload-mix 20:80,240:20\n");                // 80 % small and 20 % large notifications
+  printf("  throughput.exe -p COM11 -m 1 10 --payload-trace sensor.txt\n");               // Replay packet sizes and gaps of a trace
+  printf("  throughput.exe -p COM11 -m 1 10 --streams 1,1,1 --stream-probe 20\n");       // Three equal streams and a latency probe
+  printf("  throughput.exe -p COM11 -m 1 60 --clock-sync\n");                             // Slave clock drift and both results on the host clock
+  printf("  throughput.exe -p COM11 -m 1 30 --flight-recorder flight.csv\n");             // Slave send events of each run
+  printf("  throughput.exe -p COM11 -m 1 60 --gap-multiple 2 --gap-flag 100\n");           // Stricter stall detection
+  printf("  throughput.exe -p /dev/ttyACM0 --params 2 25 247 1 --daemon /tmp/tt.sock\n");  // Take tests over a control socket
+  printf("  throughput.exe -p /dev/ttyACM0 -m 1 30 --live-stats /tt0\n");                  // Watch with tt_top /tt0
+  printf("  throughput.exe -p /dev/ttyACM0 --daemon /tmp/tt.sock --metrics 9464\n");        // Scrape http://127.0.0.1:9464/metrics
+  printf("  throughput.exe -h \n\n");
+}
+
+static void help(void)
+{
+  printf("\nHelp:\n");
+  printf("-p <port>       - COM port e.g. COM11 \n");
+  printf("-b <baudRate>   - Baud rate.\n");
+  printf("                  Default %u b/s.\n", DEFAULT_BAUD_RATE);
+  printf("-f <1/0>        - Enable/Disable flow control. Enabled by default (1).\n");
+  printf("-m <1/2/3/4/5>  - Transmission mode.\n");
+  printf("1=fixed time in seconds, 2=fixed data amount in bytes, 3=free mode using buttons on slave,\n");
+  printf("4=round trip latency, followed by the number of pings (default 1000),\n");
+  printf("5=connectionless, count broadcasts of a SoC broadcaster for the given seconds (default 10).\n");
+  printf("--params        - Connection parameters <phy 1=1M/2=2M/4=LE Coded (S8) > <connection interval [ms]> <mtu size [B]> <1=notify/2=indicate>\n");
+  printf("                  Defaults: 1, 50 ms, 250B, 1=notifications/2=indications\n");
+  printf("--record <file> - Record all serial traffic with timestamps into a capture file.\n");
+  printf("--replay <file> - Replay a capture instead of opening a serial port. Use the same test options as the recording.\n");
+  printf("--realtime      - Replay at the recorded pace instead of as fast as possible.\n");
+  printf("--rx-cpu <n>    - Pin the serial RX thread to CPU n, -1 to leave it unpinned. Linux only.\n");
+  printf("                  Default is the last online CPU.\n");
+  printf("--channels <s>  - Fixed time mode only. One run per data channel subset, then a per-channel profile.\n");
+  printf("                  Subsets separated by ',', ranges joined by '+', e.g. 0-9,10-19,20-36 or 0+20,1+21.\n");
+  printf("                  'pairs' runs neighbouring channel pairs. At least 2 channels per subset.\n");
+  printf("--afh <1/0>     - Whether the NCP firmware has AFH enabled, recorded with the profile for comparison.\n");
+  printf("--channel-csv <file> - Append the per-channel profile to a CSV file.\n");
+  printf("--tx-power <l>  - Fixed time mode only. One run per TX power level in dBm on both sides, e.g. 10,5,0,-10.\n");
+  printf("                  Set powers, RSSI and throughput are printed per level.\n");
+  printf("--tx-target <bps> - Report the lowest TX power level that still reaches this throughput.\n");
+  printf("--payload-mix <m> - Notification sizes drawn at random by weight, size:weight pairs e.g. 20:80,240:20.\n");
+  printf("                  At most %u sizes, weights 1-255.\n", PAYLOAD_MIX_MAX_BINS);
+  printf("--payload-trace <file> - Notification sizes and gaps replayed from a file, one \"<size> <gap us>\" line per packet.\n");
+  printf("                  At most %u packets, looped until the run ends.\n", PAYLOAD_TRACE_MAX);
+  printf("--streams <w>   - Notifications spread over several stream characteristics by weight, e.g. 1,1,1 or 4,1.\n");
+  printf("                  Throughput, share and queueing delay are printed per stream.\n");
+  printf("--stream-probe <ms> - Add a small probe notification on its own stream every ms, sent ahead of the bulk data.\n");
+  printf("                  At most %u streams including the probe.\n", STREAM_MAX);
+  printf("--clock-sync    - Have the slave stamp its data with its RTCC count and fit it against the host clock.\n");
+  printf("                  Drift, offset and the slave result on the host clock are printed after each run.\n");
+  printf("--flight-recorder <csv> - Dump the slave's record of its last %u send events after each run, print a summary\n", FLIGHT_RECORDER_RECORDS);
+  printf("                  of failures and gaps and append the events to csv.\n");
+  printf("--gap-multiple <n> - Count pauses longer than n connection intervals between received packets as gaps,\n");
+  printf("                  default %u. Gap count, stalled time and the longest gap are in every result.\n", GAP_DEFAULT_MULTIPLE);
+  printf("--gap-flag <ms> - Flag runs with a gap at least this long as stalled, default %u ms, 0 for any gap.\n", GAP_DEFAULT_FLAG_MS);
+  printf("--daemon <path> - Keep the NCP booted and run tests requested over a Unix domain socket, one JSON object per line,\n");
+  printf("                  e.g. {\"id\":\"a\",\"mode\":1,\"time\":5,\"phy\":2}. Other options give the defaults. Not on Windows.\n");
+  printf("--live-stats <name> - Publish live counters to POSIX shared memory under name, e.g. /tt0, for tt_top and\n");
+  printf("                  other monitors. The RSSI is requested once a second while connected. Not on Windows.\n");
+  printf("--metrics <port> - Serve OpenMetrics text at http://127.0.0.1:port/metrics from a separate thread.\n");
+  printf("                  The RSSI is polled as with --live-stats. Not on Windows.\n");
+  printf("-h              - Help\n\n");
+  usage();
+  exit(EXIT_SUCCESS);
+}
+
+// Prompt user to exit or boot and start a new scan.
+static void handle_user_input(void)
+{
+  char command[64];
+  printf("\n\nRun the test again? (run/reset/exit)>");
+  fflush(stdout);
+
+  fgets(command, sizeof(command) - 2, stdin);
+  fflush(stdin);
+
+  if (strncmp(command, "exit\n", 5) == 0) {
+    gecko_cmd_system_reset(0);
+    uartClose();
+    exit(0);
+  } else if (strncmp(command, "run\n", 4) == 0) {
+    app_rerun(&app, &params); // Reuse connection, peer address and GATT handles where possible.
+  } else if (strncmp(command, "reset\n", 6) == 0) {
+    gecko_cmd_le_gap_end_procedure();
+    gecko_cmd_system_reset(0); // Go to regular boot and start scanning again.
+  } else {
+    printf("Invalid command: %s\n", command);
+    handle_user_input();
+  }
+
+  if (signal(SIGINT, &sighandler) == SIG_ERR) {
+    printf("\nCan't catch SIGINT\n");
+  }
+  userKeyboardInterrupt = 0;
+}
+
+// Results of the daemon's tests go back to the client that asked for them.
+static void on_result(void *user, const TestResult_t *result)
+{
+  if (daemonPath && daemon_running()) {
+    daemon_done(result);
+    daemonNcpReady = true;
+  }
+}
+
+static void on_window(void *user, const AppWindow_t *window)
+{
+  liveWindowThroughput = window->throughput;
+}
+
+// Hand the tester's progress to the live statistics segment and the metrics endpoint.
+// Called every LIVE_STATS_PERIOD_US at most.
+static void publish_progress(void)
+{
+  AppProgress_t progress;
+  LiveStats_t stats;
+
+  app_progress(&app, &progress);
+  if (progress.measuring && !liveMeasuring) {
+    liveWindowThroughput = 0; // The window of the last run is no news.
+  }
+  liveMeasuring = progress.measuring;
+
+  memset(&stats, 0, sizeof(stats));
+  stats.state = (uint8_t)progress.state;
+  stats.mode = params.mode;
+  stats.connected = progress.connected;
+  stats.measuring = progress.measuring;
+  stats.phy = progress.phy;
+  stats.rssi = progress.rssi;
+  stats.interval = progress.interval;
+  stats.slaveLatency = progress.slaveLatency;
+  stats.supervisionTimeout = progress.supervisionTimeout;
+  stats.mtu = progress.mtu;
+  stats.pdu = progress.pdu;
+  stats.cmdLastError = progress.cmdLastError;
+  stats.seconds = progress.seconds;
+  stats.bytes = progress.bits / 8;
+  stats.operations = progress.operations;
+  stats.windowThroughput = liveWindowThroughput;
+  stats.throughput = (progress.seconds > 0) ? (uint32_t)((double)progress.bits / progress.seconds) : 0;
+  stats.runs = progress.runs;
+  stats.roundTrips = progress.roundTrips;
+  stats.pingsLost = progress.pingsLost;
+  stats.setupTimeouts = progress.setupTimeouts;
+  stats.cmdDeferred = progress.cmdDeferred;
+  stats.cmdRetries = progress.cmdRetries;
+  stats.cmdDropped = progress.cmdDropped;
+  live_stats_publish(&stats);
+  if (metricsPort) {
+    metrics_update(&progress, params.mode, liveWindowThroughput);
+  }
+
+  // The RSSI is only reported on request. Not during a measured run, where the command and its
+  // event would compete with the data. A replay can't answer commands the capture doesn't have.
+  if (((++liveUpdates % LIVE_STATS_RSSI_EVERY) == 0) && progress.connected && !progress.measuring && !replayPath) {
+    app_request_rssi(&app);
+  }
+}
+
+// Daemon mode: take tests from the control socket and run them back to back on the booted NCP.
+static void serve_daemon(void)
+{
+  if (userKeyboardInterrupt || daemon_shutdown_requested()) {
+    gecko_cmd_system_reset(0);
+    uartClose();
+    printf("Exiting daemon...\n\n");
+    exit(0);
+  }
+
+  daemon_poll();
+  if (daemon_running()) {
+    if (daemon_timed_out()) {
+      // Whatever the test is stuck in, the next one starts from a fresh boot.
+      daemon_failed("Test did not finish in time, the NCP is reset before the next test");
+      daemonNcpReady = false;
+    }
+    return;
+  }
+
+  if (daemon_next(&params)) {
+    if (daemonNcpReady) {
+      app_rerun(&app, &params); // Reuse connection, peer address and GATT handles where possible.
+    } else {
+      printf("Resetting NCP target...\n");
+      gecko_cmd_le_gap_end_procedure();
+      gecko_cmd_system_reset(0);
+    }
+  }
+}
+
+/***********************************************************************************************/ /**
+ *  \brief  Command line parser for additional parameters
+ *  \param[in] argc Argument count.
+ *  \param[in] argv Buffer contaning .
+ **************************************************************************************************/
+static void parse_commands(int argc, char *argv[]) 
+{
+  if (argc == 1) {
+    help();
+  }
+
+  for (uint8_t i = 1; i < argc; i++)
+  { // 0th argument is name of executable so start at 1st.
+    if (argv[i][0] == '-') { // -flag.
+      // Port
+      if (argv[i][1] == 'p') {
+        if (argv[i + 1]) {
+          uartPort = argv[i + 1];
+        }
+        // Baud rate
+      } else if (argv[i][1] == 'b') {
+        if (argv[i + 1]) {
+          baudRate = atoi(argv[i + 1]);
+        }
+        // Flow control
+      } else if (argv[i][1] == 'f') {
+        if (argv[i + 1]) {
+          flowControl = atoi(argv[i + 1]);
+        }
+        // Transimission Mode
+      } else if (argv[i][1] == 'm') {
+        // Assign mode
+        if (argv[i + 1]) {
+          if ((atoi(argv[i + 1]) >= 1) && (atoi(argv[i + 1]) <= 5)) {
+            params.mode = atoi(argv[i + 1]);
+            if (params.mode == 1) { // Fixed modes take the time or amount as argument so check for that.
+              if (argv[i + 2]) {
+                if ((atoi(argv[i + 2]) >= 1) && (atoi(argv[i + 2]) < 600)) { // Between 1s and 10min
+                  params.fixed_time = atoi(argv[i + 2]);
+                } else {
+                  printf("Fixed time has invalid type or exceeds interval 1s - 10 min.\n");
+                  exit(EXIT_FAILURE);
+                }
+              } else {
+                printf("Please input a valid time parameter.\n");
+                exit(EXIT_FAILURE);
+              }
+            } else if (params.mode == 2) {
+              if (argv[i + 2]) {
+                if ((atoi(argv[i + 2]) >= 1000) && (atoi(argv[i + 2]) < 10000000)) { // Between 1k and 10M.
+                  params.fixed_amount = atoi(argv[i + 2]);
+                } else {
+                  printf("Fixed amount has invalid type or exceeds interval 1k - 10M.\n");
+                  exit(EXIT_FAILURE);
+                }
+              } else {
+                printf("Please input a valid data amount parameter.\n");
+                exit(EXIT_FAILURE);
+              }
+            } else if (params.mode == 5) {
+              params.fixed_time = 10;
+              if (argv[i + 2] && (argv[i + 2][0] != '-')) {
+                if ((atoi(argv[i + 2]) >= 1) && (atoi(argv[i + 2]) < 600)) { // Between 1s and 10min
+                  params.fixed_time = atoi(argv[i + 2]);
+                } else {
+                  printf("Scan time has invalid type or exceeds interval 1s - 10 min.\n");
+                  exit(EXIT_FAILURE);
+                }
+              }
+            } else if (params.mode == 4) {
+              if (argv[i + 2] && (argv[i + 2][0] != '-')) {
+                if ((atoi(argv[i + 2]) >= 1) && (atoi(argv[i + 2]) <= 1000000)) {
+                  params.ping_count = atoi(argv[i + 2]);
+                } else {
+                  printf("Ping count exceeds interval 1 - 1M.\n");
+                  exit(EXIT_FAILURE);
+                }
+              }
+            }
+          } else {
+            printf("Mode must be one of these: 1 = fixed transmit time , 2 = fixed transmit data, 3 = free mode with buttons, 4 = latency, 5 = connectionless.\n");
+            exit(EXIT_FAILURE);
+          }
+        }
+      } else if (argv[i][1] == '-') {
+        // --flags
+        if (strncmp(&argv[i][2], "params", 6) == 0) {
+          // Assign test parameters.
+          if (argv[i + 1]) {
+            if ((atoi(argv[i + 1]) == 1) || (atoi(argv[i + 1]) == 2) || (atoi(argv[i + 1]) == 4)) {
+              params.phy = atoi(argv[i + 1]);
+              if (argv[i + 2]) {
+                if (atoi(argv[i + 2]) >= 20) {
+                  // User input is in ms, but value is passed as (ms / 1.25)
+                  params.connection_interval = (uint16_t)(((float)atoi(argv[i + 2])) / 1.25);
+                  if (argv[i + 3]) {
+                    if ((atoi(argv[i + 3]) >= 23) && (atoi(argv[i + 3]) <= 250)) {
+                      params.mtu_size = atoi(argv[i + 3]);
+                      if (argv[i + 4]) {
+                        if ((atoi(argv[i + 4]) == 1) || (atoi(argv[i + 4]) == 2)) {
+                          params.client_conf_flag = atoi(argv[i + 4]);
+                        } else {
+                          printf("Wrong Client Characteristic Configuration argument. Must be 1 for notification or 2 for indication\n");
+                          exit(EXIT_FAILURE);
+                        }
+                      }
+                    } else {
+                      printf("MTU size must be between 23 and 250.\n");
+                      exit(EXIT_FAILURE);
+                    }
+                  }
+                } else {
+                  printf("Connection interval should be above 20 (20 * 1.25 = 25 ms).\n");
+                  exit(EXIT_FAILURE);
+                }
+              }
+            } else {
+              printf("PHY must be one of these: 1 = 1M, 2 = 2M, 4 = 125k\n");
+              exit(EXIT_FAILURE);
+            }
+          }
+        } else if (strncmp(&argv[i][2], "record", 6) == 0) {
+          if (argv[i + 1]) {
+            recordPath = argv[i + 1];
+          } else {
+            printf("Please give a file to record into.\n");
+            exit(EXIT_FAILURE);
+          }
+        } else if (strncmp(&argv[i][2], "replay", 6) == 0) {
+          if (argv[i + 1]) {
+            replayPath = argv[i + 1];
+          } else {
+            printf("Please give a capture file to replay.\n");
+            exit(EXIT_FAILURE);
+          }
+        } else if (strncmp(&argv[i][2], "realtime", 8) == 0) {
+          replayRealtime = true;
+        } else if (strncmp(&argv[i][2], "clock-sync", 10) == 0) {
+          clockSync = true;
+        } else if (strncmp(&argv[i][2], "flight-recorder", 15) == 0) {
+          if (argv[i + 1]) {
+            flightCsvPath = argv[i + 1];
+          } else {
+            printf("Please give a CSV file for the flight recorder events.\n");
+            exit(EXIT_FAILURE);
+          }
+        } else if (strncmp(&argv[i][2], "rx-cpu", 6) == 0) {
+          if (argv[i + 1]) {
+            rxCpu = (atoi(argv[i + 1]) < 0) ? RX_CPU_NONE : atoi(argv[i + 1]);
+          } else {
+            printf("Please give a CPU number for the RX thread.\n");
+            exit(EXIT_FAILURE);
+          }
+        } else if (strncmp(&argv[i][2], "channel-csv", 11) == 0) {
+          if (argv[i + 1]) {
+            channelCsvPath = argv[i + 1];
+          } else {
+            printf("Please give a CSV file for the channel profile.\n");
+            exit(EXIT_FAILURE);
+          }
+        } else if (strncmp(&argv[i][2], "channels", 8) == 0) {
+          if (argv[i + 1]) {
+            channelSpec = argv[i + 1];
+          } else {
+            printf("Please give the channel subsets to run.\n");
+            exit(EXIT_FAILURE);
+          }
+        } else if (strncmp(&argv[i][2], "tx-power", 8) == 0) {
+          if (argv[i + 1]) {
+            txPowerSpec = argv[i + 1];
+          } else {
+            printf("Please give the TX power levels to run.\n");
+            exit(EXIT_FAILURE);
+          }
+        } else if (strncmp(&argv[i][2], "tx-target", 9) == 0) {
+          if (argv[i + 1] && (atoi(argv[i + 1]) > 0)) {
+            txPowerTarget = atoi(argv[i + 1]);
+          } else {
+            printf("Please give a target throughput in bps.\n");
+            exit(EXIT_FAILURE);
+          }
+        } else if (strncmp(&argv[i][2], "payload-mix", 11) == 0) {
+          if (argv[i + 1]) {
+            payloadMixSpec = argv[i + 1];
+          } else {
+            printf("Please give the payload sizes and weights.\n");
+            exit(EXIT_FAILURE);
+          }
+        } else if (strncmp(&argv[i][2], "payload-trace", 13) == 0) {
+          if (argv[i + 1]) {
+            payloadTracePath = argv[i + 1];
+          } else {
+            printf("Please give a payload trace file.\n");
+            exit(EXIT_FAILURE);
+          }
+        } else if (strncmp(&argv[i][2], "gap-multiple", 12) == 0) {
+          if (argv[i + 1] && (atoi(argv[i + 1]) > 0) && (atoi(argv[i + 1]) <= 0xFF)) {
+            gapMultiple = atoi(argv[i + 1]);
+          } else {
+            printf("Please give the gap length in connection intervals, 1-255.\n");
+            exit(EXIT_FAILURE);
+          }
+        } else if (strncmp(&argv[i][2], "gap-flag", 8) == 0) {
+          if (argv[i + 1] && (atoi(argv[i + 1]) >= 0)) {
+            gapFlagMs = atoi(argv[i + 1]);
+          } else {
+            printf("Please give the gap that flags a run in ms.\n");
+            exit(EXIT_FAILURE);
+          }
+        } else if (strncmp(&argv[i][2], "stream-probe", 12) == 0) {
+          if (argv[i + 1] && (atoi(argv[i + 1]) > 0) && (atoi(argv[i + 1]) <= 0xFFFF)) {
+            streamProbeMs = atoi(argv[i + 1]);
+          } else {
+            printf("Please give the probe interval in ms.\n");
+            exit(EXIT_FAILURE);
+          }
+        } else if (strncmp(&argv[i][2], "streams", 7) == 0) {
+          if (argv[i + 1]) {
+            streamSpec = argv[i + 1];
+          } else {
+            printf("Please give the stream weights.\n");
+            exit(EXIT_FAILURE);
+          }
+        } else if (strncmp(&argv[i][2], "daemon", 6) == 0) {
+          if (argv[i + 1]) {
+            daemonPath = argv[i + 1];
+          } else {
+            printf("Please give a socket path for the daemon.\n");
+            exit(EXIT_FAILURE);
+          }
+        } else if (strncmp(&argv[i][2], "live-stats", 10) == 0) {
+          if (argv[i + 1] && (argv[i + 1][0] == '/')) {
+            liveStatsName = argv[i + 1];
+          } else {
+            printf("Please give a shared memory name starting with '/' for the live statistics.\n");
+            exit(EXIT_FAILURE);
+          }
+        } else if (strncmp(&argv[i][2], "metrics", 7) == 0) {
+          if (argv[i + 1] && (atoi(argv[i + 1]) > 0) && (atoi(argv[i + 1]) <= 65535)) {
+            metricsPort = (uint16_t)atoi(argv[i + 1]);
+          } else {
+            printf("Please give a TCP port between 1 and 65535 for the metrics.\n");
+            exit(EXIT_FAILURE);
+          }
+        } else if (strncmp(&argv[i][2], "afh", 3) == 0) {
+          if (argv[i + 1] && ((atoi(argv[i + 1]) == 0) || (atoi(argv[i + 1]) == 1))) {
+            channelAfh = (atoi(argv[i + 1]) == 1) ? ChannelAfh_On : ChannelAfh_Off;
+          } else {
+            printf("AFH must be 1 for enabled or 0 for disabled.\n");
+            exit(EXIT_FAILURE);
+          }
+        }
+        // Show help
+      } else if (argv[i][1] == 'h') {
+        help();
+        exit(EXIT_SUCCESS);
+      } else {
+        usage();
+        exit(EXIT_FAILURE);
+      }
+    }
+  }
+
+  // Mode is known only after all arguments are read.
+  if (channelSpec) {
+    if (params.mode != 1) {
+      printf("Channel subsets need fixed time mode (-m 1).\n");
+      exit(EXIT_FAILURE);
+    }
+    if (channel_plan_parse(&channelPlan, channelSpec) < 0) {
+      printf("Invalid channel subsets: %s. Channels are 0-36, at most %u subsets of at least %u channels.\n",
+             channelSpec, CHANNEL_PLAN_MAX_SUBSETS - 1, CHANNEL_SUBSET_MIN);
+      exit(EXIT_FAILURE);
+    }
+    channelPlan.afh = channelAfh;
+    app_set_channel_plan(&app, &channelPlan, channelCsvPath);
+  }
+  if (txPowerSpec) {
+    if ((params.mode != 1) || channelSpec) {
+      printf("TX power levels need fixed time mode (-m 1) and can't be combined with channel subsets.\n");
+      exit(EXIT_FAILURE);
+    }
+    if (tx_power_plan_parse(&txPowerPlan, txPowerSpec) < 0) {
+      printf("Invalid TX power levels: %s. At most %u levels between -30 and 20 dBm.\n", txPowerSpec, TX_POWER_PLAN_MAX_LEVELS);
+      exit(EXIT_FAILURE);
+    }
+    txPowerPlan.targetBps = txPowerTarget;
+    app_set_tx_power_plan(&app, &txPowerPlan);
+  }
+  if (payloadMixSpec || payloadTracePath) {
+    if ((params.mode == 4) || (params.mode == 5) || (payloadMixSpec && payloadTracePath)) {
+      printf("A payload mix or trace needs a throughput mode (-m 1/2/3) and only one of them can be given.\n");
+      exit(EXIT_FAILURE);
+    }
+    if (payloadMixSpec && (payload_mix_parse(&payloadSchedule, payloadMixSpec) < 0)) {
+      printf("Invalid payload mix: %s. At most %u size:weight pairs, weights 1-255.\n", payloadMixSpec, PAYLOAD_MIX_MAX_BINS);
+      exit(EXIT_FAILURE);
+    }
+    if (payloadTracePath && (payload_trace_load(&payloadSchedule, payloadTracePath) < 0)) {
+      printf("Invalid payload trace: %s. At most %u \"<size> <gap us>\" lines, gaps up to 6.5 s.\n", payloadTracePath, PAYLOAD_TRACE_MAX);
+      exit(EXIT_FAILURE);
+    }
+    if (params.client_conf_flag != 1) {
+      printf("Only notifications follow the payload schedule, indications keep one size.\n");
+    }
+    app_set_payload_schedule(&app, &payloadSchedule);
+  }
+  if (streamSpec || streamProbeMs) {
+    if (!streamSpec || (params.mode == 4) || (params.mode == 5) || ((params.mode != 3) && (params.client_conf_flag != 1))) {
+      printf("Streams need weights (--streams) and a notification throughput mode (-m 1/2/3).\n");
+      exit(EXIT_FAILURE);
+    }
+    if (parse_stream_weights(&streamConfig, streamSpec) < 0) {
+      printf("Invalid stream weights: %s. At most %u streams including the probe, weights 1-255.\n", streamSpec, STREAM_MAX);
+      exit(EXIT_FAILURE);
+    }
+    streamConfig.probeIntervalMs = (uint16_t)streamProbeMs;
+    if (stream_config_total(&streamConfig) > STREAM_MAX) {
+      printf("At most %u streams including the probe.\n", STREAM_MAX);
+      exit(EXIT_FAILURE);
+    }
+    app_set_stream_config(&app, &streamConfig);
+  }
+  if (clockSync) {
+    if (!daemonPath && ((params.mode == 4) || (params.mode == 5))) {
+      printf("Clock sync needs a throughput mode (-m 1/2/3).\n");
+      exit(EXIT_FAILURE);
+    }
+    app_set_clock_sync(&app, true);
+  }
+  if (flightCsvPath) {
+    if (!daemonPath && ((params.mode == 4) || (params.mode == 5))) {
+      printf("The flight recorder needs a throughput mode (-m 1/2/3).\n");
+      exit(EXIT_FAILURE);
+    }
+    app_set_flight_recorder(&app, flightCsvPath);
+  }
+  app_set_gap_detector(&app, (uint8_t)gapMultiple, (uint32_t)gapFlagMs);
+  if (daemonPath && replayPath) {
+    printf("A replay can't take requests, use --daemon with a serial port.\n");
+    exit(EXIT_FAILURE);
+  }
+#if ((_WIN32 == 1) || (__CYGWIN__ == 1))
+  if (daemonPath) {
+    printf("Daemon mode needs Unix domain sockets and is not available on Windows.\n");
+    exit(EXIT_FAILURE);
+  }
+  if (liveStatsName) {
+    printf("Live statistics need POSIX shared memory and are not available on Windows.\n");
+    exit(EXIT_FAILURE);
+  }
+  if (metricsPort) {
+    printf("The metrics endpoint is not available on Windows.\n");
+    exit(EXIT_FAILURE);
+  }
+#endif
+}
+
+// Stream weights separated by ',', one bulk stream per weight.
+static int parse_stream_weights(StreamConfig_t *config, const char *spec)
+{
+  char buf[64];
+  char *token;
+
+  memset(config, 0, sizeof(StreamConfig_t));
+  if (strlen(spec) >= sizeof(buf)) {
+    return -1;
+  }
+  strcpy(buf, spec);
+  for (token = strtok(buf, ","); token != NULL; token = strtok(NULL, ",")) {
+    char *end;
+    long weight = strtol(token, &end, 10);
+
+    if ((end == token) || (*end != '\0') || (weight < 1) || (weight > 255) || (config->count >= STREAM_MAX)) {
+      return -1;
+    }
+    config->weights[config->count++] = (uint8_t)weight;
+  }
+  return (config->count > 0) ? 0 : -1;
+}
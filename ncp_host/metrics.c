@@ -0,0 +1,340 @@
+/***********************************************************************************************/ /**
+ * \file   metrics.c
+ * \brief  OpenMetrics endpoint on the loopback interface, served from its own thread
+ *
+ * The event loop hands over a snapshot of the tester a few times a second with metrics_update().
+ * The server thread answers each scrape from a copy of the latest snapshot, so a slow or stuck
+ * scraper costs the event loop nothing but the copy. Per-run counters of the tester are turned
+ * into session totals here, so the exported counters only ever grow.
+ **************************************************************************************************/
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <stdbool.h>
+#include <stdarg.h>
+#include <ctype.h>
+
+/* BG stack headers, for the event type in app.h */
+#include "gecko_bglib.h"
+
+#include "metrics.h"
+
+#if ((_WIN32 == 1) || (__CYGWIN__ == 1))
+
+// POSIX sockets only.
+int metrics_start(uint16_t port) { return -1; }
+void metrics_stop(void) {}
+void metrics_update(const AppProgress_t *progress, uint8_t mode, uint32_t windowThroughput) {}
+
+#else
+#include <unistd.h>
+#include <errno.h>
+#include <poll.h>
+#include <signal.h>
+#include <pthread.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+// --------------------------------
+// Local variables and constants
+#define METRICS_POLL_MS         200     // The server thread notices metrics_stop() within this
+#define METRICS_REQUEST_MAX     1024
+#define METRICS_BODY_MAX        8192
+#define METRICS_CLIENT_TIMEOUT_S 2
+
+typedef struct {
+    AppProgress_t progress;
+    uint8_t mode;
+    uint32_t windowThroughput;
+    uint64_t bits;              // Session totals over all runs
+    uint64_t operations;
+    bool valid;
+} MetricsSnapshot_t;
+
+typedef struct {
+    char *buf;
+    size_t len;
+} MetricsBody_t;
+
+static int listenFd = -1;
+static pthread_t serverThread;
+static bool serverRunning = false;
+static pthread_mutex_t snapshotLock = PTHREAD_MUTEX_INITIALIZER;
+static MetricsSnapshot_t snapshot;
+// Run values at the last update, owned by the event loop.
+static uint64_t lastRunBits = 0;
+static uint32_t lastRunOperations = 0;
+static uint32_t lastRuns = 0;
+static bool lastMeasuring = false;
+
+/***************************************************************************************************
+ * Static Function Declarations
+ **************************************************************************************************/
+static void *server_thread(void *arg);
+static void serve_client(int fd);
+static void format_metrics(MetricsBody_t *body, const MetricsSnapshot_t *snap);
+static void append(MetricsBody_t *body, const char *format, ...);
+static void phase_label(char *buf, size_t size, SetupPhase_t phase);
+
+/***************************************************************************************************
+ * Public Function Definitions
+ **************************************************************************************************/
+
+/***********************************************************************************************/ /**
+ *  \brief  Open the endpoint and start the server thread.
+ *  \param[in] port TCP port on 127.0.0.1.
+ *  \return  0 on success, -1 on failure.
+ **************************************************************************************************/
+int metrics_start(uint16_t port)
+{
+    struct sockaddr_in addr;
+    int one = 1;
+    sigset_t blocked, previous;
+    int ret;
+
+    listenFd = socket(AF_INET, SOCK_STREAM, 0);
+    if (listenFd < 0) {
+        return -1;
+    }
+    setsockopt(listenFd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if ((bind(listenFd, (struct sockaddr *)&addr, sizeof(addr)) < 0) || (listen(listenFd, 4) < 0)) {
+        close(listenFd);
+        listenFd = -1;
+        return -1;
+    }
+    // A scraper that goes away mid answer must not take the tester down.
+    signal(SIGPIPE, SIG_IGN);
+
+    // SIGINT stays with the main thread, which polls the flag set by its handler.
+    sigemptyset(&blocked);
+    sigaddset(&blocked, SIGINT);
+    pthread_sigmask(SIG_BLOCK, &blocked, &previous);
+    __atomic_store_n(&serverRunning, true, __ATOMIC_RELEASE);
+    ret = pthread_create(&serverThread, NULL, server_thread, NULL);
+    pthread_sigmask(SIG_SETMASK, &previous, NULL);
+
+    if (ret != 0) {
+        serverRunning = false;
+        close(listenFd);
+        listenFd = -1;
+        return -1;
+    }
+    return 0;
+}
+
+// Stop the server thread and close the endpoint.
+void metrics_stop(void)
+{
+    if (__atomic_exchange_n(&serverRunning, false, __ATOMIC_ACQ_REL)) {
+        pthread_join(serverThread, NULL);
+        close(listenFd);
+        listenFd = -1;
+    }
+}
+
+/***********************************************************************************************/ /**
+ *  \brief  Replace the snapshot scrapes are answered from. Called from the event loop.
+ *  \param[in] progress Tester progress, see app_progress().
+ *  \param[in] mode Test mode, as -m.
+ *  \param[in] windowThroughput Throughput of the last full window, bps.
+ **************************************************************************************************/
+void metrics_update(const AppProgress_t *progress, uint8_t mode, uint32_t windowThroughput)
+{
+    uint64_t bits = 0;
+    uint32_t operations = 0;
+
+    // The tester's counters count the run in progress and are cleared when it ends or the
+    // connection closes. A run that ended since the last update shows in the run number, and a
+    // run that wasn't in progress at the last update started from zero.
+    if (progress->measuring) {
+        if ((progress->runs != lastRuns) || !lastMeasuring) {
+            lastRunBits = 0;
+            lastRunOperations = 0;
+        }
+        bits = progress->bits - lastRunBits;
+        operations = progress->operations - lastRunOperations;
+    }
+
+    lastRunBits = progress->bits;
+    lastRunOperations = progress->operations;
+    lastRuns = progress->runs;
+    lastMeasuring = progress->measuring;
+
+    pthread_mutex_lock(&snapshotLock);
+    snapshot.progress = *progress;
+    snapshot.mode = mode;
+    snapshot.windowThroughput = windowThroughput;
+    snapshot.bits += bits;
+    snapshot.operations += operations;
+    snapshot.valid = true;
+    pthread_mutex_unlock(&snapshotLock);
+}
+
+/***************************************************************************************************
+ * Static Function Definitions
+ **************************************************************************************************/
+
+static void *server_thread(void *arg)
+{
+    struct pollfd pfd = { .fd = listenFd, .events = POLLIN };
+
+    while (__atomic_load_n(&serverRunning, __ATOMIC_ACQUIRE)) {
+        int fd;
+
+        if (poll(&pfd, 1, METRICS_POLL_MS) <= 0) {
+            continue;
+        }
+        fd = accept(listenFd, NULL, NULL);
+        if (fd >= 0) {
+            serve_client(fd);
+            close(fd);
+        }
+    }
+    return NULL;
+}
+
+// One request per connection. Only GET /metrics is served, everything else is a 404.
+static void serve_client(int fd)
+{
+    char request[METRICS_REQUEST_MAX];
+    size_t len = 0;
+    struct timeval timeout = { .tv_sec = METRICS_CLIENT_TIMEOUT_S };
+    char body[METRICS_BODY_MAX];
+    MetricsBody_t out = { body, 0 };
+    MetricsSnapshot_t snap;
+    char header[256];
+    int headerLen;
+
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+    while (len < (sizeof(request) - 1)) {
+        ssize_t got = recv(fd, &request[len], sizeof(request) - 1 - len, 0);
+
+        if (got <= 0) {
+            return;
+        }
+        len += (size_t)got;
+        request[len] = '\0';
+        if (strstr(request, "\r\n\r\n") || strstr(request, "\n\n")) {
+            break;
+        }
+    }
+
+    if ((strncmp(request, "GET /metrics ", 13) != 0) && (strncmp(request, "GET /metrics?", 13) != 0)) {
+        const char *notFound = "HTTP/1.1 404 Not Found\r\nContent-Type: text/plain\r\nContent-Length: 10\r\nConnection: close\r\n\r\nNot found\n";
+        send(fd, notFound, strlen(notFound), 0);
+        return;
+    }
+
+    pthread_mutex_lock(&snapshotLock);
+    snap = snapshot;
+    pthread_mutex_unlock(&snapshotLock);
+
+    format_metrics(&out, &snap);
+    headerLen = snprintf(header, sizeof(header),
+                         "HTTP/1.1 200 OK\r\n"
+                         "Content-Type: application/openmetrics-text; version=1.0.0; charset=utf-8\r\n"
+                         "Content-Length: %u\r\nConnection: close\r\n\r\n", (unsigned)out.len);
+    if (send(fd, header, (size_t)headerLen, 0) == headerLen) {
+        send(fd, body, out.len, 0);
+    }
+}
+
+static void format_metrics(MetricsBody_t *body, const MetricsSnapshot_t *snap)
+{
+    const AppProgress_t *p = &snap->progress;
+
+    append(body, "# TYPE tt_up gauge\n# HELP tt_up Whether the tester has published a snapshot yet.\n");
+    append(body, "tt_up %u\n", snap->valid ? 1 : 0);
+    if (!snap->valid) {
+        append(body, "# EOF\n");
+        return;
+    }
+
+    append(body, "# TYPE tt_mode gauge\n# HELP tt_mode Test mode as given with -m.\ntt_mode %u\n", snap->mode);
+    append(body, "# TYPE tt_state gauge\n# HELP tt_state Tester state: 0 scanning, 1 setting parameters, 2 discovering, 3 transmission, 4 broadcast scan, 5 plan step.\n");
+    append(body, "tt_state %u\n", (unsigned)p->state);
+    append(body, "# TYPE tt_connected gauge\ntt_connected %u\n", p->connected ? 1 : 0);
+    append(body, "# TYPE tt_measuring gauge\n# HELP tt_measuring Whether a data run is in progress.\ntt_measuring %u\n", p->measuring ? 1 : 0);
+
+    append(body, "# TYPE tt_throughput_bits_per_second gauge\n# UNIT tt_throughput_bits_per_second bits_per_second\n");
+    append(body, "# HELP tt_throughput_bits_per_second Host measured throughput over the last 1 s window and over the run.\n");
+    append(body, "tt_throughput_bits_per_second{over=\"window\"} %u\n", snap->windowThroughput);
+    append(body, "tt_throughput_bits_per_second{over=\"run\"} %u\n",
+           (p->seconds > 0) ? (uint32_t)((double)p->bits / p->seconds) : 0);
+    append(body, "# TYPE tt_received_bytes counter\n# UNIT tt_received_bytes bytes\ntt_received_bytes_total %llu\n",
+           (unsigned long long)(snap->bits / 8));
+    append(body, "# TYPE tt_operations counter\n# HELP tt_operations Notifications or indications received.\ntt_operations_total %llu\n",
+           (unsigned long long)snap->operations);
+    append(body, "# TYPE tt_runs counter\n# HELP tt_runs Data runs ended.\ntt_runs_total %u\n", p->runs);
+
+    if (p->rssi != APP_RSSI_UNKNOWN) {
+        append(body, "# TYPE tt_rssi_dbm gauge\n# UNIT tt_rssi_dbm dbm\ntt_rssi_dbm %d\n", p->rssi);
+    }
+    if (p->connected) {
+        append(body, "# TYPE tt_phy gauge\n# HELP tt_phy PHY in use: 1 1M, 2 2M, 4 Coded.\ntt_phy %u\n", p->phy);
+        append(body, "# TYPE tt_connection_interval_seconds gauge\n# UNIT tt_connection_interval_seconds seconds\n");
+        append(body, "tt_connection_interval_seconds %.5f\n", p->interval * 0.00125);
+        append(body, "# TYPE tt_mtu_bytes gauge\n# UNIT tt_mtu_bytes bytes\ntt_mtu_bytes %u\n", p->mtu);
+        append(body, "# TYPE tt_pdu_bytes gauge\n# UNIT tt_pdu_bytes bytes\ntt_pdu_bytes %u\n", p->pdu);
+    }
+
+    append(body, "# TYPE tt_disconnects counter\n# HELP tt_disconnects Connections closed, planned reconnections included.\n");
+    append(body, "tt_disconnects_total %u\n", p->disconnects);
+    append(body, "# TYPE tt_setup_timeouts counter\ntt_setup_timeouts_total %u\n", p->setupTimeouts);
+    append(body, "# TYPE tt_round_trips counter\ntt_round_trips_total %u\n", p->roundTrips);
+    append(body, "# TYPE tt_pings_lost counter\ntt_pings_lost_total %u\n", p->pingsLost);
+    append(body, "# TYPE tt_transmission_writes counter\n# HELP tt_transmission_writes transmission_on/off writes the NCP was too busy for.\n");
+    append(body, "tt_transmission_writes_total{outcome=\"deferred\"} %u\n", p->cmdDeferred);
+    append(body, "tt_transmission_writes_total{outcome=\"retried\"} %u\n", p->cmdRetries);
+    append(body, "tt_transmission_writes_total{outcome=\"dropped\"} %u\n", p->cmdDropped);
+
+    append(body, "# TYPE tt_setup_seconds summary\n# UNIT tt_setup_seconds seconds\n");
+    append(body, "# HELP tt_setup_seconds Connection setup per phase, phases overlap and total covers them all.\n");
+    for (uint8_t i = 0; i < SETUP_PHASES; i++) {
+        char label[16];
+
+        phase_label(label, sizeof(label), (SetupPhase_t)i);
+        append(body, "tt_setup_seconds_count{phase=\"%s\"} %u\n", label, p->setup.count[i]);
+        append(body, "tt_setup_seconds_sum{phase=\"%s\"} %.6f\n", label, (double)p->setup.sum[i] / 1e6);
+    }
+    append(body, "# EOF\n");
+}
+
+// Formatted output that stops at the end of the buffer.
+static void append(MetricsBody_t *body, const char *format, ...)
+{
+    va_list args;
+    int written;
+
+    if (body->len >= (METRICS_BODY_MAX - 1)) {
+        return;
+    }
+    va_start(args, format);
+    written = vsnprintf(&body->buf[body->len], METRICS_BODY_MAX - body->len, format, args);
+    va_end(args);
+    if (written > 0) {
+        body->len += ((size_t)written < (METRICS_BODY_MAX - body->len)) ? (size_t)written : (METRICS_BODY_MAX - 1 - body->len);
+    }
+}
+
+// Phase names in lower case, as label values.
+static void phase_label(char *buf, size_t size, SetupPhase_t phase)
+{
+    const char *name = setup_timing_phase_name(phase);
+    size_t i;
+
+    for (i = 0; (name[i] != '\0') && (i < (size - 1)); i++) {
+        buf[i] = (char)tolower((unsigned char)name[i]);
+    }
+    buf[i] = '\0';
+}
+#endif
@@ -0,0 +1,32 @@
+/***********************************************************************************************/ /**
+ * \file   metrics.h
+ * \brief  OpenMetrics endpoint on the loopback interface, served from its own thread
+ **************************************************************************************************/
+
+#ifndef METRICS_H
+#define METRICS_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "app.h"
+
+/***************************************************************************************************
+ * Function Declarations
+ **************************************************************************************************/
+// Listen on 127.0.0.1:port and answer GET /metrics from the server thread.
+int metrics_start(uint16_t port);
+void metrics_stop(void);
+
+// Hand the server a new snapshot. Only the copy is made here, scrapes format their own copy.
+void metrics_update(const AppProgress_t *progress, uint8_t mode, uint32_t windowThroughput);
+
+#ifdef __cplusplus
+};
+#endif
+
+#endif /* METRICS_H */
@@ -0,0 +1,64 @@
+/***********************************************************************************************/ /**
+ * \file   monotonic.c
+ * \brief  Monotonic clock shared by the host modules
+ *
+ * Event arrival times from the RX thread, transmission timing, capture replay and the live
+ * statistics all compare readings of this one clock.
+ **************************************************************************************************/
+
+#include <stdint.h>
+
+#include "monotonic.h"
+
+#if ((_WIN32 == 1) || (__CYGWIN__ == 1))
+#include <windows.h>
+
+// The counter is split into whole seconds and the remainder. At a 10 MHz counter frequency,
+// counter * 1e6 would overflow int64 after about 10 days of uptime, counter * 1e9 after 15 minutes.
+static uint64_t counter_to(uint64_t unitsPerSecond)
+{
+    LARGE_INTEGER counter, frequency;
+    QueryPerformanceFrequency(&frequency);
+    QueryPerformanceCounter(&counter);
+    return ((uint64_t)(counter.QuadPart / frequency.QuadPart) * unitsPerSecond)
+           + (uint64_t)(((counter.QuadPart % frequency.QuadPart) * unitsPerSecond) / frequency.QuadPart);
+}
+
+/***********************************************************************************************/ /**
+ *  \brief  Monotonic time in microseconds.
+ **************************************************************************************************/
+uint64_t monotonic_now_us(void)
+{
+    return counter_to(1000000);
+}
+
+/***********************************************************************************************/ /**
+ *  \brief  Monotonic time in nanoseconds.
+ **************************************************************************************************/
+uint64_t monotonic_now_ns(void)
+{
+    return counter_to(1000000000);
+}
+#else
+#include <time.h>
+
+/***********************************************************************************************/ /**
+ *  \brief  Monotonic time in microseconds.
+ **************************************************************************************************/
+uint64_t monotonic_now_us(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ((uint64_t)ts.tv_sec * 1000000) + ((uint64_t)ts.tv_nsec / 1000);
+}
+
+/***********************************************************************************************/ /**
+ *  \brief  Monotonic time in nanoseconds.
+ **************************************************************************************************/
+uint64_t monotonic_now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ((uint64_t)ts.tv_sec * 1000000000) + (uint64_t)ts.tv_nsec;
+}
+#endif
@@ -0,0 +1,25 @@
+/***********************************************************************************************/ /**
+ * \file   monotonic.h
+ * \brief  Monotonic clock shared by the host modules
+ **************************************************************************************************/
+
+#ifndef MONOTONIC_H
+#define MONOTONIC_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+
+/***************************************************************************************************
+ * Function Declarations
+ **************************************************************************************************/
+uint64_t monotonic_now_us(void);
+uint64_t monotonic_now_ns(void);
+
+#ifdef __cplusplus
+};
+#endif
+
+#endif /* MONOTONIC_H */
@@ -0,0 +1,131 @@
+/***********************************************************************************************/ /**
+ * \file   payload_trace.c
+ * \brief  Payload size mixes and traces given on the command line, pushed to the slave
+ *
+ * A mix is a list of size:weight pairs, e.g. 20:80,240:20 sends 20 byte notifications four times
+ * as often as 240 byte ones. A trace file has one packet per line, "<size> <gap us>", the gap
+ * being the wait before the packet. Lines starting with '#' are comments. Sizes above what the
+ * link takes are cut to the notification size the slave calculated.
+ **************************************************************************************************/
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <stdbool.h>
+
+#include "payload_trace.h"
+
+#define PAYLOAD_SIZE_MAX    0xFFFF
+#define PAYLOAD_GAP_MAX_US  ((uint32_t)0xFFFF * PAYLOAD_GAP_UNIT_US)
+
+/***************************************************************************************************
+ * Public Function Definitions
+ **************************************************************************************************/
+
+/***********************************************************************************************/ /**
+ *  \brief  Build a size mix from the command line.
+ *  \param[out] schedule Schedule to fill.
+ *  \param[in] spec Comma separated size:weight pairs, weights 1-255.
+ *  \return  0 on success, -1 on a malformed list or too many sizes.
+ **************************************************************************************************/
+int payload_mix_parse(PayloadSchedule_t *schedule, const char *spec)
+{
+    char buf[256];
+    char *token;
+    uint16_t total = 0;
+
+    payload_schedule_reset(schedule);
+    if (strlen(spec) >= sizeof(buf)) {
+        return -1;
+    }
+    strcpy(buf, spec);
+    for (token = strtok(buf, ","); token != NULL; token = strtok(NULL, ",")) {
+        char *end;
+        long size = strtol(token, &end, 10);
+        long weight;
+
+        if ((end == token) || (*end != ':') || (size < 1) || (size > PAYLOAD_SIZE_MAX)) {
+            return -1;
+        }
+        weight = strtol(end + 1, &end, 10);
+        if ((*end != '\0') || (weight < 1) || (weight > 255) || (schedule->binCount >= PAYLOAD_MIX_MAX_BINS)) {
+            return -1;
+        }
+        schedule->bins[schedule->binCount].size = (uint16_t)size;
+        schedule->bins[schedule->binCount].weight = (uint8_t)weight;
+        schedule->binCount++;
+        total += (uint16_t)weight;
+    }
+    if (schedule->binCount == 0) {
+        return -1;
+    }
+    schedule->weightTotal = total;
+    schedule->kind = SCHEDULE_MIX;
+    return 0;
+}
+
+/***********************************************************************************************/ /**
+ *  \brief  Load a size and inter-arrival trace.
+ *  \param[out] schedule Schedule to fill.
+ *  \param[in] path Trace file path.
+ *  \return  Number of packets loaded, -1 if the file can't be read, is empty, malformed or
+ *           longer than PAYLOAD_TRACE_MAX packets.
+ **************************************************************************************************/
+int payload_trace_load(PayloadSchedule_t *schedule, const char *path)
+{
+    FILE *f = fopen(path, "r");
+    char line[128];
+
+    payload_schedule_reset(schedule);
+    if (f == NULL) {
+        return -1;
+    }
+    while (fgets(line, sizeof(line), f) != NULL) {
+        char *p = line + strspn(line, " \t");
+        unsigned long size;
+        unsigned long gapUs;
+
+        if ((*p == '#') || (*p == '\r') || (*p == '\n') || (*p == '\0')) {
+            continue;
+        }
+        if ((sscanf(p, "%lu %lu", &size, &gapUs) != 2) || (size < 1) || (size > PAYLOAD_SIZE_MAX)
+            || (gapUs > PAYLOAD_GAP_MAX_US) || (schedule->traceLen >= PAYLOAD_TRACE_MAX)) {
+            fclose(f);
+            return -1;
+        }
+        // Gaps travel in 0.1 ms units, rounded to the nearest.
+        schedule->trace[schedule->traceLen].size = (uint16_t)size;
+        schedule->trace[schedule->traceLen].gap = (uint16_t)((gapUs + (PAYLOAD_GAP_UNIT_US / 2)) / PAYLOAD_GAP_UNIT_US);
+        schedule->traceLen++;
+    }
+    fclose(f);
+    if (schedule->traceLen == 0) {
+        return -1;
+    }
+    schedule->traceLoaded = schedule->traceLen;
+    schedule->kind = SCHEDULE_TRACE;
+    return schedule->traceLen;
+}
+
+// One line summary of what is sent to the slave.
+void payload_schedule_print(const PayloadSchedule_t *schedule)
+{
+    if (schedule->kind == SCHEDULE_MIX) {
+        printf("Payload mix:");
+        for (uint8_t i = 0; i < schedule->binCount; i++) {
+            printf(" %u B %.0f%%", schedule->bins[i].size, (100.0 * schedule->bins[i].weight) / schedule->weightTotal);
+        }
+        printf("\n");
+    } else if (schedule->kind == SCHEDULE_TRACE) {
+        uint64_t bytes = 0;
+        uint64_t gaps = 0;
+
+        for (uint16_t i = 0; i < schedule->traceLen; i++) {
+            bytes += schedule->trace[i].size;
+            gaps += schedule->trace[i].gap;
+        }
+        printf("Payload trace: %u packets, mean %.1f B, mean gap %.1f ms, looped until the run ends\n",
+               schedule->traceLen, (double)bytes / schedule->traceLen, (double)gaps / (10.0 * schedule->traceLen));
+    }
+}
@@ -0,0 +1,31 @@
+/***********************************************************************************************/ /**
+ * \file   payload_trace.h
+ * \brief  Payload size mixes and traces given on the command line, pushed to the slave
+ **************************************************************************************************/
+
+#ifndef PAYLOAD_TRACE_H
+#define PAYLOAD_TRACE_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "../soc/app_payload_schedule.h"
+
+/***************************************************************************************************
+ * Function Declarations
+ **************************************************************************************************/
+// Sizes and weights separated by ',', e.g. "20:80,240:20".
+int payload_mix_parse(PayloadSchedule_t *schedule, const char *spec);
+// One "<size> <gap us>" line per packet.
+int payload_trace_load(PayloadSchedule_t *schedule, const char *path);
+void payload_schedule_print(const PayloadSchedule_t *schedule);
+
+#ifdef __cplusplus
+};
+#endif
+
+#endif /* PAYLOAD_TRACE_H */
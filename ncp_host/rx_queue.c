@@ -0,0 +1,346 @@
+/***********************************************************************************************/ /**
+ * \file   rx_queue.c
+ * \brief  Serial RX thread and single-producer/single-consumer frame queue
+ *
+ * The RX thread is the only writer of rxHead and the application thread the only writer of
+ * rxTail, so the ring needs no locks. Each slot holds one complete BGAPI frame, read straight
+ * from the serial port, and the time its header arrived. A side that has to wait for the other,
+ * the application for a frame or the RX thread for a free slot, sleeps on a condition variable.
+ * The other side only takes the mutex to wake it when it has flagged that it is waiting.
+ **************************************************************************************************/
+
+#if defined(__linux__)
+#define _GNU_SOURCE     // pthread_setaffinity_np
+#endif
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <stdbool.h>
+#include <signal.h>
+#include <pthread.h>
+#include <sched.h>
+#include <unistd.h>
+
+#include "rx_queue.h"
+#include "monotonic.h"
+
+// --------------------------------
+// Local variables and constants
+#define RX_QUEUE_SLOTS      256                 // Power of two
+#define RX_HEADER_LEN       4
+#define RX_FRAME_MAX        (RX_HEADER_LEN + 2047)  // 11 bit payload length
+#define RX_EVENT_TIMES      64                  // Deeper than the BGLIB event queue
+
+typedef struct {
+    uint64_t timeUs;
+    uint16_t len;
+    uint8_t data[RX_FRAME_MAX];
+} RxFrame_t;
+
+static RxFrame_t rxRing[RX_QUEUE_SLOTS];
+static uint32_t rxHead = 0;             // Next slot to fill, written by the RX thread only
+static uint32_t rxTail = 0;             // Next slot to consume, written by the application only
+static uint32_t rxHighWater = 0;
+
+static pthread_t rxThread;
+static RxInput_t rxInput = NULL;
+static bool rxRunning = false;
+static bool rxFailed = false;
+
+static pthread_mutex_t rxLock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t rxFilled = PTHREAD_COND_INITIALIZER;     // A frame was queued or the RX thread quit
+static pthread_cond_t rxDrained = PTHREAD_COND_INITIALIZER;    // A slot was handed back or a stop was asked for
+static bool appWaiting = false;         // Application sleeps on rxFilled
+static bool rxWaiting = false;          // RX thread sleeps on rxDrained
+
+// Application thread only.
+static RxFrame_t *currentFrame = NULL;
+static uint16_t currentOffset = 0;
+static uint64_t eventTimes[RX_EVENT_TIMES];
+static uint8_t eventTimesHead = 0;
+static uint8_t eventTimesCount = 0;
+
+/***************************************************************************************************
+ * Static Function Declarations
+ **************************************************************************************************/
+static void *rx_thread(void *arg);
+static bool read_exact(uint8_t *data, uint32_t len);
+static void pin_thread(int cpu);
+static bool next_frame(void);
+static bool wait_frame(void);
+static void wait_slot(void);
+static void wake(bool *waiting, pthread_cond_t *cond);
+static void wake_all(pthread_cond_t *cond);
+
+/***************************************************************************************************
+ * Public Function Definitions
+ **************************************************************************************************/
+
+/***********************************************************************************************/ /**
+ *  \brief  Start reading the serial port on a dedicated thread.
+ *  \param[in] input Blocking serial read function.
+ *  \param[in] cpu CPU to pin the thread to, RX_CPU_AUTO or RX_CPU_NONE.
+ *  \return  0 on success, -1 on failure.
+ **************************************************************************************************/
+int rx_thread_start(RxInput_t input, int cpu)
+{
+    int ret;
+
+    rxInput = input;
+    __atomic_store_n(&rxRunning, true, __ATOMIC_RELEASE);
+
+#if defined(_WIN32) && !defined(__CYGWIN__)
+    ret = pthread_create(&rxThread, NULL, rx_thread, NULL);
+#else
+    // SIGINT stays with the main thread, which polls the flag set by its handler.
+    sigset_t blocked, previous;
+    sigemptyset(&blocked);
+    sigaddset(&blocked, SIGINT);
+    pthread_sigmask(SIG_BLOCK, &blocked, &previous);
+    ret = pthread_create(&rxThread, NULL, rx_thread, NULL);
+    pthread_sigmask(SIG_SETMASK, &previous, NULL);
+#endif
+
+    if (ret != 0) {
+        rxRunning = false;
+        return -1;
+    }
+    pin_thread(cpu);
+    return 0;
+}
+
+// Ask the RX thread to quit and wait for it. It notices within one serial read timeout.
+void rx_thread_stop(void)
+{
+    if (__atomic_exchange_n(&rxRunning, false, __ATOMIC_ACQ_REL)) {
+        wake_all(&rxDrained);
+        pthread_join(rxThread, NULL);
+    }
+}
+
+// True if the serial port read failed while the thread was running.
+bool rx_thread_failed(void)
+{
+    return __atomic_load_n(&rxFailed, __ATOMIC_ACQUIRE);
+}
+
+/***********************************************************************************************/ /**
+ *  \brief  BGLIB input function. Blocks until len bytes have been taken from the queue.
+ *  \param[in] len Number of bytes requested.
+ *  \param[out] data Destination buffer.
+ *  \return  Number of bytes read, -1 if the RX thread has failed.
+ **************************************************************************************************/
+int32_t rx_queue_input(uint32_t len, uint8_t *data)
+{
+    uint32_t copied = 0;
+
+    while (copied < len) {
+        uint16_t available;
+
+        while (!currentFrame && !next_frame()) {
+            if (!wait_frame()) {
+                return -1;
+            }
+        }
+
+        available = currentFrame->len - currentOffset;
+        if (available > (len - copied)) {
+            available = (uint16_t)(len - copied);
+        }
+        memcpy(data + copied, &currentFrame->data[currentOffset], available);
+        currentOffset += available;
+        copied += available;
+
+        if (currentOffset == currentFrame->len) {
+            // Slot consumed, hand it back to the RX thread.
+            currentFrame = NULL;
+            __atomic_store_n(&rxTail, rxTail + 1, __ATOMIC_SEQ_CST);
+            wake(&rxWaiting, &rxDrained);
+        }
+    }
+    return (int32_t)len;
+}
+
+// BGLIB peek function. Bytes that can be read without waiting, at most one frame.
+int32_t rx_queue_peek(void)
+{
+    if (!currentFrame && !next_frame()) {
+        return 0;
+    }
+    return currentFrame->len - currentOffset;
+}
+
+/***********************************************************************************************/ /**
+ *  \brief  Arrival time of the oldest event frame not yet returned by gecko_peek_event().
+ *  BGLIB hands out events in the order they were read, also those it queued while waiting
+ *  for a command response, so a FIFO of event arrival times stays in step with it.
+ *  \param[out] timeUs Arrival time in monotonic microseconds.
+ *  \return  false if no time is pending.
+ **************************************************************************************************/
+bool rx_queue_pop_event_time(uint64_t *timeUs)
+{
+    if (eventTimesCount == 0) {
+        return false;
+    }
+    *timeUs = eventTimes[(uint8_t)(eventTimesHead - eventTimesCount) % RX_EVENT_TIMES];
+    eventTimesCount--;
+    return true;
+}
+
+// Most frames that have been waiting in the queue at once.
+uint32_t rx_queue_high_water(void)
+{
+    return __atomic_load_n(&rxHighWater, __ATOMIC_RELAXED);
+}
+
+/***************************************************************************************************
+ * Static Function Definitions
+ **************************************************************************************************/
+
+static void *rx_thread(void *arg)
+{
+    (void)arg;
+
+    while (__atomic_load_n(&rxRunning, __ATOMIC_ACQUIRE)) {
+        uint32_t head = rxHead;
+        uint32_t used = head - __atomic_load_n(&rxTail, __ATOMIC_ACQUIRE);
+        RxFrame_t *frame;
+        uint16_t payloadLen;
+
+        if (used == RX_QUEUE_SLOTS) {
+            // Application is a full ring behind. Let the serial driver and flow control buffer.
+            wait_slot();
+            continue;
+        }
+        if (used >= rxHighWater) {
+            __atomic_store_n(&rxHighWater, used + 1, __ATOMIC_RELAXED);
+        }
+
+        frame = &rxRing[head % RX_QUEUE_SLOTS];
+        if (!read_exact(frame->data, RX_HEADER_LEN)) {
+            break;
+        }
+        frame->timeUs = monotonic_now_us();
+        payloadLen = (uint16_t)(((frame->data[0] & 0x07) << 8) | frame->data[1]);
+        if ((payloadLen > 0) && !read_exact(&frame->data[RX_HEADER_LEN], payloadLen)) {
+            break;
+        }
+        frame->len = RX_HEADER_LEN + payloadLen;
+
+        __atomic_store_n(&rxHead, head + 1, __ATOMIC_SEQ_CST);
+        wake(&appWaiting, &rxFilled);
+    }
+    // The application may be waiting for a frame that won't come.
+    wake_all(&rxFilled);
+    return NULL;
+}
+
+// Read until len bytes are in or the port fails. Serial reads time out, so a stop request
+// is noticed between reads.
+static bool read_exact(uint8_t *data, uint32_t len)
+{
+    uint32_t got = 0;
+
+    while (got < len) {
+        int32_t ret = rxInput(len - got, data + got);
+
+        if (!__atomic_load_n(&rxRunning, __ATOMIC_ACQUIRE)) {
+            return false;
+        }
+        if (ret < 0) {
+            __atomic_store_n(&rxFailed, true, __ATOMIC_RELEASE);
+            return false;
+        }
+        got += (uint32_t)ret;
+    }
+    return true;
+}
+
+static void pin_thread(int cpu)
+{
+#if defined(__linux__)
+    cpu_set_t set;
+
+    if (cpu == RX_CPU_NONE) {
+        return;
+    }
+    if (cpu == RX_CPU_AUTO) {
+        cpu = (int)sysconf(_SC_NPROCESSORS_ONLN) - 1;
+    }
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    if (pthread_setaffinity_np(rxThread, sizeof(set), &set) != 0) {
+        printf("Could not pin RX thread to CPU %d\n", cpu);
+    }
+#else
+    (void)cpu; // Only supported on Linux.
+#endif
+}
+
+// Take the next queued frame, if any, and note its arrival time if it's an event.
+static bool next_frame(void)
+{
+    if (__atomic_load_n(&rxHead, __ATOMIC_ACQUIRE) == rxTail) {
+        return false;
+    }
+
+    currentFrame = &rxRing[rxTail % RX_QUEUE_SLOTS];
+    currentOffset = 0;
+
+    if (currentFrame->data[0] & 0x80) {
+        eventTimes[eventTimesHead] = currentFrame->timeUs;
+        eventTimesHead = (eventTimesHead + 1) % RX_EVENT_TIMES;
+        if (eventTimesCount < RX_EVENT_TIMES) {
+            eventTimesCount++;
+        }
+    }
+    return true;
+}
+
+// Sleep until the RX thread queues a frame. Returns false if it has quit, e.g. on a port failure.
+static bool wait_frame(void)
+{
+    bool alive;
+
+    pthread_mutex_lock(&rxLock);
+    __atomic_store_n(&appWaiting, true, __ATOMIC_SEQ_CST);
+    while ((alive = (__atomic_load_n(&rxRunning, __ATOMIC_ACQUIRE) && !rx_thread_failed()))
+           && (__atomic_load_n(&rxHead, __ATOMIC_SEQ_CST) == rxTail)) {
+        pthread_cond_wait(&rxFilled, &rxLock);
+    }
+    __atomic_store_n(&appWaiting, false, __ATOMIC_RELAXED);
+    pthread_mutex_unlock(&rxLock);
+    return alive || (__atomic_load_n(&rxHead, __ATOMIC_ACQUIRE) != rxTail);
+}
+
+// Sleep until the application hands a slot back or a stop is asked for.
+static void wait_slot(void)
+{
+    pthread_mutex_lock(&rxLock);
+    __atomic_store_n(&rxWaiting, true, __ATOMIC_SEQ_CST);
+    while (__atomic_load_n(&rxRunning, __ATOMIC_ACQUIRE)
+           && ((rxHead - __atomic_load_n(&rxTail, __ATOMIC_SEQ_CST)) == RX_QUEUE_SLOTS)) {
+        pthread_cond_wait(&rxDrained, &rxLock);
+    }
+    __atomic_store_n(&rxWaiting, false, __ATOMIC_RELAXED);
+    pthread_mutex_unlock(&rxLock);
+}
+
+// Wake the other side if it has flagged that it sleeps. The index it waits on is stored with
+// sequential consistency before the flag is read, and the sleeper sets the flag before it reads
+// the index, so one of the two always sees the other.
+static void wake(bool *waiting, pthread_cond_t *cond)
+{
+    if (__atomic_load_n(waiting, __ATOMIC_SEQ_CST)) {
+        wake_all(cond);
+    }
+}
+
+static void wake_all(pthread_cond_t *cond)
+{
+    pthread_mutex_lock(&rxLock);
+    pthread_cond_broadcast(cond);
+    pthread_mutex_unlock(&rxLock);
+}
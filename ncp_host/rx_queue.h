@@ -0,0 +1,43 @@
+/***********************************************************************************************/ /**
+ * \file   rx_queue.h
+ * \brief  Serial RX thread and single-producer/single-consumer frame queue
+ **************************************************************************************************/
+
+#ifndef RX_QUEUE_H
+#define RX_QUEUE_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/***************************************************************************************************
+ * Type Definitions
+ **************************************************************************************************/
+// Blocking read function of the serial port, e.g. uartRx.
+typedef int32_t (*RxInput_t)(uint32_t len, uint8_t *data);
+
+#define RX_CPU_NONE     (-1)    // Don't pin the RX thread
+#define RX_CPU_AUTO     (-2)    // Pin the RX thread to the last online CPU
+
+/***************************************************************************************************
+ * Function Declarations
+ **************************************************************************************************/
+// RX thread. Reads whole BGAPI frames from input and queues them with their arrival time.
+int rx_thread_start(RxInput_t input, int cpu);
+void rx_thread_stop(void);
+bool rx_thread_failed(void);
+
+// Application side. Drop-in BGLIB input and peek functions reading from the queue.
+int32_t rx_queue_input(uint32_t len, uint8_t *data);
+int32_t rx_queue_peek(void);
+bool rx_queue_pop_event_time(uint64_t *timeUs);
+uint32_t rx_queue_high_water(void);
+
+#ifdef __cplusplus
+};
+#endif
+
+#endif /* RX_QUEUE_H */
@@ -0,0 +1,143 @@
+/***********************************************************************************************/ /**
+ * \file   tt_top.c
+ * \brief  Live view of a running throughput tester, read from its --live-stats segment
+ *
+ * The segment is mapped read-only, so any number of viewers can watch without slowing the tester.
+ **************************************************************************************************/
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <stdbool.h>
+#include <signal.h>
+#include <unistd.h>
+
+#include "live_stats.h"
+#include "monotonic.h"
+
+// --------------------------------
+// Local variables and constants
+#define TT_TOP_DEFAULT_PERIOD_MS    500
+#define TT_TOP_STALE_US             2000000     // The tester updates every 50 ms, this long means it is stuck or gone
+
+// State_t of app.h, in order.
+static const char *const STATE_NAMES[] = {"scanning", "setting parameters", "discovering", "transmission", "broadcast scan", "plan step"};
+
+static volatile int stop = 0;
+
+/***************************************************************************************************
+ * Static Function Declarations
+ **************************************************************************************************/
+static void sighandler(int sig) { stop = 1; }
+static void usage(void);
+static void print_stats(const char *name, const LiveStats_t *stats);
+
+/***************************************************************************************************
+ * Public Function Definitions
+ **************************************************************************************************/
+
+/***********************************************************************************************/ /**
+ *  \brief  tt_top [--once] [--period <ms>] <name>
+ *  \param[in] argc Argument count.
+ *  \param[in] argv Arguments.
+ *  \return  0 on success, 1 when the segment can't be read.
+ **************************************************************************************************/
+int main(int argc, char *argv[])
+{
+    const char *name = NULL;
+    bool once = false;
+    long periodMs = TT_TOP_DEFAULT_PERIOD_MS;
+    bool attached = false;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--once") == 0) {
+            once = true;
+        } else if ((strcmp(argv[i], "--period") == 0) && ((i + 1) < argc)) {
+            periodMs = strtol(argv[++i], NULL, 10);
+        } else if ((argv[i][0] == '/') && (name == NULL)) {
+            name = argv[i];
+        } else {
+            usage();
+            return 1;
+        }
+    }
+    if ((name == NULL) || (periodMs < 10)) {
+        usage();
+        return 1;
+    }
+
+    signal(SIGINT, sighandler);
+    while (!stop) {
+        LiveStats_t stats;
+
+        if (!attached) {
+            attached = (live_stats_attach(name) == 0);
+        }
+        if (attached && live_stats_read(&stats)) {
+            print_stats(name, &stats);
+            // A tester that has gone away leaves the old mapping behind, look for a new one.
+            if ((monotonic_now_us() - stats.updatedUs) > TT_TOP_STALE_US) {
+                live_stats_detach();
+                attached = false;
+            }
+        } else if (once) {
+            printf("No live statistics under %s, start the tester with --live-stats %s\n", name, name);
+        } else {
+            printf("\033[H\033[2JWaiting for a tester writing %s...\n", name);
+            fflush(stdout);
+        }
+        if (once) {
+            break;
+        }
+        usleep((useconds_t)periodMs * 1000);
+    }
+
+    live_stats_detach();
+    return attached ? 0 : 1;
+}
+
+/***************************************************************************************************
+ * Static Function Definitions
+ **************************************************************************************************/
+
+static void usage(void)
+{
+    printf("Usage: tt_top [--once] [--period <ms>] <name>\n");
+    printf("  <name>          - Segment given to the tester with --live-stats, e.g. /tt0\n");
+    printf("  --once          - Print one snapshot and exit, e.g. for loggers.\n");
+    printf("  --period <ms>   - Refresh period, default %u ms.\n", TT_TOP_DEFAULT_PERIOD_MS);
+}
+
+static void print_stats(const char *name, const LiveStats_t *stats)
+{
+    uint64_t ageUs = monotonic_now_us() - stats->updatedUs;
+    const char *state = (stats->state < (sizeof(STATE_NAMES) / sizeof(STATE_NAMES[0]))) ? STATE_NAMES[stats->state] : "?";
+
+    printf("\033[H\033[2J");
+    printf("%s - pid %u, updated %.2f s ago%s\n\n", name, stats->pid, (double)ageUs / 1e6,
+           (ageUs > TT_TOP_STALE_US) ? " (stale)" : "");
+    printf("State:      %s, mode %u%s, %u runs done\n", state, stats->mode,
+           stats->measuring ? ", measuring" : "", stats->runs);
+    if (stats->connected) {
+        printf("Link:       PHY %u, interval %.2f ms, latency %u, timeout %u ms, MTU %u, PDU %u\n",
+               stats->phy, stats->interval * 1.25, stats->slaveLatency, stats->supervisionTimeout * 10u, stats->mtu, stats->pdu);
+    } else {
+        printf("Link:       not connected\n");
+    }
+    if (stats->rssi != LIVE_STATS_RSSI_UNKNOWN) {
+        printf("RSSI:       %d dBm\n", stats->rssi);
+    } else {
+        printf("RSSI:       -\n");
+    }
+    printf("\n");
+    printf("Run:        %.2f s, %llu B, %u packets\n", stats->seconds, (unsigned long long)stats->bytes, stats->operations);
+    printf("Throughput: %u bps over the last window, %u bps over the run\n", stats->windowThroughput, stats->throughput);
+    if ((stats->roundTrips > 0) || (stats->pingsLost > 0)) {
+        printf("Latency:    %u round trips, %u pings lost\n", stats->roundTrips, stats->pingsLost);
+    }
+    printf("\n");
+    printf("Errors:     %u setup timeouts, transmission writes %u deferred, %u retries, %u dropped, last error 0x%04x\n",
+           stats->setupTimeouts, stats->cmdDeferred, stats->cmdRetries, stats->cmdDropped, stats->cmdLastError);
+    fflush(stdout);
+}
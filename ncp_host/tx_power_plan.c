@@ -0,0 +1,185 @@
+/***********************************************************************************************/ /**
+ * \file   tx_power_plan.c
+ * \brief  TX power levels run one after another on a live connection
+ *
+ * Each level gets one fixed time run. The NCP and, through the test plan, the slave are set to the
+ * level and the powers the stacks actually set are kept next to throughput and RSSI. The lowest
+ * level that still reaches the target throughput is what matters for battery life.
+ **************************************************************************************************/
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <stdbool.h>
+
+#include "tx_power_plan.h"
+
+/***************************************************************************************************
+ * Static Function Declarations
+ **************************************************************************************************/
+static int parse_level(const char *text, int16_t *level);
+static void print_dbm(int16_t level);
+
+/***************************************************************************************************
+ * Public Function Definitions
+ **************************************************************************************************/
+
+/***********************************************************************************************/ /**
+ *  \brief  Build a TX power plan from the command line.
+ *  \param[out] plan Plan to fill, the target throughput is left at 0.
+ *  \param[in] spec Levels in dBm.
+ *  \return  0 on success, -1 on a malformed list or too many levels.
+ **************************************************************************************************/
+int tx_power_plan_parse(TxPowerPlan_t *plan, const char *spec)
+{
+    char buf[256];
+    char *token;
+
+    memset(plan, 0, sizeof(TxPowerPlan_t));
+    if (strlen(spec) >= sizeof(buf)) {
+        return -1;
+    }
+    strcpy(buf, spec);
+    for (token = strtok(buf, ","); token != NULL; token = strtok(NULL, ",")) {
+        if (plan->count >= TX_POWER_PLAN_MAX_LEVELS) {
+            return -1;
+        }
+        if (parse_level(token, &plan->levels[plan->count].requested) < 0) {
+            return -1;
+        }
+        plan->count++;
+    }
+    tx_power_plan_restart(plan);
+    return (plan->count > 0) ? 0 : -1;
+}
+
+// Forget the results and start again from the first level.
+void tx_power_plan_restart(TxPowerPlan_t *plan)
+{
+    for (uint8_t i = 0; i < plan->count; i++) {
+        TxPowerLevel_t *level = &plan->levels[i];
+
+        level->actual = TX_POWER_UNKNOWN;
+        level->peerActual = TX_POWER_UNKNOWN;
+        level->rssi = 0;
+        level->throughput = 0;
+        level->peerThroughput = 0;
+        level->done = false;
+    }
+    plan->current = 0;
+}
+
+// True while levels are left to run.
+bool tx_power_plan_pending(const TxPowerPlan_t *plan)
+{
+    return plan->current < plan->count;
+}
+
+// Requested power of the level to run next, 0.1 dBm.
+int16_t tx_power_plan_level(const TxPowerPlan_t *plan)
+{
+    return plan->levels[(plan->current < plan->count) ? plan->current : (plan->count - 1)].requested;
+}
+
+// Powers the NCP and the slave stacks set for the current level, 0.1 dBm.
+void tx_power_plan_set_actual(TxPowerPlan_t *plan, int16_t actual, int16_t peerActual)
+{
+    if (plan->current < plan->count) {
+        plan->levels[plan->current].actual = actual;
+        plan->levels[plan->current].peerActual = peerActual;
+    }
+}
+
+// Host measured throughput of the run on the current level.
+void tx_power_plan_record(TxPowerPlan_t *plan, uint32_t throughput)
+{
+    if (plan->current < plan->count) {
+        plan->levels[plan->current].throughput = throughput;
+    }
+}
+
+void tx_power_plan_set_rssi(TxPowerPlan_t *plan, int8_t rssi)
+{
+    if (plan->current < plan->count) {
+        plan->levels[plan->current].rssi = rssi;
+    }
+}
+
+// Slave result of the current level has arrived, move on to the next level.
+void tx_power_plan_complete(TxPowerPlan_t *plan, uint32_t peerThroughput)
+{
+    if (plan->current >= plan->count) {
+        return;
+    }
+    plan->levels[plan->current].peerThroughput = peerThroughput;
+    plan->levels[plan->current].done = true;
+    plan->current++;
+}
+
+// Print the result of each level and the lowest level reaching the target.
+void tx_power_plan_print(const TxPowerPlan_t *plan)
+{
+    int lowest = -1;
+
+    printf("-------------------------------\n");
+    printf("TX POWER PROFILE:\n\n");
+    printf("Requested    NCP set  Slave set  RSSI  Throughput (bps)  Slave (bps)\n");
+    for (uint8_t i = 0; i < plan->count; i++) {
+        const TxPowerLevel_t *level = &plan->levels[i];
+
+        print_dbm(level->requested);
+        printf("  ");
+        print_dbm(level->actual);
+        printf("  ");
+        print_dbm(level->peerActual);
+        if (level->done) {
+            printf(" %5d %17u %12u\n", level->rssi, level->throughput, level->peerThroughput);
+        } else {
+            printf(" %5s %17s %12s\n", "-", "-", "-");
+        }
+        if (level->done && (plan->targetBps > 0) && (level->throughput >= plan->targetBps)
+            && ((lowest < 0) || (level->actual < plan->levels[lowest].actual))) {
+            lowest = i;
+        }
+    }
+
+    if (plan->targetBps > 0) {
+        printf("\n");
+        if (lowest < 0) {
+            printf("No level reached %u bps.\n", plan->targetBps);
+        } else {
+            printf("Lowest level reaching %u bps: ", plan->targetBps);
+            print_dbm(plan->levels[lowest].actual);
+            printf(", %u bps at RSSI %d\n", plan->levels[lowest].throughput, plan->levels[lowest].rssi);
+        }
+    }
+    printf("-------------------------------\n\n");
+}
+
+/***************************************************************************************************
+ * Static Function Definitions
+ **************************************************************************************************/
+
+// dBm with at most one decimal into 0.1 dBm.
+static int parse_level(const char *text, int16_t *level)
+{
+    char *end;
+    double dbm = strtod(text, &end);
+
+    if ((end == text) || (*end != '\0') || (dbm < -30.0) || (dbm > 20.0)) {
+        return -1;
+    }
+    *level = (int16_t)((dbm < 0) ? ((dbm * 10.0) - 0.5) : ((dbm * 10.0) + 0.5));
+    return 0;
+}
+
+// 9 characters wide.
+static void print_dbm(int16_t level)
+{
+    if (level == TX_POWER_UNKNOWN) {
+        printf("%9s", "-");
+    } else {
+        printf("%5.1f dBm", (double)level / 10.0);
+    }
+}
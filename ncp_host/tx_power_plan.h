@@ -0,0 +1,57 @@
+/***********************************************************************************************/ /**
+ * \file   tx_power_plan.h
+ * \brief  TX power levels run one after another on a live connection
+ **************************************************************************************************/
+
+#ifndef TX_POWER_PLAN_H
+#define TX_POWER_PLAN_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/***************************************************************************************************
+ * Type Definitions
+ **************************************************************************************************/
+#define TX_POWER_PLAN_MAX_LEVELS    16
+#define TX_POWER_UNKNOWN            0x7FFF  // Same value as TEST_PLAN_TX_POWER_KEEP
+
+typedef struct {
+    int16_t requested;          // 0.1 dBm
+    int16_t actual;             // Set on the NCP by the stack
+    int16_t peerActual;         // Set on the slave, TX_POWER_UNKNOWN if the slave can't tell
+    int8_t rssi;                // Of the slave, read at the end of the run
+    uint32_t throughput;        // Host measured, bps
+    uint32_t peerThroughput;    // Reported by the slave, bps
+    bool done;
+} TxPowerLevel_t;
+
+typedef struct {
+    TxPowerLevel_t levels[TX_POWER_PLAN_MAX_LEVELS];
+    uint8_t count;
+    uint8_t current;            // Level of the run in progress or next to run
+    uint32_t targetBps;         // Lowest level still reaching this is reported, 0 for none
+} TxPowerPlan_t;
+
+/***************************************************************************************************
+ * Function Declarations
+ **************************************************************************************************/
+// Levels in dBm separated by ',', one decimal allowed, e.g. "10,6,3,0,-5.5".
+int tx_power_plan_parse(TxPowerPlan_t *plan, const char *spec);
+void tx_power_plan_restart(TxPowerPlan_t *plan);
+bool tx_power_plan_pending(const TxPowerPlan_t *plan);
+int16_t tx_power_plan_level(const TxPowerPlan_t *plan);
+void tx_power_plan_set_actual(TxPowerPlan_t *plan, int16_t actual, int16_t peerActual);
+void tx_power_plan_record(TxPowerPlan_t *plan, uint32_t throughput);
+void tx_power_plan_set_rssi(TxPowerPlan_t *plan, int8_t rssi);
+void tx_power_plan_complete(TxPowerPlan_t *plan, uint32_t peerThroughput);
+void tx_power_plan_print(const TxPowerPlan_t *plan);
+
+#ifdef __cplusplus
+};
+#endif
+
+#endif /* TX_POWER_PLAN_H */
@@ -61,6 +61,7 @@ void appMain(gecko_configuration_t *pconfig)
 #endif
 
   setup_pins_interrupts();
+  setup_command_queue();
    // Set mode to master if PB0 pressed at boot time.
   if (GPIO_PinInGet(BSP_BUTTON0_PORT, BSP_BUTTON0_PIN)) {
     roleIsSlave = true;
@@ -69,11 +70,22 @@ void appMain(gecko_configuration_t *pconfig)
     roleIsSlave = false;
     roleString = (char *)ROLE_SCANNER_STRING;
   }
+  // PB1 held as well at boot time selects connectionless mode.
+  if (!GPIO_PinInGet(BSP_BUTTON1_PORT, BSP_BUTTON1_PIN)) {
+    connectionless = true;
+    roleString = (char *)(roleIsSlave ? ROLE_BROADCAST_STRING : ROLE_BROADCAST_SCAN_STRING);
+  }
 
   // Initialize display
   GRAPHICS_Init();
 
-  if (roleIsSlave) {
+  if (connectionless) {
+    if (roleIsSlave) {
+      broadcaster_main();
+    } else {
+      broadcast_scanner_main();
+    }
+  } else if (roleIsSlave) {
     slave_main();
   } else {
     master_main();
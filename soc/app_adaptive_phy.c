@@ -0,0 +1,137 @@
+/***************************************************************************//**
+ * @file app_adaptive_phy.c
+ * @brief PHY selection policy for the adaptive mode
+ *******************************************************************************/
+
+#include <string.h>
+#include "app_adaptive_phy.h"
+
+// Indexed slowest to fastest, so a higher index is a faster PHY.
+static const uint8_t PHYS[ADAPTIVE_PHY_COUNT] = { ADAPTIVE_PHY_S8, ADAPTIVE_PHY_1M, ADAPTIVE_PHY_2M };
+// Lowest RSSI worth using the PHY at, about 8 dB above typical sensitivity.
+static const int8_t RSSI_FLOOR[ADAPTIVE_PHY_COUNT] = { -95, -89, -86 };
+// Goodput expected with a good signal at the default intervals, bps.
+static const uint32_t NOMINAL_GOODPUT[ADAPTIVE_PHY_COUNT] = { 90000, 700000, 1300000 };
+
+static int8_t phy_index(uint8_t phy);
+
+/**
+ * @brief adaptive_phy_reset
+ * Forget all measurements, e.g. on a new connection.
+ * @param ctx - Policy state
+ * @param allowed - Mask of PHYs the radio supports
+ */
+void adaptive_phy_reset(AdaptivePhy_t *ctx, uint8_t allowed) {
+  memset(ctx, 0, sizeof(AdaptivePhy_t));
+  ctx->allowed = allowed;
+}
+
+/**
+ * @brief adaptive_phy_window
+ * Feed one measurement window taken while data was flowing.
+ * @param ctx - Policy state
+ * @param phy - PHY in use during the window
+ * @param bps - Goodput measured over the window
+ * @param rssi - Latest RSSI in dBm
+ * @return PHY to switch to, 0 to stay
+ */
+uint8_t adaptive_phy_window(AdaptivePhy_t *ctx, uint8_t phy, uint32_t bps, int8_t rssi) {
+  int8_t current = phy_index(phy);
+  uint8_t best = 0;
+  uint32_t bestEstimate = 0;
+
+  if (current < 0) {
+    return 0;
+  }
+  if (ctx->windowsOnPhy < UINT8_MAX) {
+    ctx->windowsOnPhy++;
+  }
+  // The first window after a switch still contains the PHY update procedure.
+  if (ctx->windowsOnPhy == 1) {
+    return 0;
+  }
+
+  if (ctx->measured[current] && (ctx->windowsOnPhy > 2)) {
+    ctx->goodput[current] = (ctx->goodput[current] + bps) / 2;
+  } else {
+    ctx->goodput[current] = bps;
+  }
+  ctx->goodputRssi[current] = rssi;
+  ctx->measured[current] = true;
+
+  if (ctx->windowsOnPhy <= ADAPTIVE_PHY_MIN_DWELL_WINDOWS) {
+    return 0;
+  }
+
+  for (uint8_t i = 0; i < ADAPTIVE_PHY_COUNT; i++) {
+    uint32_t estimate;
+    if (i == current) {
+      continue;
+    }
+    estimate = adaptive_phy_estimate(ctx, PHYS[i], phy, rssi);
+    if (estimate > bestEstimate) {
+      bestEstimate = estimate;
+      best = PHYS[i];
+    }
+  }
+
+  if (best && (((uint64_t) bestEstimate * 100) > ((uint64_t) ctx->goodput[current] * (100 + ADAPTIVE_PHY_MARGIN_PERCENT)))) {
+    if (best == ctx->candidate) {
+      ctx->betterWindows++;
+    } else {
+      ctx->candidate = best;
+      ctx->betterWindows = 1;
+    }
+    if (ctx->betterWindows >= ADAPTIVE_PHY_HOLD_WINDOWS) {
+      ctx->windowsOnPhy = 0;
+      ctx->candidate = 0;
+      ctx->betterWindows = 0;
+      return best;
+    }
+  } else {
+    ctx->candidate = 0;
+    ctx->betterWindows = 0;
+  }
+  return 0;
+}
+
+/**
+ * @brief adaptive_phy_estimate
+ * Goodput expected on a PHY at the given RSSI.
+ * @param ctx - Policy state
+ * @param phy - PHY to estimate
+ * @param current - PHY in use, its measurement is taken as is
+ * @param rssi - Latest RSSI in dBm
+ * @return Estimated goodput in bps, 0 if the PHY is unsupported or the signal is too weak for it
+ */
+uint32_t adaptive_phy_estimate(const AdaptivePhy_t *ctx, uint8_t phy, uint8_t current, int8_t rssi) {
+  int8_t i = phy_index(phy);
+  int8_t c = phy_index(current);
+  int16_t floor;
+
+  if ((i < 0) || !(ctx->allowed & phy)) {
+    return 0;
+  }
+  if (i == c) {
+    return ctx->goodput[i];
+  }
+
+  floor = RSSI_FLOOR[i] + ((i > c) ? ADAPTIVE_PHY_HYSTERESIS_DB : 0);
+  if (rssi < floor) {
+    return 0;
+  }
+  if (ctx->measured[i] && (((rssi - ctx->goodputRssi[i]) <= ADAPTIVE_PHY_RSSI_MATCH_DB)
+                           && ((ctx->goodputRssi[i] - rssi) <= ADAPTIVE_PHY_RSSI_MATCH_DB))) {
+    return ctx->goodput[i];
+  }
+  return NOMINAL_GOODPUT[i];
+}
+
+static int8_t phy_index(uint8_t phy) {
+  for (uint8_t i = 0; i < ADAPTIVE_PHY_COUNT; i++) {
+    if (PHYS[i] == phy) {
+      return i;
+    }
+  }
+  return -1;
+}
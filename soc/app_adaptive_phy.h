@@ -0,0 +1,55 @@
+/**
+ * @file
+ * @brief app_adaptive_phy.h
+ * PHY selection policy for the master's adaptive mode. Every window the
+ * measured goodput of the PHY in use is compared with an estimate for the
+ * other PHYs. The estimate is the goodput last measured on that PHY at a
+ * similar RSSI, or a nominal rate if the RSSI clears the PHY's floor.
+ * A switch needs a clear margin over several windows, and moving to a
+ * faster PHY needs extra RSSI headroom.
+ ******************************************************************************/
+
+#ifndef APP_ADAPTIVE_PHY_H
+#define APP_ADAPTIVE_PHY_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// PHY bits as used by le_connection_set_phy
+#define ADAPTIVE_PHY_1M   0x01
+#define ADAPTIVE_PHY_2M   0x02
+#define ADAPTIVE_PHY_S8   0x04
+#define ADAPTIVE_PHY_COUNT  3
+
+#define ADAPTIVE_PHY_MARGIN_PERCENT     20    // Another PHY must promise this much more goodput
+#define ADAPTIVE_PHY_HOLD_WINDOWS       3     // ... for this many windows in a row
+#define ADAPTIVE_PHY_MIN_DWELL_WINDOWS  5     // Windows to stay on a PHY after switching to it
+#define ADAPTIVE_PHY_HYSTERESIS_DB      6     // Extra RSSI needed above the floor to move to a faster PHY
+#define ADAPTIVE_PHY_RSSI_MATCH_DB      6     // A past measurement counts if taken within this RSSI
+
+typedef struct {
+  uint8_t allowed;                            // Mask of PHYs the radio supports
+  uint32_t goodput[ADAPTIVE_PHY_COUNT];       // Smoothed goodput per PHY, bps
+  int8_t goodputRssi[ADAPTIVE_PHY_COUNT];     // RSSI at the last measurement
+  bool measured[ADAPTIVE_PHY_COUNT];
+  uint8_t windowsOnPhy;                       // Windows since the last switch
+  uint8_t candidate;                          // PHY that looked better in the last window
+  uint8_t betterWindows;                      // Consecutive windows the candidate looked better
+} AdaptivePhy_t;
+
+/**************************************************************************//**
+ * Adaptive PHY function declarations
+ *****************************************************************************/
+void adaptive_phy_reset(AdaptivePhy_t *ctx, uint8_t allowed);
+uint8_t adaptive_phy_window(AdaptivePhy_t *ctx, uint8_t phy, uint32_t bps, int8_t rssi);
+uint32_t adaptive_phy_estimate(const AdaptivePhy_t *ctx, uint8_t phy, uint8_t current, int8_t rssi);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
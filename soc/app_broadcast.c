@@ -0,0 +1,185 @@
+/***************************************************************************//**
+ * @file app_broadcast.c
+ * @brief Connectionless throughput framing and counters
+ *******************************************************************************/
+
+#include <string.h>
+#include "app_broadcast.h"
+#include "app_payload.h"
+
+#define AD_TYPE_MANUFACTURER    0xFF
+#define AD_MAX_DATA             254     // AD length byte counts the type and at most 254 data bytes
+#define COMPANY_ID              0x02FF  // Silicon Labs
+#define BROADCAST_TAG_0         'T'
+#define BROADCAST_TAG_1         'B'
+
+static const char *const PHY_NAMES[BROADCAST_PHYS] = { "1M", "2M", "Coded" };
+
+/**
+ * @brief broadcast_build
+ * Fill advertising data with the header and as much rolling payload as fits.
+ * The payload continues from what the buffer held before, so pass the same buffer every time.
+ * @param data - Advertising data buffer
+ * @param len - Bytes to fill, BROADCAST_HEADER_LEN to BROADCAST_MAX_LEN
+ * @param seq - Sequence number of this update
+ * @param phy - PHY the data is sent on, 1 = 1M, 2 = 2M, 4 = Coded
+ * @return Bytes filled
+ */
+uint16_t broadcast_build(uint8_t *data, uint16_t len, uint32_t seq, uint8_t phy) {
+  uint16_t pos = 0;
+
+  if (len > BROADCAST_MAX_LEN) {
+    len = BROADCAST_MAX_LEN;
+  }
+  if (len < BROADCAST_HEADER_LEN) {
+    return 0;
+  }
+
+  data[pos++] = BROADCAST_HEADER_LEN - 1;
+  data[pos++] = AD_TYPE_MANUFACTURER;
+  data[pos++] = (uint8_t) COMPANY_ID;
+  data[pos++] = (uint8_t) (COMPANY_ID >> 8);
+  data[pos++] = BROADCAST_TAG_0;
+  data[pos++] = BROADCAST_TAG_1;
+  data[pos++] = (uint8_t) seq;
+  data[pos++] = (uint8_t) (seq >> 8);
+  data[pos++] = (uint8_t) (seq >> 16);
+  data[pos++] = (uint8_t) (seq >> 24);
+  data[pos++] = phy;
+
+  // Payload AD structures, an AD needs at least its length and type bytes plus one byte of data
+  while ((len - pos) >= 3) {
+    uint16_t chunk = len - pos - 2;
+    if (chunk > (AD_MAX_DATA - 1)) {
+      chunk = AD_MAX_DATA - 1;
+    }
+    data[pos++] = (uint8_t) (chunk + 1);
+    data[pos++] = AD_TYPE_MANUFACTURER;
+    payload_generate(&data[pos], chunk);
+    pos += chunk;
+  }
+  return pos;
+}
+
+/**
+ * @brief broadcast_parse
+ * @param data - Advertising data as received
+ * @param len - Length of data
+ * @param seq - Sequence number, set if the data is a broadcast
+ * @param phy - PHY the broadcaster sent on, set if the data is a broadcast
+ * @return true if the data starts with a broadcast header
+ */
+bool broadcast_parse(const uint8_t *data, uint16_t len, uint32_t *seq, uint8_t *phy) {
+  if ((len < BROADCAST_HEADER_LEN) || (data[0] != (BROADCAST_HEADER_LEN - 1)) || (data[1] != AD_TYPE_MANUFACTURER)
+      || (data[2] != (uint8_t) COMPANY_ID) || (data[3] != (uint8_t) (COMPANY_ID >> 8))
+      || (data[4] != BROADCAST_TAG_0) || (data[5] != BROADCAST_TAG_1)) {
+    return false;
+  }
+  *seq = (uint32_t) data[6] | ((uint32_t) data[7] << 8) | ((uint32_t) data[8] << 16) | ((uint32_t) data[9] << 24);
+  *phy = data[10];
+  return true;
+}
+
+/**
+ * @brief broadcast_rx_reset
+ * @param rx - Counters to clear
+ */
+void broadcast_rx_reset(BroadcastRx_t *rx) {
+  memset(rx, 0, sizeof(BroadcastRx_t));
+}
+
+/**
+ * @brief broadcast_rx_add
+ * Count received advertising data if it is a broadcast. A sequence number lower
+ * than the last one means the broadcaster restarted, counting resumes from it.
+ * @param rx - Counters
+ * @param data - Advertising data as received
+ * @param len - Length of data
+ * @param now - Current time
+ * @return true if the data was a broadcast
+ */
+bool broadcast_rx_add(BroadcastRx_t *rx, const uint8_t *data, uint16_t len, uint32_t now) {
+  BroadcastStats_t *stats;
+  uint32_t seq;
+  uint8_t phy;
+
+  if (!broadcast_parse(data, len, &seq, &phy)) {
+    return false;
+  }
+
+  stats = &rx->phy[broadcast_phy_index(phy)];
+  if (!stats->started) {
+    stats->started = true;
+    stats->firstAt = now;
+  } else if (seq == stats->lastSeq) {
+    stats->duplicates++;
+    return true;
+  } else if (seq > (stats->lastSeq + 1)) {
+    uint32_t skipped = seq - stats->lastSeq - 1;
+    stats->lost += skipped;
+    stats->gaps++;
+    if (skipped > stats->longestGap) {
+      stats->longestGap = skipped;
+    }
+  }
+
+  stats->lastSeq = seq;
+  stats->lastAt = now;
+  stats->packets++;
+  stats->bytes += len;
+  return true;
+}
+
+/**
+ * @brief broadcast_bps
+ * @param stats - Counters of one PHY
+ * @param ticksPerSecond - Clock units per second of the timestamps
+ * @return Unique bits per second from the first to the last packet, 0 before two packets
+ */
+uint32_t broadcast_bps(const BroadcastStats_t *stats, uint32_t ticksPerSecond) {
+  uint32_t span = stats->lastAt - stats->firstAt;
+
+  if ((stats->packets < 2) || (span == 0)) {
+    return 0;
+  }
+  return (uint32_t) ((stats->bytes * 8 * ticksPerSecond) / span);
+}
+
+/**
+ * @brief broadcast_loss_permille
+ * @param stats - Counters of one PHY
+ * @return Share of sequence numbers never received, in 0.1 %
+ */
+uint16_t broadcast_loss_permille(const BroadcastStats_t *stats) {
+  uint64_t expected = (uint64_t) stats->packets + stats->lost;
+
+  if (expected == 0) {
+    return 0;
+  }
+  return (uint16_t) (((uint64_t) stats->lost * 1000) / expected);
+}
+
+/**
+ * @brief broadcast_phy_index
+ * @param phy - PHY bit, 1 = 1M, 2 = 2M, 4 = Coded
+ * @return Index into the per-PHY counters
+ */
+uint8_t broadcast_phy_index(uint8_t phy) {
+  switch (phy) {
+    case 2:
+      return 1;
+    case 4:
+      return 2;
+    default:
+      return 0;
+  }
+}
+
+/**
+ * @brief broadcast_phy_name
+ * @param index - Index into the per-PHY counters
+ * @return Printable PHY name
+ */
+const char *broadcast_phy_name(uint8_t index) {
+  return (index < BROADCAST_PHYS) ? PHY_NAMES[index] : "?";
+}
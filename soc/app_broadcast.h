@@ -0,0 +1,59 @@
+/**
+ * @file
+ * @brief app_broadcast.h
+ * Connectionless throughput. The broadcaster fills extended advertising data
+ * with a header AD structure carrying a sequence number and the PHY it sends
+ * on, followed by manufacturer specific AD structures of rolling payload. The
+ * scanner counts unique packets, bytes and skipped sequence numbers per PHY.
+ * Timestamps are 32-bit counts in any unit, wrap-around is fine as long as a
+ * measurement is shorter than one wrap.
+ ******************************************************************************/
+
+#ifndef APP_BROADCAST_H
+#define APP_BROADCAST_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#define BROADCAST_HEADER_LEN    11      // AD length, type, company id, tag, sequence number, PHY
+#define BROADCAST_MAX_LEN       253     // Non-connectable extended advertising data set in one command
+#define BROADCAST_PHYS          3       // 1M, 2M and Coded
+
+typedef struct {
+  uint32_t packets;             // Unique sequence numbers received
+  uint32_t duplicates;          // Same data seen again in a later advertising event
+  uint32_t lost;                // Sequence numbers skipped
+  uint32_t gaps;                // Runs of skipped sequence numbers
+  uint32_t longestGap;          // Longest run of skipped sequence numbers
+  uint64_t bytes;               // Advertising data bytes of unique packets
+  uint32_t firstAt;
+  uint32_t lastAt;
+  uint32_t lastSeq;
+  bool started;
+} BroadcastStats_t;
+
+typedef struct {
+  BroadcastStats_t phy[BROADCAST_PHYS];
+} BroadcastRx_t;
+
+/**************************************************************************//**
+ * Connectionless throughput function declarations
+ *****************************************************************************/
+uint16_t broadcast_build(uint8_t *data, uint16_t len, uint32_t seq, uint8_t phy);
+bool broadcast_parse(const uint8_t *data, uint16_t len, uint32_t *seq, uint8_t *phy);
+void broadcast_rx_reset(BroadcastRx_t *rx);
+bool broadcast_rx_add(BroadcastRx_t *rx, const uint8_t *data, uint16_t len, uint32_t now);
+uint32_t broadcast_bps(const BroadcastStats_t *stats, uint32_t ticksPerSecond);
+uint16_t broadcast_loss_permille(const BroadcastStats_t *stats);
+uint8_t broadcast_phy_index(uint8_t phy);
+const char *broadcast_phy_name(uint8_t index);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,111 @@
+/***************************************************************************//**
+ * @file app_clock_sync.c
+ * @brief Slave RTCC stamps and the drift fit on the receiving side
+ *******************************************************************************/
+
+#include <string.h>
+#include <math.h>
+#include "app_clock_sync.h"
+
+/**
+ * @brief clock_stamp
+ * Write the RTCC count at the start of a notification or indication.
+ * @param data - Payload
+ * @param len - Payload length, shorter than CLOCK_STAMP_LEN leaves it unstamped
+ * @param ticks - RTCC count at the time the payload is handed to the stack
+ */
+void clock_stamp(uint8_t *data, uint16_t len, uint32_t ticks) {
+  if (len < CLOCK_STAMP_LEN) {
+    return;
+  }
+  for (uint8_t i = 0; i < CLOCK_STAMP_LEN; i++) {
+    data[i] = (uint8_t) (ticks >> (8 * i));
+  }
+}
+
+/**
+ * @brief clock_stamp_read
+ * @param data - Received payload
+ * @param len - Received length
+ * @param ticks - Slave RTCC count
+ * @return false if the payload is too short to carry a stamp
+ */
+bool clock_stamp_read(const uint8_t *data, uint16_t len, uint32_t *ticks) {
+  if (len < CLOCK_STAMP_LEN) {
+    return false;
+  }
+  *ticks = (uint32_t) data[0] | ((uint32_t) data[1] << 8) | ((uint32_t) data[2] << 16) | ((uint32_t) data[3] << 24);
+  return true;
+}
+
+/**
+ * @brief clock_sync_reset
+ * Start of a run on the receiving side.
+ */
+void clock_sync_reset(ClockSync_t *sync) {
+  memset(sync, 0, sizeof(ClockSync_t));
+}
+
+/**
+ * @brief clock_sync_add
+ * Take one stamped packet. The RTCC wraps every 36 hours, so the count is unwrapped
+ * from the difference to the previous stamp.
+ * @param sync - Fit in progress
+ * @param ticks - Slave RTCC count carried by the packet
+ * @param rxUs - Receive time on the local clock
+ * @param len - Packet length, counted in the throughput over the stamped span
+ */
+void clock_sync_add(ClockSync_t *sync, uint32_t ticks, uint64_t rxUs, uint16_t len) {
+  double x, y, dx, dy;
+
+  if (sync->count == 0) {
+    sync->firstTicks = ticks;
+    sync->firstUs = rxUs;
+  } else {
+    sync->ticks += (int32_t) (ticks - sync->lastTicks);
+    sync->bits += (uint64_t) len * 8;
+  }
+  sync->lastTicks = ticks;
+  sync->lastUs = rxUs;
+  sync->count++;
+
+  x = (double) sync->ticks / CLOCK_TICKS_PER_SECOND;
+  y = (double) (int64_t) (rxUs - sync->firstUs) / 1e6;
+  dx = x - sync->meanX;
+  dy = y - sync->meanY;
+  sync->meanX += dx / sync->count;
+  sync->meanY += dy / sync->count;
+  sync->cxx += dx * (x - sync->meanX);
+  sync->cxy += dx * (y - sync->meanY);
+  sync->cyy += dy * (y - sync->meanY);
+}
+
+/**
+ * @brief clock_sync_fit
+ * Least squares line of receiver time over slave time.
+ * @param sync - Stamps of the run
+ * @param fit - Rate, offset and their spread
+ * @return false with fewer than CLOCK_SYNC_MIN_STAMPS stamps or no slave time between them
+ */
+bool clock_sync_fit(const ClockSync_t *sync, ClockFit_t *fit) {
+  double residuals;
+  double variance;
+  double intercept;
+
+  if ((sync->count < CLOCK_SYNC_MIN_STAMPS) || (sync->cxx <= 0)) {
+    return false;
+  }
+  fit->stamps = sync->count;
+  fit->rate = sync->cxy / sync->cxx;
+  residuals = sync->cyy - (fit->rate * sync->cxy);
+  variance = (residuals > 0) ? (residuals / (sync->count - 2)) : 0;
+  fit->rateError = sqrt(variance / sync->cxx);
+  fit->jitterUs = sqrt(variance) * 1e6;
+  // Both axes start at the first stamp, move the intercept back to the clocks themselves.
+  intercept = sync->meanY - (fit->rate * sync->meanX);
+  fit->offsetUs = (double) sync->firstUs + (intercept * 1e6) - (((double) sync->firstTicks * 1e6) / CLOCK_TICKS_PER_SECOND);
+  fit->slaveSeconds = (double) sync->ticks / CLOCK_TICKS_PER_SECOND;
+  fit->receiverSeconds = (double) (sync->lastUs - sync->firstUs) / 1e6;
+  fit->bits = sync->bits;
+  return true;
+}
@@ -0,0 +1,71 @@
+/**
+ * @file
+ * @brief app_clock_sync.h
+ * Slave RTCC against receiver clock. With TEST_PLAN_FLAG_CLOCK_STAMPS set
+ * the slave writes its RTCC count into the first CLOCK_STAMP_LEN bytes of
+ * every notification and indication, little endian, just before handing it
+ * to the stack. Stream notifications carry the same count in their header
+ * anyway. The receiver fits its own receive times against the stamps by
+ * least squares: the slope is the rate of its clock against the slave
+ * RTCC, the intercept the offset between the two including the one-way
+ * delay. Queueing in the slave TX queue shows up as residuals, it only
+ * biases the slope if the queue keeps growing or shrinking over the run.
+ ******************************************************************************/
+
+#ifndef APP_CLOCK_SYNC_H
+#define APP_CLOCK_SYNC_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#define CLOCK_STAMP_LEN             4
+#define CLOCK_TICKS_PER_SECOND      32768   // Slave RTCC
+#define CLOCK_SYNC_MIN_STAMPS       16      // Fewer give no useful error estimate
+
+typedef struct {
+  uint32_t count;
+  uint32_t firstTicks;
+  uint32_t lastTicks;
+  int64_t ticks;                    // Since the first stamp, unwrapped
+  uint64_t firstUs;                 // Receive time of the first stamp
+  uint64_t lastUs;
+  uint64_t bits;                    // Payload after the first stamped packet
+  // Running means and co-moments of x = slave seconds and y = receiver seconds since the first
+  // stamp, updated one stamp at a time so long runs don't lose the residuals to rounding.
+  double meanX;
+  double meanY;
+  double cxx;
+  double cxy;
+  double cyy;
+} ClockSync_t;
+
+typedef struct {
+  uint32_t stamps;
+  double rate;                      // Receiver seconds per slave second
+  double rateError;                 // Standard error of rate
+  double offsetUs;                  // Receiver minus slave time at the first stamp, one-way delay included
+  double jitterUs;                  // Standard deviation of the residuals
+  double slaveSeconds;              // First to last stamp on each clock
+  double receiverSeconds;
+  uint64_t bits;                    // Carried between the first and the last stamp
+} ClockFit_t;
+
+/**************************************************************************//**
+ * Clock sync function declarations
+ *****************************************************************************/
+void clock_stamp(uint8_t *data, uint16_t len, uint32_t ticks);
+bool clock_stamp_read(const uint8_t *data, uint16_t len, uint32_t *ticks);
+
+void clock_sync_reset(ClockSync_t *sync);
+void clock_sync_add(ClockSync_t *sync, uint32_t ticks, uint64_t rxUs, uint16_t len);
+bool clock_sync_fit(const ClockSync_t *sync, ClockFit_t *fit);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,151 @@
+/***************************************************************************//**
+ * @file app_cmd_queue.c
+ * @brief Deferred retry of stack commands
+ *******************************************************************************/
+
+#include <string.h>
+#include "app_cmd_queue.h"
+
+static CmdStats_t *stats_for(CmdQueue_t *queue, uint8_t id);
+
+/**
+ * @brief cmd_queue_init
+ * Start with an empty queue and zeroed counters.
+ * @param queue - Queue to set up
+ * @param clock - Time source for the retry gap
+ * @param retryGap - Minimum time between two attempts of the same command
+ * @param maxAttempts - Attempts before a command is dropped, including the first
+ */
+void cmd_queue_init(CmdQueue_t *queue, CmdClock_t clock, uint32_t retryGap, uint16_t maxAttempts) {
+  memset(queue, 0, sizeof(CmdQueue_t));
+  queue->clock = clock;
+  queue->retryGap = retryGap;
+  queue->maxAttempts = maxAttempts ? maxAttempts : 1;
+}
+
+/**
+ * @brief cmd_queue_submit
+ * Issue a command now if nothing is pending, otherwise or if it fails queue it for later.
+ * @param queue - Queue
+ * @param id - Command id for the counters, below CMD_QUEUE_IDS
+ * @param issue - Function issuing the command
+ * @param args - Arguments passed to issue, copied
+ * @param len - Length of args, at most CMD_QUEUE_ARGS_MAX
+ * @return true if the command went out straight away
+ */
+bool cmd_queue_submit(CmdQueue_t *queue, uint8_t id, CmdIssue_t issue, const void *args, uint8_t len) {
+  CmdStats_t *stats = stats_for(queue, id);
+  CmdEntry_t *entry;
+  uint8_t copy[CMD_QUEUE_ARGS_MAX] = { 0 };
+  uint16_t result;
+
+  if (len > CMD_QUEUE_ARGS_MAX) {
+    len = CMD_QUEUE_ARGS_MAX;
+  }
+  if (len > 0) {
+    memcpy(copy, args, len);
+  }
+
+  if (queue->count == 0) {
+    result = issue(copy);
+    if (result == 0) {
+      stats->issued++;
+      return true;
+    }
+    stats->lastError = result;
+  } else {
+    result = 0;
+  }
+
+  if (queue->count == CMD_QUEUE_DEPTH) {
+    stats->dropped++;
+    return false;
+  }
+
+  entry = &queue->entries[(queue->head + queue->count) % CMD_QUEUE_DEPTH];
+  entry->issue = issue;
+  entry->id = id;
+  entry->lastResult = result;
+  entry->attempts = (result != 0) ? 1 : 0;
+  entry->lastAttempt = queue->clock();
+  memcpy(entry->args, copy, sizeof(copy));
+  queue->count++;
+  stats->deferred++;
+  return false;
+}
+
+/**
+ * @brief cmd_queue_pump
+ * Retry pending commands in order, stopping at the first one that still fails
+ * or isn't due yet. Call from the main loop.
+ * @param queue - Queue
+ * @return Number of commands still pending
+ */
+uint8_t cmd_queue_pump(CmdQueue_t *queue) {
+  while (queue->count > 0) {
+    CmdEntry_t *entry = &queue->entries[queue->head];
+    CmdStats_t *stats = stats_for(queue, entry->id);
+    uint32_t now = queue->clock();
+    uint16_t result;
+
+    if ((entry->attempts > 0) && ((now - entry->lastAttempt) < queue->retryGap)) {
+      break;
+    }
+
+    result = entry->issue(entry->args);
+    entry->attempts++;
+    entry->lastAttempt = now;
+    if (result != 0) {
+      entry->lastResult = result;
+      stats->lastError = result;
+      stats->retries++;
+      if (entry->attempts < queue->maxAttempts) {
+        break;
+      }
+      stats->dropped++;
+    } else {
+      stats->issued++;
+    }
+
+    queue->head = (queue->head + 1) % CMD_QUEUE_DEPTH;
+    queue->count--;
+  }
+  return queue->count;
+}
+
+/**
+ * @brief cmd_queue_clear
+ * Drop everything pending, e.g. when the connection the commands refer to closes.
+ * @param queue - Queue
+ */
+void cmd_queue_clear(CmdQueue_t *queue) {
+  while (queue->count > 0) {
+    stats_for(queue, queue->entries[queue->head].id)->dropped++;
+    queue->head = (queue->head + 1) % CMD_QUEUE_DEPTH;
+    queue->count--;
+  }
+}
+
+/**
+ * @brief cmd_queue_pending
+ * @param queue - Queue
+ * @return true while any command is waiting to go out
+ */
+bool cmd_queue_pending(const CmdQueue_t *queue) {
+  return (queue->count > 0);
+}
+
+/**
+ * @brief cmd_queue_stats
+ * @param queue - Queue
+ * @param id - Command id
+ * @return Counters of the command id
+ */
+const CmdStats_t *cmd_queue_stats(const CmdQueue_t *queue, uint8_t id) {
+  return &queue->stats[(id < CMD_QUEUE_IDS) ? id : (CMD_QUEUE_IDS - 1)];
+}
+
+// Ids out of range share the last slot rather than writing past the table.
+static CmdStats_t *stats_for(CmdQueue_t *queue, uint8_t id) {
+  return &queue->stats[(id < CMD_QUEUE_IDS) ? id : (CMD_QUEUE_IDS - 1)];
+}
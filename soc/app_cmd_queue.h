@@ -0,0 +1,74 @@
+/**
+ * @file
+ * @brief app_cmd_queue.h
+ * Deferred retry of stack commands. A command that fails, typically because
+ * the stack is out of buffers while a transfer is running, is kept with its
+ * arguments and issued again from the main loop instead of being spun on.
+ * Commands go out in submission order, a new one waits behind any that are
+ * still pending. Each command is tried at most maxAttempts times, at least
+ * retryGap clock units apart, then dropped. Counters are kept per command id.
+ * Clearing the queue drops every pending command, whatever its id.
+ ******************************************************************************/
+
+#ifndef APP_CMD_QUEUE_H
+#define APP_CMD_QUEUE_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#define CMD_QUEUE_DEPTH     8
+#define CMD_QUEUE_IDS       8           // Distinct command ids counted
+#define CMD_QUEUE_ARGS_MAX  8           // Bytes of arguments kept per command
+
+// Issues the command, returns the stack result code, 0 on success.
+typedef uint16_t (*CmdIssue_t)(const void *args);
+
+// Monotonic clock in any unit, wrap-around is fine.
+typedef uint32_t (*CmdClock_t)(void);
+
+typedef struct {
+  CmdIssue_t issue;
+  uint32_t lastAttempt;
+  uint16_t attempts;
+  uint16_t lastResult;
+  uint8_t id;
+  uint8_t args[CMD_QUEUE_ARGS_MAX];
+} CmdEntry_t;
+
+typedef struct {
+  uint32_t issued;              // Went out, first time or after retries
+  uint32_t deferred;            // Failed on submission and were queued
+  uint32_t retries;             // Failed attempts from the queue
+  uint32_t dropped;             // Gave up, queue full or cleared
+  uint16_t lastError;           // Result of the last failed attempt
+} CmdStats_t;
+
+typedef struct {
+  CmdEntry_t entries[CMD_QUEUE_DEPTH];
+  uint8_t head;
+  uint8_t count;
+  uint16_t maxAttempts;
+  uint32_t retryGap;
+  CmdClock_t clock;
+  CmdStats_t stats[CMD_QUEUE_IDS];
+} CmdQueue_t;
+
+/**************************************************************************//**
+ * Command queue function declarations
+ *****************************************************************************/
+void cmd_queue_init(CmdQueue_t *queue, CmdClock_t clock, uint32_t retryGap, uint16_t maxAttempts);
+bool cmd_queue_submit(CmdQueue_t *queue, uint8_t id, CmdIssue_t issue, const void *args, uint8_t len);
+uint8_t cmd_queue_pump(CmdQueue_t *queue);
+void cmd_queue_clear(CmdQueue_t *queue);
+bool cmd_queue_pending(const CmdQueue_t *queue);
+const CmdStats_t *cmd_queue_stats(const CmdQueue_t *queue, uint8_t id);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
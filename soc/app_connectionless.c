@@ -0,0 +1,292 @@
+/***************************************************************************//**
+ * @file app_connectionless.c
+ * @brief Connectionless mode functions:
+ * broadcaster_main: streams rolling payload in non-connectable extended advertising
+ * broadcast_scanner_main: counts received broadcast bytes, duplicates and gaps per PHY
+ ******************************************************************************/
+
+#include "app.h"
+#include "app_utils.h"
+#include "app_broadcast.h"
+
+// Broadcaster
+static uint8_t broadcastData[BROADCAST_MAX_LEN];
+static uint8_t broadcastPhy = PHY_1M;
+static uint32_t broadcastSeq = 0;
+static bool broadcasting = false;
+
+// Scanner
+static BroadcastRx_t broadcastRx;
+static uint8_t scanPhy = le_gap_phy_1m;
+
+static void broadcast_start(void);
+static void broadcast_stop(void);
+static void broadcast_update(void);
+static void broadcast_next_phy(void);
+static void broadcaster_display(void);
+static void broadcast_scan_start(void);
+static void broadcast_scanner_display(void);
+static void broadcast_scanner_report(void);
+static void append_line(const char *text);
+
+/***************************************************************************************************
+ * @brief Broadcaster main loop
+ **************************************************************************************************/
+void broadcaster_main(void) {
+  while (1) {
+    struct gecko_cmd_packet *evt;
+
+    evt = gecko_peek_event();
+    switch (BGLIB_MSG_ID(evt->header)) {
+      case gecko_evt_system_boot_id:
+        txPowerResp = gecko_cmd_system_set_tx_power(TX_POWER)->set_power;
+        broadcast_start();
+        broadcaster_display();
+        gecko_cmd_hardware_set_soft_timer(HW_TICKS_PER_SECOND, SOFT_TIMER_DISPLAY_REFRESH_HANDLE, 0);
+        break;
+
+      case gecko_evt_hardware_soft_timer_id:
+        if (evt->data.evt_hardware_soft_timer.handle == SOFT_TIMER_BROADCAST_HANDLE) {
+          broadcast_update();
+        } else if (evt->data.evt_hardware_soft_timer.handle == SOFT_TIMER_DISPLAY_REFRESH_HANDLE) {
+          broadcaster_display();
+        }
+        break;
+
+      case gecko_evt_system_external_signal_id:
+        // PB0 pauses and resumes, PB1 moves to the next PHY
+        if (evt->data.evt_system_external_signal.extsignals & NOTIFICATIONS_START) {
+          if (broadcasting) {
+            broadcast_stop();
+          } else {
+            broadcast_start();
+          }
+        }
+        if (evt->data.evt_system_external_signal.extsignals & INDICATIONS_START) {
+          broadcast_next_phy();
+        }
+        broadcaster_display();
+        break;
+
+      default:
+        break;
+    }
+  }
+}
+
+/***************************************************************************************************
+ * @brief Broadcast scanner main loop
+ **************************************************************************************************/
+void broadcast_scanner_main(void) {
+  while (1) {
+    struct gecko_cmd_packet *evt;
+
+    evt = gecko_peek_event();
+    switch (BGLIB_MSG_ID(evt->header)) {
+      case gecko_evt_system_boot_id:
+        txPowerResp = gecko_cmd_system_set_tx_power(TX_POWER)->set_power;
+        broadcast_rx_reset(&broadcastRx);
+        broadcast_scan_start();
+        broadcast_scanner_display();
+        gecko_cmd_hardware_set_soft_timer(HW_TICKS_PER_SECOND, SOFT_TIMER_DISPLAY_REFRESH_HANDLE, 0);
+        break;
+
+      case gecko_evt_le_gap_scan_response_id:
+        // Bit 7 of the packet type marks extended advertising, legacy packets can't carry a broadcast
+        if (evt->data.evt_le_gap_scan_response.packet_type & 0x80) {
+          broadcast_rx_add(&broadcastRx, evt->data.evt_le_gap_scan_response.data.data,
+                           evt->data.evt_le_gap_scan_response.data.len, RTCC_CounterGet());
+        }
+        break;
+
+      case gecko_evt_hardware_soft_timer_id:
+        if (evt->data.evt_hardware_soft_timer.handle == SOFT_TIMER_DISPLAY_REFRESH_HANDLE) {
+          broadcast_scanner_display();
+        }
+        break;
+
+      case gecko_evt_system_external_signal_id:
+        // PB0 logs the results and starts counting again, PB1 toggles the scanning PHY
+        if (evt->data.evt_system_external_signal.extsignals & (LATENCY_START | SWEEP_TOGGLE)) {
+          broadcast_scanner_report();
+          broadcast_rx_reset(&broadcastRx);
+        }
+        if (evt->data.evt_system_external_signal.extsignals & SCAN_PHY_CHANGE) {
+#if defined(_SILICON_LABS_32B_SERIES_1_CONFIG_3) || defined(_SILICON_LABS_32B_SERIES_2_CONFIG_1)
+          scanPhy = (scanPhy == le_gap_phy_1m) ? le_gap_phy_coded : le_gap_phy_1m;
+#endif
+          gecko_cmd_le_gap_end_procedure();
+          broadcast_scan_start();
+        }
+        broadcast_scanner_display();
+        break;
+
+      default:
+        break;
+    }
+  }
+}
+
+/**
+ * @brief broadcast_start
+ * Set up the broadcast advertising set on the current PHY and start sending.
+ * Extended advertising needs a secondary PHY, 2M and Coded data is announced on 1M and Coded primaries.
+ */
+static void broadcast_start(void) {
+  uint8_t primary = (broadcastPhy == PHY_S8) ? le_gap_phy_coded : le_gap_phy_1m;
+
+  set_phy_string(broadcastPhy);
+  gecko_cmd_le_gap_set_advertise_timing(BROADCAST_ADV_SET, BROADCAST_ADV_INTERVAL, BROADCAST_ADV_INTERVAL, 0, 0);
+  gecko_cmd_le_gap_set_advertise_channel_map(BROADCAST_ADV_SET, 7);
+  gecko_cmd_le_gap_clear_advertise_configuration(BROADCAST_ADV_SET, 1); // Extended PDUs, legacy ones carry only 31 bytes
+  gecko_cmd_le_gap_set_advertise_phy(BROADCAST_ADV_SET, primary, broadcastPhy);
+  broadcast_update();
+  gecko_cmd_le_gap_start_advertising(BROADCAST_ADV_SET, le_gap_user_data, le_gap_non_connectable);
+  gecko_cmd_hardware_set_soft_timer(BROADCAST_UPDATE_TICKS, SOFT_TIMER_BROADCAST_HANDLE, 0);
+  broadcasting = true;
+  printLog("Broadcast: PHY %s, %u bytes every %u ms\r\n", phyString + 5, BROADCAST_MAX_LEN,
+           (unsigned int) ((BROADCAST_UPDATE_TICKS * 1000) / HW_TICKS_PER_SECOND));
+}
+
+/**
+ * @brief broadcast_stop
+ */
+static void broadcast_stop(void) {
+  gecko_cmd_hardware_set_soft_timer(0, SOFT_TIMER_BROADCAST_HANDLE, 0);
+  gecko_cmd_le_gap_stop_advertising(BROADCAST_ADV_SET);
+  broadcasting = false;
+}
+
+/**
+ * @brief broadcast_update
+ * Put the next sequence number and payload into the advertising data. Updates come a bit
+ * slower than advertising events so every update is on air at least once.
+ */
+static void broadcast_update(void) {
+  uint16_t len = broadcast_build(broadcastData, BROADCAST_MAX_LEN, broadcastSeq, broadcastPhy);
+
+  if (gecko_cmd_le_gap_bt5_set_adv_data(BROADCAST_ADV_SET, 0, len, broadcastData)->result == 0) {
+    broadcastSeq++;
+  }
+}
+
+/**
+ * @brief broadcast_next_phy
+ * Cycle 1M -> 2M -> Coded S8 -> 1M, skipping PHYs the chip lacks, and restart on the new PHY.
+ */
+static void broadcast_next_phy(void) {
+  switch (broadcastPhy) {
+    case PHY_1M:
+#if defined(_SILICON_LABS_32B_SERIES_1_CONFIG_2) || defined(_SILICON_LABS_32B_SERIES_1_CONFIG_3) || defined(_SILICON_LABS_32B_SERIES_2_CONFIG_1)
+      broadcastPhy = PHY_2M;
+#endif
+      break;
+
+    case PHY_2M:
+#if defined(_SILICON_LABS_32B_SERIES_1_CONFIG_3) || defined(_SILICON_LABS_32B_SERIES_2_CONFIG_1)
+      broadcastPhy = PHY_S8;
+#else
+      broadcastPhy = PHY_1M;
+#endif
+      break;
+
+    default:
+      broadcastPhy = PHY_1M;
+      break;
+  }
+
+  set_phy_string(broadcastPhy);
+  if (broadcasting) {
+    broadcast_stop();
+    broadcast_start();
+  }
+}
+
+/**
+ * @brief broadcaster_display
+ */
+static void broadcaster_display(void) {
+  char text[17];
+
+  set_phy_string(broadcastPhy);
+  GRAPHICS_Clear();
+  GRAPHICS_AppendString(roleString);
+  sprintf(txPowerString + 4, ((txPowerResp / 10) == 0) ? "%01d dBm" : "%+0d dBm", txPowerResp / 10); // 0 dBm without sign
+  GRAPHICS_AppendString(txPowerString);
+  append_line(broadcasting ? "STATUS: On" : "STATUS: Off");
+  append_line(phyString);
+  snprintf(text, sizeof(text), "SEQ: %lu", (unsigned long) broadcastSeq);
+  append_line(text);
+  // Offered rate, what reaches a scanner is shown there
+  snprintf(text, sizeof(text), "TX: %lu bps",
+           (unsigned long) (((uint64_t) BROADCAST_MAX_LEN * 8 * HW_TICKS_PER_SECOND) / BROADCAST_UPDATE_TICKS));
+  append_line(text);
+  GRAPHICS_Update();
+}
+
+/**
+ * @brief broadcast_scan_start
+ * Passive scanning on the selected primary PHY. Broadcasts on 2M are announced on 1M.
+ */
+static void broadcast_scan_start(void) {
+  gecko_cmd_le_gap_set_discovery_type(5, 0);
+  gecko_cmd_le_gap_set_discovery_timing(5, SCAN_INTERVAL, SCAN_WINDOW);
+  gecko_cmd_le_gap_start_discovery(scanPhy, le_gap_discover_observation);
+}
+
+/**
+ * @brief broadcast_scanner_display
+ * Throughput and loss of each PHY heard from since the last reset.
+ */
+static void broadcast_scanner_display(void) {
+  char text[17];
+
+  GRAPHICS_Clear();
+  GRAPHICS_AppendString(roleString);
+  append_line((scanPhy == le_gap_phy_coded) ? "SCAN: CODED" : "SCAN: 1M");
+
+  for (uint8_t i = 0; i < BROADCAST_PHYS; i++) {
+    const BroadcastStats_t *stats = &broadcastRx.phy[i];
+    uint16_t loss = broadcast_loss_permille(stats);
+
+    if (stats->packets == 0) {
+      continue;
+    }
+    snprintf(text, sizeof(text), "%-5s %5lu kbps", broadcast_phy_name(i),
+             (unsigned long) (broadcast_bps(stats, HW_TICKS_PER_SECOND) / 1000));
+    append_line(text);
+    snprintf(text, sizeof(text), "LOSS: %u.%u%%", loss / 10, loss % 10);
+    append_line(text);
+    snprintf(text, sizeof(text), "GAPS: %lu", (unsigned long) stats->gaps);
+    append_line(text);
+  }
+  GRAPHICS_Update();
+}
+
+/**
+ * @brief broadcast_scanner_report
+ * Log the results of each PHY heard from since the last reset.
+ */
+static void broadcast_scanner_report(void) {
+  for (uint8_t i = 0; i < BROADCAST_PHYS; i++) {
+    const BroadcastStats_t *stats = &broadcastRx.phy[i];
+    uint16_t loss = broadcast_loss_permille(stats);
+
+    if (stats->packets == 0) {
+      continue;
+    }
+    printLog("Broadcast %s: %lu bps, %lu packets, %lu bytes, %lu duplicates, %lu lost (%u.%u%%), %lu gaps, longest %lu\r\n",
+             broadcast_phy_name(i), (unsigned long) broadcast_bps(stats, HW_TICKS_PER_SECOND),
+             (unsigned long) stats->packets, (unsigned long) stats->bytes, (unsigned long) stats->duplicates,
+             (unsigned long) stats->lost, loss / 10, loss % 10, (unsigned long) stats->gaps,
+             (unsigned long) stats->longestGap);
+  }
+}
+
+// Append one display line, padded and terminated the way the other display strings are.
+static void append_line(const char *text) {
+  char line[17];
+
+  snprintf(line, sizeof(line), "%-15.15s\n", text);
+  GRAPHICS_AppendString(line);
+}
@@ -0,0 +1,143 @@
+/***************************************************************************//**
+ * @file app_event_census.c
+ * @brief Count and time of the BGAPI events handled in a run
+ *******************************************************************************/
+
+#include <string.h>
+#include "app_event_census.h"
+
+// Events the tester handles, BGAPI 2.x classes and IDs.
+typedef struct {
+  uint8_t cls;
+  uint8_t id;
+  const char *name;
+} EventName_t;
+
+static const EventName_t EVENT_NAMES[] = {
+  { 0x01, 0x00, "system_boot" },
+  { 0x01, 0x03, "system_external_signal" },
+  { 0x03, 0x00, "le_gap_scan_response" },
+  { 0x03, 0x01, "le_gap_adv_timeout" },
+  { 0x03, 0x04, "le_gap_extended_scan_response" },
+  { 0x08, 0x00, "le_connection_opened" },
+  { 0x08, 0x01, "le_connection_closed" },
+  { 0x08, 0x02, "le_connection_parameters" },
+  { 0x08, 0x03, "le_connection_rssi" },
+  { 0x08, 0x04, "le_connection_phy_status" },
+  { 0x09, 0x00, "gatt_mtu_exchanged" },
+  { 0x09, 0x01, "gatt_service" },
+  { 0x09, 0x02, "gatt_characteristic" },
+  { 0x09, 0x04, "gatt_characteristic_value" },
+  { 0x09, 0x06, "gatt_procedure_completed" },
+  { 0x0a, 0x00, "gatt_server_attribute_value" },
+  { 0x0a, 0x03, "gatt_server_characteristic_status" },
+  { 0x0c, 0x00, "hardware_soft_timer" },
+};
+
+/**
+ * @brief event_census_reset
+ * Start of a run.
+ * @param census - Census
+ * @param ticksPerSecond - Rate of the ticks given to event_census_add()
+ */
+void event_census_reset(EventCensus_t *census, uint32_t ticksPerSecond) {
+  memset(census, 0, sizeof(EventCensus_t));
+  census->ticksPerSecond = ticksPerSecond;
+}
+
+/**
+ * @brief event_census_add
+ * Count one handled event.
+ * @param census - Census
+ * @param msgId - BGLIB_MSG_ID() of the event header, class in bits 16-23 and ID in bits 24-31
+ * @param ticks - Time spent handling it
+ */
+void event_census_add(EventCensus_t *census, uint32_t msgId, uint32_t ticks) {
+  uint8_t cls = (uint8_t) (msgId >> 16);
+  uint8_t id = (uint8_t) (msgId >> 24);
+  EventCensusEntry_t *entry = &census->other;
+
+  if ((cls < EVENT_CENSUS_CLASSES) && (id < EVENT_CENSUS_IDS)) {
+    entry = &census->entries[cls][id];
+  }
+  entry->count++;
+  entry->ticks += ticks;
+  census->total++;
+  census->totalTicks += ticks;
+}
+
+/**
+ * @brief event_census_top
+ * The entries that took the most handling time, most first. A run of cheap events
+ * can still hurt by its count, so ties go to the larger count.
+ * @param census - Census
+ * @param top - Filled with up to max entries
+ * @param max - Room in top
+ * @return Number of entries filled in
+ */
+uint8_t event_census_top(const EventCensus_t *census, EventCensusTop_t *top, uint8_t max) {
+  uint8_t n = 0;
+
+  for (uint16_t i = 0; i <= (EVENT_CENSUS_CLASSES * EVENT_CENSUS_IDS); i++) {
+    const EventCensusEntry_t *entry;
+    EventCensusTop_t candidate;
+    uint8_t pos;
+
+    if (i < (EVENT_CENSUS_CLASSES * EVENT_CENSUS_IDS)) {
+      entry = &census->entries[i / EVENT_CENSUS_IDS][i % EVENT_CENSUS_IDS];
+      candidate.cls = (uint8_t) (i / EVENT_CENSUS_IDS);
+      candidate.id = (uint8_t) (i % EVENT_CENSUS_IDS);
+    } else {
+      entry = &census->other;
+      candidate.cls = EVENT_CENSUS_OTHER;
+      candidate.id = EVENT_CENSUS_OTHER;
+    }
+    if (entry->count == 0) {
+      continue;
+    }
+    candidate.count = entry->count;
+    candidate.ticks = entry->ticks;
+
+    // Insertion into the short sorted list.
+    for (pos = n; pos > 0; pos--) {
+      if ((top[pos - 1].ticks > candidate.ticks)
+          || ((top[pos - 1].ticks == candidate.ticks) && (top[pos - 1].count >= candidate.count))) {
+        break;
+      }
+      if (pos < max) {
+        top[pos] = top[pos - 1];
+      }
+    }
+    if (pos < max) {
+      top[pos] = candidate;
+      if (n < max) {
+        n++;
+      }
+    }
+  }
+  return n;
+}
+
+/**
+ * @brief event_census_us
+ * @return Ticks of the census in microseconds
+ */
+uint32_t event_census_us(const EventCensus_t *census, uint64_t ticks) {
+  if (census->ticksPerSecond == 0) {
+    return 0;
+  }
+  return (uint32_t) ((ticks * 1000000) / census->ticksPerSecond);
+}
+
+/**
+ * @brief event_census_name
+ * @return Name of an event the tester handles, NULL for others
+ */
+const char *event_census_name(uint8_t cls, uint8_t id) {
+  for (uint8_t i = 0; i < (sizeof(EVENT_NAMES) / sizeof(EVENT_NAMES[0])); i++) {
+    if ((EVENT_NAMES[i].cls == cls) && (EVENT_NAMES[i].id == id)) {
+      return EVENT_NAMES[i].name;
+    }
+  }
+  return NULL;
+}
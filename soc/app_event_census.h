@@ -0,0 +1,65 @@
+/**
+ * @file
+ * @brief app_event_census.h
+ * BGAPI events handled during a data run, counted per class and ID with the
+ * time spent on them. The table is indexed directly by the class and ID
+ * bytes of the message header, anything beyond it shares one entry. The
+ * handling time is in whatever ticks the caller measures, given once per
+ * run.
+ ******************************************************************************/
+
+#ifndef APP_EVENT_CENSUS_H
+#define APP_EVENT_CENSUS_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#ifndef EVENT_CENSUS_CLASSES
+#define EVENT_CENSUS_CLASSES    16      // Classes 0x00-0x0f, system to sm, have their own rows
+#endif
+
+#ifndef EVENT_CENSUS_IDS
+#define EVENT_CENSUS_IDS        16      // 4 kB of table with the classes above
+#endif
+
+#define EVENT_CENSUS_TOP        5       // Entries printed with a result
+#define EVENT_CENSUS_OTHER      0xFF    // Class and ID of the shared entry
+
+typedef struct {
+  uint32_t count;
+  uint64_t ticks;                   // Handling time
+} EventCensusEntry_t;
+
+typedef struct {
+  EventCensusEntry_t entries[EVENT_CENSUS_CLASSES][EVENT_CENSUS_IDS];
+  EventCensusEntry_t other;         // Classes and IDs the table has no room for
+  uint32_t ticksPerSecond;
+  uint32_t total;
+  uint64_t totalTicks;
+} EventCensus_t;
+
+typedef struct {
+  uint8_t cls;                      // EVENT_CENSUS_OTHER for the shared entry
+  uint8_t id;
+  uint32_t count;
+  uint64_t ticks;
+} EventCensusTop_t;
+
+/**************************************************************************//**
+ * Event census function declarations
+ *****************************************************************************/
+void event_census_reset(EventCensus_t *census, uint32_t ticksPerSecond);
+void event_census_add(EventCensus_t *census, uint32_t msgId, uint32_t ticks);
+uint8_t event_census_top(const EventCensus_t *census, EventCensusTop_t *top, uint8_t max);
+uint32_t event_census_us(const EventCensus_t *census, uint64_t ticks);
+const char *event_census_name(uint8_t cls, uint8_t id);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
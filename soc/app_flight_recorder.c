@@ -0,0 +1,178 @@
+/***************************************************************************//**
+ * @file app_flight_recorder.c
+ * @brief Flight recorder ring and its read-out chunks
+ *******************************************************************************/
+
+#include <string.h>
+#include "app_flight_recorder.h"
+
+static const char *const EVENT_NAMES[] = {
+  "?", "run start", "run end", "send ok", "send failed", "confirmation", "phy", "parameters"
+};
+
+static uint16_t oldest_slot(const FlightRecorder_t *rec);
+
+/**
+ * @brief flight_recorder_reset
+ * Forget the previous run.
+ */
+void flight_recorder_reset(FlightRecorder_t *rec) {
+  memset(rec, 0, sizeof(FlightRecorder_t));
+}
+
+/**
+ * @brief flight_recorder_add
+ * Record an event, overwriting the oldest one once the ring is full.
+ * @param rec - Recorder
+ * @param ticks - RTCC count of the event
+ * @param event - FlightEvent_t
+ * @param detail - Event detail
+ * @param value - Event value
+ */
+void flight_recorder_add(FlightRecorder_t *rec, uint32_t ticks, uint8_t event, uint8_t detail, uint16_t value) {
+  FlightRecord_t *record = &rec->records[rec->next];
+
+  if (rec->frozen) {
+    return;
+  }
+  if (rec->count < FLIGHT_RECORDER_RECORDS) {
+    rec->count++;
+  } else {
+    rec->overwritten++;
+  }
+  record->ticks = ticks;
+  record->event = event;
+  record->detail = detail;
+  record->value = value;
+  rec->next = (uint16_t) ((rec->next + 1) % FLIGHT_RECORDER_RECORDS);
+}
+
+/**
+ * @brief flight_recorder_send
+ * Record the outcome of a send. Failures with the same result in a row share one record
+ * holding their count, a stalled TX queue would otherwise overwrite the whole ring.
+ * @param rec - Recorder
+ * @param ticks - RTCC count of the attempt
+ * @param channel - FlightChannel_t
+ * @param result - BGAPI result of the send
+ * @param len - Bytes handed to the stack
+ */
+void flight_recorder_send(FlightRecorder_t *rec, uint32_t ticks, uint8_t channel, uint16_t result, uint16_t len) {
+  FlightRecord_t *last = &rec->records[(rec->next + FLIGHT_RECORDER_RECORDS - 1) % FLIGHT_RECORDER_RECORDS];
+
+  if (result == 0) {
+    flight_recorder_add(rec, ticks, FLIGHT_SEND_OK, channel, len);
+  } else if (!rec->frozen && (rec->count > 0) && (last->event == FLIGHT_SEND_FAILED)
+             && (last->detail == (uint8_t) result) && (last->value < 0xFFFF)) {
+    last->value++;
+  } else {
+    flight_recorder_add(rec, ticks, FLIGHT_SEND_FAILED, (uint8_t) result, 1);
+  }
+}
+
+/**
+ * @brief flight_recorder_chunk
+ * Encode the read-out chunk starting at a record.
+ * @param rec - Recorder, frozen while the dump goes out
+ * @param first - Index of the first record, 0 is the oldest
+ * @param maxLen - Room in the notification, at least FLIGHT_CHUNK_HEADER_LEN + FLIGHT_RECORD_LEN
+ * @param data - Chunk
+ * @return Chunk length, 0 if first is past the end
+ */
+uint16_t flight_recorder_chunk(const FlightRecorder_t *rec, uint16_t first, uint16_t maxLen, uint8_t *data) {
+  uint16_t len = FLIGHT_CHUNK_HEADER_LEN;
+
+  if ((first > rec->count) || ((first == rec->count) && (first > 0))) {
+    return 0;
+  }
+  if (maxLen > FLIGHT_CHUNK_MAX_LEN) {
+    maxLen = FLIGHT_CHUNK_MAX_LEN;
+  }
+  data[0] = (uint8_t) first;
+  data[1] = (uint8_t) (first >> 8);
+  data[2] = (uint8_t) rec->count;
+  data[3] = (uint8_t) (rec->count >> 8);
+  for (uint8_t i = 0; i < 4; i++) {
+    data[4 + i] = (uint8_t) (rec->overwritten >> (8 * i));
+  }
+  for (uint16_t i = first; (i < rec->count) && ((len + FLIGHT_RECORD_LEN) <= maxLen); i++) {
+    const FlightRecord_t *record = &rec->records[(oldest_slot(rec) + i) % FLIGHT_RECORDER_RECORDS];
+
+    for (uint8_t b = 0; b < 4; b++) {
+      data[len + b] = (uint8_t) (record->ticks >> (8 * b));
+    }
+    data[len + 4] = record->event;
+    data[len + 5] = record->detail;
+    data[len + 6] = (uint8_t) record->value;
+    data[len + 7] = (uint8_t) (record->value >> 8);
+    len += FLIGHT_RECORD_LEN;
+  }
+  return len;
+}
+
+/**
+ * @brief flight_recorder_abort_chunk
+ * Encode the header-only chunk that tells the client the dump ends here.
+ * @param rec - Recorder
+ * @param data - Chunk
+ * @return Chunk length
+ */
+uint16_t flight_recorder_abort_chunk(const FlightRecorder_t *rec, uint8_t *data) {
+  data[0] = (uint8_t) FLIGHT_CHUNK_ABORTED;
+  data[1] = (uint8_t) (FLIGHT_CHUNK_ABORTED >> 8);
+  data[2] = (uint8_t) rec->count;
+  data[3] = (uint8_t) (rec->count >> 8);
+  for (uint8_t i = 0; i < 4; i++) {
+    data[4 + i] = (uint8_t) (rec->overwritten >> (8 * i));
+  }
+  return FLIGHT_CHUNK_HEADER_LEN;
+}
+
+/**
+ * @brief flight_chunk_parse
+ * @param data - Received chunk
+ * @param len - Received length
+ * @param chunk - Header and the records it holds
+ * @return false if the chunk is too short or its records run past the dump. An abort
+ * chunk parses with first FLIGHT_CHUNK_ABORTED and no records.
+ */
+bool flight_chunk_parse(const uint8_t *data, uint16_t len, FlightChunk_t *chunk) {
+  if (len < FLIGHT_CHUNK_HEADER_LEN) {
+    return false;
+  }
+  chunk->first = (uint16_t) (data[0] | (data[1] << 8));
+  chunk->total = (uint16_t) (data[2] | (data[3] << 8));
+  chunk->overwritten = (uint32_t) data[4] | ((uint32_t) data[5] << 8) | ((uint32_t) data[6] << 16) | ((uint32_t) data[7] << 24);
+  chunk->records = (uint16_t) ((len - FLIGHT_CHUNK_HEADER_LEN) / FLIGHT_RECORD_LEN);
+  chunk->data = &data[FLIGHT_CHUNK_HEADER_LEN];
+  if (chunk->first == FLIGHT_CHUNK_ABORTED) {
+    chunk->records = 0;
+    return true;
+  }
+  return ((uint32_t) chunk->first + chunk->records) <= chunk->total;
+}
+
+/**
+ * @brief flight_record_decode
+ * @param data - FLIGHT_RECORD_LEN bytes of a chunk
+ * @param record - Decoded record
+ */
+void flight_record_decode(const uint8_t *data, FlightRecord_t *record) {
+  record->ticks = (uint32_t) data[0] | ((uint32_t) data[1] << 8) | ((uint32_t) data[2] << 16) | ((uint32_t) data[3] << 24);
+  record->event = data[4];
+  record->detail = data[5];
+  record->value = (uint16_t) (data[6] | (data[7] << 8));
+}
+
+/**
+ * @brief flight_event_name
+ * @param event - FlightEvent_t
+ * @return Short name for logs
+ */
+const char *flight_event_name(uint8_t event) {
+  return (event < (sizeof(EVENT_NAMES) / sizeof(EVENT_NAMES[0]))) ? EVENT_NAMES[event] : EVENT_NAMES[0];
+}
+
+static uint16_t oldest_slot(const FlightRecorder_t *rec) {
+  return (uint16_t) ((rec->next + FLIGHT_RECORDER_RECORDS - rec->count) % FLIGHT_RECORDER_RECORDS);
+}
@@ -0,0 +1,103 @@
+/**
+ * @file
+ * @brief app_flight_recorder.h
+ * Send events of the last run kept in a RAM ring on the slave, read out
+ * over GATT afterwards. The ring is cleared when a run starts and keeps the
+ * newest FLIGHT_RECORDER_RECORDS events, older ones are overwritten. The
+ * ring is frozen while it is being dumped, so a dump is one consistent run.
+ *
+ * Record, 8 bytes little endian:
+ *   0-3   slave RTCC count
+ *   4     event, FlightEvent_t
+ *   5     detail, see FlightEvent_t
+ *   6-7   value, see FlightEvent_t
+ *
+ * Read-out: the client subscribes to notifications of the flight_recorder
+ * characteristic and writes FLIGHT_DUMP_START to it. The slave answers
+ * between runs with chunks, a header followed by as many whole records as
+ * fit, oldest first:
+ *   0-1   index of the first record in the chunk
+ *   2-3   records in the dump
+ *   4-7   records overwritten before the oldest one
+ * An empty ring is dumped as one chunk holding the header only. A slave that
+ * has to give up on a dump ends it with a header-only chunk whose first
+ * index is FLIGHT_CHUNK_ABORTED. Nothing is recorded while a dump is going
+ * out.
+ ******************************************************************************/
+
+#ifndef APP_FLIGHT_RECORDER_H
+#define APP_FLIGHT_RECORDER_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#ifndef FLIGHT_RECORDER_RECORDS
+#define FLIGHT_RECORDER_RECORDS     512     // 4 kB of RAM
+#endif
+#define FLIGHT_RECORD_LEN           8
+#define FLIGHT_CHUNK_HEADER_LEN     8
+#define FLIGHT_CHUNK_MAX_LEN        244     // Characteristic size
+#define FLIGHT_DUMP_START           0x01
+#define FLIGHT_CHUNK_ABORTED        0xFFFF  // First index of the chunk ending a dump the slave gave up on
+
+typedef enum {
+  FLIGHT_RUN_START = 1,         // detail: PlanDirection_t of the run, value: payload size
+  FLIGHT_RUN_END = 2,
+  FLIGHT_SEND_OK = 3,           // detail: FlightChannel_t, value: bytes handed to the stack
+  FLIGHT_SEND_FAILED = 4,       // detail: BGAPI result - 0x0100, value: attempts in a row failing with it
+  FLIGHT_CONFIRMATION = 5,      // value: bytes confirmed
+  FLIGHT_PHY_CHANGE = 6,        // detail: PHY
+  FLIGHT_PARAMETERS = 7         // detail: PDU size, value: connection interval in 1.25 ms units
+} FlightEvent_t;
+
+typedef enum {
+  FLIGHT_CHANNEL_NOTIFY = 0,
+  FLIGHT_CHANNEL_INDICATE = 1,
+  FLIGHT_CHANNEL_STREAM = 2     // Stream n is FLIGHT_CHANNEL_STREAM + n - 1
+} FlightChannel_t;
+
+typedef struct {
+  uint32_t ticks;
+  uint8_t event;
+  uint8_t detail;
+  uint16_t value;
+} FlightRecord_t;
+
+typedef struct {
+  FlightRecord_t records[FLIGHT_RECORDER_RECORDS];
+  uint16_t next;                // Slot of the next record
+  uint16_t count;
+  uint32_t overwritten;
+  bool frozen;                  // Dump in progress
+} FlightRecorder_t;
+
+typedef struct {
+  uint16_t first;
+  uint16_t total;
+  uint32_t overwritten;
+  uint16_t records;             // Whole records in this chunk
+  const uint8_t *data;          // The first of them
+} FlightChunk_t;
+
+/**************************************************************************//**
+ * Flight recorder function declarations
+ *****************************************************************************/
+void flight_recorder_reset(FlightRecorder_t *rec);
+void flight_recorder_add(FlightRecorder_t *rec, uint32_t ticks, uint8_t event, uint8_t detail, uint16_t value);
+void flight_recorder_send(FlightRecorder_t *rec, uint32_t ticks, uint8_t channel, uint16_t result, uint16_t len);
+uint16_t flight_recorder_chunk(const FlightRecorder_t *rec, uint16_t first, uint16_t maxLen, uint8_t *data);
+uint16_t flight_recorder_abort_chunk(const FlightRecorder_t *rec, uint8_t *data);
+
+bool flight_chunk_parse(const uint8_t *data, uint16_t len, FlightChunk_t *chunk);
+void flight_record_decode(const uint8_t *data, FlightRecord_t *record);
+const char *flight_event_name(uint8_t event);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,56 @@
+/***************************************************************************//**
+ * @file app_gap_detector.c
+ * @brief Gaps between received packets of a data run
+ *******************************************************************************/
+
+#include <string.h>
+#include "app_gap_detector.h"
+
+/**
+ * @brief gap_detector_reset
+ * Start of a run on the receiving side.
+ * @param gap - Detector
+ * @param multiple - Connection intervals a pause has to last to count as a gap, 0 for GAP_DEFAULT_MULTIPLE
+ * @param startUs - Start of the run, gaps are timed from it
+ */
+void gap_detector_reset(GapDetector_t *gap, uint8_t multiple, uint64_t startUs) {
+  memset(gap, 0, sizeof(GapDetector_t));
+  gap->multiple = (multiple > 0) ? multiple : GAP_DEFAULT_MULTIPLE;
+  gap->startUs = startUs;
+}
+
+/**
+ * @brief gap_detector_add
+ * Take one received packet. The threshold follows the interval in use, so a run
+ * keeps working through a connection parameter update.
+ * @param gap - Detector
+ * @param timeUs - Arrival time, on the clock given to gap_detector_reset()
+ * @param interval - Connection interval in 1.25 ms units, 0 while unknown
+ */
+void gap_detector_add(GapDetector_t *gap, uint64_t timeUs, uint16_t interval) {
+  uint64_t lengthUs;
+
+  if (gap->receiving && (interval > 0) && (timeUs > gap->lastUs)) {
+    lengthUs = timeUs - gap->lastUs;
+    if (lengthUs > ((uint64_t) interval * 1250 * gap->multiple)) {
+      gap->count++;
+      gap->stalledUs += lengthUs;
+      if (lengthUs > gap->longestUs) {
+        gap->longestUs = (lengthUs > UINT32_MAX) ? UINT32_MAX : (uint32_t) lengthUs;
+        gap->longestAtUs = (gap->lastUs > gap->startUs) ? (gap->lastUs - gap->startUs) : 0;
+      }
+    }
+  }
+  gap->receiving = true;
+  gap->lastUs = timeUs;
+}
+
+/**
+ * @brief gap_detector_flagged
+ * @param gap - Detector at the end of a run
+ * @param flagMs - Longest acceptable gap, 0 for any gap at all
+ * @return true if the run stalled for longer than flagMs
+ */
+bool gap_detector_flagged(const GapDetector_t *gap, uint32_t flagMs) {
+  return (gap->count > 0) && (gap->longestUs >= ((uint64_t) flagMs * 1000));
+}
@@ -0,0 +1,51 @@
+/**
+ * @file
+ * @brief app_gap_detector.h
+ * Stalls in a data run on the receiving side. A gap is a pause between two
+ * received packets longer than GapDetector_t.multiple connection intervals,
+ * the kind a missed connection event or a near supervision timeout leaves
+ * behind and a throughput average hides. The wait for the first packet of
+ * a run is not a gap.
+ ******************************************************************************/
+
+#ifndef APP_GAP_DETECTOR_H
+#define APP_GAP_DETECTOR_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#ifndef GAP_DEFAULT_MULTIPLE
+#define GAP_DEFAULT_MULTIPLE    4       // Connection intervals without data before a pause counts as a gap
+#endif
+
+#ifndef GAP_DEFAULT_FLAG_MS
+#define GAP_DEFAULT_FLAG_MS     250     // A run with a gap this long is flagged as stalled
+#endif
+
+typedef struct {
+  uint8_t multiple;
+  bool receiving;                   // A packet of the run has arrived
+  uint64_t lastUs;                  // Arrival of the previous packet
+  uint64_t startUs;                 // Start of the run
+  uint32_t count;
+  uint64_t stalledUs;               // Sum of the gaps
+  uint32_t longestUs;
+  uint64_t longestAtUs;             // Start of the longest gap, from the start of the run
+} GapDetector_t;
+
+/**************************************************************************//**
+ * Gap detector function declarations
+ *****************************************************************************/
+void gap_detector_reset(GapDetector_t *gap, uint8_t multiple, uint64_t startUs);
+void gap_detector_add(GapDetector_t *gap, uint64_t timeUs, uint16_t interval);
+bool gap_detector_flagged(const GapDetector_t *gap, uint32_t flagMs);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
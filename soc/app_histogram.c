@@ -0,0 +1,140 @@
+/***************************************************************************//**
+ * @file app_histogram.c
+ * @brief Log-linear latency histogram
+ *******************************************************************************/
+
+#include <string.h>
+#include "app_histogram.h"
+
+static uint16_t bucket_index(uint32_t value);
+static uint32_t bucket_highest_value(uint16_t index);
+
+/**
+ * @brief histogram_reset
+ * Clear all counts.
+ * @param hist - Histogram to clear
+ */
+void histogram_reset(Histogram_t *hist) {
+  memset(hist, 0, sizeof(Histogram_t));
+  hist->min = UINT32_MAX;
+}
+
+/**
+ * @brief histogram_record
+ * Count one value. Values above HISTOGRAM_MAX_VALUE land in the top bucket.
+ * @param hist - Histogram to update
+ * @param value - Value to record, e.g. round-trip time in microseconds
+ */
+void histogram_record(Histogram_t *hist, uint32_t value) {
+  if (value > HISTOGRAM_MAX_VALUE) {
+    value = HISTOGRAM_MAX_VALUE;
+  }
+
+  hist->counts[bucket_index(value)]++;
+  hist->total++;
+  hist->sum += value;
+  if (value < hist->min) {
+    hist->min = value;
+  }
+  if (value > hist->max) {
+    hist->max = value;
+  }
+}
+
+/**
+ * @brief histogram_merge
+ * Add the counts of one histogram to another.
+ * @param dest - Histogram to add to
+ * @param src - Histogram to add
+ */
+void histogram_merge(Histogram_t *dest, const Histogram_t *src) {
+  if (src->total == 0) {
+    return;
+  }
+
+  for (uint16_t i = 0; i < HISTOGRAM_BUCKETS; i++) {
+    dest->counts[i] += src->counts[i];
+  }
+  dest->total += src->total;
+  dest->sum += src->sum;
+  if (src->min < dest->min) {
+    dest->min = src->min;
+  }
+  if (src->max > dest->max) {
+    dest->max = src->max;
+  }
+}
+
+/**
+ * @brief histogram_percentile
+ * Look up the value below which the given share of recorded values falls.
+ * Returns the highest value equivalent to the matching bucket, capped to the
+ * largest recorded value.
+ * @param hist - Histogram to query
+ * @param permille - Percentile in tenths of a percent, e.g. 999 for p99.9
+ * @return Percentile value, 0 if nothing has been recorded
+ */
+uint32_t histogram_percentile(const Histogram_t *hist, uint16_t permille) {
+  uint32_t target;
+  uint32_t seen = 0;
+
+  if (hist->total == 0) {
+    return 0;
+  }
+
+  // Rank of the wanted value, rounded up so that p100 is the last value.
+  target = (uint32_t)((((uint64_t)hist->total * permille) + 999) / 1000);
+  if (target == 0) {
+    target = 1;
+  }
+
+  for (uint16_t i = 0; i < HISTOGRAM_BUCKETS; i++) {
+    seen += hist->counts[i];
+    if (seen >= target) {
+      uint32_t value = bucket_highest_value(i);
+      return (value > hist->max) ? hist->max : value;
+    }
+  }
+  return hist->max;
+}
+
+/**
+ * @brief histogram_mean
+ * @param hist - Histogram to query
+ * @return Mean of the recorded values, 0 if nothing has been recorded
+ */
+uint32_t histogram_mean(const Histogram_t *hist) {
+  return (hist->total == 0) ? 0 : (uint32_t)(hist->sum / hist->total);
+}
+
+// Values below HISTOGRAM_SUB_BUCKETS map one to one, above that the bucket is picked
+// by the position of the most significant bit and the next HISTOGRAM_SUB_BUCKET_BITS bits.
+static uint16_t bucket_index(uint32_t value) {
+  uint8_t msb = 0;
+  uint8_t shift;
+
+  if (value < HISTOGRAM_SUB_BUCKETS) {
+    return (uint16_t)value;
+  }
+
+#if defined(__GNUC__)
+  msb = (uint8_t)(31 - __builtin_clz(value));
+#else
+  for (uint32_t v = value >> 1; v != 0; v >>= 1) {
+    msb++;
+  }
+#endif
+  shift = msb - HISTOGRAM_SUB_BUCKET_BITS;
+  return (uint16_t)(((shift + 1) * HISTOGRAM_SUB_BUCKETS) + ((value >> shift) - HISTOGRAM_SUB_BUCKETS));
+}
+
+static uint32_t bucket_highest_value(uint16_t index) {
+  uint8_t shift;
+
+  if (index < HISTOGRAM_SUB_BUCKETS) {
+    return index;
+  }
+
+  shift = (uint8_t)((index / HISTOGRAM_SUB_BUCKETS) - 1);
+  return ((uint32_t)(HISTOGRAM_SUB_BUCKETS + (index % HISTOGRAM_SUB_BUCKETS)) << shift) + ((1UL << shift) - 1);
+}
@@ -0,0 +1,52 @@
+/**
+ * @file
+ * @brief app_histogram.h
+ * Log-linear latency histogram in the style of HdrHistogram. Values below
+ * HISTOGRAM_SUB_BUCKETS are counted exactly, above that every power of two is
+ * split into HISTOGRAM_SUB_BUCKETS buckets, so the relative error stays below
+ * 1 / HISTOGRAM_SUB_BUCKETS at any magnitude.
+ ******************************************************************************/
+
+#ifndef APP_HISTOGRAM_H
+#define APP_HISTOGRAM_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+
+#ifndef HISTOGRAM_SUB_BUCKET_BITS
+#define HISTOGRAM_SUB_BUCKET_BITS   4       // 16 buckets per power of two, 6.25% resolution
+#endif
+
+#ifndef HISTOGRAM_VALUE_BITS
+#define HISTOGRAM_VALUE_BITS        24      // Largest tracked value 2^24 - 1, about 16.7 s in microseconds
+#endif
+
+#define HISTOGRAM_SUB_BUCKETS       (1U << HISTOGRAM_SUB_BUCKET_BITS)
+#define HISTOGRAM_MAX_VALUE         ((1UL << HISTOGRAM_VALUE_BITS) - 1)
+#define HISTOGRAM_BUCKETS           ((HISTOGRAM_VALUE_BITS - HISTOGRAM_SUB_BUCKET_BITS + 1) * HISTOGRAM_SUB_BUCKETS)
+
+typedef struct {
+  uint32_t counts[HISTOGRAM_BUCKETS];
+  uint32_t total;
+  uint32_t min;
+  uint32_t max;
+  uint64_t sum;
+} Histogram_t;
+
+/**************************************************************************//**
+ * Histogram function declarations
+ *****************************************************************************/
+void histogram_reset(Histogram_t *hist);
+void histogram_record(Histogram_t *hist, uint32_t value);
+void histogram_merge(Histogram_t *dest, const Histogram_t *src);
+uint32_t histogram_percentile(const Histogram_t *hist, uint16_t permille);
+uint32_t histogram_mean(const Histogram_t *hist);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -1,349 +1,1347 @@
-/***************************************************************************//**
- * @file app_master.c
- * @brief Master mode functions:
- * master_main: main event loop
- * process_scan_response:  filter through AD data to identify slave device
- ******************************************************************************/
-
-#include "app_utils.h"
-
-/**************************************************************************//**
- * MASTER SIDE MACROS
- *****************************************************************************/
-#define CONN_INTERVAL_1MPHY_MAX     40		    // 40 * 1.25ms = 50ms
-#define CONN_INTERVAL_1MPHY_MIN     40		    // 40 * 1.25ms = 50ms
-#define SLAVE_LATENCY_1MPHY         0			    // How many connection intervals can the slave skip if no data is to be sent
-#define SUPERVISION_TIMEOUT_1MPHY   100       // 100 * 10ms = 1000ms
-#define CONN_INTERVAL_2MPHY_MAX     20		    // 20 * 1.25ms = 25ms
-#define CONN_INTERVAL_2MPHY_MIN     20		    // 20 * 1.25ms = 25ms
-#define SLAVE_LATENCY_2MPHY         0			    // How many connection intervals can the slave skip if no data is to be sent
-#define SUPERVISION_TIMEOUT_2MPHY   100       // 100 * 10ms = 1000ms
-#define CONN_INTERVAL_125KPHY_MAX   160       // 160 * 1.25ms = 200ms
-#define CONN_INTERVAL_125KPHY_MIN   160       // 160 * 1.25ms = 200ms
-#define SLAVE_LATENCY_125KPHY       0			    // How many connection intervals can the slave skip if no data is to be sent
-#define SUPERVISION_TIMEOUT_125KPHY 200       // 200 * 10ms = 2000ms
-
-const char DEVICE_NAME_STRING[] = "Throughput Tester";    // Device name to match against scan results.
-
-static int process_scan_response(struct gecko_msg_le_gap_scan_response_evt_t *pResp);
-
-/***************************************************************************************************
- * @brief Master mode main loop
- **************************************************************************************************/
-void master_main(void) {
-  while (1) {
-    /* Event pointer for handling events */
-    struct gecko_cmd_packet *evt;
-
-    evt = gecko_peek_event();
-    /* Main state loop */
-    switch (state) {
-
-      case ADV_SCAN:
-
-        switch (BGLIB_MSG_ID(evt->header) ) {
-          case gecko_evt_system_boot_id:
-            reset_variables();
-            gecko_cmd_gatt_set_max_mtu(250);
-            txPowerResp = gecko_cmd_system_set_tx_power(TX_POWER)->set_power; // 0.1 dBm count, stack may return something around the setpoint
-            refresh_display();
-            setup_adv_scan();
-            gecko_cmd_hardware_set_soft_timer(HW_TICKS_PER_SECOND, SOFT_TIMER_DISPLAY_REFRESH_HANDLE, 0);
-            break;
-
-          case gecko_evt_le_gap_scan_response_id:
-            if (process_scan_response(&(evt->data.evt_le_gap_scan_response)) > 0) {
-              gecko_cmd_le_gap_end_procedure(); // Stop scanning in the background.
-              gecko_cmd_le_gap_connect(evt->data.evt_le_gap_scan_response.address,
-                                      evt->data.evt_le_gap_scan_response.address_type,
-                                      (phyInUse == le_gap_phy_2m) ? le_gap_phy_1m : phyInUse);
-            }
-            break;
-
-          case gecko_evt_le_connection_opened_id:
-            connection = evt->data.evt_le_connection_opened.connection;
-            sprintf(phyString + 5, "%s", (phyInUse == PHY_S8) ? "CODED S8" : "1M");
-            roleString = (char *)ROLE_MASTER_STRING;
-            state = CONNECTED;
-            break;
-
-          default:
-            break;
-        }
-        break;
-
-      case CONNECTED:
-
-        if (phyToUse) {
-          gecko_cmd_le_connection_set_phy(connection, phyToUse);  // If change is needed, change PHY.
-        }
-
-        switch (BGLIB_MSG_ID(evt->header) ) {
-          case gecko_evt_le_connection_phy_status_id:
-            // Once a PHY change has been done, reset phyToUse and set conn parameters according to used PHY.
-            // set_timing_parameters replaces connection_set_parameters in 2.12
-            // Last 2 parameters are min and max length of connection event.
-            phyToUse = 0;
-            phyInUse = evt->data.evt_le_connection_phy_status.phy;
-
-            switch (phyInUse) {
-              case PHY_1M:
-                sprintf(phyString + 5, "%s", "1M");
-                gecko_cmd_le_connection_set_timing_parameters(connection,
-                                                    CONN_INTERVAL_1MPHY_MIN,
-                                                    CONN_INTERVAL_1MPHY_MAX,
-                                                    SLAVE_LATENCY_1MPHY,
-                                                    SUPERVISION_TIMEOUT_1MPHY,
-                                                    0, 
-                                                    0xFFFF);
-                break;
-
-              case PHY_2M:
-                sprintf(phyString + 5, "%s", "2M");
-                gecko_cmd_le_connection_set_timing_parameters(connection,
-                                                    CONN_INTERVAL_2MPHY_MIN,
-                                                    CONN_INTERVAL_2MPHY_MAX,
-                                                    SLAVE_LATENCY_2MPHY,
-                                                    SUPERVISION_TIMEOUT_2MPHY,
-                                                    0, 
-                                                    0xFFFF);
-                break;
-
-              case PHY_S8:
-                sprintf(phyString + 5, "%s", "CODED S8");
-                gecko_cmd_le_connection_set_timing_parameters(connection,
-                                                    CONN_INTERVAL_125KPHY_MIN,
-                                                    CONN_INTERVAL_125KPHY_MAX,
-                                                    SLAVE_LATENCY_125KPHY,
-                                                    SUPERVISION_TIMEOUT_125KPHY, 
-                                                    0, 
-                                                    0xFFFF);
-                break;
-
-              default:
-                break;
-            }
-            break;
-
-          /* Check if the user-type OTA Control Characteristic was written.
-            * If ota_control was written, boot the device into Device Firmware Upgrade (DFU) mode. */
-          case gecko_evt_gatt_server_user_write_request_id:
-            if (evt->data.evt_gatt_server_user_write_request.characteristic == gattdb_ota_control) {
-              /* Set flag to enter to OTA mode */
-              boot_to_dfu = 1;
-              /* Send response to Write Request */
-              gecko_cmd_gatt_server_send_user_write_response(evt->data.evt_gatt_server_user_write_request.connection,
-                                                            gattdb_ota_control,
-                                                            bg_err_success);
-              /* Close connection to enter to DFU OTA mode */
-              gecko_cmd_le_connection_close(evt->data.evt_gatt_server_user_write_request.connection);
-            }
-            break;
-          default:
-            break;
-        }
-
-        // Subscribe to Notifications and Indications data characteristics when PHY and interval have been set correctly.
-        if (!phyToUse) {
-          switch (phyInUse) {
-            case PHY_1M:
-              if (interval == CONN_INTERVAL_1MPHY_MIN) {
-                gecko_cmd_gatt_set_characteristic_notification(connection, gattdb_throughput_notifications, gatt_notification);
-                state = SUBSCRIBED_NOTIFICATIONS;
-              }
-              break;
-
-            case PHY_2M:
-              if (interval == CONN_INTERVAL_2MPHY_MIN) {
-                gecko_cmd_gatt_set_characteristic_notification(connection, gattdb_throughput_notifications, gatt_notification);
-                state = SUBSCRIBED_NOTIFICATIONS;
-              }
-              break;
-
-            case PHY_S8:
-              if (interval == CONN_INTERVAL_125KPHY_MIN) {
-                gecko_cmd_gatt_set_characteristic_notification(connection, gattdb_throughput_notifications, gatt_notification);
-                state = SUBSCRIBED_NOTIFICATIONS;
-              }
-              break;
-
-            default:
-              break;
-          }
-        }
-        break;
-
-      case SUBSCRIBED_NOTIFICATIONS:
-        switch (BGLIB_MSG_ID(evt->header) ) {
-          // Master/Client waits for completion of subscribing to notifications.
-          case gecko_evt_gatt_procedure_completed_id:
-            gecko_cmd_gatt_set_characteristic_notification(connection, gattdb_throughput_indications, gatt_indication);
-            state = SUBSCRIBED_INDICATIONS;
-            break;
-
-          case gecko_evt_le_connection_phy_status_id:
-            update_displayed_phy(evt->data.evt_le_connection_phy_status.phy);
-            break;
-
-          default:
-            break;
-        }
-        break;
-
-      case SUBSCRIBED_INDICATIONS:
-        switch (BGLIB_MSG_ID(evt->header) ) {
-          case gecko_evt_gatt_procedure_completed_id:
-            state = SUBSCRIBED;
-            break;
-
-          case gecko_evt_le_connection_phy_status_id:
-            update_displayed_phy(evt->data.evt_le_connection_phy_status.phy);
-            break;
-
-          default:
-            break;
-        }
-        break;
-
-      case SUBSCRIBED:
-        if (phyToUse) {
-          gecko_cmd_le_connection_set_phy(connection, phyToUse);  // If change is needed, change PHY.
-        }
-
-        switch (BGLIB_MSG_ID(evt->header) ) {
-          // Turn off display on master
-          case gecko_evt_gatt_server_attribute_value_id:
-            // Write GATT to signal that transmission starts and display should be turned off.
-            if (evt->data.evt_gatt_server_attribute_value.attribute == gattdb_transmission_on) {
-              if (evt->data.evt_gatt_server_attribute_value.value.data[0] == TRANSMISSION_ON) {
-                bitsSent = 0;
-                throughput = 0;
-                timeElapsed = RTCC_CounterGet();
-                // Disable display refresh
-                while(gecko_cmd_hardware_set_soft_timer(0, SOFT_TIMER_DISPLAY_REFRESH_HANDLE, 0)->result != 0);
-                state = RECEIVE;
-              }
-            }
-            break;
-
-          case gecko_evt_le_connection_phy_status_id:
-            phyToUse = 0;
-            phyInUse = evt->data.evt_le_connection_phy_status.phy;
-
-            switch (phyInUse) {
-              case PHY_1M:
-                sprintf(phyString + 5, "%s", "1M");
-                gecko_cmd_le_connection_set_timing_parameters(connection,
-                                                    CONN_INTERVAL_1MPHY_MIN,
-                                                    CONN_INTERVAL_1MPHY_MAX,
-                                                    SLAVE_LATENCY_1MPHY,
-                                                    SUPERVISION_TIMEOUT_1MPHY, 
-                                                    0, 
-                                                    0xFFFF);
-                break;
-              case PHY_2M:
-                sprintf(phyString + 5, "%s", "2M");
-                gecko_cmd_le_connection_set_timing_parameters(connection,
-                                                    CONN_INTERVAL_2MPHY_MIN,
-                                                    CONN_INTERVAL_2MPHY_MAX,
-                                                    SLAVE_LATENCY_2MPHY,
-                                                    SUPERVISION_TIMEOUT_2MPHY, 
-                                                    0, 
-                                                    0xFFFF);
-                break;
-              case PHY_S8:
-                sprintf(phyString + 5, "%s", "CODED S8");
-                gecko_cmd_le_connection_set_timing_parameters(connection,
-                                                    CONN_INTERVAL_125KPHY_MIN,
-                                                    CONN_INTERVAL_125KPHY_MAX,
-                                                    SLAVE_LATENCY_125KPHY,
-                                                    SUPERVISION_TIMEOUT_125KPHY, 
-                                                    0, 
-                                                    0xFFFF);
-                break;
-              default:
-                break;
-            }
-            break;
-
-          default:
-            break;
-        }
-        break;
-
-      case RECEIVE:
-        // Master exclusive state
-        switch (BGLIB_MSG_ID(evt->header) ) {
-
-          case gecko_evt_gatt_server_attribute_value_id:
-            // Slave has written to master's GATT to signal that transmission is ending and display should be turned on.
-            if (evt->data.evt_gatt_server_attribute_value.attribute == gattdb_transmission_on) {
-              if (evt->data.evt_gatt_server_attribute_value.value.data[0] == TRANSMISSION_OFF) {
-                timeElapsed = RTCC_CounterGet() - timeElapsed;
-                // Enable display refresh
-                while(gecko_cmd_hardware_set_soft_timer(HW_TICKS_PER_SECOND, SOFT_TIMER_DISPLAY_REFRESH_HANDLE, 0)->result != 0);
-                // Calculate throughput
-                throughput = (uint32_t) ((float) bitsSent / (float) ((float) timeElapsed / (float) HW_TICKS_PER_SECOND ));
-                state = SUBSCRIBED;
-              }
-            }
-            break;
-
-          case gecko_evt_gatt_characteristic_value_id:
-            /* Data received on master/client side */
-            if (evt->data.evt_gatt_characteristic_value.characteristic == gattdb_throughput_indications) {
-              if (evt->data.evt_gatt_characteristic_value.att_opcode == gatt_handle_value_indication) {
-                gecko_cmd_gatt_send_characteristic_confirmation(evt->data.evt_gatt_characteristic_value.connection);
-              }
-            }
-            bitsSent += (evt->data.evt_gatt_characteristic_value.value.len * 8);
-            operationCount++;
-            break;
-
-          default:
-            break;
-        }
-        break;
-      default:
-        break;
-    }
-    handle_universal_events(evt);
-  }
-}
-
-/**************************************************************************//**
- * @brief process_scan_response
- * Processes advertisement packets looking for "Throughput Tester" device name
- *****************************************************************************/
-
-/**
- * @brief process_scan_response
- * Processes advertisement packets looking for "Throughput Tester" device name.
- * More specific filtering logic can be added here.
- * @param pResp - scan_response structure passed in from scan_response event
- * @return adMatchFound - bool flag, 1 if correct name found
- */
-static int process_scan_response(struct gecko_msg_le_gap_scan_response_evt_t *pResp) {
-  int i = 0;
-  int adMatchFound = 0;
-  int adLen;
-  int adType;
-
-  while (i < (pResp->data.len - 1)) {
-    adLen = pResp->data.data[i];
-    adType = pResp->data.data[i + 1];
-
-    // Type 0x09 = Complete Local Name, 0x08 Shortened Name
-    if (adType == 0x09) {
-      // Check if device name is Throughput Tester
-      if (memcmp(pResp->data.data + i + 2, DEVICE_NAME_STRING, 17) == 0) {
-        adMatchFound = 1;
-        break;
-      }
-    }
-    // Jump to next AD record
-    i = i + adLen + 1;
-  }
-
-  return (adMatchFound);
-}
+/***************************************************************************//**
+ * @file app_master.c
+ * @brief Master mode functions:
+ * master_main: main event loop
+ * process_scan_response:  filter through AD data to identify slave device
+ * latency_*: round trip latency measurement against the slave echo
+ * sweep_*: unattended run through a table of PHY, interval and payload settings, or TX power levels
+ * adaptive_*: PHY switching on RSSI and measured goodput while receiving
+ * setup_*: connection setup breakdown from scanning to the test being ready
+ * streams_*: per-stream throughput and queueing delay when the slave sends on several characteristics
+ * gaps_*: stalls between the packets received in a run
+ ******************************************************************************/
+
+#include "app.h"
+#include "app_utils.h"
+#include "app_adaptive_phy.h"
+#include "app_setup_timing.h"
+#include "app_gap_detector.h"
+
+/**************************************************************************//**
+ * MASTER SIDE MACROS
+ *****************************************************************************/
+#define CONN_INTERVAL_1MPHY_MAX     40		    // 40 * 1.25ms = 50ms
+#define CONN_INTERVAL_1MPHY_MIN     40		    // 40 * 1.25ms = 50ms
+#define SLAVE_LATENCY_1MPHY         0			    // How many connection intervals can the slave skip if no data is to be sent
+#define SUPERVISION_TIMEOUT_1MPHY   100       // 100 * 10ms = 1000ms
+#define CONN_INTERVAL_2MPHY_MAX     20		    // 20 * 1.25ms = 25ms
+#define CONN_INTERVAL_2MPHY_MIN     20		    // 20 * 1.25ms = 25ms
+#define SLAVE_LATENCY_2MPHY         0			    // How many connection intervals can the slave skip if no data is to be sent
+#define SUPERVISION_TIMEOUT_2MPHY   100       // 100 * 10ms = 1000ms
+#define CONN_INTERVAL_125KPHY_MAX   160       // 160 * 1.25ms = 200ms
+#define CONN_INTERVAL_125KPHY_MIN   160       // 160 * 1.25ms = 200ms
+#define SLAVE_LATENCY_125KPHY       0			    // How many connection intervals can the slave skip if no data is to be sent
+#define SUPERVISION_TIMEOUT_125KPHY 200       // 200 * 10ms = 2000ms
+
+#define SWEEP_RUN_MS                5000                        // Length of each sweep run, fixed time test plan
+#define SWEEP_STAGE_TIMEOUT_TICKS   (10 * HW_TICKS_PER_SECOND)  // Step is counted as failed if a stage takes longer
+#define SWEEP_RESULT_LEN            19                          // Bytes per step in the sweep_results characteristic
+#define SWEEP_MAX_STEPS             12                          // sweep_results holds this many rows
+#define SWEEP_ROWS_PER_PAGE         4
+
+const char DEVICE_NAME_STRING[] = "Throughput Tester";    // Device name to match against scan results.
+
+// Round trip latency measurement. Results are kept per PHY, each PHY uses a fixed interval.
+static Histogram_t latencyRun;
+static Histogram_t latencyPerPhy[3];
+static uint32_t pingSeq = 0;
+static uint32_t pingSentAt = 0;
+static uint32_t pingsLost = 0;
+static uint8_t pingData[LATENCY_PING_SIZE];
+
+// Sweep. One step per table row, the slave runs each step from a fixed time test plan.
+typedef enum {
+  SWEEP_IDLE,
+  SWEEP_SAVE_PLAN,      // Reading the slave test plan to restore it afterwards
+  SWEEP_SET_PHY,
+  SWEEP_SET_INTERVAL,
+  SWEEP_WRITE_PLAN,
+  SWEEP_READ_POWER,     // Reading back the TX power the slave set
+  SWEEP_RUN,
+  SWEEP_READ_RSSI,
+  SWEEP_READ_RESULT,
+  SWEEP_RESTORE_PLAN
+} SweepStage_t;
+
+typedef struct {
+  uint8_t phy;
+  uint16_t interval;      // 1.25 ms units
+  uint16_t payloadSize;   // 0 = slave picks the optimal size
+  int16_t txPower;        // 0.1 dBm on both sides, TEST_PLAN_TX_POWER_KEEP leaves it as it is
+} SweepStep_t;
+
+typedef struct {
+  uint8_t phy;
+  uint8_t ok;
+  uint16_t interval;
+  uint16_t packetSize;        // Average received payload
+  uint32_t throughput;        // Measured by the master
+  uint32_t slaveThroughput;   // Read back from the slave throughput_result
+  int16_t txPower;            // Set by the stack, 0.1 dBm
+  int16_t slaveTxPower;       // Read back from the slave test_plan
+  int8_t rssi;                // Of the slave at the end of the run
+} SweepResult_t;
+
+#if defined(SWEEP_TX_POWER)
+// Levels in 0.1 dBm, both sides step through them on the PHY and interval in use
+static const int16_t sweepTxPowers[] = { SWEEP_TX_POWER_LEVELS };
+#define SWEEP_STEP_COUNT  (sizeof(sweepTxPowers) / sizeof(sweepTxPowers[0]))
+#else
+static const SweepStep_t sweepSteps[] = {
+  { PHY_1M, 6, 0, TEST_PLAN_TX_POWER_KEEP },
+  { PHY_1M, 40, 0, TEST_PLAN_TX_POWER_KEEP },
+  { PHY_1M, 40, 20, TEST_PLAN_TX_POWER_KEEP },
+  { PHY_1M, 160, 0, TEST_PLAN_TX_POWER_KEEP },
+#if defined(_SILICON_LABS_32B_SERIES_1_CONFIG_2) || defined(_SILICON_LABS_32B_SERIES_1_CONFIG_3) || defined(_SILICON_LABS_32B_SERIES_2_CONFIG_1)
+  { PHY_2M, 6, 0, TEST_PLAN_TX_POWER_KEEP },
+  { PHY_2M, 20, 0, TEST_PLAN_TX_POWER_KEEP },
+  { PHY_2M, 20, 20, TEST_PLAN_TX_POWER_KEEP },
+  { PHY_2M, 160, 0, TEST_PLAN_TX_POWER_KEEP },
+#endif
+#if defined(_SILICON_LABS_32B_SERIES_1_CONFIG_3) || defined(_SILICON_LABS_32B_SERIES_2_CONFIG_1)
+  { PHY_S8, 40, 0, TEST_PLAN_TX_POWER_KEEP },
+  { PHY_S8, 160, 0, TEST_PLAN_TX_POWER_KEEP },
+  { PHY_S8, 160, 20, TEST_PLAN_TX_POWER_KEEP },
+#endif
+};
+#define SWEEP_STEP_COUNT  (sizeof(sweepSteps) / sizeof(sweepSteps[0]))
+#endif
+
+static SweepStep_t sweepPlan[SWEEP_MAX_STEPS];    // Steps of the sweep in progress
+static uint8_t sweepStepCount = 0;
+static SweepResult_t sweepResults[SWEEP_MAX_STEPS];
+static SweepStage_t sweepStage = SWEEP_IDLE;
+static uint8_t sweepIndex = 0;
+static uint8_t sweepCount = 0;            // Steps with a result
+static uint8_t sweepPage = 0;             // 0 = normal display, otherwise results page
+static bool sweepStopRequested = false;
+static uint32_t sweepOpsAtStart = 0;
+static uint8_t savedPlan[TEST_PLAN_MAX_LEN];
+static uint8_t savedPlanLen = 0;
+
+// Adaptive PHY. Goodput is measured over ADAPTIVE_PHY_WINDOW_TICKS windows while in RECEIVE.
+static AdaptivePhy_t adaptive;
+static int8_t adaptiveRssi = 0;
+static uint32_t adaptiveLastBits = 0;
+static uint32_t adaptiveLastTick = 0;
+static bool adaptiveWasReceiving = false;
+static uint8_t adaptiveSwitchedFrom = 0;     // PHY before the last switch, 0 once the switch is logged
+static uint32_t adaptiveBeforeBps = 0;
+static uint8_t adaptiveWindowsSinceSwitch = 0;
+
+// Connection setup breakdown in RTCC ticks, per connection and since boot.
+static SetupRun_t setupRun;
+static SetupStats_t setupStats;
+
+// Stream test. The slave sends on the stream characteristics, the master sorts what arrives per stream.
+#if defined(STREAM_TEST)
+static const uint8_t streamWeights[] = { STREAM_TEST_WEIGHTS };
+#endif
+static StreamConfig_t streamsActive;      // Configuration written to the slave, count 0 when not testing streams
+static StreamRx_t streamRx;
+static uint8_t streamSetupIndex = 0;      // Subscriptions made, then the configuration write
+
+// Gaps between received packets, timed in microseconds from the start of the run in RECEIVE.
+static GapDetector_t gaps;
+
+static int process_scan_response(struct gecko_msg_le_gap_scan_response_evt_t *pResp);
+static uint16_t phy_default_interval(uint8_t phy);
+static void set_phy_timing_parameters(uint8_t phy, uint16_t intervalOverride);
+static void latency_start(void);
+static void latency_send_ping(void);
+static void latency_end(void);
+static void print_latency(const char *label, Histogram_t *hist);
+static void sweep_handle_event(struct gecko_cmd_packet *evt);
+static void sweep_start(void);
+static void sweep_apply_step(void);
+static void sweep_write_plan(void);
+static void sweep_start_run(void);
+#if defined(SWEEP_TX_POWER)
+static void sweep_report_lowest_power(void);
+#endif
+static void sweep_record_step(bool ok);
+static void sweep_advance(void);
+static void sweep_finish(void);
+static void sweep_set_stage(SweepStage_t stage, uint32_t timeoutTicks);
+static uint16_t sweep_interval(void);
+static void sweep_publish_results(void);
+static void sweep_render_page(void);
+static void sweep_next_page(void);
+static void adaptive_handle_event(struct gecko_cmd_packet *evt);
+static void adaptive_window(void);
+static const char *phy_name(uint8_t phy);
+static void setup_handle_event(struct gecko_cmd_packet *evt);
+static void print_setup_timing(void);
+static void streams_setup_next(void);
+static void streams_record(struct gecko_cmd_packet *evt);
+static void streams_report(void);
+static void gaps_record(void);
+static void gaps_report(void);
+
+/***************************************************************************************************
+ * @brief Master mode main loop
+ **************************************************************************************************/
+void master_main(void) {
+  while (1) {
+    /* Event pointer for handling events */
+    struct gecko_cmd_packet *evt;
+    uint32_t passStart = cycle_count();
+
+    evt = gecko_peek_event();
+    /* Main state loop */
+    switch (state) {
+
+      case ADV_SCAN:
+
+        switch (BGLIB_MSG_ID(evt->header) ) {
+          case gecko_evt_system_boot_id:
+            reset_variables();
+            gecko_cmd_gatt_set_max_mtu(250);
+            txPowerResp = gecko_cmd_system_set_tx_power(TX_POWER)->set_power; // 0.1 dBm count, stack may return something around the setpoint
+            refresh_display();
+            setup_adv_scan();
+            setup_timing_begin(&setupRun, RTCC_CounterGet());
+            gecko_cmd_hardware_set_soft_timer(HW_TICKS_PER_SECOND, SOFT_TIMER_DISPLAY_REFRESH_HANDLE, 0);
+            break;
+
+          case gecko_evt_le_gap_scan_response_id:
+            if (process_scan_response(&(evt->data.evt_le_gap_scan_response)) > 0) {
+              setup_timing_mark(&setupRun, SETUP_MARK_PEER_FOUND, RTCC_CounterGet());
+              gecko_cmd_le_gap_end_procedure(); // Stop scanning in the background.
+              gecko_cmd_le_gap_connect(evt->data.evt_le_gap_scan_response.address,
+                                      evt->data.evt_le_gap_scan_response.address_type,
+                                      (phyInUse == le_gap_phy_2m) ? le_gap_phy_1m : phyInUse);
+            }
+            break;
+
+          case gecko_evt_le_connection_opened_id:
+            connection = evt->data.evt_le_connection_opened.connection;
+            setup_timing_mark(&setupRun, SETUP_MARK_CONNECTED, RTCC_CounterGet());
+            set_phy_string(phyInUse);
+            roleString = (char *)ROLE_MASTER_STRING;
+            state = CONNECTED;
+            break;
+
+          default:
+            break;
+        }
+        break;
+
+      case CONNECTED:
+
+        if (phyToUse) {
+          gecko_cmd_le_connection_set_phy(connection, phyToUse);  // If change is needed, change PHY.
+        }
+
+        switch (BGLIB_MSG_ID(evt->header) ) {
+          case gecko_evt_le_connection_phy_status_id:
+            // Once a PHY change has been done, reset phyToUse and set conn parameters according to used PHY.
+            // set_timing_parameters replaces connection_set_parameters in 2.12
+            // Last 2 parameters are min and max length of connection event.
+            phyToUse = 0;
+            phyInUse = evt->data.evt_le_connection_phy_status.phy;
+            set_phy_timing_parameters(phyInUse, 0);
+            break;
+
+          /* Check if the user-type OTA Control Characteristic was written.
+            * If ota_control was written, boot the device into Device Firmware Upgrade (DFU) mode. */
+          case gecko_evt_gatt_server_user_write_request_id:
+            if (evt->data.evt_gatt_server_user_write_request.characteristic == gattdb_ota_control) {
+              /* Set flag to enter to OTA mode */
+              boot_to_dfu = 1;
+              /* Send response to Write Request */
+              gecko_cmd_gatt_server_send_user_write_response(evt->data.evt_gatt_server_user_write_request.connection,
+                                                            gattdb_ota_control,
+                                                            bg_err_success);
+              /* Close connection to enter to DFU OTA mode */
+              gecko_cmd_le_connection_close(evt->data.evt_gatt_server_user_write_request.connection);
+            }
+            break;
+          default:
+            break;
+        }
+
+        // Subscribe to Notifications and Indications data characteristics when PHY and interval have been set correctly.
+        if (!phyToUse && phy_default_interval(phyInUse) && (interval == phy_default_interval(phyInUse))) {
+          // The master uses its own GATT handles for the slave, so there is no discovery phase
+          uint32_t now = RTCC_CounterGet();
+          setup_timing_mark(&setupRun, SETUP_MARK_PARAMETERS, now);
+          setup_timing_mark(&setupRun, SETUP_MARK_LINK_READY, now);
+          setup_timing_mark(&setupRun, SETUP_MARK_SUBSCRIBE_START, now);
+          gecko_cmd_gatt_set_characteristic_notification(connection, gattdb_throughput_notifications, gatt_notification);
+          state = SUBSCRIBED_NOTIFICATIONS;
+        }
+        break;
+
+      case SUBSCRIBED_NOTIFICATIONS:
+        switch (BGLIB_MSG_ID(evt->header) ) {
+          // Master/Client waits for completion of subscribing to notifications.
+          case gecko_evt_gatt_procedure_completed_id:
+            gecko_cmd_gatt_set_characteristic_notification(connection, gattdb_throughput_indications, gatt_indication);
+            state = SUBSCRIBED_INDICATIONS;
+            break;
+
+          case gecko_evt_le_connection_phy_status_id:
+            update_displayed_phy(evt->data.evt_le_connection_phy_status.phy);
+            break;
+
+          default:
+            break;
+        }
+        break;
+
+      case SUBSCRIBED_INDICATIONS:
+        switch (BGLIB_MSG_ID(evt->header) ) {
+          case gecko_evt_gatt_procedure_completed_id:
+            gecko_cmd_gatt_set_characteristic_notification(connection, gattdb_latency_ping, gatt_notification);
+            state = SUBSCRIBED_LATENCY;
+            break;
+
+          case gecko_evt_le_connection_phy_status_id:
+            update_displayed_phy(evt->data.evt_le_connection_phy_status.phy);
+            break;
+
+          default:
+            break;
+        }
+        break;
+
+      case SUBSCRIBED_LATENCY:
+        switch (BGLIB_MSG_ID(evt->header) ) {
+          case gecko_evt_gatt_procedure_completed_id:
+#if defined(STREAM_TEST)
+            streamSetupIndex = 0;
+            state = SUBSCRIBED_STREAMS;
+            streams_setup_next();
+#else
+            state = SUBSCRIBED;
+            setup_timing_mark(&setupRun, SETUP_MARK_TEST_START, RTCC_CounterGet());
+            setup_timing_add(&setupStats, &setupRun);
+            print_setup_timing();
+#endif
+            break;
+
+          case gecko_evt_le_connection_phy_status_id:
+            update_displayed_phy(evt->data.evt_le_connection_phy_status.phy);
+            break;
+
+          default:
+            break;
+        }
+        break;
+
+      case SUBSCRIBED_STREAMS:
+        switch (BGLIB_MSG_ID(evt->header) ) {
+          case gecko_evt_gatt_procedure_completed_id:
+            if (streamSetupIndex > stream_config_total(&streamsActive)) {
+              state = SUBSCRIBED;
+              setup_timing_mark(&setupRun, SETUP_MARK_TEST_START, RTCC_CounterGet());
+              setup_timing_add(&setupStats, &setupRun);
+              print_setup_timing();
+            } else {
+              streams_setup_next();
+            }
+            break;
+
+          case gecko_evt_le_connection_phy_status_id:
+            update_displayed_phy(evt->data.evt_le_connection_phy_status.phy);
+            break;
+
+          default:
+            break;
+        }
+        break;
+
+      case SUBSCRIBED:
+        if (phyToUse) {
+          gecko_cmd_le_connection_set_phy(connection, phyToUse);  // If change is needed, change PHY.
+        }
+
+        switch (BGLIB_MSG_ID(evt->header) ) {
+          // Turn off display on master
+          case gecko_evt_gatt_server_attribute_value_id:
+            // Write GATT to signal that transmission starts and display should be turned off.
+            if (evt->data.evt_gatt_server_attribute_value.attribute == gattdb_transmission_on) {
+              if (evt->data.evt_gatt_server_attribute_value.value.data[0] == TRANSMISSION_ON) {
+                bitsSent = 0;
+                throughput = 0;
+                timeElapsed = RTCC_CounterGet();
+                stream_rx_reset(&streamRx);
+                gap_detector_reset(&gaps, GAP_DEFAULT_MULTIPLE, 0);
+                start_event_census();
+                // Disable display refresh
+                set_display_refresh(false);
+                state = RECEIVE;
+              }
+            }
+            break;
+
+          case gecko_evt_system_external_signal_id:
+            // Short PB0 press turns the page instead while sweep results are shown
+            if ((evt->data.evt_system_external_signal.extsignals & LATENCY_START) && (sweepPage == 0)) {
+              latency_start();
+            }
+            break;
+
+          case gecko_evt_le_connection_phy_status_id:
+            phyToUse = 0;
+            phyInUse = evt->data.evt_le_connection_phy_status.phy;
+            set_phy_timing_parameters(phyInUse, sweep_interval());
+            break;
+
+          default:
+            break;
+        }
+        break;
+
+      case RECEIVE:
+        // Master exclusive state
+        switch (BGLIB_MSG_ID(evt->header) ) {
+
+          case gecko_evt_gatt_server_attribute_value_id:
+            // Slave has written to master's GATT to signal that transmission is ending and display should be turned on.
+            if (evt->data.evt_gatt_server_attribute_value.attribute == gattdb_transmission_on) {
+              if (evt->data.evt_gatt_server_attribute_value.value.data[0] == TRANSMISSION_OFF) {
+                timeElapsed = RTCC_CounterGet() - timeElapsed;
+                // Enable display refresh
+                set_display_refresh(true);
+                // Calculate throughput
+                throughput = (uint32_t) ((float) bitsSent / (float) ((float) timeElapsed / (float) HW_TICKS_PER_SECOND ));
+                streams_report();
+                gaps_report();
+                report_event_census();
+                state = SUBSCRIBED;
+              }
+            }
+            break;
+
+          case gecko_evt_le_connection_phy_status_id:
+            // Adaptive mode switches PHY in the middle of a run
+            phyToUse = 0;
+            phyInUse = evt->data.evt_le_connection_phy_status.phy;
+            set_phy_timing_parameters(phyInUse, sweep_interval());
+            break;
+
+          case gecko_evt_gatt_characteristic_value_id:
+            /* Data received on master/client side */
+            if (evt->data.evt_gatt_characteristic_value.characteristic == gattdb_throughput_indications) {
+              if (evt->data.evt_gatt_characteristic_value.att_opcode == gatt_handle_value_indication) {
+                gecko_cmd_gatt_send_characteristic_confirmation(evt->data.evt_gatt_characteristic_value.connection);
+              }
+            }
+            bitsSent += (evt->data.evt_gatt_characteristic_value.value.len * 8);
+            operationCount++;
+            streams_record(evt);
+            gaps_record();
+            break;
+
+          default:
+            break;
+        }
+        break;
+
+      case PING:
+        // Master exclusive state, one ping in flight at a time.
+        switch (BGLIB_MSG_ID(evt->header) ) {
+          case gecko_evt_gatt_characteristic_value_id:
+            if ((evt->data.evt_gatt_characteristic_value.characteristic == gattdb_latency_ping)
+                && (evt->data.evt_gatt_characteristic_value.value.len >= LATENCY_PING_SIZE)) {
+              uint32_t ticks = RTCC_CounterGet() - pingSentAt;
+              uint32_t seq;
+
+              memcpy(&seq, evt->data.evt_gatt_characteristic_value.value.data, sizeof(seq));
+              // Late echoes of pings already counted as lost are dropped.
+              if (seq == pingSeq) {
+                histogram_record(&latencyRun, (uint32_t)(((uint64_t)ticks * 1000000) / HW_TICKS_PER_SECOND));
+                if ((latencyRun.total + pingsLost) >= LATENCY_PING_COUNT) {
+                  latency_end();
+                } else {
+                  latency_send_ping();
+                }
+              }
+            }
+            break;
+
+          case gecko_evt_hardware_soft_timer_id:
+            if (evt->data.evt_hardware_soft_timer.handle == SOFT_TIMER_LATENCY_TIMEOUT_HANDLE) {
+              if ((RTCC_CounterGet() - pingSentAt) > LATENCY_TIMEOUT_TICKS) {
+                pingsLost++;
+                if ((latencyRun.total + pingsLost) >= LATENCY_PING_COUNT) {
+                  latency_end();
+                } else {
+                  latency_send_ping();
+                }
+              }
+            }
+            break;
+
+          case gecko_evt_system_external_signal_id:
+            // PB0 pressed again, stop early.
+            if (evt->data.evt_system_external_signal.extsignals & LATENCY_START) {
+              latency_end();
+            }
+            break;
+
+          default:
+            break;
+        }
+        break;
+
+      default:
+        break;
+    }
+    sweep_handle_event(evt);
+    adaptive_handle_event(evt);
+    setup_handle_event(evt);
+    handle_universal_events(evt);
+    count_event(evt, passStart);
+  }
+}
+
+/**
+ * @brief phy_default_interval
+ * @param phy - PHY_1M, PHY_2M or PHY_S8
+ * @return Connection interval used for the PHY outside of a sweep, 0 for an unknown PHY
+ */
+static uint16_t phy_default_interval(uint8_t phy) {
+  switch (phy) {
+    case PHY_1M:
+      return CONN_INTERVAL_1MPHY_MIN;
+    case PHY_2M:
+      return CONN_INTERVAL_2MPHY_MIN;
+    case PHY_S8:
+      return CONN_INTERVAL_125KPHY_MIN;
+    default:
+      return 0;
+  }
+}
+
+/**
+ * @brief set_phy_timing_parameters
+ * Show the PHY in use and request the connection timing for it.
+ * set_timing_parameters replaces connection_set_parameters in 2.12
+ * Last 2 parameters are min and max length of connection event.
+ * @param phy - PHY in use
+ * @param intervalOverride - Interval to use instead of the PHY default, 0 for the default
+ */
+static void set_phy_timing_parameters(uint8_t phy, uint16_t intervalOverride) {
+  uint16_t intervalMin;
+  uint16_t intervalMax;
+  uint16_t slaveLatency;
+  uint16_t timeout;
+
+  switch (phy) {
+    case PHY_1M:
+      intervalMin = CONN_INTERVAL_1MPHY_MIN;
+      intervalMax = CONN_INTERVAL_1MPHY_MAX;
+      slaveLatency = SLAVE_LATENCY_1MPHY;
+      timeout = SUPERVISION_TIMEOUT_1MPHY;
+      break;
+
+    case PHY_2M:
+      intervalMin = CONN_INTERVAL_2MPHY_MIN;
+      intervalMax = CONN_INTERVAL_2MPHY_MAX;
+      slaveLatency = SLAVE_LATENCY_2MPHY;
+      timeout = SUPERVISION_TIMEOUT_2MPHY;
+      break;
+
+    case PHY_S8:
+      intervalMin = CONN_INTERVAL_125KPHY_MIN;
+      intervalMax = CONN_INTERVAL_125KPHY_MAX;
+      slaveLatency = SLAVE_LATENCY_125KPHY;
+      timeout = SUPERVISION_TIMEOUT_125KPHY;
+      break;
+
+    default:
+      return;
+  }
+
+  set_phy_string(phy);
+  if (intervalOverride) {
+    intervalMin = intervalOverride;
+    intervalMax = intervalOverride;
+    // Keep the supervision timeout above six intervals, in 10 ms units
+    if (timeout < ((intervalMax * 3) / 4)) {
+      timeout = (intervalMax * 3) / 4;
+    }
+  }
+
+  gecko_cmd_le_connection_set_timing_parameters(connection, intervalMin, intervalMax, slaveLatency, timeout, 0, 0xFFFF);
+}
+
+/**
+ * @brief latency_start
+ * Start a round trip latency measurement on the current connection.
+ */
+static void latency_start(void) {
+  histogram_reset(&latencyRun);
+  pingSeq = 0;
+  pingsLost = 0;
+  // Display refresh takes several milliseconds, keep it off so it doesn't show up as latency.
+  set_display_refresh(false);
+  gecko_cmd_hardware_set_soft_timer(HW_TICKS_PER_SECOND / 2, SOFT_TIMER_LATENCY_TIMEOUT_HANDLE, 0);
+  state = PING;
+  latency_send_ping();
+}
+
+/**
+ * @brief latency_send_ping
+ * Write the next sequence number to the slave. A failed write is caught by the timeout.
+ */
+static void latency_send_ping(void) {
+  pingSeq++;
+  memcpy(pingData, &pingSeq, sizeof(pingSeq));
+  pingSentAt = RTCC_CounterGet();
+  gecko_cmd_gatt_write_characteristic_value_without_response(connection, gattdb_latency_ping, LATENCY_PING_SIZE, pingData);
+}
+
+/**
+ * @brief latency_end
+ * Report the measurement, add it to the totals of the PHY in use and go back to SUBSCRIBED.
+ */
+static void latency_end(void) {
+  uint8_t phyIndex = (phyInUse == PHY_S8) ? 2 : ((phyInUse == PHY_2M) ? 1 : 0);
+  uint32_t p50 = histogram_percentile(&latencyRun, 500);
+  uint32_t p99 = histogram_percentile(&latencyRun, 990);
+
+  gecko_cmd_hardware_set_soft_timer(0, SOFT_TIMER_LATENCY_TIMEOUT_HANDLE, 0);
+
+  if (latencyPerPhy[phyIndex].total == 0) {
+    histogram_reset(&latencyPerPhy[phyIndex]);
+  }
+  histogram_merge(&latencyPerPhy[phyIndex], &latencyRun);
+
+  printLog("Latency, PHY %s, interval %u ms: %lu pings, %lu lost\r\n", phyString + 5,
+           (unsigned int) ((float) interval * 1.25), latencyRun.total, pingsLost);
+  print_latency("Run", &latencyRun);
+  print_latency("PHY total", &latencyPerPhy[phyIndex]);
+
+  // Display fits 7 digits of microseconds.
+  sprintf(latencyP50String + 5, "%7luus", (p50 > 9999999) ? 9999999 : p50);
+  latencyP50String[14] = ' ';
+  sprintf(latencyP99String + 5, "%7luus", (p99 > 9999999) ? 9999999 : p99);
+  latencyP99String[14] = ' ';
+  latencyMeasured = true;
+  operationCount = latencyRun.total;
+
+  set_display_refresh(true);
+  state = SUBSCRIBED;
+}
+
+/**
+ * @brief print_latency
+ * Log percentiles of a latency histogram.
+ * @param label - Line prefix
+ * @param hist - Round trip times in microseconds
+ */
+static void print_latency(const char *label, Histogram_t *hist) {
+  printLog("%s: p50 %lu, p90 %lu, p99 %lu, p99.9 %lu, max %lu us\r\n", label,
+           histogram_percentile(hist, 500), histogram_percentile(hist, 900),
+           histogram_percentile(hist, 990), histogram_percentile(hist, 999), hist->max);
+}
+
+/**
+ * @brief sweep_handle_event
+ * Drive the sweep from stack events. Runs after the state machine, so RECEIVE has
+ * already worked out the throughput when the end of a run is seen here.
+ * @param evt - The same stack event processed by main event loop
+ */
+static void sweep_handle_event(struct gecko_cmd_packet *evt) {
+  switch (BGLIB_MSG_ID(evt->header)) {
+    case gecko_evt_system_external_signal_id:
+      if (evt->data.evt_system_external_signal.extsignals & SWEEP_TOGGLE) {
+        if (sweepStage == SWEEP_IDLE) {
+          if (state == SUBSCRIBED) {
+            sweep_start();
+          }
+        } else {
+          // Stop after the step in progress so the slave is left in a known state
+          sweepStopRequested = true;
+        }
+      }
+      if ((evt->data.evt_system_external_signal.extsignals & LATENCY_START) && (sweepPage > 0)) {
+        sweep_next_page();
+      }
+      break;
+
+    case gecko_evt_le_connection_phy_status_id:
+      if (sweepStage == SWEEP_SET_PHY) {
+        if (phyInUse != sweepPlan[sweepIndex].phy) {
+          sweep_record_step(false);
+          sweep_advance();
+        } else if (interval == sweepPlan[sweepIndex].interval) {
+          sweep_write_plan();
+        } else {
+          // The state machine has already requested the step interval for the new PHY
+          sweep_set_stage(SWEEP_SET_INTERVAL, SWEEP_STAGE_TIMEOUT_TICKS);
+        }
+      }
+      break;
+
+    case gecko_evt_le_connection_parameters_id:
+      if ((sweepStage == SWEEP_SET_INTERVAL)
+          && (evt->data.evt_le_connection_parameters.interval == sweepPlan[sweepIndex].interval)) {
+        sweep_write_plan();
+      }
+      break;
+
+    case gecko_evt_gatt_characteristic_value_id:
+      if ((sweepStage == SWEEP_SAVE_PLAN) && (evt->data.evt_gatt_characteristic_value.characteristic == gattdb_test_plan)) {
+        savedPlanLen = (evt->data.evt_gatt_characteristic_value.value.len > TEST_PLAN_MAX_LEN)
+                       ? TEST_PLAN_MAX_LEN : evt->data.evt_gatt_characteristic_value.value.len;
+        memcpy(savedPlan, evt->data.evt_gatt_characteristic_value.value.data, savedPlanLen);
+      } else if ((sweepStage == SWEEP_READ_POWER) && (evt->data.evt_gatt_characteristic_value.characteristic == gattdb_test_plan)) {
+        TestPlan_t slavePlan = { .txPower = TEST_PLAN_TX_POWER_KEEP };
+
+        if (test_plan_parse(&slavePlan, evt->data.evt_gatt_characteristic_value.value.data, evt->data.evt_gatt_characteristic_value.value.len)) {
+          sweepResults[sweepIndex].slaveTxPower = slavePlan.txPower;
+        }
+      } else if ((sweepStage == SWEEP_READ_RESULT)
+                 && (evt->data.evt_gatt_characteristic_value.characteristic == gattdb_throughput_result)
+                 && (evt->data.evt_gatt_characteristic_value.value.len >= sizeof(uint32_t))) {
+        memcpy(&sweepResults[sweepIndex].slaveThroughput, evt->data.evt_gatt_characteristic_value.value.data, sizeof(uint32_t));
+      }
+      break;
+
+    case gecko_evt_gatt_procedure_completed_id:
+      switch (sweepStage) {
+        case SWEEP_SAVE_PLAN:
+          if (evt->data.evt_gatt_procedure_completed.result != 0) {
+            printLog("Sweep: slave test plan not readable, 0x%04x\r\n", evt->data.evt_gatt_procedure_completed.result);
+            sweep_set_stage(SWEEP_IDLE, 0);
+            sweep_render_page();
+            break;
+          }
+          sweep_apply_step();
+          break;
+
+        case SWEEP_WRITE_PLAN:
+          if (evt->data.evt_gatt_procedure_completed.result != 0) {
+            sweep_record_step(false);
+            sweep_advance();
+            break;
+          }
+          if (sweepPlan[sweepIndex].txPower != TEST_PLAN_TX_POWER_KEEP) {
+            sweep_set_stage(SWEEP_READ_POWER, SWEEP_STAGE_TIMEOUT_TICKS);
+            gecko_cmd_gatt_read_characteristic_value(connection, gattdb_test_plan);
+            break;
+          }
+          sweep_start_run();
+          break;
+
+        case SWEEP_READ_POWER:
+          sweep_start_run();
+          break;
+
+        case SWEEP_READ_RESULT:
+          sweep_record_step(evt->data.evt_gatt_procedure_completed.result == 0);
+          sweep_advance();
+          break;
+
+        case SWEEP_RESTORE_PLAN:
+          sweep_set_stage(SWEEP_IDLE, 0);
+          sweep_render_page();
+          break;
+
+        default:
+          break;
+      }
+      break;
+
+    case gecko_evt_gatt_server_attribute_value_id:
+      if ((sweepStage == SWEEP_RUN)
+          && (evt->data.evt_gatt_server_attribute_value.attribute == gattdb_transmission_on)
+          && (evt->data.evt_gatt_server_attribute_value.value.data[0] == TRANSMISSION_OFF)) {
+        uint32_t packets = operationCount - sweepOpsAtStart;
+
+        sweepResults[sweepIndex].throughput = throughput;
+        sweepResults[sweepIndex].packetSize = packets ? (uint16_t) ((bitsSent / 8) / packets) : 0;
+        sweep_set_stage(SWEEP_READ_RSSI, SWEEP_STAGE_TIMEOUT_TICKS);
+        gecko_cmd_le_connection_get_rssi(connection);
+      }
+      break;
+
+    case gecko_evt_le_connection_rssi_id:
+      if (sweepStage == SWEEP_READ_RSSI) {
+        sweepResults[sweepIndex].rssi = evt->data.evt_le_connection_rssi.rssi;
+        sweep_set_stage(SWEEP_READ_RESULT, SWEEP_STAGE_TIMEOUT_TICKS);
+        gecko_cmd_gatt_read_characteristic_value(connection, gattdb_throughput_result);
+      }
+      break;
+
+    case gecko_evt_hardware_soft_timer_id:
+      if ((evt->data.evt_hardware_soft_timer.handle == SOFT_TIMER_SWEEP_HANDLE) && (sweepStage != SWEEP_IDLE)) {
+        printLog("Sweep: step %u timed out in stage %u\r\n", sweepIndex + 1, sweepStage);
+        if (state == RECEIVE) {
+          set_display_refresh(true);
+          state = SUBSCRIBED;
+        }
+        if ((sweepStage == SWEEP_SAVE_PLAN) || (sweepStage == SWEEP_RESTORE_PLAN)) {
+          sweep_set_stage(SWEEP_IDLE, 0);
+          sweep_render_page();
+        } else {
+          sweep_record_step(false);
+          sweep_advance();
+        }
+      }
+      break;
+
+    case gecko_evt_le_connection_closed_id:
+      if (sweepStage != SWEEP_IDLE) {
+        printLog("Sweep: connection lost at step %u\r\n", sweepIndex + 1);
+        sweep_set_stage(SWEEP_IDLE, 0);
+        sweep_render_page();
+      }
+      break;
+
+    default:
+      break;
+  }
+}
+
+/**
+ * @brief sweep_start
+ * Build the steps, clear the results and save the slave test plan before the first step.
+ * A TX power sweep stays on the PHY and interval in use.
+ */
+static void sweep_start(void) {
+  sweepStepCount = (SWEEP_STEP_COUNT < SWEEP_MAX_STEPS) ? SWEEP_STEP_COUNT : SWEEP_MAX_STEPS;
+#if defined(SWEEP_TX_POWER)
+  for (uint8_t i = 0; i < sweepStepCount; i++) {
+    sweepPlan[i].phy = phyInUse;
+    sweepPlan[i].interval = interval;
+    sweepPlan[i].payloadSize = 0;
+    sweepPlan[i].txPower = sweepTxPowers[i];
+  }
+#else
+  memcpy(sweepPlan, sweepSteps, sweepStepCount * sizeof(SweepStep_t));
+#endif
+  memset(sweepResults, 0, sizeof(sweepResults));
+  sweepIndex = 0;
+  sweepCount = 0;
+  sweepPage = 1;
+  sweepStopRequested = false;
+  savedPlanLen = 0;
+  printLog("Sweep: %u steps of %u ms\r\n", sweepStepCount, SWEEP_RUN_MS);
+  sweep_publish_results();
+  sweep_set_stage(SWEEP_SAVE_PLAN, SWEEP_STAGE_TIMEOUT_TICKS);
+  sweep_render_page();
+  refresh_display();
+  gecko_cmd_gatt_read_characteristic_value(connection, gattdb_test_plan);
+}
+
+/**
+ * @brief sweep_apply_step
+ * Change whatever differs from the current step, PHY first, then interval, then run.
+ */
+static void sweep_apply_step(void) {
+  const SweepStep_t *step;
+
+  if (sweepStopRequested || (sweepIndex >= sweepStepCount)) {
+    sweep_finish();
+    return;
+  }
+
+  step = &sweepPlan[sweepIndex];
+  if (step->phy != phyInUse) {
+    sweep_set_stage(SWEEP_SET_PHY, SWEEP_STAGE_TIMEOUT_TICKS);
+    gecko_cmd_le_connection_set_phy(connection, step->phy);
+  } else if (step->interval != interval) {
+    sweep_set_stage(SWEEP_SET_INTERVAL, SWEEP_STAGE_TIMEOUT_TICKS);
+    set_phy_timing_parameters(phyInUse, step->interval);
+  } else {
+    sweep_write_plan();
+  }
+}
+
+/**
+ * @brief sweep_write_plan
+ * Give the slave a fixed time notification plan with the payload size and TX power of the
+ * current step. The master sets the same TX power on its side.
+ */
+static void sweep_write_plan(void) {
+  TestPlan_t plan = {
+    .mode = PLAN_MODE_FIXED_TIME,
+    .direction = PLAN_DIRECTION_NOTIFY,
+    .payloadSize = sweepPlan[sweepIndex].payloadSize,
+    .amount = 0,
+    .durationMs = SWEEP_RUN_MS,
+    .txPower = sweepPlan[sweepIndex].txPower
+  };
+  uint8_t encoded[TEST_PLAN_ENCODED_LEN];
+  uint16_t len = test_plan_encode(&plan, encoded);
+
+  if (plan.txPower != TEST_PLAN_TX_POWER_KEEP) {
+    txPowerResp = gecko_cmd_system_set_tx_power(plan.txPower)->set_power;
+  }
+  sweepResults[sweepIndex].txPower = txPowerResp;
+  sweepResults[sweepIndex].slaveTxPower = TEST_PLAN_TX_POWER_KEEP;
+
+  sweep_set_stage(SWEEP_WRITE_PLAN, SWEEP_STAGE_TIMEOUT_TICKS);
+  gecko_cmd_gatt_write_characteristic_value(connection, gattdb_test_plan, len, encoded);
+}
+
+/**
+ * @brief sweep_start_run
+ * Slave starts a notification run of SWEEP_RUN_MS and answers with transmission_on.
+ */
+static void sweep_start_run(void) {
+  sweepOpsAtStart = operationCount;
+  sweep_set_stage(SWEEP_RUN, SWEEP_STAGE_TIMEOUT_TICKS + ((SWEEP_RUN_MS / 1000) * HW_TICKS_PER_SECOND));
+  gecko_cmd_gatt_write_characteristic_value_without_response(connection, gattdb_transmission_on, 1, &TRANSMISSION_ON);
+}
+
+/**
+ * @brief sweep_record_step
+ * Complete the result row of the current step and publish the table.
+ * @param ok - false if the step could not be set up or run
+ */
+static void sweep_record_step(bool ok) {
+  SweepResult_t *result = &sweepResults[sweepIndex];
+
+  result->phy = sweepPlan[sweepIndex].phy;
+  result->interval = sweepPlan[sweepIndex].interval;
+  result->ok = ok;
+  if (!ok) {
+    result->throughput = 0;
+    result->slaveThroughput = 0;
+  }
+  sweepCount = sweepIndex + 1;
+
+  printLog("Sweep %u/%u: PHY %u, interval %u ms, %u B packets, %lu bps (slave %lu bps), TX %d/%d, RSSI %d%s\r\n",
+           sweepIndex + 1, sweepStepCount, result->phy,
+           (unsigned int) ((float) result->interval * 1.25), result->packetSize,
+           result->throughput, result->slaveThroughput, result->txPower, result->slaveTxPower,
+           result->rssi, ok ? "" : " FAILED");
+  sweep_publish_results();
+}
+
+/**
+ * @brief sweep_advance
+ * Move on to the next step, or finish if that was the last one.
+ */
+static void sweep_advance(void) {
+  sweepIndex++;
+  sweep_render_page();
+  sweep_apply_step();
+}
+
+/**
+ * @brief sweep_finish
+ * Go back to the default interval of the PHY in use and give the slave its own test plan back.
+ */
+static void sweep_finish(void) {
+  printLog("Sweep: %s after %u steps\r\n", sweepStopRequested ? "stopped" : "done", sweepCount);
+#if defined(SWEEP_TX_POWER)
+  sweep_report_lowest_power();
+  txPowerResp = gecko_cmd_system_set_tx_power(TX_POWER)->set_power;
+#endif
+  set_phy_timing_parameters(phyInUse, 0);
+  if (savedPlanLen > 0) {
+    sweep_set_stage(SWEEP_RESTORE_PLAN, SWEEP_STAGE_TIMEOUT_TICKS);
+    gecko_cmd_gatt_write_characteristic_value(connection, gattdb_test_plan, savedPlanLen, savedPlan);
+  } else {
+    sweep_set_stage(SWEEP_IDLE, 0);
+  }
+  sweep_render_page();
+}
+
+#if defined(SWEEP_TX_POWER)
+/**
+ * @brief sweep_report_lowest_power
+ * Log the lowest master TX power that still reached SWEEP_TX_POWER_TARGET_BPS.
+ */
+static void sweep_report_lowest_power(void) {
+  int8_t lowest = -1;
+
+  for (uint8_t i = 0; i < sweepCount; i++) {
+    if (sweepResults[i].ok && (sweepResults[i].throughput >= SWEEP_TX_POWER_TARGET_BPS)
+        && ((lowest < 0) || (sweepResults[i].txPower < sweepResults[lowest].txPower))) {
+      lowest = i;
+    }
+  }
+  if (lowest < 0) {
+    printLog("Sweep: no TX power reached %lu bps\r\n", (unsigned long) SWEEP_TX_POWER_TARGET_BPS);
+  } else {
+    printLog("Sweep: lowest TX power for %lu bps is %d/%d (0.1 dBm), %lu bps at RSSI %d\r\n",
+             (unsigned long) SWEEP_TX_POWER_TARGET_BPS, sweepResults[lowest].txPower,
+             sweepResults[lowest].slaveTxPower, sweepResults[lowest].throughput, sweepResults[lowest].rssi);
+  }
+}
+#endif
+
+/**
+ * @brief sweep_set_stage
+ * @param stage - Next stage
+ * @param timeoutTicks - Watchdog for the stage, 0 stops it
+ */
+static void sweep_set_stage(SweepStage_t stage, uint32_t timeoutTicks) {
+  sweepStage = stage;
+  gecko_cmd_hardware_set_soft_timer(timeoutTicks, SOFT_TIMER_SWEEP_HANDLE, 1);
+}
+
+/**
+ * @brief sweep_interval
+ * @return Interval of the step being set up, 0 outside of a sweep
+ */
+static uint16_t sweep_interval(void) {
+  if ((sweepStage == SWEEP_IDLE) || (sweepStage == SWEEP_RESTORE_PLAN) || (sweepIndex >= sweepStepCount)) {
+    return 0;
+  }
+  return sweepPlan[sweepIndex].interval;
+}
+
+/**
+ * @brief sweep_publish_results
+ * Write the result rows to the local sweep_results characteristic, little endian
+ * PHY, status, interval, packet size, throughput, slave throughput, TX power, slave TX power
+ * and RSSI per step.
+ */
+static void sweep_publish_results(void) {
+  uint8_t encoded[SWEEP_MAX_STEPS * SWEEP_RESULT_LEN];
+  uint8_t *p = encoded;
+
+  for (uint8_t i = 0; i < sweepCount; i++) {
+    *p++ = sweepResults[i].phy;
+    *p++ = sweepResults[i].ok;
+    memcpy(p, &sweepResults[i].interval, 2);
+    memcpy(p + 2, &sweepResults[i].packetSize, 2);
+    memcpy(p + 4, &sweepResults[i].throughput, 4);
+    memcpy(p + 8, &sweepResults[i].slaveThroughput, 4);
+    memcpy(p + 12, &sweepResults[i].txPower, 2);
+    memcpy(p + 14, &sweepResults[i].slaveTxPower, 2);
+    p[16] = (uint8_t) sweepResults[i].rssi;
+    p += 17;
+  }
+  gecko_cmd_gatt_server_write_attribute_value(gattdb_sweep_results, 0, p - encoded, encoded);
+}
+
+/**
+ * @brief sweep_render_page
+ * Lay out the current results page for refresh_display, two lines per step.
+ */
+static void sweep_render_page(void) {
+  char text[16];
+  uint8_t pages = (sweepCount + SWEEP_ROWS_PER_PAGE - 1) / SWEEP_ROWS_PER_PAGE;
+  uint8_t line = 0;
+
+  if (sweepPage == 0) {
+    sweepLineCount = 0;
+    return;
+  }
+  if (pages == 0) {
+    pages = 1;
+  }
+  if (sweepPage > pages) {
+    sweepPage = pages;
+  }
+
+  if (sweepStage != SWEEP_IDLE) {
+    snprintf(text, sizeof(text), "SWEEP %u/%u", sweepIndex + 1, sweepStepCount);
+  } else {
+    snprintf(text, sizeof(text), "SWEEP P%u/%u", sweepPage, pages);
+  }
+  sprintf(sweepLines[line++], "%-15.15s\n", text);
+
+  for (uint8_t i = (sweepPage - 1) * SWEEP_ROWS_PER_PAGE; (i < sweepCount) && (line < SWEEP_LCD_LINES); i++) {
+    SweepResult_t *result = &sweepResults[i];
+
+    if (sweepPlan[i].txPower != TEST_PLAN_TX_POWER_KEEP) {
+      // Master and slave TX power in dBm and RSSI
+      snprintf(text, sizeof(text), "TX%+3d/%+3d %4d", result->txPower / 10, result->slaveTxPower / 10, result->rssi);
+    } else {
+      snprintf(text, sizeof(text), "%s %4ums %3uB", phy_name(result->phy), (unsigned int) ((float) result->interval * 1.25), result->packetSize);
+    }
+    sprintf(sweepLines[line++], "%-15.15s\n", text);
+    if (result->ok) {
+      snprintf(text, sizeof(text), " %7lu bps", result->throughput);
+    } else {
+      snprintf(text, sizeof(text), " FAILED");
+    }
+    sprintf(sweepLines[line++], "%-15.15s\n", text);
+  }
+  sweepLineCount = line;
+}
+
+/**
+ * @brief sweep_next_page
+ * Show the next results page. After the last page the normal display comes back,
+ * unless a sweep is still running.
+ */
+static void sweep_next_page(void) {
+  uint8_t pages = (sweepCount + SWEEP_ROWS_PER_PAGE - 1) / SWEEP_ROWS_PER_PAGE;
+
+  if (sweepPage >= pages) {
+    sweepPage = (sweepStage != SWEEP_IDLE) ? 1 : 0;
+  } else {
+    sweepPage++;
+  }
+  sweep_render_page();
+  refresh_display();
+}
+
+/**
+ * @brief adaptive_handle_event
+ * Measurement windows, RSSI and connection changes for the adaptive PHY mode.
+ * @param evt - The same stack event processed by main event loop
+ */
+static void adaptive_handle_event(struct gecko_cmd_packet *evt) {
+  switch (BGLIB_MSG_ID(evt->header)) {
+    case gecko_evt_hardware_soft_timer_id:
+      if (evt->data.evt_hardware_soft_timer.handle == SOFT_TIMER_ADAPTIVE_PHY_HANDLE) {
+        adaptive_window();
+      }
+      break;
+
+    case gecko_evt_le_connection_rssi_id:
+      adaptiveRssi = evt->data.evt_le_connection_rssi.rssi;
+      break;
+
+    case gecko_evt_le_connection_opened_id:
+    case gecko_evt_le_connection_closed_id:
+      adaptive_phy_reset(&adaptive, PHY_1M
+#if defined(_SILICON_LABS_32B_SERIES_1_CONFIG_2) || defined(_SILICON_LABS_32B_SERIES_1_CONFIG_3) || defined(_SILICON_LABS_32B_SERIES_2_CONFIG_1)
+                         | PHY_2M
+#endif
+#if defined(_SILICON_LABS_32B_SERIES_1_CONFIG_3) || defined(_SILICON_LABS_32B_SERIES_2_CONFIG_1)
+                         | PHY_S8
+#endif
+                         );
+      adaptiveWasReceiving = false;
+      adaptiveSwitchedFrom = 0;
+      break;
+
+    default:
+      break;
+  }
+}
+
+/**
+ * @brief adaptive_window
+ * End of a measurement window. Windows that overlap the start of a run or
+ * a sweep are skipped, the sweep sets the PHY itself.
+ */
+static void adaptive_window(void) {
+  uint32_t now = RTCC_CounterGet();
+  uint32_t bits = (bitsSent >= adaptiveLastBits) ? (bitsSent - adaptiveLastBits) : bitsSent;
+  uint32_t ticks = now - adaptiveLastTick;
+  bool receiving = (state == RECEIVE);
+  uint32_t bps;
+  uint8_t target;
+
+  adaptiveLastBits = bitsSent;
+  adaptiveLastTick = now;
+
+  if (!adaptivePhy || (connection == 0xFF)) {
+    return;
+  }
+  // Display refresh is off during runs, so the RSSI is read here.
+  gecko_cmd_le_connection_get_rssi(connection);
+
+  if (!receiving || !adaptiveWasReceiving || (sweepStage != SWEEP_IDLE) || (ticks == 0)) {
+    adaptiveWasReceiving = receiving;
+    return;
+  }
+  bps = (uint32_t) (((uint64_t) bits * HW_TICKS_PER_SECOND) / ticks);
+
+  // Report the first full window on the new PHY against the last one on the old PHY.
+  if (adaptiveSwitchedFrom && (++adaptiveWindowsSinceSwitch >= 2)) {
+    printLog("Adaptive PHY: %s -> %s at %d dBm, %lu -> %lu bps\r\n", phy_name(adaptiveSwitchedFrom),
+             phy_name(phyInUse), adaptiveRssi, adaptiveBeforeBps, bps);
+    adaptiveSwitchedFrom = 0;
+  }
+
+  target = adaptive_phy_window(&adaptive, phyInUse, bps, adaptiveRssi);
+  if (target && (target != phyInUse)) {
+    adaptiveSwitchedFrom = phyInUse;
+    adaptiveBeforeBps = bps;
+    adaptiveWindowsSinceSwitch = 0;
+    gecko_cmd_le_connection_set_phy(connection, target);
+  }
+}
+
+/**
+ * @brief phy_name
+ * @param phy - PHY_1M, PHY_2M or PHY_S8
+ * @return Short PHY name for logs
+ */
+static const char *phy_name(uint8_t phy) {
+  switch (phy) {
+    case PHY_2M:
+      return "2M";
+    case PHY_S8:
+      return "S8";
+    default:
+      return "1M";
+  }
+}
+
+/**
+ * @brief setup_handle_event
+ * Setup milestones that can arrive in any state.
+ * @param evt - The same stack event processed by main event loop
+ */
+static void setup_handle_event(struct gecko_cmd_packet *evt) {
+  switch (BGLIB_MSG_ID(evt->header)) {
+    case gecko_evt_gatt_mtu_exchanged_id:
+      setup_timing_mark(&setupRun, SETUP_MARK_MTU, RTCC_CounterGet());
+      break;
+
+    case gecko_evt_le_connection_closed_id:
+      // Scanning starts again in handle_universal_events
+      setup_timing_begin(&setupRun, RTCC_CounterGet());
+      break;
+
+    default:
+      break;
+  }
+}
+
+/**
+ * @brief print_setup_timing
+ * Log the setup phases of this connection next to the statistics since boot, in ms.
+ * Parameters and MTU both count from the connection opening.
+ */
+static void print_setup_timing(void) {
+  printLog("Setup timing (ms): phase, this connection, min, mean, max, connections\r\n");
+  for (uint8_t i = 0; i < SETUP_PHASES; i++) {
+    uint32_t duration;
+    uint32_t mean;
+
+    if (setupStats.count[i] == 0) {
+      continue;
+    }
+    mean = (uint32_t) (setupStats.sum[i] / setupStats.count[i]);
+    if (!setup_timing_phase(&setupRun, (SetupPhase_t) i, &duration)) {
+      duration = 0;
+    }
+    printLog("%-10s %6lu %6lu %6lu %6lu %4lu\r\n", setup_timing_phase_name((SetupPhase_t) i),
+             (uint32_t) (((uint64_t) duration * 1000) / HW_TICKS_PER_SECOND),
+             (uint32_t) (((uint64_t) setupStats.min[i] * 1000) / HW_TICKS_PER_SECOND),
+             (uint32_t) (((uint64_t) mean * 1000) / HW_TICKS_PER_SECOND),
+             (uint32_t) (((uint64_t) setupStats.max[i] * 1000) / HW_TICKS_PER_SECOND),
+             setupStats.count[i]);
+  }
+}
+
+/**
+ * @brief streams_setup_next
+ * Next step of the stream setup: subscribe to each stream in use, then write the
+ * configuration to the slave. Continued on each procedure completion in SUBSCRIBED_STREAMS.
+ */
+static void streams_setup_next(void) {
+#if defined(STREAM_TEST)
+  uint8_t encoded[STREAM_CONFIG_LEN];
+
+  if (streamSetupIndex == 0) {
+    uint8_t limit = (STREAM_TEST_PROBE_MS > 0) ? (STREAM_MAX - 1) : STREAM_MAX;
+
+    memset(&streamsActive, 0, sizeof(streamsActive));
+    streamsActive.count = (sizeof(streamWeights) > limit) ? limit : sizeof(streamWeights);
+    memcpy(streamsActive.weights, streamWeights, streamsActive.count);
+    streamsActive.probeIntervalMs = STREAM_TEST_PROBE_MS;
+  }
+  if (streamSetupIndex < stream_config_total(&streamsActive)) {
+    gecko_cmd_gatt_set_characteristic_notification(connection, streamHandles[streamSetupIndex], gatt_notification);
+  } else {
+    gecko_cmd_gatt_write_characteristic_value(connection, gattdb_stream_config, stream_config_encode(&streamsActive, encoded), encoded);
+  }
+  streamSetupIndex++;
+#endif
+}
+
+/**
+ * @brief streams_record
+ * Sort a notification received in RECEIVE into its stream.
+ * @param evt - gatt_characteristic_value event
+ */
+static void streams_record(struct gecko_cmd_packet *evt) {
+  for (uint8_t i = 0; i < stream_config_total(&streamsActive); i++) {
+    if (evt->data.evt_gatt_characteristic_value.characteristic == streamHandles[i]) {
+      stream_rx_record(&streamRx, i,
+                       evt->data.evt_gatt_characteristic_value.value.data,
+                       evt->data.evt_gatt_characteristic_value.value.len,
+                       ((uint64_t) RTCC_CounterGet() * 1000000) / HW_TICKS_PER_SECOND);
+      break;
+    }
+  }
+}
+
+/**
+ * @brief streams_report
+ * Log throughput and queueing delay per stream of the run that just ended. A probe
+ * whose delay grows with the bulk load is waiting behind bulk data in the TX queue.
+ */
+static void streams_report(void) {
+  uint32_t ms = (uint32_t) (((uint64_t) timeElapsed * 1000) / HW_TICKS_PER_SECOND);
+
+  if ((stream_config_total(&streamsActive) == 0) || (ms == 0)) {
+    return;
+  }
+  for (uint8_t i = 0; i < stream_config_total(&streamsActive); i++) {
+    StreamStats_t *stats = &streamRx.streams[i];
+
+    printLog("Stream %u%s: %lu bps, %lu packets, %lu missing, delay p50 %lu, p99 %lu, max %lu us\r\n",
+             i + 1, (i == stream_probe_index(&streamsActive)) ? " (probe)" : "",
+             (unsigned long) ((stats->bytes * 8 * 1000) / ms), (unsigned long) stats->packets,
+             (unsigned long) stats->missing, (unsigned long) histogram_percentile(&stats->delay, 500),
+             (unsigned long) histogram_percentile(&stats->delay, 990), (unsigned long) stats->delay.max);
+  }
+}
+
+/**
+ * @brief gaps_record
+ * Time a packet received in RECEIVE against the previous one.
+ */
+static void gaps_record(void) {
+  uint32_t ticks = RTCC_CounterGet() - timeElapsed;
+
+  gap_detector_add(&gaps, ((uint64_t) ticks * 1000000) / HW_TICKS_PER_SECOND, interval);
+}
+
+/**
+ * @brief gaps_report
+ * Log the gaps of the finished run, flagged if one of them reached GAP_DEFAULT_FLAG_MS.
+ */
+static void gaps_report(void) {
+  printLog("Gaps over %u intervals: %lu, stalled %lu ms, longest %lu ms at %lu ms%s\r\n", gaps.multiple,
+           (unsigned long) gaps.count, (unsigned long) (gaps.stalledUs / 1000), (unsigned long) (gaps.longestUs / 1000),
+           (unsigned long) (gaps.longestAtUs / 1000), gap_detector_flagged(&gaps, GAP_DEFAULT_FLAG_MS) ? ", STALLED" : "");
+}
+
+/**************************************************************************//**
+ * @brief process_scan_response
+ * Processes advertisement packets looking for "Throughput Tester" device name
+ *****************************************************************************/
+
+/**
+ * @brief process_scan_response
+ * Processes advertisement packets looking for "Throughput Tester" device name.
+ * More specific filtering logic can be added here.
+ * @param pResp - scan_response structure passed in from scan_response event
+ * @return adMatchFound - bool flag, 1 if correct name found
+ */
+static int process_scan_response(struct gecko_msg_le_gap_scan_response_evt_t *pResp) {
+  int i = 0;
+  int adMatchFound = 0;
+  int adLen;
+  int adType;
+
+  while (i < (pResp->data.len - 1)) {
+    adLen = pResp->data.data[i];
+    adType = pResp->data.data[i + 1];
+
+    // Type 0x09 = Complete Local Name, 0x08 Shortened Name
+    if (adType == 0x09) {
+      // Check if device name is Throughput Tester
+      if (memcmp(pResp->data.data + i + 2, DEVICE_NAME_STRING, 17) == 0) {
+        adMatchFound = 1;
+        break;
+      }
+    }
+    // Jump to next AD record
+    i = i + adLen + 1;
+  }
+
+  return (adMatchFound);
+}
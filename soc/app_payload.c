@@ -0,0 +1,111 @@
+/***************************************************************************//**
+ * @file app_payload.c
+ * @brief Payload sizing and circular data generation
+ *******************************************************************************/
+
+#include "app_payload.h"
+
+/**
+ * @brief payload_notification_size
+ * Calculate optimal notification size given current PDU and MTU sizes.
+ * @param mtu - Negotiated ATT MTU
+ * @param pdu - Negotiated LL PDU size
+ * @param configuredSize - Fixed size requested by configuration, 0 for automatic
+ * @param currentSize - Size in use, returned when MTU or PDU is still unknown
+ * @return Notification payload size in bytes
+ */
+uint16_t payload_notification_size(uint16_t mtu, uint16_t pdu, uint16_t configuredSize, uint16_t currentSize) {
+  if (configuredSize == 0 || configuredSize > (mtu - NOTIFICATION_GATT_HEADER)) {
+    if ((pdu != 0) && (mtu != 0)) {
+      // Optimally split over multiple over-the-air packets.
+      if (pdu <= mtu) {
+        return (pdu - (L2CAP_HEADER + NOTIFICATION_GATT_HEADER))
+               + ((mtu - NOTIFICATION_GATT_HEADER - pdu + (L2CAP_HEADER + NOTIFICATION_GATT_HEADER)) / pdu * pdu);
+      }
+      // Single over-the-air packet, but accommodate room for headers.
+      if ((pdu - mtu) <= L2CAP_HEADER) {
+        return pdu - (L2CAP_HEADER + NOTIFICATION_GATT_HEADER); // LL PDU size - (L2CAP+GATT Headers)
+      }
+      // Room for the whole MTU, so data payload is MTU - Header of operation.
+      return mtu - NOTIFICATION_GATT_HEADER; // MTU - GATT Header
+    }
+    return currentSize;
+  }
+  return configuredSize;
+}
+
+/**
+ * @brief payload_indication_size
+ * Calculate indication size given current MTU size.
+ * @param mtu - Negotiated ATT MTU
+ * @param configuredSize - Fixed size requested by configuration, 0 for automatic
+ * @return Indication payload size in bytes
+ */
+uint16_t payload_indication_size(uint16_t mtu, uint16_t configuredSize) {
+  // MTU - 3B for indication GATT operation header.
+  if (configuredSize == 0 || configuredSize > (mtu - INDICATION_GATT_HEADER)) {
+    return mtu - INDICATION_GATT_HEADER; // If larger than max, use max for operation.
+  }
+  return configuredSize; // If smaller, use given.
+}
+
+/**
+ * @brief ll_pdu_airtime_us
+ * @param length - LL payload bytes, 0 for an empty PDU
+ * @param phy - 1 = 1M, 2 = 2M, 4 = Coded S8
+ * @return Time on air of one unencrypted LL data PDU in microseconds
+ */
+static uint32_t ll_pdu_airtime_us(uint16_t length, uint8_t phy) {
+  switch (phy) {
+    case 2:
+      // Preamble 2, access address 4, header 2, CRC 3 bytes at 2 Mbps
+      return (11 + (uint32_t) length) * 4;
+    case 4:
+      // Preamble, access address, CI and TERM1 take 376 us, header, payload and CRC 64 us per byte, TERM2 24 us
+      return 376 + ((5 + (uint32_t) length) * 64) + 24;
+    default:
+      // Preamble 1, access address 4, header 2, CRC 3 bytes at 1 Mbps
+      return (10 + (uint32_t) length) * 8;
+  }
+}
+
+/**
+ * @brief payload_airtime_us
+ * Connection event time taken by one notification or indication: every LL fragment is
+ * answered by or answers an empty PDU of the peer, with an inter frame space after each.
+ * @param attPayload - Payload bytes of the GATT operation
+ * @param pdu - Negotiated LL PDU size, 0 if not known yet
+ * @param phy - 1 = 1M, 2 = 2M, 4 = Coded S8
+ * @return Microseconds of connection event used
+ */
+uint32_t payload_airtime_us(uint16_t attPayload, uint16_t pdu, uint8_t phy) {
+  uint32_t remaining = (uint32_t) attPayload + NOTIFICATION_GATT_HEADER + L2CAP_HEADER;
+  uint32_t overhead = ll_pdu_airtime_us(0, phy) + (2 * LL_T_IFS_US);
+  uint32_t total = 0;
+
+  if (pdu == 0) {
+    pdu = LL_DATA_PDU_DEFAULT;
+  }
+  while (remaining > 0) {
+    uint16_t fragment = (remaining > pdu) ? pdu : (uint16_t) remaining;
+
+    total += ll_pdu_airtime_us(fragment, phy) + overhead;
+    remaining -= fragment;
+  }
+  return total;
+}
+
+/**
+ * @brief payload_generate
+ * Generate circular data (0-255) continuing from the last byte of the previous payload.
+ * @param data - Payload buffer
+ * @param length - Payload length in bytes
+ */
+void payload_generate(uint8_t *data, uint16_t length) {
+
+  data[0] = data[length - 1] + 1;
+
+  for (int i = 1; i < length; i++) {
+    data[i] = data[i - 1] + 1;
+  }
+}
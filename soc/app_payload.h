@@ -0,0 +1,35 @@
+/**
+ * @file
+ * @brief app_payload.h
+ * Notification and indication sizes for the negotiated MTU and LL PDU size,
+ * the rolling payload bytes, and the air time of one ATT payload.
+ ******************************************************************************/
+
+#ifndef APP_PAYLOAD_H
+#define APP_PAYLOAD_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+
+#define INDICATION_GATT_HEADER              3       // GATT operation header byte count
+#define NOTIFICATION_GATT_HEADER            3       // GATT operation header byte count
+#define L2CAP_HEADER                        4       // Header byte count
+#define LL_DATA_PDU_DEFAULT                 27      // LL payload size without data length extension
+#define LL_T_IFS_US                         150     // Inter frame space
+
+/**************************************************************************//**
+ * Payload function declarations
+ *****************************************************************************/
+uint16_t payload_notification_size(uint16_t mtu, uint16_t pdu, uint16_t configuredSize, uint16_t currentSize);
+uint16_t payload_indication_size(uint16_t mtu, uint16_t configuredSize);
+void payload_generate(uint8_t *data, uint16_t length);
+uint32_t payload_airtime_us(uint16_t attPayload, uint16_t pdu, uint8_t phy);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,216 @@
+/***************************************************************************//**
+ * @file app_payload_schedule.c
+ * @brief Payload size mix and trace replay
+ *******************************************************************************/
+
+#include <string.h>
+#include "app_payload_schedule.h"
+
+#define PAYLOAD_SCHEDULE_SEED   0x2545F491    // Same draw on every run, so runs compare
+
+static uint16_t read_u16(const uint8_t *p);
+static void write_u16(uint8_t *p, uint16_t value);
+
+/**
+ * @brief payload_schedule_reset
+ * Back to one constant size.
+ * @param schedule - Schedule to clear
+ */
+void payload_schedule_reset(PayloadSchedule_t *schedule) {
+  memset(schedule, 0, sizeof(PayloadSchedule_t));
+  schedule->kind = SCHEDULE_CONSTANT;
+  schedule->rng = PAYLOAD_SCHEDULE_SEED;
+}
+
+/**
+ * @brief payload_schedule_write
+ * Take a constant schedule, a size mix or a trace chunk. A mix with an empty bin or a chunk
+ * that doesn't follow on from the previous one leaves the schedule as it was.
+ * @param schedule - Schedule to update
+ * @param data - Written value
+ * @param len - Written length
+ * @return true if the write was valid
+ */
+bool payload_schedule_write(PayloadSchedule_t *schedule, const uint8_t *data, uint16_t len) {
+  if (len < 1) {
+    return false;
+  }
+
+  switch (data[0]) {
+    case SCHEDULE_CONSTANT:
+      payload_schedule_reset(schedule);
+      return true;
+
+    case SCHEDULE_MIX: {
+      uint8_t count;
+      uint16_t total = 0;
+
+      if ((len < 2) || (data[1] == 0) || (data[1] > PAYLOAD_MIX_MAX_BINS) || (len < (2 + (3 * data[1])))) {
+        return false;
+      }
+      count = data[1];
+      for (uint8_t i = 0; i < count; i++) {
+        if ((read_u16(&data[2 + (3 * i)]) == 0) || (data[4 + (3 * i)] == 0)) {
+          return false;
+        }
+        total += data[4 + (3 * i)];
+      }
+      payload_schedule_reset(schedule);
+      for (uint8_t i = 0; i < count; i++) {
+        schedule->bins[i].size = read_u16(&data[2 + (3 * i)]);
+        schedule->bins[i].weight = data[4 + (3 * i)];
+      }
+      schedule->binCount = count;
+      schedule->weightTotal = total;
+      schedule->kind = SCHEDULE_MIX;
+      return true;
+    }
+
+    case SCHEDULE_TRACE: {
+      uint16_t first;
+      uint16_t total;
+      uint16_t count;
+
+      if (len < PAYLOAD_TRACE_HEADER_LEN) {
+        return false;
+      }
+      first = read_u16(&data[1]);
+      total = read_u16(&data[3]);
+      count = (len - PAYLOAD_TRACE_HEADER_LEN) / PAYLOAD_TRACE_ENTRY_LEN;
+      if ((total == 0) || (total > PAYLOAD_TRACE_MAX) || ((first + count) > total)) {
+        return false;
+      }
+      // The first chunk starts a new trace, later chunks must follow on.
+      if (first == 0) {
+        payload_schedule_reset(schedule);
+        schedule->traceLen = total;
+      } else if ((schedule->traceLen != total) || (schedule->traceLoaded != first)) {
+        return false;
+      }
+      for (uint16_t i = 0; i < count; i++) {
+        const uint8_t *p = &data[PAYLOAD_TRACE_HEADER_LEN + (PAYLOAD_TRACE_ENTRY_LEN * i)];
+
+        schedule->trace[first + i].size = read_u16(p);
+        schedule->trace[first + i].gap = read_u16(p + 2);
+      }
+      schedule->traceLoaded = first + count;
+      if (schedule->traceLoaded == schedule->traceLen) {
+        schedule->kind = SCHEDULE_TRACE;
+      }
+      return true;
+    }
+
+    default:
+      return false;
+  }
+}
+
+/**
+ * @brief payload_schedule_active
+ * @return true if sizes come from a mix or a complete trace
+ */
+bool payload_schedule_active(const PayloadSchedule_t *schedule) {
+  return schedule->kind != SCHEDULE_CONSTANT;
+}
+
+/**
+ * @brief payload_schedule_restart
+ * Start of a run, the trace and the random draw start from the beginning.
+ */
+void payload_schedule_restart(PayloadSchedule_t *schedule) {
+  schedule->tracePos = 0;
+  schedule->rng = PAYLOAD_SCHEDULE_SEED;
+}
+
+/**
+ * @brief payload_schedule_next
+ * Size of the next packet and how long to wait before sending it.
+ * @param schedule - Active schedule
+ * @param maxSize - Largest payload the link takes, larger sizes are cut to it
+ * @param gapUs - Wait before the packet, 0 for back to back
+ * @return Payload size in bytes, maxSize if no schedule is active
+ */
+uint16_t payload_schedule_next(PayloadSchedule_t *schedule, uint16_t maxSize, uint32_t *gapUs) {
+  uint16_t size = maxSize;
+
+  *gapUs = 0;
+  if (schedule->kind == SCHEDULE_MIX) {
+    uint32_t draw;
+
+    // xorshift32
+    schedule->rng ^= schedule->rng << 13;
+    schedule->rng ^= schedule->rng >> 17;
+    schedule->rng ^= schedule->rng << 5;
+    draw = schedule->rng % schedule->weightTotal;
+    for (uint8_t i = 0; i < schedule->binCount; i++) {
+      if (draw < schedule->bins[i].weight) {
+        size = schedule->bins[i].size;
+        break;
+      }
+      draw -= schedule->bins[i].weight;
+    }
+  } else if (schedule->kind == SCHEDULE_TRACE) {
+    size = schedule->trace[schedule->tracePos].size;
+    *gapUs = (uint32_t) schedule->trace[schedule->tracePos].gap * PAYLOAD_GAP_UNIT_US;
+    schedule->tracePos = (schedule->tracePos + 1) % schedule->traceLen;
+  }
+  return (size > maxSize) ? maxSize : size;
+}
+
+/**
+ * @brief payload_schedule_encode
+ * Next characteristic write of a schedule. A mix or constant schedule is one write,
+ * a trace as many as it takes at maxLen bytes each.
+ * @param schedule - Schedule to encode
+ * @param next - Progress, 0 before the first write
+ * @param maxLen - Longest write the link takes, e.g. ATT MTU - 3
+ * @param data - Buffer of at least maxLen bytes
+ * @return Write length, 0 once everything is written
+ */
+uint16_t payload_schedule_encode(const PayloadSchedule_t *schedule, uint16_t *next, uint16_t maxLen, uint8_t *data) {
+  uint16_t count;
+
+  data[0] = schedule->kind;
+  if (schedule->kind != SCHEDULE_TRACE) {
+    if (*next > 0) {
+      return 0;
+    }
+    *next = 1;
+    if (schedule->kind == SCHEDULE_CONSTANT) {
+      return 1;
+    }
+    data[1] = schedule->binCount;
+    for (uint8_t i = 0; i < schedule->binCount; i++) {
+      write_u16(&data[2 + (3 * i)], schedule->bins[i].size);
+      data[4 + (3 * i)] = schedule->bins[i].weight;
+    }
+    return 2 + (3 * schedule->binCount);
+  }
+
+  if ((*next >= schedule->traceLen) || (maxLen < (PAYLOAD_TRACE_HEADER_LEN + PAYLOAD_TRACE_ENTRY_LEN))) {
+    return 0;
+  }
+  count = (maxLen - PAYLOAD_TRACE_HEADER_LEN) / PAYLOAD_TRACE_ENTRY_LEN;
+  if (count > (schedule->traceLen - *next)) {
+    count = schedule->traceLen - *next;
+  }
+  write_u16(&data[1], *next);
+  write_u16(&data[3], schedule->traceLen);
+  for (uint16_t i = 0; i < count; i++) {
+    uint8_t *p = &data[PAYLOAD_TRACE_HEADER_LEN + (PAYLOAD_TRACE_ENTRY_LEN * i)];
+
+    write_u16(p, schedule->trace[*next + i].size);
+    write_u16(p + 2, schedule->trace[*next + i].gap);
+  }
+  *next += count;
+  return PAYLOAD_TRACE_HEADER_LEN + (PAYLOAD_TRACE_ENTRY_LEN * count);
+}
+
+static uint16_t read_u16(const uint8_t *p) {
+  return (uint16_t) (p[0] | (p[1] << 8));
+}
+
+static void write_u16(uint8_t *p, uint16_t value) {
+  p[0] = (uint8_t) value;
+  p[1] = (uint8_t) (value >> 8);
+}
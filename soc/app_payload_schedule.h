@@ -0,0 +1,82 @@
+/**
+ * @file
+ * @brief app_payload_schedule.h
+ * Payload sizes of a notification run drawn from a size mix or replayed from
+ * a trace of sizes and inter-arrival gaps. The client writes the schedule to
+ * the payload_schedule characteristic.
+ *
+ * Wire format, little endian:
+ *   0     kind, ScheduleKind_t
+ *   Constant: nothing else, the run goes back to one size.
+ *   Mix:
+ *   1     bin count, up to PAYLOAD_MIX_MAX_BINS
+ *   2-    per bin: size u16, weight u8
+ *   Trace, written in chunks:
+ *   1-2   index of the first entry in this write
+ *   3-4   total entry count, up to PAYLOAD_TRACE_MAX
+ *   5-    per entry: size u16, gap before the packet in 0.1 ms u16
+ * A trace becomes active once its last entry has been written. Each write
+ * fits in one ATT write request, a write the slave doesn't take is answered
+ * with PAYLOAD_SCHEDULE_ATT_REFUSED.
+ ******************************************************************************/
+
+#ifndef APP_PAYLOAD_SCHEDULE_H
+#define APP_PAYLOAD_SCHEDULE_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#define PAYLOAD_MIX_MAX_BINS        8
+#define PAYLOAD_TRACE_MAX           256
+#define PAYLOAD_TRACE_HEADER_LEN    5
+#define PAYLOAD_TRACE_ENTRY_LEN     4
+#define PAYLOAD_GAP_UNIT_US         100
+#define PAYLOAD_SCHEDULE_ATT_REFUSED 0x80   // Application ATT error for a write that isn't taken
+
+typedef enum {
+  SCHEDULE_CONSTANT = 0,        // One size for the whole run, the default
+  SCHEDULE_MIX = 1,             // Sizes drawn at random by weight, sent back to back
+  SCHEDULE_TRACE = 2            // Sizes and gaps replayed in order, looping at the end
+} ScheduleKind_t;
+
+typedef struct {
+  uint16_t size;
+  uint8_t weight;
+} PayloadBin_t;
+
+typedef struct {
+  uint16_t size;
+  uint16_t gap;                 // Before the packet, 0.1 ms
+} PayloadTraceEntry_t;
+
+typedef struct {
+  uint8_t kind;
+  uint8_t binCount;
+  uint16_t weightTotal;
+  PayloadBin_t bins[PAYLOAD_MIX_MAX_BINS];
+  uint16_t traceLen;
+  uint16_t traceLoaded;         // Entries written so far, trace is used once all are in
+  uint16_t tracePos;
+  PayloadTraceEntry_t trace[PAYLOAD_TRACE_MAX];
+  uint32_t rng;
+} PayloadSchedule_t;
+
+/**************************************************************************//**
+ * Payload schedule function declarations
+ *****************************************************************************/
+void payload_schedule_reset(PayloadSchedule_t *schedule);
+bool payload_schedule_write(PayloadSchedule_t *schedule, const uint8_t *data, uint16_t len);
+bool payload_schedule_active(const PayloadSchedule_t *schedule);
+void payload_schedule_restart(PayloadSchedule_t *schedule);
+uint16_t payload_schedule_next(PayloadSchedule_t *schedule, uint16_t maxSize, uint32_t *gapUs);
+uint16_t payload_schedule_encode(const PayloadSchedule_t *schedule, uint16_t *next, uint16_t maxLen, uint8_t *data);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,111 @@
+/***************************************************************************//**
+ * @file app_setup_timing.c
+ * @brief Connection setup breakdown
+ *******************************************************************************/
+
+#include <string.h>
+#include "app_setup_timing.h"
+
+// Each phase runs from the first present of two start marks to an end mark.
+typedef struct {
+  SetupMark_t from;
+  SetupMark_t fallback;         // Used if from is missing, SETUP_MARKS for none
+  SetupMark_t to;
+  const char *name;
+} PhaseDefinition_t;
+
+static const PhaseDefinition_t PHASES[SETUP_PHASES] = {
+  { SETUP_MARK_START,           SETUP_MARKS,      SETUP_MARK_PEER_FOUND,      "Scan" },
+  { SETUP_MARK_PEER_FOUND,      SETUP_MARK_START, SETUP_MARK_CONNECTED,       "Connect" },
+  { SETUP_MARK_CONNECTED,       SETUP_MARK_START, SETUP_MARK_PARAMETERS,      "Parameters" },
+  { SETUP_MARK_CONNECTED,       SETUP_MARKS,      SETUP_MARK_MTU,             "MTU" },
+  { SETUP_MARK_DISCOVERY_START, SETUP_MARKS,      SETUP_MARK_SUBSCRIBE_START, "Discovery" },
+  { SETUP_MARK_SUBSCRIBE_START, SETUP_MARKS,      SETUP_MARK_TEST_START,      "Subscribe" },
+  { SETUP_MARK_START,           SETUP_MARKS,      SETUP_MARK_TEST_START,      "Total" }
+};
+
+#define IS_MARKED(run, mark)  (((run)->marked & (1U << (mark))) != 0)
+
+/**
+ * @brief setup_timing_begin
+ * Forget the previous run and mark its start.
+ * @param run - Run to start
+ * @param now - Current time
+ */
+void setup_timing_begin(SetupRun_t *run, uint32_t now) {
+  memset(run, 0, sizeof(SetupRun_t));
+  setup_timing_mark(run, SETUP_MARK_START, now);
+}
+
+/**
+ * @brief setup_timing_mark
+ * Record a milestone. Only the first time is kept, so repeated events don't move it.
+ * @param run - Run in progress
+ * @param mark - Milestone reached
+ * @param now - Current time
+ */
+void setup_timing_mark(SetupRun_t *run, SetupMark_t mark, uint32_t now) {
+  if ((mark >= SETUP_MARKS) || IS_MARKED(run, mark)) {
+    return;
+  }
+  run->at[mark] = now;
+  run->marked |= (uint16_t) (1U << mark);
+}
+
+/**
+ * @brief setup_timing_phase
+ * @param run - Run to look at
+ * @param phase - Phase to work out
+ * @param duration - Phase length in the unit of the marks
+ * @return false if the phase didn't happen in this run
+ */
+bool setup_timing_phase(const SetupRun_t *run, SetupPhase_t phase, uint32_t *duration) {
+  const PhaseDefinition_t *def;
+  SetupMark_t from;
+
+  if (phase >= SETUP_PHASES) {
+    return false;
+  }
+  def = &PHASES[phase];
+  from = def->from;
+  if (!IS_MARKED(run, from)) {
+    from = def->fallback;
+  }
+  if ((from >= SETUP_MARKS) || !IS_MARKED(run, from) || !IS_MARKED(run, def->to)) {
+    return false;
+  }
+  *duration = run->at[def->to] - run->at[from];
+  return true;
+}
+
+/**
+ * @brief setup_timing_add
+ * Add every phase that happened in a run to the aggregates.
+ * @param stats - Aggregates to update
+ * @param run - Finished run
+ */
+void setup_timing_add(SetupStats_t *stats, const SetupRun_t *run) {
+  for (uint8_t i = 0; i < SETUP_PHASES; i++) {
+    uint32_t duration;
+    if (!setup_timing_phase(run, (SetupPhase_t) i, &duration)) {
+      continue;
+    }
+    if ((stats->count[i] == 0) || (duration < stats->min[i])) {
+      stats->min[i] = duration;
+    }
+    if (duration > stats->max[i]) {
+      stats->max[i] = duration;
+    }
+    stats->count[i]++;
+    stats->sum[i] += duration;
+  }
+}
+
+/**
+ * @brief setup_timing_phase_name
+ * @param phase - Phase
+ * @return Name for reports
+ */
+const char *setup_timing_phase_name(SetupPhase_t phase) {
+  return (phase < SETUP_PHASES) ? PHASES[phase].name : "?";
+}
@@ -0,0 +1,72 @@
+/**
+ * @file
+ * @brief app_setup_timing.h
+ * Connection setup breakdown. The client marks each milestone between the
+ * start of a run and the start of the transfer, phases are worked out from
+ * pairs of marks. Parameters and MTU are negotiated at the same time, so both
+ * phases are measured from the connection opening and overlap. Phases whose
+ * marks are missing, e.g. discovery with cached handles, are left out of the
+ * statistics. Timestamps are 32-bit counts in any unit, wrap-around is fine
+ * as long as a phase is shorter than one wrap.
+ ******************************************************************************/
+
+#ifndef APP_SETUP_TIMING_H
+#define APP_SETUP_TIMING_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+#include <stdbool.h>
+
+typedef enum {
+  SETUP_MARK_START,             // Scanning started or a rerun was requested
+  SETUP_MARK_PEER_FOUND,        // Matching scan response
+  SETUP_MARK_CONNECTED,         // Connection opened
+  SETUP_MARK_PARAMETERS,        // Requested PHY and interval in place
+  SETUP_MARK_MTU,               // MTU exchanged
+  SETUP_MARK_LINK_READY,        // Everything the test needs from the link layer is in place
+  SETUP_MARK_DISCOVERY_START,
+  SETUP_MARK_SUBSCRIBE_START,
+  SETUP_MARK_TEST_START,
+  SETUP_MARKS
+} SetupMark_t;
+
+typedef enum {
+  SETUP_PHASE_SCAN,
+  SETUP_PHASE_CONNECT,
+  SETUP_PHASE_PARAMETERS,
+  SETUP_PHASE_MTU,
+  SETUP_PHASE_DISCOVERY,
+  SETUP_PHASE_SUBSCRIBE,
+  SETUP_PHASE_TOTAL,
+  SETUP_PHASES
+} SetupPhase_t;
+
+typedef struct {
+  uint32_t at[SETUP_MARKS];
+  uint16_t marked;              // Bit per SetupMark_t
+} SetupRun_t;
+
+typedef struct {
+  uint32_t count[SETUP_PHASES];   // Zero initialised stats are empty
+  uint32_t min[SETUP_PHASES];
+  uint32_t max[SETUP_PHASES];
+  uint64_t sum[SETUP_PHASES];
+} SetupStats_t;
+
+/**************************************************************************//**
+ * Setup timing function declarations
+ *****************************************************************************/
+void setup_timing_begin(SetupRun_t *run, uint32_t now);
+void setup_timing_mark(SetupRun_t *run, SetupMark_t mark, uint32_t now);
+bool setup_timing_phase(const SetupRun_t *run, SetupPhase_t phase, uint32_t *duration);
+void setup_timing_add(SetupStats_t *stats, const SetupRun_t *run);
+const char *setup_timing_phase_name(SetupPhase_t phase);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,204 @@
+/***************************************************************************//**
+ * @file app_streams.c
+ * @brief Stream configuration, scheduling and receive statistics
+ *******************************************************************************/
+
+#include <string.h>
+#include "app_streams.h"
+
+#define STREAM_NONE   0xFF
+
+static uint32_t read_u32(const uint8_t *p);
+
+/**
+ * @brief stream_config_parse
+ * Take a stream configuration. A short write, a bulk stream without weight or a probe with no
+ * stream left for it keeps the configuration in use.
+ * @param config - Configuration to update
+ * @param data - Written value
+ * @param len - Written length
+ * @return true if the write was valid
+ */
+bool stream_config_parse(StreamConfig_t *config, const uint8_t *data, uint16_t len) {
+  StreamConfig_t parsed;
+
+  if (len < STREAM_CONFIG_LEN) {
+    return false;
+  }
+  memset(&parsed, 0, sizeof(parsed));
+  parsed.count = data[0];
+  memcpy(parsed.weights, &data[1], STREAM_MAX);
+  parsed.probeIntervalMs = (uint16_t) (data[5] | (data[6] << 8));
+
+  // The probe needs a stream of its own.
+  if ((parsed.count > STREAM_MAX) || ((parsed.probeIntervalMs > 0) && (parsed.count >= STREAM_MAX))) {
+    return false;
+  }
+  for (uint8_t i = 0; i < parsed.count; i++) {
+    if (parsed.weights[i] == 0) {
+      return false;
+    }
+  }
+  for (uint8_t i = parsed.count; i < STREAM_MAX; i++) {
+    parsed.weights[i] = 0;
+  }
+  if (parsed.count == 0) {
+    parsed.probeIntervalMs = 0;
+  }
+
+  *config = parsed;
+  return true;
+}
+
+/**
+ * @brief stream_config_encode
+ * @param config - Configuration to encode
+ * @param data - Buffer of at least STREAM_CONFIG_LEN bytes
+ * @return Encoded length
+ */
+uint16_t stream_config_encode(const StreamConfig_t *config, uint8_t *data) {
+  data[0] = config->count;
+  memcpy(&data[1], config->weights, STREAM_MAX);
+  data[5] = (uint8_t) config->probeIntervalMs;
+  data[6] = (uint8_t) (config->probeIntervalMs >> 8);
+  return STREAM_CONFIG_LEN;
+}
+
+/**
+ * @brief stream_config_total
+ * @return Streams in use including the probe, 0 if streams are off
+ */
+uint8_t stream_config_total(const StreamConfig_t *config) {
+  return config->count + ((config->probeIntervalMs > 0) ? 1 : 0);
+}
+
+/**
+ * @brief stream_probe_index
+ * @return Stream carrying the probe, STREAM_MAX if there is none
+ */
+uint8_t stream_probe_index(const StreamConfig_t *config) {
+  return (config->probeIntervalMs > 0) ? config->count : STREAM_MAX;
+}
+
+/**
+ * @brief stream_scheduler_reset
+ * Start of a run, credits and sequence numbers from zero.
+ */
+void stream_scheduler_reset(StreamScheduler_t *sched) {
+  memset(sched, 0, sizeof(StreamScheduler_t));
+}
+
+/**
+ * @brief stream_pick
+ * Bulk stream the next notification goes to. The choice only takes effect with
+ * stream_commit(), so a notification the stack refuses is retried on the same stream.
+ * @param sched - Scheduler state
+ * @param config - Stream configuration
+ * @param subscribed - Bit mask of the streams the client subscribed to
+ * @return Stream index, STREAM_MAX if no bulk stream is subscribed
+ */
+uint8_t stream_pick(const StreamScheduler_t *sched, const StreamConfig_t *config, uint8_t subscribed) {
+  uint8_t best = STREAM_NONE;
+  int16_t bestCredit = 0;
+
+  for (uint8_t i = 0; i < config->count; i++) {
+    int16_t credit;
+
+    if (!(subscribed & (1 << i))) {
+      continue;
+    }
+    credit = sched->credit[i] + config->weights[i];
+    if ((best == STREAM_NONE) || (credit > bestCredit)) {
+      best = i;
+      bestCredit = credit;
+    }
+  }
+  return (best == STREAM_NONE) ? STREAM_MAX : best;
+}
+
+/**
+ * @brief stream_commit
+ * Account a notification sent on a bulk stream. Every stream gains its weight and the one
+ * that sent pays the total, which spreads the streams evenly instead of in bursts.
+ * @param sched - Scheduler state
+ * @param config - Stream configuration
+ * @param subscribed - Same mask as given to stream_pick()
+ * @param stream - Stream returned by stream_pick()
+ */
+void stream_commit(StreamScheduler_t *sched, const StreamConfig_t *config, uint8_t subscribed, uint8_t stream) {
+  int16_t total = 0;
+
+  for (uint8_t i = 0; i < config->count; i++) {
+    if (subscribed & (1 << i)) {
+      sched->credit[i] += config->weights[i];
+      total += config->weights[i];
+    }
+  }
+  sched->credit[stream] -= total;
+  sched->seq[stream]++;
+}
+
+/**
+ * @brief stream_stamp
+ * Write the stream header at the start of a notification.
+ * @param data - Notification data, at least STREAM_HEADER_LEN bytes
+ * @param seq - Sequence number on the stream
+ * @param ticks - RTCC count at the time the notification is handed to the stack
+ */
+void stream_stamp(uint8_t *data, uint32_t seq, uint32_t ticks) {
+  for (uint8_t i = 0; i < 4; i++) {
+    data[i] = (uint8_t) (seq >> (8 * i));
+    data[4 + i] = (uint8_t) (ticks >> (8 * i));
+  }
+}
+
+/**
+ * @brief stream_rx_reset
+ * Start of a run on the receiving side.
+ */
+void stream_rx_reset(StreamRx_t *rx) {
+  memset(rx, 0, sizeof(StreamRx_t));
+  for (uint8_t i = 0; i < STREAM_MAX; i++) {
+    histogram_reset(&rx->streams[i].delay);
+  }
+}
+
+/**
+ * @brief stream_rx_record
+ * Count a received stream notification and its queueing delay.
+ * @param rx - Receive statistics
+ * @param stream - Stream index the notification came on
+ * @param data - Notification data
+ * @param len - Notification length
+ * @param rxUs - Receive time in microseconds on the local clock
+ */
+void stream_rx_record(StreamRx_t *rx, uint8_t stream, const uint8_t *data, uint16_t len, uint64_t rxUs) {
+  StreamStats_t *stats;
+  uint32_t seq;
+  int64_t offset;
+
+  if ((stream >= STREAM_MAX) || (len < STREAM_HEADER_LEN)) {
+    return;
+  }
+  stats = &rx->streams[stream];
+  seq = read_u32(data);
+  offset = (int64_t) rxUs - (int64_t) (((uint64_t) read_u32(&data[4]) * 1000000) / STREAM_TICKS_PER_SECOND);
+
+  stats->bytes += len;
+  stats->packets++;
+  if (seq > stats->nextSeq) {
+    stats->missing += seq - stats->nextSeq;
+  }
+  stats->nextSeq = seq + 1;
+
+  // The first packets of a run find the queue empty, later minimums only correct for jitter.
+  if (!rx->haveBase || (offset < rx->baseUs)) {
+    rx->baseUs = offset;
+    rx->haveBase = true;
+  }
+  histogram_record(&stats->delay, (uint32_t) (offset - rx->baseUs));
+}
+
+static uint32_t read_u32(const uint8_t *p) {
+  return (uint32_t) p[0] | ((uint32_t) p[1] << 8) | ((uint32_t) p[2] << 16) | ((uint32_t) p[3] << 24);
+}
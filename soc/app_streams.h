@@ -0,0 +1,85 @@
+/**
+ * @file
+ * @brief app_streams.h
+ * Notification streams on several characteristics at once, to see how the
+ * stack shares the link between them and whether a low rate stream gets stuck
+ * behind bulk data in the TX queue.
+ *
+ * The client writes the configuration to the stream_config characteristic,
+ * little endian:
+ *   0     bulk stream count, 0 turns streams off
+ *   1-4   weight of each bulk stream, equal weights give round robin
+ *   5-6   probe interval in ms, 0 = no probe. The probe is a small
+ *         notification on the stream after the bulk ones, sent at this
+ *         interval ahead of any bulk data.
+ *
+ * Every stream notification starts with a header:
+ *   0-3   sequence number of the stream
+ *   4-7   slave RTCC count when the notification was handed to the stack
+ * The receiver takes the smallest receive time minus send time seen in a run
+ * as the empty queue delay and counts anything above it as queueing delay.
+ * The two clocks drift apart by up to about 100 ppm, i.e. 1 ms in 10 s.
+ ******************************************************************************/
+
+#ifndef APP_STREAMS_H
+#define APP_STREAMS_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "app_histogram.h"
+
+#define STREAM_MAX                  4       // stream_1 to stream_4 in the GATT database
+#define STREAM_CONFIG_LEN           7
+#define STREAM_HEADER_LEN           8
+#define STREAM_TICKS_PER_SECOND     32768   // Slave RTCC
+
+typedef struct {
+  uint8_t count;                    // Bulk streams, the probe comes on top
+  uint8_t weights[STREAM_MAX];
+  uint16_t probeIntervalMs;
+} StreamConfig_t;
+
+typedef struct {
+  int16_t credit[STREAM_MAX];       // Smooth weighted round robin
+  uint32_t seq[STREAM_MAX];
+} StreamScheduler_t;
+
+typedef struct {
+  uint64_t bytes;
+  uint32_t packets;
+  uint32_t missing;                 // Sequence numbers skipped
+  uint32_t nextSeq;
+  Histogram_t delay;                // Queueing delay in microseconds
+} StreamStats_t;
+
+typedef struct {
+  StreamStats_t streams[STREAM_MAX];
+  int64_t baseUs;                   // Smallest receive minus send time of the run
+  bool haveBase;
+} StreamRx_t;
+
+/**************************************************************************//**
+ * Stream function declarations
+ *****************************************************************************/
+bool stream_config_parse(StreamConfig_t *config, const uint8_t *data, uint16_t len);
+uint16_t stream_config_encode(const StreamConfig_t *config, uint8_t *data);
+uint8_t stream_config_total(const StreamConfig_t *config);
+uint8_t stream_probe_index(const StreamConfig_t *config);
+
+void stream_scheduler_reset(StreamScheduler_t *sched);
+uint8_t stream_pick(const StreamScheduler_t *sched, const StreamConfig_t *config, uint8_t subscribed);
+void stream_commit(StreamScheduler_t *sched, const StreamConfig_t *config, uint8_t subscribed, uint8_t stream);
+void stream_stamp(uint8_t *data, uint32_t seq, uint32_t ticks);
+
+void stream_rx_reset(StreamRx_t *rx);
+void stream_rx_record(StreamRx_t *rx, uint8_t stream, const uint8_t *data, uint16_t len, uint64_t rxUs);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
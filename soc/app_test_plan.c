@@ -0,0 +1,90 @@
+/***************************************************************************//**
+ * @file app_test_plan.c
+ * @brief Test plan encoding and decoding
+ *******************************************************************************/
+
+#include <string.h>
+#include "app_test_plan.h"
+
+static uint16_t read_u16(const uint8_t *p);
+static uint32_t read_u32(const uint8_t *p);
+
+/**
+ * @brief test_plan_parse
+ * Update a plan from a characteristic write, fields the write leaves out keep their values.
+ * An unknown mode or direction, or a fixed amount or time of 0, leaves the plan as it was.
+ * @param plan - Plan to update
+ * @param data - Written value
+ * @param len - Written length
+ * @return true if the write was valid
+ */
+bool test_plan_parse(TestPlan_t *plan, const uint8_t *data, uint16_t len) {
+  TestPlan_t parsed = *plan;
+
+  if ((len < 1) || (data[0] < TEST_PLAN_VERSION)) {
+    return false;
+  }
+
+  if (len >= 2) {
+    parsed.mode = data[1];
+  }
+  if (len >= 3) {
+    parsed.direction = data[2];
+  }
+  if (len >= 5) {
+    parsed.payloadSize = read_u16(&data[3]);
+  }
+  if (len >= 9) {
+    parsed.amount = read_u32(&data[5]);
+  }
+  if (len >= 13) {
+    parsed.durationMs = read_u32(&data[9]);
+  }
+  if (len >= 15) {
+    parsed.txPower = (int16_t) read_u16(&data[13]);
+  }
+  if (len >= 16) {
+    parsed.flags = data[15] & TEST_PLAN_FLAGS_KNOWN;
+  }
+
+  if ((parsed.mode > PLAN_MODE_FIXED_TIME) || (parsed.direction > PLAN_DIRECTION_INDICATE)) {
+    return false;
+  }
+  if (((parsed.mode == PLAN_MODE_FIXED_AMOUNT) && (parsed.amount == 0))
+      || ((parsed.mode == PLAN_MODE_FIXED_TIME) && (parsed.durationMs == 0))) {
+    return false;
+  }
+
+  *plan = parsed;
+  return true;
+}
+
+/**
+ * @brief test_plan_encode
+ * @param plan - Plan to encode
+ * @param data - Buffer of at least TEST_PLAN_ENCODED_LEN bytes
+ * @return Encoded length
+ */
+uint16_t test_plan_encode(const TestPlan_t *plan, uint8_t *data) {
+  data[0] = TEST_PLAN_VERSION;
+  data[1] = plan->mode;
+  data[2] = plan->direction;
+  data[3] = (uint8_t) plan->payloadSize;
+  data[4] = (uint8_t) (plan->payloadSize >> 8);
+  for (uint8_t i = 0; i < 4; i++) {
+    data[5 + i] = (uint8_t) (plan->amount >> (8 * i));
+    data[9 + i] = (uint8_t) (plan->durationMs >> (8 * i));
+  }
+  data[13] = (uint8_t) plan->txPower;
+  data[14] = (uint8_t) ((uint16_t) plan->txPower >> 8);
+  data[15] = plan->flags;
+  return TEST_PLAN_ENCODED_LEN;
+}
+
+static uint16_t read_u16(const uint8_t *p) {
+  return (uint16_t) (p[0] | (p[1] << 8));
+}
+
+static uint32_t read_u32(const uint8_t *p) {
+  return (uint32_t) p[0] | ((uint32_t) p[1] << 8) | ((uint32_t) p[2] << 16) | ((uint32_t) p[3] << 24);
+}
@@ -0,0 +1,72 @@
+/**
+ * @file
+ * @brief app_test_plan.h
+ * Test plan run by the slave, written by the client to the test_plan
+ * characteristic.
+ *
+ * Wire format, little endian. Writes may stop after any field, the fields
+ * left out keep their current values. Bytes after the known fields are
+ * ignored so that newer clients can append fields.
+ *   0     version, TEST_PLAN_VERSION
+ *   1     mode, PlanMode_t
+ *   2     direction, PlanDirection_t
+ *   3-4   payload size in bytes, 0 = automatic
+ *   5-8   amount in bytes for PLAN_MODE_FIXED_AMOUNT
+ *   9-12  duration in ms for PLAN_MODE_FIXED_TIME
+ *   13-14 TX power in 0.1 dBm, signed, TEST_PLAN_TX_POWER_KEEP leaves it as
+ *         it is. The slave publishes the power the stack actually set.
+ *   15    flags, TEST_PLAN_FLAG_*. A slave that doesn't know a flag reads
+ *         back without it.
+ ******************************************************************************/
+
+#ifndef APP_TEST_PLAN_H
+#define APP_TEST_PLAN_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#define TEST_PLAN_VERSION       1
+#define TEST_PLAN_ENCODED_LEN   16
+#define TEST_PLAN_MAX_LEN       20      // Characteristic size, room for new fields
+#define TEST_PLAN_TX_POWER_KEEP 0x7FFF  // No change to the slave TX power
+
+#define TEST_PLAN_FLAG_CLOCK_STAMPS 0x01  // RTCC count at the start of each notification and indication, see app_clock_sync.h
+#define TEST_PLAN_FLAGS_KNOWN       TEST_PLAN_FLAG_CLOCK_STAMPS
+
+typedef enum {
+  PLAN_MODE_FREE = 0,           // Run while the button is held or until transmission_on is cleared
+  PLAN_MODE_FIXED_AMOUNT = 1,   // Stop after amount bytes
+  PLAN_MODE_FIXED_TIME = 2      // Stop after durationMs
+} PlanMode_t;
+
+typedef enum {
+  PLAN_DIRECTION_AUTO = 0,      // Notifications if subscribed to both
+  PLAN_DIRECTION_NOTIFY = 1,
+  PLAN_DIRECTION_INDICATE = 2
+} PlanDirection_t;
+
+typedef struct {
+  uint8_t mode;
+  uint8_t direction;
+  uint16_t payloadSize;
+  uint32_t amount;
+  uint32_t durationMs;
+  int16_t txPower;
+  uint8_t flags;
+} TestPlan_t;
+
+/**************************************************************************//**
+ * Test plan function declarations
+ *****************************************************************************/
+bool test_plan_parse(TestPlan_t *plan, const uint8_t *data, uint16_t len);
+uint16_t test_plan_encode(const TestPlan_t *plan, uint8_t *data);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
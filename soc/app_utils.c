@@ -1,579 +1,1227 @@
-/***************************************************************************//**
- * @file app_utils.c
- * @brief Definitions of common variables and functions
- *******************************************************************************/
- 
-#include "app_utils.h"
-
-/**************************************************************************//**
- * Common variable definitions
- *****************************************************************************/
-const uint8_t TRANSMISSION_ON = 1;
-const uint8_t TRANSMISSION_OFF = 0;
-
-const char NOTIFY_ENABLED_STRING[] = {"NOTIFY: Yes\n"};
-const char NOTIFY_DISABLED_STRING[] = {"NOTIFY: No\n"};
-const char INDICATE_ENABLED_STRING[] = {"INDICATE: Yes\n"};
-const char INDICATE_DISABLED_STRING[] = {"INDICATE: No\n"};
-const char ROLE_SLAVE_STRING[] = {"ROLE: Slave\n"};
-const char ROLE_MASTER_STRING[] = {"ROLE: Master\n"};
-const char ROLE_ADVERT_STRING[] = {"ROLE: Advert\n"};
-const char ROLE_SCANNER_STRING[] = {"ROLE: Scanner\n"};
-
-uint8_t boot_to_dfu = 0;                         // Flag for indicating DFU Reset must be performed
-State_t state = ADV_SCAN;
-uint8_t connection = 0xFF;                       // Connection handle initialized to known unreachable handle.
-uint16_t mtuSize = 0;                            // Variable to hold the MTU size once a new connection is formed
-uint16_t pduSize = 0;                            // Variable to hold PDU size once a new connection is formed
-uint16_t interval = 0;                           // Variable to hold connection interval
-
-uint8_t notificationsData[DATA_SIZE] = {0};
-uint8_t indicationsData[DATA_SIZE] = {0};
-uint16_t maxDataSizeIndications = DATA_SIZE;
-uint16_t maxDataSizeNotifications = DATA_SIZE;   // Variable to calculate maximum data size for optimal throughput
-uint32_t throughput = 0;
-uint32_t bitsSent = 0;
-uint32_t timeElapsed = 0;
-uint32_t operationCount = 0;
-
-uint8_t phyInUse = PHY_1M;
-uint8_t phyToUse = 0;
-
-bool roleIsSlave = true;
-bool waitingForConfirmation = 0;                         // Flag to check if waiting for any pending confirmations
-volatile bool buttonOneReleased = true;                  // Flag to check if button has been released for indications.
-bool notificationsSubscribed = false;
-bool indicationsSubscribed = false;
-bool advStopped = false;                                 // Check if advertising has been stopped once the connection is formed.
-#ifdef SEND_FIXED_TRANSFER_TIME
-bool fixedTimeExpired = false;
-#endif
-
-/* Display strings */
-char throughputString[] = "TH:           \n";       // Char array to print the throughput
-char mtuSizeString[] = "MTU:    ";                  // Char array to print MTU size on the display
-char connIntervalString[] = "INTRV:      ";         // Char array to print connection interval on the display
-char pduSizeString[] = "PDU:    ";                  // Char array to print PDU size on the display
-char phyString[] = "PHY:          ";	              // Char array to print PHY in use on the display
-
-char maxDataSizeString[] = "DATA SIZE:    ";
-char statusConnectedString[] = {"RSSI:     \n"};
-char operationCountString[] = "CNT:          \n";
-char statusDisconnectedString[] = {"STATUS: Discon\n"};
-
-char *notifyString = (char *)NOTIFY_DISABLED_STRING;
-char *indicateString = (char *)INDICATE_DISABLED_STRING;
-char *statusString = (char *)statusDisconnectedString;
-char *roleString;
-
-int16_t txPowerResp = TX_POWER;
-char txPowerString[] = "TX:        "; // 8 spaces, display TX power in dBm
-
-#if defined(SEND_FIXED_TRANSFER_COUNT) && defined(SEND_FIXED_TRANSFER_TIME)
-#error "These are mutually exclusive options, you either do a fixed amount of transfers of transfer over a fixed amount of time."
-#endif
-
-/**************************************************************************//**
- * Common function definitions
- *****************************************************************************/
-
-/**
- * @reset_variables
- * Reset necessary flags and state to known states
- */
-void reset_variables(void) {
-  connection = 0xFF;
-  throughput = 0;
-  bitsSent = 0;
-  mtuSize = 0;
-  pduSize = 0;
-  interval = 0;
-  operationCount = 0;
-  maxDataSizeNotifications = 0;
-  maxDataSizeIndications = 0;
-  state = ADV_SCAN;
-  memset(notificationsData, 0, DATA_SIZE);
-  memset(indicationsData, 0, DATA_SIZE);
-  notificationsSubscribed = false;
-  indicationsSubscribed = false;
-  advStopped = false;
-}
-
-/**
- * @brief set_display_defaults
- * Set display strings according to device role defaults
- */
-void set_display_defaults(void) {
-  // Clear display strings on disconnect
-  if (roleIsSlave) {
-      roleString = (char *)ROLE_ADVERT_STRING;
-  } else {
-      roleString = (char *)ROLE_SCANNER_STRING;
-  }
-
-  notifyString = (char *)NOTIFY_DISABLED_STRING;
-  indicateString = (char *)INDICATE_DISABLED_STRING;
-  statusString = (char *)statusDisconnectedString;
-
-  sprintf(txPowerString + 4, ((txPowerResp / 10) == 0) ? "%01d dBm" : "%+0d dBm", txPowerResp / 10); // 0 dBm without sign
-  sprintf(mtuSizeString + 5, "%s", "   ");			        // 3 spaces
-  sprintf(throughputString + 4, "%s", "       ");		    // 7 spaces
-  sprintf(pduSizeString + 5, "%s", "   ");			        // 3 spaces
-  sprintf(connIntervalString + 7, "%s", "    ");		    // 4 spaces
-  sprintf(maxDataSizeString + 11, "%s", "   ");		      // 3 spaces
-  sprintf(phyString + 5, "%s", "        ");					    // 8 spaces
-  sprintf(operationCountString + 5, "%s", "         "); // 9 spaces
-}
-
-/**
- * @brief update_displayed_phy
- * Changes displayed string to reflect used PHY
- * @param currentPhy - Currently used PHY (le_gap_phy_type)
- */
-void update_displayed_phy(uint8_t currentPhy) {
-  phyToUse = 0;
-  phyInUse = currentPhy;
-
-  switch(phyInUse) {
-    case PHY_1M:
-      sprintf(phyString + 5, "%s", "1M");
-      break;
-
-    case PHY_2M:
-      sprintf(phyString + 5, "%s", "2M");
-      break;
-
-    case PHY_S8:
-      sprintf(phyString + 5, "%s", "CODED S8");
-      break;
-
-    default:
-      break;
-  } 
-}
-
-/**
- * @brief setup_adv_scan
- * Start advertising or scanning depending on the role.
- */
-void setup_adv_scan(void) {
-  if (roleIsSlave) {
-    // LE Coded PHY Advertising
-    gecko_cmd_le_gap_set_advertise_timing(0, 200, 200, 0, 0);
-    gecko_cmd_le_gap_set_advertise_channel_map(0, 7);
-    gecko_cmd_le_gap_set_advertise_phy(0, le_gap_phy_coded, le_gap_phy_coded);
-    gecko_cmd_le_gap_start_advertising(0, le_gap_general_discoverable, le_gap_connectable_non_scannable);
-
-    //1M PHY Advertising
-    gecko_cmd_le_gap_set_advertise_timing(1, 160, 160, 0, 0);
-    gecko_cmd_le_gap_set_advertise_channel_map(1, 7);
-    gecko_cmd_le_gap_set_advertise_phy(1, le_gap_phy_1m, le_gap_phy_1m);
-    gecko_cmd_le_gap_start_advertising(1, le_gap_general_discoverable, le_gap_connectable_scannable);
-    advStopped = false;
-  } else {
-    // Start scanning
-    gecko_cmd_le_gap_set_discovery_type(5, 0);
-    gecko_cmd_le_gap_set_discovery_timing(5, SCAN_INTERVAL, SCAN_WINDOW);
-    // Start scanning again after disconnection with last PHY, unless 2M, which is not possible so fall back to 1M.
-    gecko_cmd_le_gap_start_discovery((phyInUse == le_gap_phy_2m) ? le_gap_phy_1m : phyInUse, le_gap_discover_observation);
-    sprintf(phyString + 5, "%s", (phyInUse == le_gap_phy_coded) ? "CODED S8" : "1M" );
-  }
-}
-
-/**
- * @brief setup_pins_interrupts
- * Configure push buttons and button interrupts
- */
-void setup_pins_interrupts(void) {
-  // Configure PB0 and PB1 as inputs on the WSTK
-  GPIO_PinModeSet(BSP_BUTTON0_PORT, BSP_BUTTON0_PIN, gpioModeInputPullFilter, 1);
-  GPIO_PinModeSet(BSP_BUTTON1_PORT, BSP_BUTTON1_PIN, gpioModeInputPullFilter, 1);
-  // Initialize interrupts
-  GPIOINT_Init();
-  // Configuring push buttons PB0 and PB1 on the WSTK to generate interrupt
-  GPIO_ExtIntConfig(BSP_BUTTON0_PORT, BSP_BUTTON0_PIN, BSP_BUTTON0_PIN, true, true, true);
-  GPIOINT_CallbackRegister(BSP_BUTTON0_PIN, handle_button_change);
-
-  GPIO_ExtIntConfig(BSP_BUTTON1_PORT, BSP_BUTTON1_PIN, BSP_BUTTON1_PIN, true, true, true);
-  GPIOINT_CallbackRegister(BSP_BUTTON1_PIN, handle_button_change);
-}
-
-/**
- * @brief handle_button_change
- * Callback function to handle buttons press and release actions
- * @param pin -  push button mask
- */
-void handle_button_change(uint8_t pin) {
-
-  if(pin == BSP_BUTTON0_PIN) {
-
-    if(!GPIO_PinInGet(BSP_BUTTON0_PORT, BSP_BUTTON0_PIN)) {
-      // PB0 pressed down
-      if(roleIsSlave) {
-        gecko_external_signal(NOTIFICATIONS_START);
-      }
-    } else {
-      // PB0 released
-      if(roleIsSlave) {
-        gecko_external_signal(NOTIFICATIONS_END);
-      }
-    }
-  } else if(pin == BSP_BUTTON1_PIN) {
-
-    if (!GPIO_PinInGet(BSP_BUTTON1_PORT, BSP_BUTTON1_PIN)) {
-      // PB1 pressed
-      if (roleIsSlave) {
-        gecko_external_signal(INDICATIONS_START);
-        buttonOneReleased = false;
-      } else {
-        // Role: Master
-        if (state == ADV_SCAN) {
-          // In master role, PB1 toggles scanning PHY between 1M and LE Coded
-          gecko_external_signal(SCAN_PHY_CHANGE);
-        } else {
-          // When connected, PB1 toggles PHY between 1M, 2M and LE Coded
-          gecko_external_signal(PHY_CHANGE);
-        }
-      }
-    } else {
-      // PB1 released
-      if (roleIsSlave) {
-        gecko_external_signal(INDICATIONS_END);
-        buttonOneReleased = true;
-      }
-    }
-  }
-}
-
-/**
- * @brief refresh_display
- * Routine to refresh the info on the display based on the Bluetooth connection status
- */
-void refresh_display(void) {
-  GRAPHICS_Clear();
-
-  GRAPHICS_AppendString(roleString);
-  sprintf(txPowerString + 4, ((txPowerResp / 10) == 0) ? "%01d dBm" : "%+0d dBm", txPowerResp / 10); // 0 dBm without sign
-  GRAPHICS_AppendString(txPowerString);
-  GRAPHICS_AppendString(statusString);
-  GRAPHICS_AppendString(phyString);
-  GRAPHICS_AppendString(connIntervalString);
-  GRAPHICS_AppendString(pduSizeString);
-  GRAPHICS_AppendString(mtuSizeString);
-  GRAPHICS_AppendString(maxDataSizeString);
-
-  if (roleIsSlave) {
-    GRAPHICS_AppendString(notifyString);
-    GRAPHICS_AppendString(indicateString);
-  }
-
-  sprintf(throughputString + 4, "%07lu", throughput);
-  throughputString[11] = ' ';
-  throughputString[12] = 'b';
-  throughputString[13] = 'p';
-  throughputString[14] = 's';
-  GRAPHICS_AppendString(throughputString);
-  sprintf(operationCountString + 5, "%09lu", operationCount);
-  GRAPHICS_AppendString(operationCountString);
-
-  GRAPHICS_Update();
-}
-
-/**
- * @brief calculate_notification_size
- * Calculate optimal notification size given current PDU and MTU sizes. 
- */
-void calculate_notification_size(void) {
-  if (DATA_TRANSFER_SIZE_NOTIFICATIONS == 0 || DATA_TRANSFER_SIZE_NOTIFICATIONS > (mtuSize - NOTIFICATION_GATT_HEADER)) {
-    if ((pduSize != 0) && (mtuSize != 0)) {
-      // Optimally split over multiple over-the-air packets.
-      if (pduSize <= mtuSize) {
-        maxDataSizeNotifications = (pduSize - (L2CAP_HEADER + NOTIFICATION_GATT_HEADER))
-                                    + ((mtuSize - NOTIFICATION_GATT_HEADER - pduSize + (L2CAP_HEADER + NOTIFICATION_GATT_HEADER)) / pduSize * pduSize);
-      } else {
-        // Single over-the-air packet, but accommodate room for headers.
-        if ((pduSize - mtuSize) <= L2CAP_HEADER) {
-          maxDataSizeNotifications = pduSize - (L2CAP_HEADER + NOTIFICATION_GATT_HEADER); // LL PDU size - (L2CAP+GATT Headers)
-        } else {
-          // Room for the whole MTU, so data payload is MTU - Header of operation.
-          maxDataSizeNotifications = mtuSize - NOTIFICATION_GATT_HEADER; // MTU - GATT Header
-        }
-      }
-    }
-  } else {
-    maxDataSizeNotifications = DATA_TRANSFER_SIZE_NOTIFICATIONS;
-  }
-}
-
-/**
- * @brief calculate_indication_size
- * Calculate indication size given current MTU size.
- */
-void calculate_indication_size(void) {
-  // MTU - 3B for indication GATT operation header.
-  if (DATA_TRANSFER_SIZE_INDICATIONS == 0 || DATA_TRANSFER_SIZE_INDICATIONS > (mtuSize - INDICATION_GATT_HEADER)) {
-    maxDataSizeIndications = mtuSize - INDICATION_GATT_HEADER; // If larger than max, use max for operation.
-  } else {
-    maxDataSizeIndications = DATA_TRANSFER_SIZE_INDICATIONS; // If smaller, use given.
-  }
-}
-
-/**
- * @brief generate_notifications_data
- * Function to generate circular data (0-255) in the data payload
- */
-void generate_notifications_data(void) {
-
-  notificationsData[0] = notificationsData[maxDataSizeNotifications - 1] + 1;
-
-  for (int i = 1; i < maxDataSizeNotifications; i++) {
-    notificationsData[i] = notificationsData[i - 1] + 1;
-  }
-}
-
-/**
- * @brief generate_indications_data
- * Function to generate circular data (0-255) in the data payload
- */
-void generate_indications_data(void) {
-
-  indicationsData[0] = indicationsData[maxDataSizeIndications - 1] + 1;
-
-  for (int i = 1; i < maxDataSizeIndications; i++) {
-    indicationsData[i] = indicationsData[i - 1] + 1;
-  }
-}
-
-/**
- * @brief start_data_transmission
- * Sets up counter variables and writes 1 to transmission_on to indicate start
- */
-void start_data_transmission(void) {
-  // Slave tells master to turn off display refresh, resets counters and starts timing a new measurement.
-  bitsSent = 0;
-  throughput = 0;
-  timeElapsed = RTCC_CounterGet();
-
-  // Turn OFF Display refresh on master side
-  while(gecko_cmd_gatt_write_characteristic_value_without_response(connection, gattdb_transmission_on, 1, &TRANSMISSION_ON)->result != 0);
-  // Stop display refresh
-  while(gecko_cmd_hardware_set_soft_timer(0, SOFT_TIMER_DISPLAY_REFRESH_HANDLE, 0)->result != 0);
-}
-
-/**
- * @brief end_data_transmission
- * Does a few things after data transmissions ended. Calculate transmission time,
- * enable display refresh in master side.
- */
-void end_data_transmission(void) {
-  timeElapsed = RTCC_CounterGet() - timeElapsed;
-  // Turn ON Display on master side - stack is probably still busy pushing the last few notifications out so we need to check output
-  while(gecko_cmd_gatt_write_characteristic_value_without_response(connection, gattdb_transmission_on, 1, &TRANSMISSION_OFF)->result != 0);
-  // Resume display refresh - stack is probably still busy pushing the last few notifications out so we need to check output
-  while(gecko_cmd_hardware_set_soft_timer(HW_TICKS_PER_SECOND, SOFT_TIMER_DISPLAY_REFRESH_HANDLE, 0)->result != 0);
-  // Calculate throughput
-  throughput = (uint32_t) ((float) bitsSent / (float) ((float) timeElapsed / (float) HW_TICKS_PER_SECOND ));
-  // Write result to local GATT to be looked up on e.g. smart phone.
-  while(gecko_cmd_gatt_server_write_attribute_value(gattdb_throughput_result, 0, sizeof(throughput), (uint8_t *) (&throughput))->result != 0);
-  // Send result to subscribed NCP host or SoC master. Check for wrong state error, which means the client isn't subscribed to indications on the result.
-  if (gecko_cmd_gatt_server_send_characteristic_notification(connection, gattdb_throughput_result, sizeof(throughput), (uint8_t *) (&throughput))->result != bg_err_wrong_state) {
-    gecko_cmd_gatt_server_send_characteristic_notification(connection, gattdb_throughput_result, sizeof(throughput), (uint8_t *) (&throughput));
-  }
-
-}
-
-/**
- * @brief handle_universal_events
- * This handles events that are 'universal' in the sense that 
- * they need to be handled regardless of program state
- * @param evt - The same stack event processed by main event loop
- */
-void handle_universal_events(struct gecko_cmd_packet *evt) {
-  // Handle universal events
-  switch (BGLIB_MSG_ID(evt->header)) {
-    case gecko_evt_system_external_signal_id:
-      switch (evt->data.evt_system_external_signal.extsignals) {
-
-        case NOTIFICATIONS_START:
-          // PB0 pressed down as slave.
-          if ( (state == SUBSCRIBED) || (state == SUBSCRIBED_NOTIFICATIONS)) {
-            state = NOTIFY;
-            generate_notifications_data();
-#if defined(SEND_FIXED_TRANSFER_TIME)
-            gecko_cmd_hardware_set_soft_timer(SEND_FIXED_TRANSFER_TIME, SOFT_TIMER_FIXED_TRANSFER_TIME_HANDLE, 1);
-            fixedTimeExpired = false;
-#endif
-            start_data_transmission();
-            break;
-          }
-          break;
-
-        case NOTIFICATIONS_END:
-          // PB0 released as slave.
-          if (state == NOTIFY) {
-#if !defined(SEND_FIXED_TRANSFER_COUNT) && !defined(SEND_FIXED_TRANSFER_TIME)
-            end_data_transmission();
-            if (notificationsSubscribed && indicationsSubscribed) {
-              state = SUBSCRIBED;
-            } else if (notificationsSubscribed) {
-              state = SUBSCRIBED_NOTIFICATIONS;
-            } else if (indicationsSubscribed) {
-              state = SUBSCRIBED_INDICATIONS;
-            } else {
-              state = CONNECTED;
-            }
-
-#endif
-            break;
-          }
-          break;
-
-        case INDICATIONS_START:
-          // PB1 pressed down as slave.
-          if ( (state == SUBSCRIBED) || (state == SUBSCRIBED_INDICATIONS) ) {
-            state = INDICATE;
-            start_data_transmission();
-            generate_indications_data();
-#if defined(SEND_FIXED_TRANSFER_TIME)
-            gecko_cmd_hardware_set_soft_timer(SEND_FIXED_TRANSFER_TIME, SOFT_TIMER_FIXED_TRANSFER_TIME_HANDLE, 1);
-            fixedTimeExpired = false;
-#endif
-            while(gecko_cmd_gatt_server_send_characteristic_notification(connection, gattdb_throughput_indications, maxDataSizeIndications, indicationsData)->result != 0);
-          }
-
-          break;
-
-        case INDICATIONS_END:
-          break;
-
-        case PHY_CHANGE:
-          // PB1 pressed down as master.
-          switch (phyInUse) {
-            case PHY_1M:
-#if defined(_SILICON_LABS_32B_SERIES_1_CONFIG_2) || defined(_SILICON_LABS_32B_SERIES_1_CONFIG_3) || defined(_SILICON_LABS_32B_SERIES_2_CONFIG_1)
-              // We're on 1M PHY, go to 2M PHY - only supported by xG12 and xG13
-              phyToUse = PHY_2M;
-#endif
-              break;
-
-            case PHY_2M:
-#if defined(_SILICON_LABS_32B_SERIES_1_CONFIG_3) || defined(_SILICON_LABS_32B_SERIES_2_CONFIG_1)
-              // We're on 2M PHY, go to 125kbit Coded PHY (S=8) - only supported by xG13
-              phyToUse = PHY_S8;
-#else
-              // We're on 2MPHY but with xG12, go back to 1M PHY
-              phyToUse = PHY_1M;
-#endif
-              break;
-
-            case PHY_S8:
-              // We're on S8 PHY, go back to 1M PHY
-              phyToUse = PHY_1M;
-              break;
-
-            default:
-              break;
-          }
-          break;
-
-        case SCAN_PHY_CHANGE:
-					if (state == ADV_SCAN) {
-						gecko_cmd_le_gap_end_procedure();
-						switch (phyInUse) {
-							case PHY_1M:
-#if defined(_SILICON_LABS_32B_SERIES_1_CONFIG_3) || defined(_SILICON_LABS_32B_SERIES_2_CONFIG_1)
-								gecko_cmd_le_gap_start_discovery(le_gap_phy_coded, le_gap_discover_observation);
-								phyInUse = PHY_S8;
-								sprintf(phyString + 5, "%s", "CODED S8");
-#else
-								gecko_cmd_le_gap_start_discovery(le_gap_phy_1m, le_gap_discover_observation);
-#endif
-								break;
-
-							case PHY_2M:
-								gecko_cmd_le_gap_start_discovery(le_gap_phy_1m, le_gap_discover_observation);
-								phyInUse = PHY_1M;
-								sprintf(phyString + 5, "%s", "1M");
-								break;
-
-							case PHY_S8:
-								// We're on S8 PHY, go to 1M PHY
-								gecko_cmd_le_gap_start_discovery(le_gap_phy_1m, le_gap_discover_observation);
-								phyInUse = PHY_1M;
-								sprintf(phyString + 5, "%s", "1M");
-								break;
-
-							default:
-								break;
-						}
-					}
-					break;
-
-        default:
-          break;
-      } // switch-extsignals
-
-      break;
-
-    case gecko_evt_hardware_soft_timer_id:
-      switch (evt->data.evt_hardware_soft_timer.handle) {
-          case SOFT_TIMER_DISPLAY_REFRESH_HANDLE:
-              gecko_cmd_le_connection_get_rssi(connection);
-              refresh_display();
-              break;
-#ifdef SEND_FIXED_TRANSFER_TIME
-          case SOFT_TIMER_FIXED_TRANSFER_TIME_HANDLE:
-            fixedTimeExpired = true;
-            if ((state == INDICATE) && waitingForConfirmation) {
-              break;
-            }
-
-            end_data_transmission();
-            state = SUBSCRIBED;
-            break;
-#endif
-          default:
-              break;
-      }
-      break;
-
-    case gecko_evt_le_connection_parameters_id:
-      pduSize = evt->data.evt_le_connection_parameters.txsize;
-      interval = evt->data.evt_le_connection_parameters.interval;
-      sprintf(pduSizeString + 5, "%03u", pduSize);
-      sprintf(connIntervalString + 7, "%04u", (unsigned int) ((float) interval * 1.25));
-      calculate_notification_size();
-      sprintf(maxDataSizeString + 11, "%03u", maxDataSizeNotifications);
-      statusString = (char *)statusConnectedString;
-      break;
-
-    case gecko_evt_gatt_mtu_exchanged_id:
-      mtuSize = evt->data.evt_gatt_mtu_exchanged.mtu;
-      sprintf(mtuSizeString + 5, "%03u", mtuSize);
-      calculate_indication_size();
-      calculate_notification_size();
-      sprintf(maxDataSizeString + 11, "%03u", maxDataSizeNotifications);
-      break;
-
-    case gecko_evt_le_connection_rssi_id:
-      sprintf(statusConnectedString + 6, "%03d", evt->data.evt_le_connection_rssi.rssi);
-      break;
-
-    case gecko_evt_le_connection_closed_id:
-      // Set key variables to defaults and state to ADV_SCAN.
-      reset_variables(); 
-      set_display_defaults();
-      // Check if need to boot to dfu mode
-      if (boot_to_dfu) {
-        gecko_cmd_system_reset(2);
-      } else {
-        // After disconnect, save the last used PHY to be the next to change into.
-        phyToUse = phyInUse; 
-        setup_adv_scan();
-      }
-      break;
-
-    default:
-      break;
-  } // switch-universal events
-}
+/***************************************************************************//**
+ * @file app_utils.c
+ * @brief Definitions of common variables and functions
+ *******************************************************************************/
+ 
+#include "app.h"
+#include "app_utils.h"
+
+/**************************************************************************//**
+ * Common variable definitions
+ *****************************************************************************/
+const uint8_t TRANSMISSION_ON = 1;
+const uint8_t TRANSMISSION_OFF = 0;
+
+const char NOTIFY_ENABLED_STRING[] = {"NOTIFY: Yes\n"};
+const char NOTIFY_DISABLED_STRING[] = {"NOTIFY: No\n"};
+const char INDICATE_ENABLED_STRING[] = {"INDICATE: Yes\n"};
+const char INDICATE_DISABLED_STRING[] = {"INDICATE: No\n"};
+const char ROLE_SLAVE_STRING[] = {"ROLE: Slave\n"};
+const char ROLE_MASTER_STRING[] = {"ROLE: Master\n"};
+const char ROLE_ADVERT_STRING[] = {"ROLE: Advert\n"};
+const char ROLE_SCANNER_STRING[] = {"ROLE: Scanner\n"};
+const char ROLE_BROADCAST_STRING[] = {"ROLE: Broadcast\n"};
+const char ROLE_BROADCAST_SCAN_STRING[] = {"ROLE: BC Scan\n"};
+
+uint8_t boot_to_dfu = 0;                         // Flag for indicating DFU Reset must be performed
+State_t state = ADV_SCAN;
+uint8_t connection = 0xFF;                       // Connection handle initialized to known unreachable handle.
+uint16_t mtuSize = 0;                            // Variable to hold the MTU size once a new connection is formed
+uint16_t pduSize = 0;                            // Variable to hold PDU size once a new connection is formed
+uint16_t interval = 0;                           // Variable to hold connection interval
+
+uint8_t notificationsData[DATA_SIZE] = {0};
+uint8_t indicationsData[DATA_SIZE] = {0};
+uint16_t maxDataSizeIndications = DATA_SIZE;
+uint16_t maxDataSizeNotifications = DATA_SIZE;   // Variable to calculate maximum data size for optimal throughput
+uint16_t notificationSize = DATA_SIZE;
+uint32_t notificationDueAt = 0;
+PayloadSchedule_t payloadSchedule;
+uint32_t runNotifications = 0;
+uint64_t runAirtimeUs = 0;
+StreamConfig_t streamConfig;
+StreamScheduler_t streamScheduler;
+uint8_t streamsSubscribed = 0;
+const uint16_t streamHandles[STREAM_MAX] = { gattdb_stream_1, gattdb_stream_2, gattdb_stream_3, gattdb_stream_4 };
+static uint32_t streamProbeDueAt = 0;
+static uint8_t streamProbeData[STREAM_HEADER_LEN];
+uint32_t throughput = 0;
+uint32_t bitsSent = 0;
+uint32_t timeElapsed = 0;
+uint32_t operationCount = 0;
+uint32_t indicationSentAt = 0;
+ConfirmHistogram_t confirmHistogram;
+CmdQueue_t cmdQueue;
+FlightRecorder_t flightRecorder;
+EventCensus_t eventCensus;
+static uint16_t flightDumpNext = 0;     // Next record to send
+static bool flightDumpActive = false;
+static bool flightDumpAborting = false; // The abort chunk is due, the client waits for the dump otherwise
+static uint8_t confirmHistogramValue[3 + (4 * CONFIRM_HISTOGRAM_BUCKETS) + 8]; // Kept for deferred writes of the characteristic
+static const char *const COMMAND_NAMES[CMD_IDS] = { "transmission_on", "display refresh", "throughput_result", "indication", "confirmation_histogram" };
+
+uint8_t phyInUse = PHY_1M;
+uint8_t phyToUse = 0;
+bool adaptivePhy = false;
+
+bool roleIsSlave = true;
+bool connectionless = false;
+bool waitingForConfirmation = 0;                         // Flag to check if waiting for any pending confirmations
+volatile bool buttonOneReleased = true;                  // Flag to check if button has been released for indications.
+bool notificationsSubscribed = false;
+bool indicationsSubscribed = false;
+bool advStopped = false;                                 // Check if advertising has been stopped once the connection is formed.
+bool fixedTimeExpired = false;
+
+/* Display strings */
+char throughputString[] = "TH:           \n";       // Char array to print the throughput
+char mtuSizeString[] = "MTU:    ";                  // Char array to print MTU size on the display
+char connIntervalString[] = "INTRV:      ";         // Char array to print connection interval on the display
+char pduSizeString[] = "PDU:    ";                  // Char array to print PDU size on the display
+char phyString[] = "PHY:          ";	              // Char array to print PHY in use on the display
+
+char maxDataSizeString[] = "DATA SIZE:    ";
+char statusConnectedString[] = {"RSSI:     \n"};
+char operationCountString[] = "CNT:          \n";
+char statusDisconnectedString[] = {"STATUS: Discon\n"};
+char latencyP50String[] = "P50:           \n";     // Median round trip time
+char latencyP99String[] = "P99:           \n";     // 99th percentile round trip time
+bool latencyMeasured = false;
+char confirmModeString[] = "CFM:           \n";     // Most common confirmation delay and its share
+char confirmMaxString[] = "CFM MAX:       \n";     // Longest confirmation delay
+char sweepLines[SWEEP_LCD_LINES][17];
+uint8_t sweepLineCount = 0;
+static volatile uint32_t buttonZeroPressedAt = 0;   // RTCC count when PB0 went down, tells short and long presses apart
+
+char *notifyString = (char *)NOTIFY_DISABLED_STRING;
+char *indicateString = (char *)INDICATE_DISABLED_STRING;
+char *statusString = (char *)statusDisconnectedString;
+char *roleString;
+
+int16_t txPowerResp = TX_POWER;
+char txPowerString[] = "TX:        "; // 8 spaces, display TX power in dBm
+
+#if defined(SEND_FIXED_TRANSFER_COUNT) && defined(SEND_FIXED_TRANSFER_TIME)
+#error "These are mutually exclusive options, you either do a fixed amount of transfers of transfer over a fixed amount of time."
+#endif
+
+/* Test plan, defaults taken from the compile time options above */
+TestPlan_t testPlan = {
+#if defined(SEND_FIXED_TRANSFER_COUNT)
+  .mode = PLAN_MODE_FIXED_AMOUNT,
+  .amount = SEND_FIXED_TRANSFER_COUNT,
+#elif defined(SEND_FIXED_TRANSFER_TIME)
+  .mode = PLAN_MODE_FIXED_TIME,
+  .durationMs = (uint32_t) (((uint64_t) SEND_FIXED_TRANSFER_TIME * 1000) / HW_TICKS_PER_SECOND),
+#else
+  .mode = PLAN_MODE_FREE,
+#endif
+  .direction = PLAN_DIRECTION_AUTO,
+  .payloadSize = 0,
+  .txPower = TX_POWER
+};
+TestPlan_t activePlan;
+
+/**************************************************************************//**
+ * Common function definitions
+ *****************************************************************************/
+
+/**
+ * @reset_variables
+ * Reset necessary flags and state to known states
+ */
+void reset_variables(void) {
+  connection = 0xFF;
+  throughput = 0;
+  bitsSent = 0;
+  mtuSize = 0;
+  pduSize = 0;
+  interval = 0;
+  operationCount = 0;
+  maxDataSizeNotifications = 0;
+  maxDataSizeIndications = 0;
+  notificationSize = 0;
+  // A schedule, streams and clock stamps belong to the client that set them up.
+  payload_schedule_reset(&payloadSchedule);
+  memset(&streamConfig, 0, sizeof(streamConfig));
+  testPlan.flags = 0;
+  streamsSubscribed = 0;
+  flightDumpActive = false;
+  flightRecorder.frozen = false;
+  start_event_census();
+  state = ADV_SCAN;
+  memset(notificationsData, 0, DATA_SIZE);
+  memset(indicationsData, 0, DATA_SIZE);
+  notificationsSubscribed = false;
+  indicationsSubscribed = false;
+  advStopped = false;
+}
+
+/**
+ * @brief set_display_defaults
+ * Set display strings according to device role defaults
+ */
+void set_display_defaults(void) {
+  // Clear display strings on disconnect
+  if (roleIsSlave) {
+      roleString = (char *)ROLE_ADVERT_STRING;
+  } else {
+      roleString = (char *)ROLE_SCANNER_STRING;
+  }
+
+  notifyString = (char *)NOTIFY_DISABLED_STRING;
+  indicateString = (char *)INDICATE_DISABLED_STRING;
+  statusString = (char *)statusDisconnectedString;
+
+  sprintf(txPowerString + 4, ((txPowerResp / 10) == 0) ? "%01d dBm" : "%+0d dBm", txPowerResp / 10); // 0 dBm without sign
+  sprintf(mtuSizeString + 5, "%s", "   ");			        // 3 spaces
+  sprintf(throughputString + 4, "%s", "       ");		    // 7 spaces
+  sprintf(pduSizeString + 5, "%s", "   ");			        // 3 spaces
+  sprintf(connIntervalString + 7, "%s", "    ");		    // 4 spaces
+  sprintf(maxDataSizeString + 11, "%s", "   ");		      // 3 spaces
+  sprintf(phyString + 5, "%s", "        ");					    // 8 spaces
+  sprintf(operationCountString + 5, "%s", "         "); // 9 spaces
+  latencyMeasured = false;
+}
+
+/**
+ * @brief update_displayed_phy
+ * Changes displayed string to reflect used PHY
+ * @param currentPhy - Currently used PHY (le_gap_phy_type)
+ */
+void update_displayed_phy(uint8_t currentPhy) {
+  flight_record(FLIGHT_PHY_CHANGE, currentPhy, 0);
+  phyToUse = 0;
+  phyInUse = currentPhy;
+  set_phy_string(phyInUse);
+}
+
+/**
+ * @brief set_phy_string
+ * Show a PHY on the display, prefixed with AUTO while the master picks the PHY itself.
+ * @param phy - PHY to show
+ */
+void set_phy_string(uint8_t phy) {
+  switch(phy) {
+    case PHY_1M:
+      sprintf(phyString + 5, "%s", adaptivePhy ? "AUTO 1M" : "1M");
+      break;
+
+    case PHY_2M:
+      sprintf(phyString + 5, "%s", adaptivePhy ? "AUTO 2M" : "2M");
+      break;
+
+    case PHY_S8:
+      sprintf(phyString + 5, "%s", adaptivePhy ? "AUTO S8" : "CODED S8");
+      break;
+
+    default:
+      break;
+  }
+}
+
+/**
+ * @brief setup_adv_scan
+ * Start advertising or scanning depending on the role.
+ */
+void setup_adv_scan(void) {
+  if (roleIsSlave) {
+    // LE Coded PHY Advertising
+    gecko_cmd_le_gap_set_advertise_timing(0, 200, 200, 0, 0);
+    gecko_cmd_le_gap_set_advertise_channel_map(0, 7);
+    gecko_cmd_le_gap_set_advertise_phy(0, le_gap_phy_coded, le_gap_phy_coded);
+    gecko_cmd_le_gap_start_advertising(0, le_gap_general_discoverable, le_gap_connectable_non_scannable);
+
+    //1M PHY Advertising
+    gecko_cmd_le_gap_set_advertise_timing(1, 160, 160, 0, 0);
+    gecko_cmd_le_gap_set_advertise_channel_map(1, 7);
+    gecko_cmd_le_gap_set_advertise_phy(1, le_gap_phy_1m, le_gap_phy_1m);
+    gecko_cmd_le_gap_start_advertising(1, le_gap_general_discoverable, le_gap_connectable_scannable);
+    advStopped = false;
+  } else {
+    // Start scanning
+    gecko_cmd_le_gap_set_discovery_type(5, 0);
+    gecko_cmd_le_gap_set_discovery_timing(5, SCAN_INTERVAL, SCAN_WINDOW);
+    // Start scanning again after disconnection with last PHY, unless 2M, which is not possible so fall back to 1M.
+    gecko_cmd_le_gap_start_discovery((phyInUse == le_gap_phy_2m) ? le_gap_phy_1m : phyInUse, le_gap_discover_observation);
+    sprintf(phyString + 5, "%s", (phyInUse == le_gap_phy_coded) ? "CODED S8" : "1M" );
+  }
+}
+
+/**
+ * @brief cmd_clock
+ * Time source of the command queue, RTCC ticks
+ */
+static uint32_t cmd_clock(void) {
+  return RTCC_CounterGet();
+}
+
+/**
+ * @brief setup_command_queue
+ * Empty the command queue and its counters, once at start up
+ */
+void setup_command_queue(void) {
+  cmd_queue_init(&cmdQueue, cmd_clock, CMD_RETRY_GAP_TICKS, CMD_MAX_ATTEMPTS);
+}
+
+/**
+ * @brief setup_pins_interrupts
+ * Configure push buttons and button interrupts
+ */
+void setup_pins_interrupts(void) {
+  // Configure PB0 and PB1 as inputs on the WSTK
+  GPIO_PinModeSet(BSP_BUTTON0_PORT, BSP_BUTTON0_PIN, gpioModeInputPullFilter, 1);
+  GPIO_PinModeSet(BSP_BUTTON1_PORT, BSP_BUTTON1_PIN, gpioModeInputPullFilter, 1);
+  // Initialize interrupts
+  GPIOINT_Init();
+  // Configuring push buttons PB0 and PB1 on the WSTK to generate interrupt
+  GPIO_ExtIntConfig(BSP_BUTTON0_PORT, BSP_BUTTON0_PIN, BSP_BUTTON0_PIN, true, true, true);
+  GPIOINT_CallbackRegister(BSP_BUTTON0_PIN, handle_button_change);
+
+  GPIO_ExtIntConfig(BSP_BUTTON1_PORT, BSP_BUTTON1_PIN, BSP_BUTTON1_PIN, true, true, true);
+  GPIOINT_CallbackRegister(BSP_BUTTON1_PIN, handle_button_change);
+}
+
+/**
+ * @brief handle_button_change
+ * Callback function to handle buttons press and release actions
+ * @param pin -  push button mask
+ */
+void handle_button_change(uint8_t pin) {
+
+  if(pin == BSP_BUTTON0_PIN) {
+
+    if(!GPIO_PinInGet(BSP_BUTTON0_PORT, BSP_BUTTON0_PIN)) {
+      // PB0 pressed down
+      if(roleIsSlave) {
+        gecko_external_signal(NOTIFICATIONS_START);
+      } else {
+        buttonZeroPressedAt = RTCC_CounterGet();
+      }
+    } else {
+      // PB0 released
+      if(roleIsSlave) {
+        gecko_external_signal(NOTIFICATIONS_END);
+      } else if ((RTCC_CounterGet() - buttonZeroPressedAt) >= BUTTON_LONG_PRESS_TICKS) {
+        // In master role, a long press starts and stops a sweep
+        gecko_external_signal(SWEEP_TOGGLE);
+      } else {
+        // A short press starts and stops a latency measurement, or turns the sweep page
+        gecko_external_signal(LATENCY_START);
+      }
+    }
+  } else if(pin == BSP_BUTTON1_PIN) {
+
+    if (!GPIO_PinInGet(BSP_BUTTON1_PORT, BSP_BUTTON1_PIN)) {
+      // PB1 pressed
+      if (roleIsSlave) {
+        gecko_external_signal(INDICATIONS_START);
+        buttonOneReleased = false;
+      } else {
+        // Role: Master
+        if (state == ADV_SCAN) {
+          // In master role, PB1 toggles scanning PHY between 1M and LE Coded
+          gecko_external_signal(SCAN_PHY_CHANGE);
+        } else {
+          // When connected, PB1 toggles PHY between 1M, 2M and LE Coded
+          gecko_external_signal(PHY_CHANGE);
+        }
+      }
+    } else {
+      // PB1 released
+      if (roleIsSlave) {
+        gecko_external_signal(INDICATIONS_END);
+        buttonOneReleased = true;
+      }
+    }
+  }
+}
+
+/**
+ * @brief refresh_display
+ * Routine to refresh the info on the display based on the Bluetooth connection status
+ */
+void refresh_display(void) {
+  GRAPHICS_Clear();
+
+  GRAPHICS_AppendString(roleString);
+  sprintf(txPowerString + 4, ((txPowerResp / 10) == 0) ? "%01d dBm" : "%+0d dBm", txPowerResp / 10); // 0 dBm without sign
+  GRAPHICS_AppendString(txPowerString);
+  GRAPHICS_AppendString(statusString);
+
+  if (sweepLineCount > 0) {
+    // Sweep results replace the connection details, pages are laid out in app_master.c
+    for (uint8_t i = 0; i < sweepLineCount; i++) {
+      GRAPHICS_AppendString(sweepLines[i]);
+    }
+    GRAPHICS_Update();
+    return;
+  }
+
+  GRAPHICS_AppendString(phyString);
+  GRAPHICS_AppendString(connIntervalString);
+  GRAPHICS_AppendString(pduSizeString);
+  GRAPHICS_AppendString(mtuSizeString);
+  GRAPHICS_AppendString(maxDataSizeString);
+
+  if (roleIsSlave) {
+    GRAPHICS_AppendString(notifyString);
+    GRAPHICS_AppendString(indicateString);
+  }
+
+  sprintf(throughputString + 4, "%07lu", throughput);
+  throughputString[11] = ' ';
+  throughputString[12] = 'b';
+  throughputString[13] = 'p';
+  throughputString[14] = 's';
+  GRAPHICS_AppendString(throughputString);
+  sprintf(operationCountString + 5, "%09lu", operationCount);
+  GRAPHICS_AppendString(operationCountString);
+
+  if (roleIsSlave && (confirmHistogram.total > 0)) {
+    GRAPHICS_AppendString(confirmModeString);
+    GRAPHICS_AppendString(confirmMaxString);
+  }
+
+  if (latencyMeasured) {
+    GRAPHICS_AppendString(latencyP50String);
+    GRAPHICS_AppendString(latencyP99String);
+  }
+
+  GRAPHICS_Update();
+}
+
+/**
+ * @brief calculate_notification_size
+ * Calculate optimal notification size given current PDU and MTU sizes and the payload size of
+ * the plan in use.
+ */
+void calculate_notification_size(void) {
+  uint16_t requested = activePlan.payloadSize ? activePlan.payloadSize : DATA_TRANSFER_SIZE_NOTIFICATIONS;
+  maxDataSizeNotifications = payload_notification_size(mtuSize, pduSize, requested, maxDataSizeNotifications);
+}
+
+/**
+ * @brief calculate_indication_size
+ * Calculate indication size given current MTU size and the payload size of the plan in use.
+ */
+void calculate_indication_size(void) {
+  uint16_t requested = activePlan.payloadSize ? activePlan.payloadSize : DATA_TRANSFER_SIZE_INDICATIONS;
+  maxDataSizeIndications = payload_indication_size(mtuSize, requested);
+}
+
+/**
+ * @brief generate_notifications_data
+ * Function to generate circular data (0-255) in the data payload. With a payload schedule
+ * the size and send time of the next notification come from the schedule.
+ */
+void generate_notifications_data(void) {
+  uint32_t gapUs;
+
+  notificationSize = payload_schedule_next(&payloadSchedule, maxDataSizeNotifications, &gapUs);
+  notificationDueAt = RTCC_CounterGet() + (uint32_t) (((uint64_t) gapUs * HW_TICKS_PER_SECOND) / 1000000);
+  payload_generate(notificationsData, notificationSize);
+}
+
+/**
+ * @brief generate_indications_data
+ * Function to generate circular data (0-255) in the data payload
+ */
+void generate_indications_data(void) {
+  payload_generate(indicationsData, maxDataSizeIndications);
+}
+
+/**
+ * @brief stamp_payload
+ * Put the RTCC count at the start of a payload about to be sent, if the run asks for clock stamps.
+ * @param data - Payload
+ * @param len - Payload length
+ */
+void stamp_payload(uint8_t *data, uint16_t len) {
+  if (activePlan.flags & TEST_PLAN_FLAG_CLOCK_STAMPS) {
+    clock_stamp(data, len, RTCC_CounterGet());
+  }
+}
+
+/**
+ * @brief start_data_transmission
+ * Sets up counter variables and writes 1 to transmission_on to indicate start
+ */
+void start_data_transmission(void) {
+  // Slave tells master to turn off display refresh, resets counters and starts timing a new measurement.
+  bitsSent = 0;
+  throughput = 0;
+  timeElapsed = RTCC_CounterGet();
+  memset(&confirmHistogram, 0, sizeof(confirmHistogram));
+  start_event_census();
+
+  // Turn OFF Display refresh on master side
+  write_transmission_on(TRANSMISSION_ON);
+  // Stop display refresh
+  set_display_refresh(false);
+}
+
+/**
+ * @brief start_plan_timer
+ * Arm the stop timer if the run is time limited.
+ */
+static void start_plan_timer(void) {
+  fixedTimeExpired = false;
+  if (activePlan.mode == PLAN_MODE_FIXED_TIME) {
+    uint32_t ticks = (uint32_t) (((uint64_t) activePlan.durationMs * HW_TICKS_PER_SECOND) / 1000);
+    gecko_cmd_hardware_set_soft_timer(ticks ? ticks : 1, SOFT_TIMER_FIXED_TRANSFER_TIME_HANDLE, 1);
+  }
+}
+
+/**
+ * @brief start_notify_run
+ * Start a notification run with the current test plan.
+ */
+void start_notify_run(void) {
+  activePlan = testPlan;
+  calculate_notification_size();
+  sprintf(maxDataSizeString + 11, "%03u", maxDataSizeNotifications);
+  state = NOTIFY;
+  flightDumpActive = false; // A new run drops a dump the receiver didn't wait for
+  flight_recorder_reset(&flightRecorder);
+  flight_record(FLIGHT_RUN_START, PLAN_DIRECTION_NOTIFY, maxDataSizeNotifications);
+  runNotifications = 0;
+  runAirtimeUs = 0;
+  payload_schedule_restart(&payloadSchedule);
+  stream_scheduler_reset(&streamScheduler);
+  streamProbeDueAt = RTCC_CounterGet();
+  generate_notifications_data();
+  start_plan_timer();
+  start_data_transmission();
+}
+
+/**
+ * @brief start_indicate_run
+ * Start an indication run with the current test plan and queue the first indication.
+ */
+void start_indicate_run(void) {
+  activePlan = testPlan;
+  calculate_indication_size();
+  state = INDICATE;
+  flightDumpActive = false;
+  flight_recorder_reset(&flightRecorder);
+  flight_record(FLIGHT_RUN_START, PLAN_DIRECTION_INDICATE, maxDataSizeIndications);
+  start_data_transmission();
+  generate_indications_data();
+  start_plan_timer();
+  send_indication();
+  waitingForConfirmation = 1;
+}
+
+/**
+ * @brief report_notification_mix
+ * Log packet rate, mean size and connection event utilization of the notification run that
+ * just ended. Utilization is the air time of the notifications and the empty PDUs answering them
+ * over the run time, so small packets show how much of the link goes to overhead.
+ */
+void report_notification_mix(void) {
+  uint32_t ms = (uint32_t) (((uint64_t) timeElapsed * 1000) / HW_TICKS_PER_SECOND);
+
+  if ((state != NOTIFY) || (runNotifications == 0) || (ms == 0)) {
+    return;
+  }
+  printLog("Notifications: %lu packets, %lu packets/s, mean %lu B, utilization %lu.%lu%%%s\r\n",
+           (unsigned long) runNotifications,
+           (unsigned long) (((uint64_t) runNotifications * 1000) / ms),
+           (unsigned long) (bitsSent / 8 / runNotifications),
+           (unsigned long) ((runAirtimeUs / ms) / 10),
+           (unsigned long) ((runAirtimeUs / ms) % 10),
+           payload_schedule_active(&payloadSchedule) ? " (scheduled)" : "");
+  for (uint8_t i = 0; i < stream_config_total(&streamConfig); i++) {
+    printLog("Stream %u: %lu packets%s\r\n", i + 1, (unsigned long) streamScheduler.seq[i],
+             (i == stream_probe_index(&streamConfig)) ? " (probe)" : "");
+  }
+}
+
+/**
+ * @brief send_stream_notification
+ * Send the next notification of a stream run. A due probe goes ahead of the bulk streams,
+ * which take turns by weight. Each notification carries its sequence number and send time.
+ * @return Bytes handed to the stack, 0 if nothing was sent
+ */
+uint16_t send_stream_notification(void) {
+  uint32_t now = RTCC_CounterGet();
+  uint8_t probe = stream_probe_index(&streamConfig);
+  uint8_t stream;
+  uint16_t size;
+  uint16_t result;
+
+  if ((probe < STREAM_MAX) && (streamsSubscribed & (1 << probe)) && ((int32_t) (now - streamProbeDueAt) >= 0)) {
+    stream_stamp(streamProbeData, streamScheduler.seq[probe], now);
+    result = gecko_cmd_gatt_server_send_characteristic_notification(connection, streamHandles[probe], STREAM_HEADER_LEN, streamProbeData)->result;
+    flight_record_send(FLIGHT_CHANNEL_STREAM + probe, result, STREAM_HEADER_LEN);
+    if (result != 0) {
+      return 0;
+    }
+    streamScheduler.seq[probe]++;
+    // No catching up after a stall, a burst of probes would only measure itself.
+    streamProbeDueAt = now + (uint32_t) (((uint64_t) streamConfig.probeIntervalMs * HW_TICKS_PER_SECOND) / 1000);
+    return STREAM_HEADER_LEN;
+  }
+
+  stream = stream_pick(&streamScheduler, &streamConfig, streamsSubscribed);
+  if ((stream >= STREAM_MAX) || ((int32_t) (now - notificationDueAt) < 0)) {
+    return 0;
+  }
+  size = (notificationSize < STREAM_HEADER_LEN) ? STREAM_HEADER_LEN : notificationSize;
+  stream_stamp(notificationsData, streamScheduler.seq[stream], now);
+  result = gecko_cmd_gatt_server_send_characteristic_notification(connection, streamHandles[stream], size, notificationsData)->result;
+  flight_record_send(FLIGHT_CHANNEL_STREAM + stream, result, size);
+  if (result != 0) {
+    return 0;
+  }
+  stream_commit(&streamScheduler, &streamConfig, streamsSubscribed, stream);
+  generate_notifications_data();
+  return size;
+}
+
+/**
+ * @brief plan_run_complete
+ * @return true once the run in progress has reached the amount or duration of its plan
+ */
+bool plan_run_complete(void) {
+  switch (activePlan.mode) {
+    case PLAN_MODE_FIXED_AMOUNT:
+      return ((uint64_t) bitsSent >= ((uint64_t) activePlan.amount * 8));
+    case PLAN_MODE_FIXED_TIME:
+      return fixedTimeExpired;
+    default:
+      return false;
+  }
+}
+
+/**
+ * @brief apply_planned_tx_power
+ * Set the TX power asked for by the test plan. Between runs the link is quiet, so the new
+ * power takes effect from the next run. The plan is left holding the power the stack set.
+ */
+void apply_planned_tx_power(void) {
+  if ((testPlan.txPower != TEST_PLAN_TX_POWER_KEEP) && (testPlan.txPower != txPowerResp)) {
+    int16_t requested = testPlan.txPower;
+
+    txPowerResp = gecko_cmd_system_set_tx_power(requested)->set_power;
+    printLog("TX power: requested %d, set %d (0.1 dBm)\r\n", requested, txPowerResp);
+  }
+  testPlan.txPower = txPowerResp;
+}
+
+/**
+ * @brief publish_test_plan
+ * Write the current test plan to the local test_plan characteristic so the client can read it back.
+ */
+void publish_test_plan(void) {
+  uint8_t encoded[TEST_PLAN_ENCODED_LEN];
+  uint16_t len = test_plan_encode(&testPlan, encoded);
+  gecko_cmd_gatt_server_write_attribute_value(gattdb_test_plan, 0, len, encoded);
+}
+
+/**
+ * @brief wrap_up_run
+ * Calculate the transmission time and throughput of the run that just ended, publish
+ * the result and print the run reports, however the run was stopped.
+ * @param tellClient - true if the slave ended the run and clears transmission_on on the client
+ */
+static void wrap_up_run(bool tellClient) {
+  timeElapsed = RTCC_CounterGet() - timeElapsed;
+  flight_record(FLIGHT_RUN_END, 0, 0);
+  if (tellClient) {
+    // Turn ON Display on master side - stack is probably still busy pushing the last few notifications out, the queue retries
+    write_transmission_on(TRANSMISSION_OFF);
+  }
+  // Resume display refresh
+  set_display_refresh(true);
+  // Calculate throughput
+  throughput = (uint32_t) ((float) bitsSent / (float) ((float) timeElapsed / (float) HW_TICKS_PER_SECOND ));
+  // Write result to local GATT to be looked up on e.g. smart phone.
+  write_throughput_result();
+  // Send result to subscribed NCP host or SoC master. Check for wrong state error, which means the client isn't subscribed to indications on the result.
+  if (gecko_cmd_gatt_server_send_characteristic_notification(connection, gattdb_throughput_result, sizeof(throughput), (uint8_t *) (&throughput))->result != bg_err_wrong_state) {
+    gecko_cmd_gatt_server_send_characteristic_notification(connection, gattdb_throughput_result, sizeof(throughput), (uint8_t *) (&throughput));
+  }
+  publish_confirmation_histogram();
+  report_notification_mix();
+  report_event_census();
+}
+
+/**
+ * @brief end_data_transmission
+ * Does a few things after data transmissions ended. Calculate transmission time,
+ * enable display refresh in master side.
+ */
+void end_data_transmission(void) {
+  wrap_up_run(true);
+}
+
+/**
+ * @brief client_ended_transmission
+ * The client stopped the run by writing TRANSMISSION_OFF, wrap it up without writing it back.
+ */
+void client_ended_transmission(void) {
+  wrap_up_run(false);
+}
+
+// Issue functions of the deferred commands. Arguments are copied by the queue.
+static uint16_t issue_transmission_on(const void *args) {
+  return gecko_cmd_gatt_write_characteristic_value_without_response(connection, gattdb_transmission_on, 1, (const uint8_t *) args)->result;
+}
+
+static uint16_t issue_display_refresh(const void *args) {
+  uint32_t ticks;
+  memcpy(&ticks, args, sizeof(ticks));
+  return gecko_cmd_hardware_set_soft_timer(ticks, SOFT_TIMER_DISPLAY_REFRESH_HANDLE, 0)->result;
+}
+
+static uint16_t issue_throughput_result(const void *args) {
+  return gecko_cmd_gatt_server_write_attribute_value(gattdb_throughput_result, 0, sizeof(uint32_t), (const uint8_t *) args)->result;
+}
+
+static uint16_t issue_indication(const void *args) {
+  uint16_t result;
+
+  (void) args;
+  stamp_payload(indicationsData, maxDataSizeIndications);
+  result = gecko_cmd_gatt_server_send_characteristic_notification(connection, gattdb_throughput_indications, maxDataSizeIndications, indicationsData)->result;
+  flight_record_send(FLIGHT_CHANNEL_INDICATE, result, maxDataSizeIndications);
+  if (result == 0) {
+    indicationSentAt = RTCC_CounterGet();
+  }
+  return result;
+}
+
+static uint16_t issue_confirmation_histogram(const void *args) {
+  (void) args;
+  return gecko_cmd_gatt_server_write_attribute_value(gattdb_confirmation_histogram, 0, sizeof(confirmHistogramValue), confirmHistogramValue)->result;
+}
+
+/**
+ * @brief send_indication
+ * Queue the indication data and timestamp it for the confirmation histogram.
+ * If the stack is busy the indication goes out later from the command queue.
+ */
+void send_indication(void) {
+  cmd_queue_submit(&cmdQueue, CMD_SEND_INDICATION, issue_indication, NULL, 0);
+}
+
+/**
+ * @brief write_transmission_on
+ * Write transmission_on on the peer, retried from the command queue while the stack is busy.
+ * @param value - TRANSMISSION_ON or TRANSMISSION_OFF
+ */
+void write_transmission_on(uint8_t value) {
+  cmd_queue_submit(&cmdQueue, CMD_TRANSMISSION_ON_OFF, issue_transmission_on, &value, sizeof(value));
+}
+
+/**
+ * @brief set_display_refresh
+ * Start or stop the once per second display refresh timer.
+ * @param on - true to refresh the display, false while a transfer is running
+ */
+void set_display_refresh(bool on) {
+  uint32_t ticks = on ? HW_TICKS_PER_SECOND : 0;
+  cmd_queue_submit(&cmdQueue, CMD_DISPLAY_REFRESH, issue_display_refresh, &ticks, sizeof(ticks));
+}
+
+/**
+ * @brief write_throughput_result
+ * Write the throughput of the last run to the local throughput_result characteristic.
+ */
+void write_throughput_result(void) {
+  cmd_queue_submit(&cmdQueue, CMD_THROUGHPUT_RESULT, issue_throughput_result, &throughput, sizeof(throughput));
+}
+
+/**
+ * @brief report_command_failures
+ * Log the commands that had to be deferred or were given up on since start up.
+ */
+void report_command_failures(void) {
+  for (uint8_t id = 0; id < CMD_IDS; id++) {
+    const CmdStats_t *stats = cmd_queue_stats(&cmdQueue, id);
+    if ((stats->deferred > 0) || (stats->dropped > 0)) {
+      printLog("Command %s: %lu issued, %lu deferred, %lu retries, %lu dropped, last error 0x%04x\r\n",
+               COMMAND_NAMES[id], (unsigned long) stats->issued, (unsigned long) stats->deferred,
+               (unsigned long) stats->retries, (unsigned long) stats->dropped, stats->lastError);
+    }
+  }
+}
+
+/**
+ * @brief record_confirmation
+ * Count the delay of a received confirmation, rounded to whole connection intervals.
+ * Bucket 1 means the confirmation came on the next connection event.
+ */
+void record_confirmation(void) {
+  uint32_t ticks = RTCC_CounterGet() - indicationSentAt;
+  uint32_t intervalTicks = ((uint32_t)interval * HW_TICKS_PER_SECOND) / 800; // interval is in 1.25 ms units
+  uint32_t bucket = CONFIRM_HISTOGRAM_BUCKETS - 1;
+
+  flight_record(FLIGHT_CONFIRMATION, 0, maxDataSizeIndications);
+
+  if (intervalTicks > 0) {
+    bucket = (ticks + (intervalTicks / 2)) / intervalTicks;
+    if (bucket > (CONFIRM_HISTOGRAM_BUCKETS - 1)) {
+      bucket = CONFIRM_HISTOGRAM_BUCKETS - 1;
+    }
+  }
+
+  confirmHistogram.counts[bucket]++;
+  confirmHistogram.total++;
+  confirmHistogram.sumTicks += ticks;
+  if (ticks > confirmHistogram.maxTicks) {
+    confirmHistogram.maxTicks = ticks;
+  }
+}
+
+/**
+ * @brief flight_record
+ * Add an event to the flight recorder, stamped with the RTCC count.
+ * @param event - FlightEvent_t
+ * @param detail - Event detail
+ * @param value - Event value
+ */
+void flight_record(uint8_t event, uint8_t detail, uint16_t value) {
+  flight_recorder_add(&flightRecorder, RTCC_CounterGet(), event, detail, value);
+}
+
+/**
+ * @brief flight_record_send
+ * Add the outcome of a data send to the flight recorder.
+ * @param channel - FlightChannel_t
+ * @param result - BGAPI result of the send
+ * @param len - Bytes handed to the stack
+ */
+void flight_record_send(uint8_t channel, uint16_t result, uint16_t len) {
+  flight_recorder_send(&flightRecorder, RTCC_CounterGet(), channel, result, len);
+}
+
+/**
+ * @brief send_flight_recorder_chunk
+ * Send the next chunk of a requested flight recorder dump. Called from the main loop
+ * between runs, a busy stack just gets the same chunk again on the next pass. Any other
+ * error ends the dump with an abort chunk.
+ */
+void send_flight_recorder_chunk(void) {
+  uint8_t chunk[FLIGHT_CHUNK_MAX_LEN];
+  uint16_t len;
+  uint16_t result;
+
+  if (!flightDumpActive) {
+    return;
+  }
+  if (flightDumpAborting) {
+    len = flight_recorder_abort_chunk(&flightRecorder, chunk);
+  } else {
+    len = flight_recorder_chunk(&flightRecorder, flightDumpNext, (mtuSize > 3) ? (mtuSize - 3) : 0, chunk);
+  }
+  if (len > 0) {
+    result = gecko_cmd_gatt_server_send_characteristic_notification(connection, gattdb_flight_recorder, len, chunk)->result;
+    if (result == bg_err_out_of_memory) {
+      return;
+    }
+    if ((result == 0) && !flightDumpAborting) {
+      flightDumpNext += (len - FLIGHT_CHUNK_HEADER_LEN) / FLIGHT_RECORD_LEN;
+      if (flightDumpNext < flightRecorder.count) {
+        return;
+      }
+    } else if (!flightDumpAborting) {
+      printLog("Flight recorder dump stopped: 0x%04x\r\n", result);
+      flightDumpAborting = true;
+      return;
+    }
+  }
+  flightDumpActive = false;
+  flightRecorder.frozen = false;
+}
+
+/**
+ * @brief start_event_census
+ * Clear the event census for a new run. The RTCC is far too coarse to time an event,
+ * so the DWT cycle counter of the core is started here too, it stays on once started.
+ */
+void start_event_census(void) {
+  CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+  DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+  event_census_reset(&eventCensus, SystemCoreClockGet());
+}
+
+/**
+ * @brief cycle_count
+ * @return Core clock cycles, wraps every minute or two
+ */
+uint32_t cycle_count(void) {
+  return DWT->CYCCNT;
+}
+
+/**
+ * @brief count_event
+ * Count the event of a main loop pass. The time is that of the whole pass, so it
+ * includes the sends the slave makes in it.
+ * @param evt - Event of the pass, NULL for a pass without one
+ * @param passStart - cycle_count() at the start of the pass
+ */
+void count_event(struct gecko_cmd_packet *evt, uint32_t passStart) {
+  if (evt != NULL) {
+    event_census_add(&eventCensus, BGLIB_MSG_ID(evt->header), cycle_count() - passStart);
+  }
+}
+
+/**
+ * @brief report_event_census
+ * Log the events handled in the run that just ended, per kB of payload moved and
+ * the ones that took the most time.
+ */
+void report_event_census(void) {
+  EventCensusTop_t top[EVENT_CENSUS_TOP];
+  uint8_t n = event_census_top(&eventCensus, top, EVENT_CENSUS_TOP);
+  uint32_t kB = bitsSent / 8192;
+
+  printLog("Events: %lu in %lu us", (unsigned long) eventCensus.total,
+           (unsigned long) event_census_us(&eventCensus, eventCensus.totalTicks));
+  if (kB > 0) {
+    printLog(", %lu per kB, %lu us per kB", (unsigned long) (eventCensus.total / kB),
+             (unsigned long) (event_census_us(&eventCensus, eventCensus.totalTicks) / kB));
+  }
+  printLog("\r\n");
+  for (uint8_t i = 0; i < n; i++) {
+    const char *name = event_census_name(top[i].cls, top[i].id);
+
+    if (name != NULL) {
+      printLog("  %s", name);
+    } else if (top[i].cls == EVENT_CENSUS_OTHER) {
+      printLog("  other classes and IDs");
+    } else {
+      printLog("  class 0x%02x id 0x%02x", top[i].cls, top[i].id);
+    }
+    printLog(": %lu, %lu us\r\n", (unsigned long) top[i].count, (unsigned long) event_census_us(&eventCensus, top[i].ticks));
+  }
+}
+
+/**
+ * @brief publish_confirmation_histogram
+ * Show the confirmation delays of the finished run on the display and write them to the
+ * confirmation_histogram characteristic. Layout, little endian:
+ * interval (u16, 1.25 ms units), bucket count (u8), counts (u32 each), mean (u32 us), max (u32 us)
+ */
+void publish_confirmation_histogram(void) {
+  uint8_t *p = confirmHistogramValue;
+  uint32_t meanUs;
+  uint32_t maxUs;
+  uint8_t mode = 0;
+  char text[10];
+
+  if (confirmHistogram.total == 0) {
+    return;
+  }
+
+  meanUs = (uint32_t) ((confirmHistogram.sumTicks * 1000000) / HW_TICKS_PER_SECOND / confirmHistogram.total);
+  maxUs = (uint32_t) (((uint64_t) confirmHistogram.maxTicks * 1000000) / HW_TICKS_PER_SECOND);
+
+  for (uint8_t i = 1; i < CONFIRM_HISTOGRAM_BUCKETS; i++) {
+    if (confirmHistogram.counts[i] > confirmHistogram.counts[mode]) {
+      mode = i;
+    }
+  }
+
+  // E.g. "CFM: 1CI  98%", last bucket shown as 8+
+  snprintf(text, sizeof(text), "%u%sCI %3lu%%", mode, (mode == (CONFIRM_HISTOGRAM_BUCKETS - 1)) ? "+" : "",
+           (confirmHistogram.counts[mode] * 100) / confirmHistogram.total);
+  memset(confirmModeString + 5, ' ', 10);
+  memcpy(confirmModeString + 5, text, strlen(text));
+  snprintf(text, 7, "%4lums", (maxUs + 500) / 1000);
+  memset(confirmMaxString + 9, ' ', 6);
+  memcpy(confirmMaxString + 9, text, strlen(text));
+
+  *p++ = (uint8_t) interval;
+  *p++ = (uint8_t) (interval >> 8);
+  *p++ = CONFIRM_HISTOGRAM_BUCKETS;
+  for (uint8_t i = 0; i < CONFIRM_HISTOGRAM_BUCKETS; i++) {
+    memcpy(p, &confirmHistogram.counts[i], 4);
+    p += 4;
+  }
+  memcpy(p, &meanUs, 4);
+  p += 4;
+  memcpy(p, &maxUs, 4);
+
+  cmd_queue_submit(&cmdQueue, CMD_CONFIRM_HISTOGRAM, issue_confirmation_histogram, NULL, 0);
+}
+
+/**
+ * @brief handle_universal_events
+ * This handles events that are 'universal' in the sense that 
+ * they need to be handled regardless of program state
+ * @param evt - The same stack event processed by main event loop
+ */
+void handle_universal_events(struct gecko_cmd_packet *evt) {
+  // Retry commands the stack couldn't take earlier
+  cmd_queue_pump(&cmdQueue);
+
+  // Handle universal events
+  switch (BGLIB_MSG_ID(evt->header)) {
+    case gecko_evt_system_external_signal_id:
+      switch (evt->data.evt_system_external_signal.extsignals) {
+
+        case NOTIFICATIONS_START:
+          // PB0 pressed down as slave.
+          if ( (state == SUBSCRIBED) || (state == SUBSCRIBED_NOTIFICATIONS)) {
+            start_notify_run();
+            break;
+          }
+          break;
+
+        case NOTIFICATIONS_END:
+          // PB0 released as slave.
+          if ((state == NOTIFY) && (activePlan.mode == PLAN_MODE_FREE)) {
+            end_data_transmission();
+            if (notificationsSubscribed && indicationsSubscribed) {
+              state = SUBSCRIBED;
+            } else if (notificationsSubscribed) {
+              state = SUBSCRIBED_NOTIFICATIONS;
+            } else if (indicationsSubscribed) {
+              state = SUBSCRIBED_INDICATIONS;
+            } else {
+              state = CONNECTED;
+            }
+            break;
+          }
+          break;
+
+        case INDICATIONS_START:
+          // PB1 pressed down as slave.
+          if ( (state == SUBSCRIBED) || (state == SUBSCRIBED_INDICATIONS) ) {
+            start_indicate_run();
+          }
+
+          break;
+
+        case INDICATIONS_END:
+          break;
+
+        case PHY_CHANGE:
+          // PB1 pressed down as master. Cycles 1M -> 2M -> Coded S8 -> AUTO -> 1M, skipping PHYs the chip lacks.
+          if (adaptivePhy) {
+            // Leave AUTO on 1M PHY
+            adaptivePhy = false;
+            gecko_cmd_hardware_set_soft_timer(0, SOFT_TIMER_ADAPTIVE_PHY_HANDLE, 0);
+            if (phyInUse != PHY_1M) {
+              phyToUse = PHY_1M;
+            }
+            set_phy_string(phyInUse);
+            break;
+          }
+
+          switch (phyInUse) {
+            case PHY_1M:
+#if defined(_SILICON_LABS_32B_SERIES_1_CONFIG_2) || defined(_SILICON_LABS_32B_SERIES_1_CONFIG_3) || defined(_SILICON_LABS_32B_SERIES_2_CONFIG_1)
+              // We're on 1M PHY, go to 2M PHY - only supported by xG12 and xG13
+              phyToUse = PHY_2M;
+#else
+              adaptivePhy = true;
+#endif
+              break;
+
+            case PHY_2M:
+#if defined(_SILICON_LABS_32B_SERIES_1_CONFIG_3) || defined(_SILICON_LABS_32B_SERIES_2_CONFIG_1)
+              // We're on 2M PHY, go to 125kbit Coded PHY (S=8) - only supported by xG13
+              phyToUse = PHY_S8;
+#else
+              // We're on 2MPHY but with xG12, the next step is AUTO
+              adaptivePhy = true;
+#endif
+              break;
+
+            case PHY_S8:
+              // We're on S8 PHY, the next step is AUTO starting from the PHY in use
+              adaptivePhy = true;
+              break;
+
+            default:
+              break;
+          }
+
+          if (adaptivePhy) {
+            gecko_cmd_hardware_set_soft_timer(ADAPTIVE_PHY_WINDOW_TICKS, SOFT_TIMER_ADAPTIVE_PHY_HANDLE, 0);
+            set_phy_string(phyInUse);
+          }
+          break;
+
+        case SCAN_PHY_CHANGE:
+					if (state == ADV_SCAN) {
+						gecko_cmd_le_gap_end_procedure();
+						switch (phyInUse) {
+							case PHY_1M:
+#if defined(_SILICON_LABS_32B_SERIES_1_CONFIG_3) || defined(_SILICON_LABS_32B_SERIES_2_CONFIG_1)
+								gecko_cmd_le_gap_start_discovery(le_gap_phy_coded, le_gap_discover_observation);
+								phyInUse = PHY_S8;
+								sprintf(phyString + 5, "%s", "CODED S8");
+#else
+								gecko_cmd_le_gap_start_discovery(le_gap_phy_1m, le_gap_discover_observation);
+#endif
+								break;
+
+							case PHY_2M:
+								gecko_cmd_le_gap_start_discovery(le_gap_phy_1m, le_gap_discover_observation);
+								phyInUse = PHY_1M;
+								sprintf(phyString + 5, "%s", "1M");
+								break;
+
+							case PHY_S8:
+								// We're on S8 PHY, go to 1M PHY
+								gecko_cmd_le_gap_start_discovery(le_gap_phy_1m, le_gap_discover_observation);
+								phyInUse = PHY_1M;
+								sprintf(phyString + 5, "%s", "1M");
+								break;
+
+							default:
+								break;
+						}
+					}
+					break;
+
+        default:
+          break;
+      } // switch-extsignals
+
+      break;
+
+    case gecko_evt_hardware_soft_timer_id:
+      switch (evt->data.evt_hardware_soft_timer.handle) {
+          case SOFT_TIMER_DISPLAY_REFRESH_HANDLE:
+              gecko_cmd_le_connection_get_rssi(connection);
+              refresh_display();
+              break;
+          case SOFT_TIMER_FIXED_TRANSFER_TIME_HANDLE:
+            fixedTimeExpired = true;
+            if ((state == INDICATE) && waitingForConfirmation) {
+              break;
+            }
+            if ((state != NOTIFY) && (state != INDICATE)) {
+              break;
+            }
+
+            end_data_transmission();
+            state = SUBSCRIBED;
+            break;
+          default:
+              break;
+      }
+      break;
+
+    case gecko_evt_le_connection_parameters_id:
+      pduSize = evt->data.evt_le_connection_parameters.txsize;
+      interval = evt->data.evt_le_connection_parameters.interval;
+      flight_record(FLIGHT_PARAMETERS, (uint8_t) pduSize, interval);
+      sprintf(pduSizeString + 5, "%03u", pduSize);
+      sprintf(connIntervalString + 7, "%04u", (unsigned int) ((float) interval * 1.25));
+      calculate_notification_size();
+      sprintf(maxDataSizeString + 11, "%03u", maxDataSizeNotifications);
+      statusString = (char *)statusConnectedString;
+      break;
+
+    case gecko_evt_gatt_mtu_exchanged_id:
+      mtuSize = evt->data.evt_gatt_mtu_exchanged.mtu;
+      sprintf(mtuSizeString + 5, "%03u", mtuSize);
+      calculate_indication_size();
+      calculate_notification_size();
+      sprintf(maxDataSizeString + 11, "%03u", maxDataSizeNotifications);
+      break;
+
+    case gecko_evt_gatt_server_attribute_value_id:
+      // Slave echoes latency pings straight back to the client.
+      if (roleIsSlave && (evt->data.evt_gatt_server_attribute_value.attribute == gattdb_latency_ping)) {
+        gecko_cmd_gatt_server_send_characteristic_notification(evt->data.evt_gatt_server_attribute_value.connection,
+                                                               gattdb_latency_ping,
+                                                               evt->data.evt_gatt_server_attribute_value.value.len,
+                                                               evt->data.evt_gatt_server_attribute_value.value.data);
+      }
+      // Slave takes a new test plan for the next run, its payload size applies when the run starts.
+      // Invalid writes are overwritten with the plan in use.
+      if (roleIsSlave && (evt->data.evt_gatt_server_attribute_value.attribute == gattdb_test_plan)) {
+        if (test_plan_parse(&testPlan,
+                            evt->data.evt_gatt_server_attribute_value.value.data,
+                            evt->data.evt_gatt_server_attribute_value.value.len)) {
+          apply_planned_tx_power();
+          printLog("Test plan: mode %u direction %u payload %u amount %lu duration %lu ms TX power %d flags 0x%02x\r\n",
+                   testPlan.mode, testPlan.direction, testPlan.payloadSize,
+                   (unsigned long) testPlan.amount, (unsigned long) testPlan.durationMs, testPlan.txPower, testPlan.flags);
+        }
+        publish_test_plan();
+      }
+      // Slave dumps the flight recorder of the last run, see send_flight_recorder_chunk().
+      if (roleIsSlave && (evt->data.evt_gatt_server_attribute_value.attribute == gattdb_flight_recorder)
+          && (evt->data.evt_gatt_server_attribute_value.value.len >= 1)
+          && (evt->data.evt_gatt_server_attribute_value.value.data[0] == FLIGHT_DUMP_START)) {
+        flightRecorder.frozen = true;
+        flightDumpNext = 0;
+        flightDumpAborting = false;
+        flightDumpActive = true;
+      }
+      // Slave takes a stream configuration for the notification runs that follow. Invalid writes are overwritten with the one in use.
+      if (roleIsSlave && (evt->data.evt_gatt_server_attribute_value.attribute == gattdb_stream_config)) {
+        uint8_t encoded[STREAM_CONFIG_LEN];
+
+        if (stream_config_parse(&streamConfig,
+                                evt->data.evt_gatt_server_attribute_value.value.data,
+                                evt->data.evt_gatt_server_attribute_value.value.len)) {
+          printLog("Streams: %u bulk, weights %u %u %u %u, probe every %u ms\r\n", streamConfig.count,
+                   streamConfig.weights[0], streamConfig.weights[1], streamConfig.weights[2], streamConfig.weights[3],
+                   streamConfig.probeIntervalMs);
+        }
+        gecko_cmd_gatt_server_write_attribute_value(gattdb_stream_config, 0, stream_config_encode(&streamConfig, encoded), encoded);
+      }
+      break;
+
+    // Slave takes a payload size mix or trace chunk for the notification runs that follow. The
+    // characteristic is user type, so a write the schedule doesn't take is refused to the client.
+    case gecko_evt_gatt_server_user_write_request_id:
+      if (roleIsSlave && (evt->data.evt_gatt_server_user_write_request.characteristic == gattdb_payload_schedule)) {
+        bool taken = (evt->data.evt_gatt_server_user_write_request.offset == 0)
+                     && payload_schedule_write(&payloadSchedule,
+                                               evt->data.evt_gatt_server_user_write_request.value.data,
+                                               evt->data.evt_gatt_server_user_write_request.value.len);
+
+        gecko_cmd_gatt_server_send_user_write_response(evt->data.evt_gatt_server_user_write_request.connection,
+                                                       gattdb_payload_schedule,
+                                                       taken ? bg_err_success : PAYLOAD_SCHEDULE_ATT_REFUSED);
+        if (!taken) {
+          printLog("Payload schedule: write refused\r\n");
+        } else if (payloadSchedule.traceLoaded == payloadSchedule.traceLen) {
+          printLog("Payload schedule: kind %u bins %u trace %u\r\n",
+                   payloadSchedule.kind, payloadSchedule.binCount, payloadSchedule.traceLen);
+        }
+      }
+      break;
+
+    case gecko_evt_le_connection_rssi_id:
+      sprintf(statusConnectedString + 6, "%03d", evt->data.evt_le_connection_rssi.rssi);
+      break;
+
+    case gecko_evt_le_connection_closed_id:
+      // Pending commands refer to the closed connection. The display refresh doesn't, and without a
+      // connection the display is refreshed in any case, so it goes in again.
+      cmd_queue_clear(&cmdQueue);
+      report_command_failures();
+      set_display_refresh(true);
+      // Set key variables to defaults and state to ADV_SCAN.
+      reset_variables(); 
+      if (roleIsSlave) {
+        publish_test_plan();
+      }
+      set_display_defaults();
+      // Check if need to boot to dfu mode
+      if (boot_to_dfu) {
+        gecko_cmd_system_reset(2);
+      } else {
+        // After disconnect, save the last used PHY to be the next to change into.
+        phyToUse = phyInUse; 
+        setup_adv_scan();
+      }
+      break;
+
+    default:
+      break;
+  } // switch-universal events
+}
@@ -1,167 +1,284 @@
-/**
- * @file
- * @brief app_utils.h
- * Common declarations for both master and slave roles.
- ******************************************************************************/
-
-#ifndef APP_UTILS_H
-#define APP_UTILS_H
-
-#ifdef __cplusplus
-extern "C" {
-#endif
-
-#ifndef MAX_CONNECTIONS
-#define MAX_CONNECTIONS 4
-#endif
-
-#ifndef MAX_ADVERTISERS
-#define MAX_ADVERTISERS 4
-#endif
-
-#include "bg_types.h"
-#include "native_gecko.h"
-#include "gatt_db.h"
-#include "em_rtcc.h"
-#include "graphics.h"
-#include "gpiointerrupt.h"
-#include <stdio.h>
-
-/**************************************************************************//**
- * Constants and state type
- *****************************************************************************/
-// Software timer handles
-#define SOFT_TIMER_DISPLAY_REFRESH_HANDLE       0
-#define SOFT_TIMER_FIXED_TRANSFER_TIME_HANDLE 	1
-
-#define DATA_SIZE                           255		// Size of the arrays for sending and receiving data
-#define DATA_TRANSFER_SIZE_INDICATIONS      0       // If == 0 or > MTU-3 then it will send MTU-3 bytes of data, otherwise it will use this value
-#define DATA_TRANSFER_SIZE_NOTIFICATIONS    0       // If == 0 or > MTU-3 then it will calculate the data amount to send for maximum over-the-air packet usage, otherwise it will use this value
-#define INDICATION_GATT_HEADER              3       // GATT operation header byte count
-#define NOTIFICATION_GATT_HEADER            3       // GATT operation header byte count
-#define L2CAP_HEADER                        4       // Header byte count
-#define HW_TICKS_PER_SECOND      (uint16_t)(32768)  // Hardware clock ticks that equal one second
-#define TX_POWER 100
-
-#define PHY_1M (0x01)
-#define PHY_2M (0x02)
-#define PHY_S8 (0x04)
-
-#define SCAN_INTERVAL               16			   // 16 * 0.625 = 10ms
-#define SCAN_WINDOW                 16			   // 16 * 0.625 = 10ms
-#define ACTIVE_SCANNING             1			   // 1 = active scanning (sends scan requests), 0 = passive scanning (doesn't send scan requests)
-
-#define NOTIFICATIONS_START (uint32)(1 << 0)   // Bit flag to external signal command
-#define NOTIFICATIONS_END   (uint32)(1 << 1)   // Bit flag to external signal command
-#define INDICATIONS_START   (uint32)(1 << 2)   // Bit flag to external signal command
-#define INDICATIONS_END     (uint32)(1 << 3)   // Bit flag to external signal command
-#define PHY_CHANGE          (uint32)(1 << 4)   // Bit flag to external signal command
-#define SCAN_PHY_CHANGE     (uint32)(1 << 5)   // Bit flag for scan PHY change 1M<->LE Coded
-
-/* COMPILE TIME OPTIONS FOR FIXED MODES BETWEEN TWO KITS. UNCOMMENT ONLY ONE. */
-//#define SEND_FIXED_TRANSFER_COUNT				10000 						          // Uncomment this if you want to send a fixed amount of indications/notifications on each button press
-//#define SEND_FIXED_TRANSFER_TIME				((HW_TICKS_PER_SECOND)*5)     // Uncomment this if you want to send indications/notifications for a fixed amount of time
-
-// Main state enum
-typedef enum {
-    ADV_SCAN,
-    CONNECTED,
-    SUBSCRIBED_NOTIFICATIONS,
-    SUBSCRIBED_INDICATIONS,
-    SUBSCRIBED,
-    RECEIVE,
-    NOTIFY,
-    INDICATE
-} State_t;
-
-/**************************************************************************//**
- * Common variable declarations
- *****************************************************************************/
-extern uint8_t boot_to_dfu;
-extern State_t state;
-extern uint8_t connection;                          // Connection handle initialized to known unreachable handle.
-extern uint16_t mtuSize ;                           // Variable to hold the MTU size once a new connection is formed
-extern uint16_t pduSize;                            // Variable to hold PDU size once a new connection is formed
-extern uint16_t interval;                           // Variable to hold connection interval
-
-extern uint8_t notificationsData[DATA_SIZE];
-extern uint8_t indicationsData[DATA_SIZE];
-extern uint16_t maxDataSizeIndications;
-extern uint16_t maxDataSizeNotifications;           // Variable to calculate maximum data size for optimal throughput
-extern uint32_t throughput;
-extern uint32_t bitsSent;
-extern uint32_t timeElapsed;
-extern uint32_t operationCount;
-
-extern uint8_t phyInUse;
-extern uint8_t phyToUse;
-
-extern bool roleIsSlave;
-extern bool waitingForConfirmation;                      // Flag to check if waiting for any pending confirmations
-extern volatile bool buttonOneReleased;                  // Flag to check if button has been released for indications.
-extern bool notificationsSubscribed;
-extern bool indicationsSubscribed;
-extern bool advStopped;                                  // Check if advertising has been stopped once the connection is formed.
-#ifdef SEND_FIXED_TRANSFER_TIME
-extern bool fixedTimeExpired;
-#endif
-
-// Display strings
-extern char throughputString[];           // Char array to print the throughput
-extern char mtuSizeString[];              // Char array to print MTU size on the display
-extern char connIntervalString[];         // Char array to print connection interval on the display
-extern char pduSizeString[];              // Char array to print PDU size on the display
-extern char phyString[];	              // Char array to print PHY in use on the display
-
-extern char maxDataSizeString[];
-extern char statusConnectedString[];
-extern char operationCountString[];
-extern char statusDisconnectedString[];
-
-extern char *notifyString;
-extern char *indicateString;
-extern char *statusString;
-extern char *roleString;
-extern int16_t txPowerResp;
-extern char txPowerString[12];
-
-// Transmission start and stop signal constants.
-const uint8_t TRANSMISSION_ON;
-const uint8_t TRANSMISSION_OFF;
-
-const char NOTIFY_ENABLED_STRING[13];
-const char NOTIFY_DISABLED_STRING[12];
-const char INDICATE_ENABLED_STRING[15];
-const char INDICATE_DISABLED_STRING[14];
-const char ROLE_SLAVE_STRING[13];
-const char ROLE_MASTER_STRING[14];
-const char ROLE_ADVERT_STRING[14];
-const char ROLE_SCANNER_STRING[15];
-
-/**************************************************************************//**
- * Common function declarations
- *****************************************************************************/
-void reset_variables(void);
-void setup_adv_scan(void);
-void setup_pins_interrupts(void);
-void handle_button_change(uint8_t pin);
-void refresh_display(void);
-void set_display_defaults(void);
-void update_displayed_phy(uint8_t currentPhy);
-
-void calculate_notification_size(void);
-void calculate_indication_size(void);
-void generate_notifications_data(void);
-void generate_indications_data(void);
-void start_data_transmission(void);
-void end_data_transmission(void);
-
-void handle_universal_events(struct gecko_cmd_packet *evt);
-void slave_main(void);
-void master_main(void);
-
-#ifdef __cplusplus
-}
-#endif
-
-#endif
+/**
+ * @file
+ * @brief app_utils.h
+ * Common declarations for both master and slave roles.
+ ******************************************************************************/
+
+#ifndef APP_UTILS_H
+#define APP_UTILS_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#ifndef MAX_CONNECTIONS
+#define MAX_CONNECTIONS 4
+#endif
+
+#ifndef MAX_ADVERTISERS
+#define MAX_ADVERTISERS 4
+#endif
+
+#include "bg_types.h"
+#include "native_gecko.h"
+#include "gatt_db.h"
+#include "em_rtcc.h"
+#include "graphics.h"
+#include "gpiointerrupt.h"
+#include "app_payload.h"
+#include "app_payload_schedule.h"
+#include "app_streams.h"
+#include "app_histogram.h"
+#include "app_test_plan.h"
+#include "app_clock_sync.h"
+#include "app_flight_recorder.h"
+#include "app_event_census.h"
+#include "app_cmd_queue.h"
+#include <stdio.h>
+
+/**************************************************************************//**
+ * Constants and state type
+ *****************************************************************************/
+// Software timer handles
+#define SOFT_TIMER_DISPLAY_REFRESH_HANDLE       0
+#define SOFT_TIMER_FIXED_TRANSFER_TIME_HANDLE 	1
+#define SOFT_TIMER_LATENCY_TIMEOUT_HANDLE       2
+#define SOFT_TIMER_SWEEP_HANDLE                 3
+#define SOFT_TIMER_ADAPTIVE_PHY_HANDLE          4
+#define SOFT_TIMER_BROADCAST_HANDLE             5
+
+#define DATA_SIZE                           255		// Size of the arrays for sending and receiving data
+#define DATA_TRANSFER_SIZE_INDICATIONS      0       // If == 0 or > MTU-3 then it will send MTU-3 bytes of data, otherwise it will use this value. Overridden by a non-zero test plan payload size
+#define DATA_TRANSFER_SIZE_NOTIFICATIONS    0       // If == 0 or > MTU-3 then it will calculate the data amount to send for maximum over-the-air packet usage, otherwise it will use this value. Overridden by a non-zero test plan payload size
+#define HW_TICKS_PER_SECOND      (uint16_t)(32768)  // Hardware clock ticks that equal one second
+#define TX_POWER 100
+
+#define PHY_1M (0x01)
+#define PHY_2M (0x02)
+#define PHY_S8 (0x04)
+
+#define SCAN_INTERVAL               16			   // 16 * 0.625 = 10ms
+#define SCAN_WINDOW                 16			   // 16 * 0.625 = 10ms
+#define ACTIVE_SCANNING             1			   // 1 = active scanning (sends scan requests), 0 = passive scanning (doesn't send scan requests)
+
+#define NOTIFICATIONS_START (uint32)(1 << 0)   // Bit flag to external signal command
+#define NOTIFICATIONS_END   (uint32)(1 << 1)   // Bit flag to external signal command
+#define INDICATIONS_START   (uint32)(1 << 2)   // Bit flag to external signal command
+#define INDICATIONS_END     (uint32)(1 << 3)   // Bit flag to external signal command
+#define PHY_CHANGE          (uint32)(1 << 4)   // Bit flag to external signal command
+#define SCAN_PHY_CHANGE     (uint32)(1 << 5)   // Bit flag for scan PHY change 1M<->LE Coded
+#define LATENCY_START       (uint32)(1 << 6)   // Bit flag to start or stop a latency measurement as master
+#define SWEEP_TOGGLE        (uint32)(1 << 7)   // Bit flag to start or stop a sweep as master
+
+#define BUTTON_LONG_PRESS_TICKS     HW_TICKS_PER_SECOND   // PB0 held this long starts a sweep instead of a latency measurement
+#define SWEEP_LCD_LINES             9                     // Header plus two lines per result row
+#define ADAPTIVE_PHY_WINDOW_TICKS   HW_TICKS_PER_SECOND   // Goodput measurement window of the adaptive PHY mode
+
+#define CONFIRM_HISTOGRAM_BUCKETS   9           // Confirmation delay in connection intervals 0..7, last bucket 8 or more
+
+#define LATENCY_PING_COUNT      1000                      // Round trips per latency measurement
+#define LATENCY_PING_SIZE       4                         // Sequence number only
+#define LATENCY_TIMEOUT_TICKS   (2 * HW_TICKS_PER_SECOND) // Ping is counted as lost if the echo takes longer
+
+// Connectionless mode, PB1 held at boot. Advertising sets 0 and 1 are the connectable ones.
+#define BROADCAST_ADV_SET       2
+#define BROADCAST_ADV_INTERVAL  32                        // 32 * 0.625 = 20 ms, shortest for non-connectable advertising
+#define BROADCAST_UPDATE_TICKS  ((HW_TICKS_PER_SECOND * 32) / 1000) // 32 ms, longer than an interval plus the 10 ms random delay
+
+#define CMD_RETRY_GAP_TICKS     33                        // About 1 ms between attempts of a deferred command
+#define CMD_MAX_ATTEMPTS        5000                      // About 5 s, longer than the longest connection interval
+
+/* TX POWER SWEEP. Uncomment to make the master sweep step both sides through these TX power levels,
+ * in 0.1 dBm, on the PHY and interval in use instead of sweeping PHY, interval and payload size. */
+//#define SWEEP_TX_POWER
+#define SWEEP_TX_POWER_LEVELS       100, 80, 60, 40, 20, 0, -100, -200
+#define SWEEP_TX_POWER_TARGET_BPS   500000      // Lowest power still reaching this is logged at the end
+
+/* STREAM TEST. Uncomment to make the master subscribe to the stream characteristics and have the slave send
+ * on them by weight, one weight per bulk stream, with a small probe every STREAM_TEST_PROBE_MS (0 = none)
+ * on the next stream. The master logs throughput and queueing delay per stream after each run. */
+//#define STREAM_TEST
+#define STREAM_TEST_WEIGHTS         1, 1, 1
+#define STREAM_TEST_PROBE_MS        20
+
+/* DEFAULT TEST PLAN FOR FIXED MODES BETWEEN TWO KITS. UNCOMMENT ONLY ONE.
+ * The plan can be changed at runtime by writing the test_plan characteristic on the slave, see app_test_plan.h. */
+//#define SEND_FIXED_TRANSFER_COUNT				10000 						          // Uncomment this if you want to send a fixed amount of indications/notifications on each button press
+//#define SEND_FIXED_TRANSFER_TIME				((HW_TICKS_PER_SECOND)*5)     // Uncomment this if you want to send indications/notifications for a fixed amount of time
+
+// Main state enum
+typedef enum {
+    ADV_SCAN,
+    CONNECTED,
+    SUBSCRIBED_NOTIFICATIONS,
+    SUBSCRIBED_INDICATIONS,
+    SUBSCRIBED_LATENCY,
+    SUBSCRIBED_STREAMS,
+    SUBSCRIBED,
+    RECEIVE,
+    NOTIFY,
+    INDICATE,
+    PING
+} State_t;
+
+// Stack commands retried through the command queue instead of spinning, ids index its counters.
+typedef enum {
+  CMD_TRANSMISSION_ON_OFF,
+  CMD_DISPLAY_REFRESH,
+  CMD_THROUGHPUT_RESULT,
+  CMD_SEND_INDICATION,
+  CMD_CONFIRM_HISTOGRAM,
+  CMD_IDS
+} AppCommand_t;
+
+// Delay from sending an indication to its confirmation, counted per run in whole connection intervals.
+typedef struct {
+  uint32_t counts[CONFIRM_HISTOGRAM_BUCKETS];
+  uint32_t total;
+  uint32_t maxTicks;
+  uint64_t sumTicks;
+} ConfirmHistogram_t;
+
+/**************************************************************************//**
+ * Common variable declarations
+ *****************************************************************************/
+extern uint8_t boot_to_dfu;
+extern State_t state;
+extern uint8_t connection;                          // Connection handle initialized to known unreachable handle.
+extern uint16_t mtuSize ;                           // Variable to hold the MTU size once a new connection is formed
+extern uint16_t pduSize;                            // Variable to hold PDU size once a new connection is formed
+extern uint16_t interval;                           // Variable to hold connection interval
+
+extern uint8_t notificationsData[DATA_SIZE];
+extern uint8_t indicationsData[DATA_SIZE];
+extern uint16_t maxDataSizeIndications;
+extern uint16_t maxDataSizeNotifications;           // Variable to calculate maximum data size for optimal throughput
+extern uint16_t notificationSize;                   // Size of the notification in notificationsData, below the maximum with a payload schedule
+extern uint32_t notificationDueAt;                  // RTCC count the next notification waits for when replaying a trace
+extern PayloadSchedule_t payloadSchedule;           // Size mix or trace written by the client, constant size by default
+extern uint32_t runNotifications;                   // Notifications sent in this run
+extern uint64_t runAirtimeUs;                       // Connection event time the notifications of this run took
+extern StreamConfig_t streamConfig;                 // Written by the client, no streams by default
+extern StreamScheduler_t streamScheduler;
+extern uint8_t streamsSubscribed;                   // Bit per stream characteristic the client subscribed to
+extern const uint16_t streamHandles[STREAM_MAX];
+extern uint32_t throughput;
+extern uint32_t bitsSent;
+extern uint32_t timeElapsed;
+extern uint32_t operationCount;
+extern uint32_t indicationSentAt;                   // RTCC count when the last indication was queued
+extern ConfirmHistogram_t confirmHistogram;
+extern CmdQueue_t cmdQueue;                         // Commands the stack was too busy to take
+extern FlightRecorder_t flightRecorder;             // Send events of the last run, dumped over GATT
+extern EventCensus_t eventCensus;                   // Events handled in the run, in core clock cycles
+
+extern uint8_t phyInUse;
+extern uint8_t phyToUse;
+extern bool adaptivePhy;                                 // Master picks the PHY itself, see app_adaptive_phy.h
+
+extern bool roleIsSlave;
+extern bool connectionless;                              // Broadcaster or broadcast scanner instead of slave or master
+extern bool waitingForConfirmation;                      // Flag to check if waiting for any pending confirmations
+extern volatile bool buttonOneReleased;                  // Flag to check if button has been released for indications.
+extern bool notificationsSubscribed;
+extern bool indicationsSubscribed;
+extern bool advStopped;                                  // Check if advertising has been stopped once the connection is formed.
+extern bool fixedTimeExpired;
+extern TestPlan_t testPlan;                              // Plan applied to the next run
+extern TestPlan_t activePlan;                            // Plan of the run in progress
+
+// Display strings
+extern char throughputString[];           // Char array to print the throughput
+extern char mtuSizeString[];              // Char array to print MTU size on the display
+extern char connIntervalString[];         // Char array to print connection interval on the display
+extern char pduSizeString[];              // Char array to print PDU size on the display
+extern char phyString[];	              // Char array to print PHY in use on the display
+
+extern char maxDataSizeString[];
+extern char statusConnectedString[];
+extern char operationCountString[];
+extern char statusDisconnectedString[];
+extern char latencyP50String[];
+extern char latencyP99String[];
+extern bool latencyMeasured;
+extern char confirmModeString[];
+extern char confirmMaxString[];
+extern char sweepLines[SWEEP_LCD_LINES][17];   // Sweep results page, shown instead of the connection details
+extern uint8_t sweepLineCount;
+
+extern char *notifyString;
+extern char *indicateString;
+extern char *statusString;
+extern char *roleString;
+extern int16_t txPowerResp;
+extern char txPowerString[12];
+
+// Transmission start and stop signal constants.
+const uint8_t TRANSMISSION_ON;
+const uint8_t TRANSMISSION_OFF;
+
+const char NOTIFY_ENABLED_STRING[13];
+const char NOTIFY_DISABLED_STRING[12];
+const char INDICATE_ENABLED_STRING[15];
+const char INDICATE_DISABLED_STRING[14];
+const char ROLE_SLAVE_STRING[13];
+const char ROLE_MASTER_STRING[14];
+const char ROLE_ADVERT_STRING[14];
+const char ROLE_SCANNER_STRING[15];
+const char ROLE_BROADCAST_STRING[17];
+const char ROLE_BROADCAST_SCAN_STRING[15];
+
+/**************************************************************************//**
+ * Common function declarations
+ *****************************************************************************/
+void reset_variables(void);
+void setup_adv_scan(void);
+void setup_pins_interrupts(void);
+void setup_command_queue(void);
+void handle_button_change(uint8_t pin);
+void refresh_display(void);
+void set_display_defaults(void);
+void update_displayed_phy(uint8_t currentPhy);
+void set_phy_string(uint8_t phy);
+
+void calculate_notification_size(void);
+void calculate_indication_size(void);
+void generate_notifications_data(void);
+void generate_indications_data(void);
+void stamp_payload(uint8_t *data, uint16_t len);
+void start_data_transmission(void);
+void end_data_transmission(void);
+void client_ended_transmission(void);
+void send_indication(void);
+void write_transmission_on(uint8_t value);
+void set_display_refresh(bool on);
+void write_throughput_result(void);
+void report_command_failures(void);
+void start_notify_run(void);
+void report_notification_mix(void);
+uint16_t send_stream_notification(void);
+void start_indicate_run(void);
+bool plan_run_complete(void);
+void publish_test_plan(void);
+void apply_planned_tx_power(void);
+void record_confirmation(void);
+void publish_confirmation_histogram(void);
+void flight_record(uint8_t event, uint8_t detail, uint16_t value);
+void flight_record_send(uint8_t channel, uint16_t result, uint16_t len);
+void send_flight_recorder_chunk(void);
+void start_event_census(void);
+uint32_t cycle_count(void);
+void count_event(struct gecko_cmd_packet *evt, uint32_t passStart);
+void report_event_census(void);
+
+void handle_universal_events(struct gecko_cmd_packet *evt);
+void slave_main(void);
+void master_main(void);
+void broadcaster_main(void);
+void broadcast_scanner_main(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif